@@ -110,9 +110,15 @@ double triangle::elevation(xy pnt)
   q=area3(*a,pnt,*c);
   r=area3(*a,*b,pnt);
   totarea=p+q+r; // should equal sarea, but because of roundoff it may be many ulps off
-  p/=totarea;
-  q/=totarea;
-  r/=totarea;
+  return elevation(p/totarea,q/totarea,r/totarea);
+}
+
+double triangle::elevation(double p,double q,double r)
+/* p, q, and r are the barycentric coordinates with respect to a, b, and c.
+ * Callers that evaluate many points in a smaller triangle can find them by
+ * interpolating the coordinates of its corners.
+ */
+{
 #ifdef FLATTRIANGLE
   return q*b->z+p*a->z+r*c->z;
 #else
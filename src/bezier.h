@@ -100,6 +100,7 @@ public:
   void setneighbor(triangle *neigh);
   void setnoneighbor(edge *neigh);
   double elevation(xy pnt);
+  double elevation(double p,double q,double r);
   void setgradient(xy pnt,xy grad);
   double ctrlpt(xy pnt1,xy pnt2);
   void flatten();
@@ -30,6 +30,9 @@
 #include <csignal>
 #include <cfloat>
 #include <cstring>
+#include <future>
+#include <atomic>
+#include <thread>
 #include <QElapsedTimer>
 #include "config.h"
 #include "point.h"
@@ -40,6 +43,7 @@
 #include "test.h"
 #include "tin.h"
 #include "dxf.h"
+#include "fileio.h"
 #include "measure.h"
 #include "pnezd.h"
 #include "csv.h"
@@ -54,6 +58,7 @@
 #include "except.h"
 #include "cogospiral.h"
 #include "qindex.h"
+#include "edgelod.h"
 #include "random.h"
 #include "ps.h"
 #include "raster.h"
@@ -89,6 +94,10 @@
 #include "leastsquares.h"
 #include "smooth5.h"
 #include "readtin.h"
+#include "scene.h"
+#include "ptin.h"
+#include "volume.h"
+#include "rendercache.h"
 
 #define psoutput true
 // affects only maketin
@@ -102,7 +111,6 @@
 
 using namespace std;
 
-char hexdig[16]={'0','1','2','3','4','5','6','7','8','9','a','b','c','d','e','f'};
 bool slowmanysum=false;
 bool testfail=false;
 document doc;
@@ -507,6 +515,129 @@ void loadknowndet(matrix &mat,string dump)
   cout<<endl;
 }
 
+matrix oldMultiply(matrix &a,matrix &b)
+// How operator* was done before it was blocked and split among threads
+{
+  matrix ret(a.getrows(),b.getcolumns());
+  int i,j,k;
+  double *sum;
+  sum=new double[a.getcolumns()];
+  for (i=0;i<a.getrows();i++)
+    for (j=0;j<b.getcolumns();j++)
+    {
+      for (k=0;k<a.getcolumns();k++)
+	sum[k]=a[i][k]*b[k][j];
+      ret[i][j]=pairwisesum(sum,a.getcolumns());
+    }
+  delete[] sum;
+  return ret;
+}
+
+matrix oldTransmult(matrix &a)
+{
+  matrix ret(a.getrows(),a.getrows());
+  int i,j,k;
+  double *sum;
+  sum=new double[a.getcolumns()];
+  for (i=0;i<a.getrows();i++)
+    for (j=0;j<=i;j++)
+    {
+      for (k=0;k<a.getcolumns();k++)
+	sum[k]=a[i][k]*a[j][k];
+      ret[i][j]=ret[j][i]=pairwisesum(sum,a.getcolumns());
+    }
+  delete[] sum;
+  return ret;
+}
+
+bool sameMatrix(matrix &a,matrix &b)
+{
+  int i,j;
+  bool ret=a.getrows()==b.getrows() && a.getcolumns()==b.getcolumns();
+  for (i=0;ret && i<a.getrows();i++)
+    for (j=0;ret && j<a.getcolumns();j++)
+      ret=a[i][j]==b[i][j];
+  return ret;
+}
+
+void testmatrixbench()
+/* Times multiplication, transmult, and Gaussian elimination of square
+ * matrices, comparing the old way of multiplying with the blocked way in
+ * one thread and in all threads. The results must be exactly the same,
+ * as the same products are added in the same order.
+ */
+{
+  int sizes[]={6,20,60,200,600,2000};
+  int i,j,n,reps,saveThreads=matrixThreads;
+  matrix a,b,c,p0,p1,p2;
+  double t0,t1,t2;
+  QElapsedTimer timer;
+  cout<<"  size    old mult    new mult 1 thread   all     old trans   new trans 1 thread   all     gausselim 1 thread   all"<<endl;
+  for (i=0;i<sizeof(sizes)/sizeof(sizes[0]);i++)
+  {
+    n=sizes[i];
+    reps=8000000/n/n/n+1;
+    a.resize(n,n);
+    b.resize(n,n);
+    a.randomize_c();
+    b.randomize_c();
+    cout<<setw(6)<<n;
+    timer.start();
+    for (j=0;j<reps;j++)
+      p0=oldMultiply(a,b);
+    t0=timer.nsecsElapsed()/1e9/reps;
+    matrixThreads=1;
+    timer.start();
+    for (j=0;j<reps;j++)
+      p1=a*b;
+    t1=timer.nsecsElapsed()/1e9/reps;
+    matrixThreads=0;
+    timer.start();
+    for (j=0;j<reps;j++)
+      p2=a*b;
+    t2=timer.nsecsElapsed()/1e9/reps;
+    tassert(sameMatrix(p0,p1) && sameMatrix(p0,p2));
+    cout<<setw(12)<<t0<<setw(12)<<t1<<setw(12)<<t2;
+    timer.start();
+    for (j=0;j<reps;j++)
+      p0=oldTransmult(a);
+    t0=timer.nsecsElapsed()/1e9/reps;
+    matrixThreads=1;
+    timer.start();
+    for (j=0;j<reps;j++)
+      p1=a.transmult();
+    t1=timer.nsecsElapsed()/1e9/reps;
+    matrixThreads=0;
+    timer.start();
+    for (j=0;j<reps;j++)
+      p2=a.transmult();
+    t2=timer.nsecsElapsed()/1e9/reps;
+    tassert(sameMatrix(p0,p1) && sameMatrix(p0,p2));
+    cout<<setw(12)<<t0<<setw(12)<<t1<<setw(12)<<t2;
+    matrixThreads=1;
+    timer.start();
+    for (j=0;j<reps;j++)
+    {
+      p1=a;
+      c=b;
+      p1.gausselim(c);
+    }
+    t1=timer.nsecsElapsed()/1e9/reps;
+    matrixThreads=0;
+    timer.start();
+    for (j=0;j<reps;j++)
+    {
+      p2=a;
+      p0=b;
+      p2.gausselim(p0);
+    }
+    t2=timer.nsecsElapsed()/1e9/reps;
+    tassert(sameMatrix(p1,p2) && sameMatrix(c,p0));
+    cout<<setw(12)<<t1<<setw(12)<<t2<<endl;
+  }
+  matrixThreads=saveThreads;
+}
+
 void testmatrix()
 {
   int i,j,chk2,chk3,chk4;
@@ -944,6 +1075,8 @@ void testmaketinaster()
   double totallength;
   int i,edgerand;
   edge *line;
+  vector<point *> region;
+  set<edge *> localEdges;
   doc.makepointlist(1);
   doc.pl[1].clear();
   aster(doc,100);
@@ -953,6 +1086,7 @@ void testmaketinaster()
   tassert(fabs(totallength-600.689)<0.001);
   doc.pl[1].maketriangles();
   tassert(doc.pl[1].checkTinConsistency());
+  tassert(doc.pl[1].spokes.matches(doc.pl[1]));
   edgerand=rng.uirandom();
   for (i=0;i<32;i++)
     if ((edgerand&(1<<i)) && doc.pl[1].edges[i].isFlippable())
@@ -961,12 +1095,336 @@ void testmaketinaster()
       doc.pl[1].edges[i].flip(&doc.pl[1]);
     }
   tassert(doc.pl[1].checkTinConsistency());
+  region.push_back(doc.pl[1].edges[7].a);
+  region.push_back(doc.pl[1].edges[7].b);
+  tassert(doc.pl[1].checkTinConsistency(region));
+  swap(doc.pl[1].edges[7].tria,doc.pl[1].edges[7].trib);
+  cout<<"Expect errors about edge 7:\n";
+  tassert(!doc.pl[1].checkTinConsistency(region));
+  tassert(!doc.pl[1].checkTinConsistency(true));
+  swap(doc.pl[1].edges[7].tria,doc.pl[1].edges[7].trib);
+  tassert(doc.pl[1].checkTinConsistency(true));
+  // Flipping redoes the rows of the spoke array for the four points.
+  tassert(doc.pl[1].spokes.valid());
+  for (i=32;i<64;i++)
+    if (doc.pl[1].edges[i].isFlippable())
+    {
+      doc.pl[1].edges[i].flip(&doc.pl[1]);
+      tassert(doc.pl[1].spokes.matches(doc.pl[1]));
+      doc.pl[1].edges[i].flip(&doc.pl[1]);
+    }
   line=doc.pl[1].points[1].line;
   for (i=0;i<5;i++)
   {
     cout<<"Edge bearing "<<bintodeg(line->bearing(&doc.pl[1].points[1]))<<'\n';
     line=line->next(&doc.pl[1].points[1]);
   }
+  // Finding local sets and checking a region read the spoke array but don't build it.
+  doc.pl[1].makeqindex();
+  doc.pl[1].setLocalSets(xy(0,0),3);
+  localEdges=doc.pl[1].localEdges;
+  doc.pl[1].spokes.clear();
+  doc.pl[1].setLocalSets(xy(0,0),3);
+  tassert(doc.pl[1].checkTinConsistency(region));
+  tassert(!doc.pl[1].spokes.valid());
+  tassert(localEdges.size() && doc.pl[1].localEdges==localEdges);
+}
+
+void testbaretin()
+/* Makes a bare TIN from the faces of a TIN made by maketin, with each corner
+ * repeated in every face it's in, and every third face given a different
+ * elevation at one corner. Checks that there is one point per position,
+ * numbered in the order the positions first appear, as looking up each
+ * corner in the quad index did, and that the edges are those of the TIN
+ * the faces came from.
+ */
+{
+  int i,j,n;
+  vector<array<xyz,3> > faces;
+  array<xyz,3> face;
+  map<pair<double,double>,int> numbered;
+  map<pair<double,double>,point *> original;
+  pair<double,double> pos;
+  ptlist::iterator k;
+  doc.makepointlist(2);
+  doc.pl[1].clear();
+  setsurface(HYPAR);
+  aster(doc,100);
+  doc.pl[1].maketin();
+  for (i=0;i<doc.pl[1].triangles.size();i++)
+  {
+    face[0]=*doc.pl[1].triangles[i].a;
+    face[1]=*doc.pl[1].triangles[i].b;
+    face[2]=*doc.pl[1].triangles[i].c;
+    if (i%3==0)
+      face[0]=xyz(xy(face[0]),face[0].elev()+1);
+    faces.push_back(face);
+  }
+  for (k=doc.pl[1].points.begin();k!=doc.pl[1].points.end();++k)
+    original[make_pair(k->second.east(),k->second.north())]=&k->second;
+  doc.pl[2].makeBareTriangles(faces);
+  for (i=n=0;i<faces.size();i++)
+    for (j=0;j<3;j++)
+    {
+      pos=make_pair(faces[i][j].east(),faces[i][j].north());
+      if (!numbered.count(pos))
+	numbered[pos]=++n;
+      tassert(xy(doc.pl[2].points[numbered[pos]])==xy(faces[i][j]));
+    }
+  tassert(doc.pl[2].points.size()==numbered.size());
+  tassert(doc.pl[2].points.size()==doc.pl[1].points.size());
+  tassert(doc.pl[2].triangles.size()==faces.size());
+  doc.pl[2].makeEdges();
+  tassert(doc.pl[2].edges.size()==doc.pl[1].edges.size());
+  tassert(doc.pl[2].checkTinConsistency());
+  for (k=doc.pl[2].points.begin();k!=doc.pl[2].points.end();++k)
+  {
+    pos=make_pair(k->second.east(),k->second.north());
+    tassert(original.count(pos) && original[pos]->valence()==k->second.valence());
+  }
+}
+
+void testtinedit()
+/* Inserts, deletes, and moves points in a TIN, checking each time the
+ * region that changed, then checks that the whole TIN is consistent and
+ * Delaunay, has the same edges as a TIN made from scratch, and that the
+ * retouched surface is close to one made from scratch. The gradients
+ * farther than one ring from the edits are not refitted, so the surfaces
+ * differ slightly.
+ */
+{
+  int i,nInserted=0,nDeleted=0,nThrown=0;
+  double lengthEdited,lengthFresh,maxDiff=0,elev;
+  bool delaunay=true;
+  xy pnt;
+  vector<point *> changed,allChanged;
+  vector<xy> probes;
+  vector<double> edited;
+  map<int,point> keep;
+  map<int,point>::iterator j;
+  doc.makepointlist(1);
+  doc.pl[1].clear();
+  setsurface(HYPAR);
+  aster(doc,100);
+  doc.pl[1].maketin();
+  doc.pl[1].makegrad(0.15);
+  doc.pl[1].maketriangles();
+  doc.pl[1].setgradient();
+  doc.pl[1].makeqindex();
+  doc.pl[1].findcriticalpts();
+  for (i=0;i<20;i++)
+  {
+    pnt=cossin((int)(i*0x9e3779b9))*(i%7+0.37);
+    changed=doc.pl[1].insertPoint(101+i,point(pnt,testsurface(pnt),"inserted"));
+    tassert(doc.pl[1].pointNumber(changed[0])==101+i);
+    tassert(doc.pl[1].checkTinConsistency(changed));
+    allChanged.insert(allChanged.end(),changed.begin(),changed.end());
+    nInserted++;
+  }
+  for (i=3;i<60;i+=7)
+  {
+    changed=doc.pl[1].deletePoint(i);
+    tassert(doc.pl[1].checkTinConsistency(changed));
+    allChanged.insert(allChanged.end(),changed.begin(),changed.end());
+    nDeleted++;
+  }
+  changed=doc.pl[1].deletePoint(105);
+  tassert(doc.pl[1].checkTinConsistency(changed));
+  allChanged.insert(allChanged.end(),changed.begin(),changed.end());
+  nDeleted++;
+  changed=doc.pl[1].movePoint(110,xyz(1.5,-2.5,testsurface(xy(1.5,-2.5))));
+  tassert(doc.pl[1].checkTinConsistency(changed));
+  allChanged.insert(allChanged.end(),changed.begin(),changed.end());
+  try
+  {
+    doc.pl[1].deletePoint(100); // on the convex hull
+  }
+  catch (BeziExcept &e)
+  {
+    nThrown++;
+  }
+  try
+  {
+    doc.pl[1].insertPoint(200,point(xy(100,100),0,"outside"));
+  }
+  catch (BeziExcept &e)
+  {
+    nThrown++;
+  }
+  tassert(nThrown==2);
+  tassert(doc.pl[1].points.size()==100+nInserted-nDeleted);
+  tassert(doc.pl[1].checkTinConsistency());
+  for (i=0;i<doc.pl[1].edges.size();i++)
+    if (!doc.pl[1].edges[i].delaunay())
+      delaunay=false;
+  tassert(delaunay);
+  sort(allChanged.begin(),allChanged.end());
+  allChanged.erase(unique(allChanged.begin(),allChanged.end()),allChanged.end());
+  for (i=allChanged.size()-1;i>=0;i--)
+    if (!doc.pl[1].revpoints.count(allChanged[i]))
+      allChanged.erase(allChanged.begin()+i);
+  doc.pl[1].retouch(allChanged,0.15);
+  for (i=0;i<400;i++)
+    probes.push_back(cossin((int)(i*0x5bd1e995))*sqrt(i/8.));
+  lengthEdited=doc.pl[1].totalEdgeLength();
+  keep=doc.pl[1].points;
+  for (i=0;i<probes.size();i++)
+    edited.push_back(doc.pl[1].elevation(probes[i]));
+  doc.pl[1].clear();
+  for (j=keep.begin();j!=keep.end();++j)
+    doc.pl[1].addpoint(j->first,point(j->second,j->second.note));
+  doc.pl[1].maketin();
+  doc.pl[1].makegrad(0.15);
+  doc.pl[1].maketriangles();
+  doc.pl[1].setgradient();
+  doc.pl[1].makeqindex();
+  lengthFresh=doc.pl[1].totalEdgeLength();
+  cout<<"Edited TIN edge length "<<ldecimal(lengthEdited)<<", fresh "<<ldecimal(lengthFresh)<<endl;
+  tassert(fabs(lengthEdited-lengthFresh)<1e-9*lengthFresh);
+  for (i=0;i<probes.size();i++)
+  {
+    elev=fabs(doc.pl[1].elevation(probes[i])-edited[i]);
+    if (elev>maxDiff)
+      maxDiff=elev;
+  }
+  cout<<"Largest difference in elevation "<<maxDiff<<endl;
+  tassert(maxDiff<0.001);
+}
+
+double cutFillPlane(xy pnt)
+{
+  return pnt.north()/17+1/14.;
+}
+
+void cutFillTin(pointlist &pl,int n,double rot,double scale,double (*surf)(xy),bool curved)
+/* Makes a TIN of n points in an asteraceous pattern, turned by rot and
+ * scaled, with elevations from surf. If curved, the triangles are fitted
+ * to the gradients at the points, else they are flat.
+ */
+{
+  int i;
+  double angle=(sqrt(5)-1)*M_PI;
+  xy pnt;
+  pl.clear();
+  for (i=0;i<n;i++)
+  {
+    pnt=cossin(angle*i+rot)*sqrt(i+0.5)*scale;
+    pl.addpoint(i+1,point(pnt,surf(pnt),"test"));
+  }
+  pl.maketin();
+  if (curved)
+  {
+    pl.makegrad(0.15);
+    pl.maketriangles();
+    pl.setgradient();
+  }
+  else
+  {
+    pl.maketriangles();
+    for (i=0;i<pl.triangles.size();i++)
+      pl.triangles[i].flatten();
+  }
+  pl.makeqindex();
+}
+
+void testcutfill()
+/* Between two planes whose difference is (x-1/2)/7, over a 6×6 square,
+ * the cut and fill are known exactly. Between a hyperbolic paraboloid and
+ * a circular paraboloid in a circle, the Halton estimate checks them.
+ * A small design TIN over a coarse existing one covers only slivers of
+ * some existing triangles; all its area must be counted.
+ */
+{
+  polyline square,bigSquare;
+  polyarc circle;
+  CutFill exact,quasi,serial;
+  map<int,triangle>::iterator t;
+  manysum designArea;
+  int i;
+  doc.makepointlist(2);
+  setsurface(FLATSLOPE);
+  cutFillTin(doc.pl[1],300,0,1,testsurface,false);
+  cutFillTin(doc.pl[2],250,1,1.07,cutFillPlane,false);
+  square.insert(xy(-3,-2));
+  square.insert(xy(3,-2));
+  square.insert(xy(3,4));
+  square.insert(xy(-3,4));
+  square.setlengths();
+  exact=cutFill(doc.pl[1],doc.pl[2],square);
+  quasi=cutFillHalton(doc.pl[1],doc.pl[2],square,100000);
+  cout<<"Planes: cut "<<exact.cut<<" fill "<<exact.fill<<" area "<<exact.area<<endl;
+  cout<<"Halton: cut "<<quasi.cut<<" fill "<<quasi.fill<<" area "<<quasi.area<<endl;
+  tassert(fabs(exact.cut-18.75/7)<1e-9);
+  tassert(fabs(exact.fill-36.75/7)<1e-9);
+  tassert(fabs(exact.area-36)<1e-9);
+  tassert(fabs(quasi.cut-exact.cut)<0.01*exact.cut);
+  tassert(fabs(quasi.fill-exact.fill)<0.01*exact.fill);
+  cutFillTin(doc.pl[1],30,0,5,testsurface,false);
+  for (t=doc.pl[2].triangles.begin();t!=doc.pl[2].triangles.end();t++)
+    designArea+=t->second.sarea;
+  bigSquare.insert(xy(-30,-30));
+  bigSquare.insert(xy(30,-30));
+  bigSquare.insert(xy(30,30));
+  bigSquare.insert(xy(-30,30));
+  bigSquare.setlengths();
+  exact=cutFill(doc.pl[1],doc.pl[2],bigSquare);
+  quasi=cutFillHalton(doc.pl[1],doc.pl[2],bigSquare,200000);
+  cout<<"Partial: cut "<<exact.cut<<" fill "<<exact.fill<<" area "<<exact.area<<
+    " design area "<<designArea.total()<<endl;
+  cout<<"Halton: cut "<<quasi.cut<<" fill "<<quasi.fill<<" area "<<quasi.area<<endl;
+  tassert(fabs(exact.area-designArea.total())<1e-9*exact.area);
+  tassert(fabs(quasi.cut-exact.cut)<0.01*exact.cut);
+  tassert(fabs(quasi.fill-exact.fill)<0.01*exact.fill);
+  tassert(fabs(quasi.area-exact.area)<0.01*exact.area);
+  setsurface(HYPAR);
+  cutFillTin(doc.pl[1],2000,0,1,testsurface,true);
+  setsurface(CIRPAR);
+  cutFillTin(doc.pl[2],1500,1,1.07,testsurface,true);
+  for (i=0;i<4;i++)
+    circle.insert(cossin(i*DEG90)*10);
+  for (i=0;i<4;i++)
+    circle.setdelta(i,DEG90);
+  circle.setlengths();
+  exact=cutFill(doc.pl[1],doc.pl[2],circle);
+  serial=cutFill(doc.pl[1],doc.pl[2],circle,1);
+  quasi=cutFillHalton(doc.pl[1],doc.pl[2],circle,200000);
+  cout<<"Paraboloids: cut "<<exact.cut<<" fill "<<exact.fill<<" area "<<exact.area<<endl;
+  cout<<"Halton: cut "<<quasi.cut<<" fill "<<quasi.fill<<" area "<<quasi.area<<endl;
+  tassert(fabs(exact.area-M_PI*100)<1e-3*exact.area);
+  tassert(fabs(serial.cut-exact.cut)<1e-9*exact.cut);
+  tassert(fabs(serial.fill-exact.fill)<1e-9*exact.fill);
+  tassert(fabs(quasi.cut-exact.cut)<0.01*exact.cut);
+  tassert(fabs(quasi.fill-exact.fill)<0.01*exact.fill);
+  tassert(fabs(quasi.area-exact.area)<0.01*exact.area);
+}
+
+void testcutfillbench()
+/* Times cutFill on two TINs of a million points each, which overlay
+ * in several million pieces, in one thread and in all threads.
+ */
+{
+  polyline square;
+  CutFill result;
+  QElapsedTimer timer;
+  int nthreads;
+  doc.makepointlist(2);
+  setsurface(HYPAR);
+  cutFillTin(doc.pl[1],1000000,0,1,testsurface,true);
+  setsurface(CIRPAR);
+  cutFillTin(doc.pl[2],1000000,1,1.07,testsurface,true);
+  cout<<doc.pl[1].triangles.size()<<" and "<<doc.pl[2].triangles.size()<<" triangles"<<endl;
+  square.insert(xy(-500,-500));
+  square.insert(xy(500,-500));
+  square.insert(xy(500,500));
+  square.insert(xy(-500,500));
+  square.setlengths();
+  for (nthreads=1;nthreads>=0;nthreads--)
+  {
+    timer.start();
+    result=cutFill(doc.pl[1],doc.pl[2],square,nthreads);
+    cout<<(nthreads?"1 thread: ":"all threads: ")<<timer.nsecsElapsed()/1e9<<" s, cut "<<
+      result.cut<<" fill "<<result.fill<<" area "<<result.area<<endl;
+  }
 }
 
 void testmaketinbigaster()
@@ -1211,7 +1669,6 @@ void test1tripolygon(int points,int petals,PostScript &ps)
 {
   int i,j;
   vector<point *> poly,hull;
-  TriPolyLogEntry entry;
   intloop holes;
   manysum area;
   polyline pl;
@@ -1250,6 +1707,9 @@ void test1tripolygon(int points,int petals,PostScript &ps)
   cout<<"Area "<<area.total()<<", should be "<<pl.area()<<endl;
   tassert(points==doc.pl[1].triangles.size()+2);
   tassert(fabs(area.total()-pl.area())<1e-12);
+  for (i=0;i<hull.size();i++)
+    for (j=0;j<points;j++)
+      tassert(area3(*hull[i],*hull[(i+1)%hull.size()],*poly[j])>=0);
   doc.pl[1].makeEdges();
   tassert(doc.pl[1].checkTinConsistency());
   holes=doc.pl[1].boundary();
@@ -1350,6 +1810,7 @@ void testtripolygon()
   test1tripolygon(89,13,ps);
   test1tripolygon(89,21,ps);
   test1tripolygon(89,34,ps);
+  test1tripolygon(4181,89,ps);
   testehcycloid(ps);
 }
 
@@ -1390,12 +1851,98 @@ void test1break0graph(pointlist &pl,string plname)
   }
 }
 
+string readWholeFile(string fileName)
+{
+  ifstream file(fileName);
+  stringstream contents;
+  contents<<file.rdbuf();
+  return contents.str();
+}
+
+void testscene()
+/* Writes a pointlist in XML, writes the document as a binary scene, reads
+ * it back, and checks that the pointlist read back gives the same XML.
+ */
+{
+  document doc2,doc3;
+  criterion crit1;
+  ofstream xmlFile;
+  ifstream sceneFile;
+  string xml1,xml2,scene;
+  bool threw=false;
+  doc.makepointlist(1);
+  doc.pl[1].clear();
+  setsurface(HYPAR);
+  aster(doc,1000);
+  crit1.str="test";
+  crit1.lo=1;
+  crit1.hi=1000;
+  crit1.istopo=true;
+  doc.pl[1].crit.push_back(crit1);
+  doc.pl[1].maketin();
+  doc.pl[1].makegrad(0.);
+  doc.pl[1].maketriangles();
+  doc.pl[1].setgradient();
+  doc.pl[1].makeqindex();
+  doc.pl[1].findcriticalpts();
+  doc.pl[1].addperimeter();
+  roughcontours(doc.pl[1],1);
+  smoothcontours(doc.pl[1],1,true,false);
+  doc.pl[1].removeperimeter();
+  doc.pl[1].type0Breaklines.push_back(Breakline0(1,2));
+  doc.pl[1].type0Breaklines.push_back(Breakline0(300,-5));
+  xmlFile.open("scene1.xml");
+  doc.pl[1].writeXml(xmlFile);
+  xmlFile.close();
+  writeScene("scene.bzs",doc);
+  readScene("scene.bzs",doc2);
+  tassert(doc2.pl.size()==doc.pl.size());
+  tassert(doc2.pl[1].checkTinConsistency());
+  xmlFile.open("scene2.xml");
+  doc2.pl[1].writeXml(xmlFile);
+  xmlFile.close();
+  xml1=readWholeFile("scene1.xml");
+  xml2=readWholeFile("scene2.xml");
+  scene=readWholeFile("scene.bzs");
+  cout<<doc.pl[1].points.size()<<" points, "<<doc.pl[1].triangles.size()<<" triangles, "<<
+    doc.pl[1].contours.size()<<" contours: XML "<<xml1.length()<<" bytes, binary "<<scene.length()<<" bytes\n";
+  tassert(xml1==xml2);
+  // The same scene without compression must read back the same.
+  writeScene("scene-raw.bzs",doc,false);
+  readScene("scene-raw.bzs",doc2);
+  xmlFile.open("scene2.xml");
+  doc2.pl[1].writeXml(xmlFile);
+  xmlFile.close();
+  xml2=readWholeFile("scene2.xml");
+  tassert(xml1==xml2);
+  cout<<"Uncompressed binary "<<readWholeFile("scene-raw.bzs").length()<<" bytes\n";
+  tassert(readWholeFile("scene-raw.bzs").length()>scene.length());
+  sceneFile.open("scene.bzs",ios::binary);
+  readScene(sceneFile,doc3,SCENE_CONTOURS);
+  sceneFile.close();
+  tassert(doc3.pl[1].points.size()==0);
+  tassert(doc3.pl[1].contours.size()==doc.pl[1].contours.size());
+  xmlFile.open("scene.bzs",ios::binary);
+  xmlFile<<scene.substr(0,scene.length()/2)<<scene.substr(scene.length()*3/4);
+  xmlFile.close();
+  try
+  {
+    readScene("scene.bzs",doc3);
+  }
+  catch (BeziExcept &e)
+  {
+    threw=true;
+  }
+  tassert(threw);
+}
+
 void testtindxf()
 {
   int i,acc,fmt;
   GroupCode a,b(0),c(70),d(11),e(290);
   vector<GroupCode> dxfTxt,dxfBin;
-  vector<array<xyz,3> > binFaces,txtFaces;
+  vector<array<xyz,3> > binFaces,txtFaces,fastFaces;
+  ofstream notDxf;
   xyz pnt;
   for (acc=i=0;i<=1001;i+=13)
   {
@@ -1442,6 +1989,14 @@ void testtindxf()
   binFaces=extractTriangles(dxfBin);
   txtFaces=extractTriangles(dxfTxt);
   cout<<binFaces.size()<<" triangles in binary file, "<<txtFaces.size()<<" in text file\n";
+  fastFaces=readDxfTriangles("tinytin-bin.dxf");
+  if (fastFaces.size()==0)
+    fastFaces=readDxfTriangles("../tinytin-bin.dxf");
+  tassert(fastFaces==binFaces);
+  fastFaces=readDxfTriangles("tinytin-txt.dxf");
+  if (fastFaces.size()==0)
+    fastFaces=readDxfTriangles("../tinytin-txt.dxf");
+  tassert(fastFaces==txtFaces);
   doc.makepointlist(1);
   doc.pl[1].makeBareTriangles(binFaces);
   cout<<doc.pl[1].points.size()<<" points "<<doc.pl[1].qinx.size()<<" qindex nodes\n";
@@ -1452,13 +2007,36 @@ void testtindxf()
     pnt=doc.pl[1].points[i];
     cout<<pnt.east()<<','<<pnt.north()<<','<<pnt.elev()<<'\n';
   }
+  // Write the TIN back out and read it.
+  writeDxf("tinytin-out-txt.dxf",doc.pl[1],true,1,0);
+  writeDxf("tinytin-out-bin.dxf",doc.pl[1],false,1,0);
+  dxfTxt=readDxfGroups("tinytin-out-txt.dxf");
+  dxfBin=readDxfGroups("tinytin-out-bin.dxf");
+  tassert(dxfTxt.size()==dxfBin.size());
+  txtFaces=extractTriangles(dxfTxt);
+  binFaces=extractTriangles(dxfBin);
+  tassert(readDxfTriangles("tinytin-out-txt.dxf")==txtFaces);
+  tassert(readDxfTriangles("tinytin-out-bin.dxf")==binFaces);
+  notDxf.open("notdxf.txt");
+  notDxf<<"This is not a DXF file.\n";
+  notDxf.close();
+  tassert(readDxfTriangles("notdxf.txt").size()==0);
+  tassert(txtFaces.size()==doc.pl[1].triangles.size());
+  tassert(binFaces.size()==doc.pl[1].triangles.size());
+  for (i=0;i<binFaces.size();i++)
+  {
+    tassert(binFaces[i][0]==*doc.pl[1].triangles[i].a);
+    tassert(binFaces[i][1]==*doc.pl[1].triangles[i].b);
+    tassert(binFaces[i][2]==*doc.pl[1].triangles[i].c);
+    tassert(dist(txtFaces[i][0],binFaces[i][0])<1e-12);
+  }
 }
 
 void testbreak0()
 {
   double leftedge,bottomedge,rightedge,topedge,conterval,totallength;
-  pointlist bull,octahedron,frucht,cycle17,chain17;
-  int rotation=DEG90,i,j,sum,nopen;
+  pointlist bull,octahedron,frucht,cycle17,chain17,chain200k;
+  int rotation=DEG90,i,j,sum,nopen,crossings=0;
   criterion crit1;
   PostScript ps;
   Breakline0 bl1,bl2,bl3;
@@ -1652,6 +2230,14 @@ void testbreak0()
   totallength=doc.pl[1].totalEdgeLength();
   cout<<"Total length with breaklines "<<totallength<<endl;
   tassert(fabs(totallength-1231.9)<0.1);
+  doc.pl[1].maketin("",false,true);
+  for (i=0;i<doc.pl[1].edges.size();i++)
+    if (doc.pl[1].checkBreak0(doc.pl[1].edges[i])&2)
+      crossings++;
+  totallength=doc.pl[1].totalEdgeLength();
+  cout<<"Total length with breaklines forced in "<<totallength<<", "<<crossings<<" crossings"<<endl;
+  tassert(fabs(totallength-1231.9)<0.1);
+  tassert(crossings==0);
   ps.endpage();
   ps.trailer();
   ps.close();
@@ -1745,6 +2331,21 @@ void testbreak0()
   tassert(sum==16);
   tassert(i==1);
   tassert(nopen==1);
+  /* A long chain, in shuffled and reversed pieces, as breaklines come from
+   * photogrammetry. Joining them one pair at a time would take hours.
+   */
+  for (i=1;i<200000;i++)
+    chain200k.type0Breaklines.push_back(Breakline0(i,i+1));
+  for (i=chain200k.type0Breaklines.size()-1;i>0;i--)
+  {
+    if (rng.ucrandom()&1)
+      chain200k.type0Breaklines[i].reverse();
+    swap(chain200k.type0Breaklines[i],chain200k.type0Breaklines[rng.uirandom()%(i+1)]);
+  }
+  chain200k.joinBreaklines();
+  tassert(chain200k.type0Breaklines.size()==1);
+  tassert(chain200k.type0Breaklines[0].size()==199999);
+  tassert(chain200k.type0Breaklines[0].lowEnd()==1);
   doc.pl.clear();
 }
 
@@ -1914,6 +2515,36 @@ void testnewton()
   tassert(fabs(sqr(x)-3)<1e-15);
 }
 
+void testcoordcheck()
+/* CoordCheck sums the z coordinates 64 ways. Compare it with sums taken
+ * one at a time.
+ */
+{
+  CoordCheck cc;
+  manysum direct[64];
+  int i,n,sz;
+  double z,maxerr=0;
+  cc.clear();
+  sz=10000;
+  for (i=0;i<sz;i++)
+  {
+    z=1000*sin(i*M_PI/sz*7)+300;
+    cc<<z;
+    for (n=0;n<64;n++)
+      if (((size_t)i>>n)&1)
+	direct[n]-=z;
+      else
+	direct[n]+=z;
+  }
+  tassert(cc.getCount()==sz);
+  for (n=0;n<64;n++)
+    if (fabs(cc[n]-direct[n].total())>maxerr)
+      maxerr=fabs(cc[n]-direct[n].total());
+  cout<<"CoordCheck largest difference "<<maxerr<<endl;
+  tassert(maxerr<1e-9);
+  tassert(sizeof(cc)<100000);
+}
+
 void testmanysum()
 {
   manysum ms,negms;
@@ -2013,6 +2644,75 @@ void testmanysum()
   tassert(fabs((backwardsum-naivebackwardsum)/(backwardsum+naivebackwardsum))<1000*DBL_EPSILON);
   tassert(fabs((naiveforwardsum-naivebackwardsum)/(naiveforwardsum+naivebackwardsum))>30*DBL_EPSILON);
   cout<<"Time in pairwisesum: "<<pairtime<<endl;
+  tassert(sizeof(manysum)<=4*sizeof(double));
+  ms.clear();
+  ms.add(summands);
+  cout<<"Bulk: "<<ldecimal(ms.total())<<endl;
+  tassert(fabs((ms.total()-backwardsum)/(ms.total()+backwardsum))<DBL_EPSILON);
+  vector<future<manysum> > parts;
+  for (i=0;i<4;i++)
+    parts.push_back(async(launch::async,[&summands](int part)
+      {
+	manysum ret;
+	size_t lo=summands.size()*part/4,hi=summands.size()*(part+1)/4;
+	ret.add(&summands[lo],hi-lo);
+	return ret;
+      },i));
+  ms.clear();
+  for (i=0;i<4;i++)
+    ms.merge(parts[i].get());
+  cout<<"Merged: "<<ldecimal(ms.total())<<endl;
+  tassert(fabs((ms.total()-backwardsum)/(ms.total()+backwardsum))<DBL_EPSILON);
+  ms.clear();
+  ms+=1;
+  ms+=1e100;
+  ms+=1;
+  ms-=1e100;
+  tassert(ms.total()==2);
+  ms+=INFINITY;
+  tassert(ms.total()==INFINITY);
+  summands.clear();
+  for (i=0;i<1000;i++)
+    summands.push_back(2*i+1);
+  for (h=PS_SCALAR;h<=pairwisesumKernel();h++)
+    for (i=0;i<=summands.size();i++)
+      tassert(pairwisesum(&summands[0],i,h)==(double)i*i);
+  testcoordcheck();
+}
+
+void testpairwisebench()
+/* Times pairwisesum with each kernel the processor can run, from 8 to 10⁸
+ * numbers, and compares their errors with the pairwise bound.
+ * The exact sum is taken to be manysum's.
+ */
+{
+  vector<double> a;
+  int i,k,reps,best=pairwisesumKernel();
+  unsigned n;
+  double exact,sum,bound,t;
+  manysum ms;
+  QElapsedTimer timer;
+  cout<<"     n   kernel  ns per number  error/bound"<<endl;
+  for (n=8;n<=100000000;n=(n<10)?10:n*10)
+  {
+    a.resize(n);
+    for (i=0;i<n;i++)
+      a[i]=exp(-(double)i/n)*(1+sin(i));
+    ms.clear();
+    ms.add(a);
+    exact=ms.total();
+    bound=ceil(log2(n))*DBL_EPSILON*exact;
+    reps=100000000/n+1;
+    for (k=PS_SCALAR;k<=best;k++)
+    {
+      timer.start();
+      for (i=0;i<reps;i++)
+	sum=pairwisesum(&a[0],n,k);
+      t=timer.nsecsElapsed()/(double)reps/n;
+      cout<<setw(9)<<n<<setw(4)<<k<<setw(14)<<t<<setw(12)<<fabs(sum-exact)/bound<<endl;
+      tassert(fabs(sum-exact)<=bound);
+    }
+  }
 }
 
 void testvcurve()
@@ -2614,8 +3314,10 @@ void testobjlist()
   int temp0,temp1;
   PostScript ps;
   BoundRect br;
-  int i;
-  vector<int> handles;
+  int i,j;
+  xy center;
+  double radius;
+  vector<int> handles,randomHandles,allh,brute;
   // Draw the four pipes that monument the boundary
   pCircle=new Circle(xy(335179.675,186270.869),1.);
   swPipe=doc.modelSpace.insert(pCircle);
@@ -2648,6 +3350,51 @@ void testobjlist()
   for (i=0;i<handles.size();i++)
     ps.spline(doc.modelSpace[handles[i]].obj->approx3d(0.001/ps.getscale()));
   ps.endpage();
+  // Check the spatial index.
+  handles=doc.modelSpace.nearby(xy(335179.675,186270.869),2);
+  tassert(count(handles.begin(),handles.end(),swPipe));
+  tassert(count(handles.begin(),handles.end(),sBoundary));
+  tassert(!count(handles.begin(),handles.end(),nePipe));
+  tassert(!count(handles.begin(),handles.end(),nCreek));
+  for (i=0;i<1000;i++)
+  {
+    center=xy(335000+rng.usrandom()/200.,186000+rng.usrandom()/200.);
+    pCircle=new Circle(center,ldexp(rng.usrandom()+1,-16-(i%8)));
+    randomHandles.push_back(doc.modelSpace.insert(pCircle));
+  }
+  for (i=0;i<20;i++)
+  {
+    center=xy(335000+rng.usrandom()/200.,186000+rng.usrandom()/200.);
+    radius=rng.usrandom()/1000.;
+    handles=doc.modelSpace.inBox(center.east()-radius,center.north()-radius,center.east()+radius,center.north()+radius);
+    brute.clear();
+    allh=doc.modelSpace.allHandles();
+    for (j=0;j<allh.size();j++)
+    {
+      BoundRect objbr;
+      objbr.include(doc.modelSpace[allh[j]].obj);
+      if (objbr.right()>=center.east()-radius && objbr.left()<=center.east()+radius &&
+	  objbr.top()>=center.north()-radius && objbr.bottom()<=center.north()+radius)
+	brute.push_back(allh[j]);
+    }
+    tassert(handles==brute);
+  }
+  for (i=0;i<randomHandles.size();i++)
+    doc.modelSpace.erase(randomHandles[i]);
+  // Check the reverse references.
+  doc.modelSpace.addReference(nCreek,nBoundary);
+  doc.modelSpace.addReference(sCreek,nBoundary);
+  doc.modelSpace.addReference(sCreek,sBoundary);
+  handles=doc.modelSpace.referrers(nBoundary);
+  tassert(handles.size()==2 && handles[0]==nCreek && handles[1]==sCreek);
+  doc.modelSpace.erase(sCreek);
+  tassert(doc.modelSpace.referrers(nBoundary).size()==1);
+  tassert(doc.modelSpace.referrers(sBoundary).size()==0);
+  // Move everything and check that the index follows.
+  doc.modelSpace.roscat(xy(335000,186000),0,1,xy(0,0));
+  handles=doc.modelSpace.nearby(xy(179.675,270.869),2);
+  tassert(count(handles.begin(),handles.end(),swPipe));
+  tassert(!count(handles.begin(),handles.end(),nePipe));
 }
 
 void spiralmicroscope(segment *a,double aalong,segment *b,double balong,string fname,int scale=1)
@@ -2740,6 +3487,139 @@ void spiralmicroscope(segment *a,double aalong,segment *b,double balong,string f
   ps.close();
 }
 
+void testrendercache()
+/* Renders a few objects in the worker threads, then stops the workers
+ * while renderings are waiting, as a canvas does when it is closed.
+ */
+{
+  int i,n,nrendered=0;
+  atomic<int> nnotify(0);
+  segment seg(xyz(0,0,0),xyz(30,40,1));
+  arc arch(xyz(0,0,0),xyz(20,10,3),xyz(50,0,2));
+  spiralarc spiral(xyz(10,-10,0),0.,0.05,xyz(60,20,0));
+  RenderItem *rip;
+  {
+    RenderCache cache;
+    cache.setNotify([&nnotify](){nnotify++;});
+    for (i=0;i<200;i++)
+    {
+      cache.clearPresent();
+      cache.setView(xy(30,10),60,0.1);
+      cache.checkInObject(&seg,1,0,0,0);
+      cache.checkInObject(&arch,1,0,0,0);
+      cache.checkInObject(&spiral,1,0,0,0);
+      cache.deleteAbsent();
+      cache.schedule();
+      if (cache.pendingCount()==0)
+	break;
+      this_thread::sleep_for(chrono::milliseconds(10));
+    }
+    tassert(cache.pendingCount()==0);
+    tassert(nnotify>=3);
+    while ((rip=cache.nextRenderItem()))
+    {
+      nrendered++;
+      tassert(rip->rendering.size()>0);
+      tassert(rip->paths.size()==rip->rendering.size());
+      tassert(rip->minx<=rip->maxx && rip->miny<=rip->maxy);
+    }
+    tassert(nrendered==3);
+    // Drop the segment. Its rendering goes away with it.
+    cache.clearPresent();
+    cache.checkInObject(&arch,1,0,0,0);
+    cache.checkInObject(&spiral,1,0,0,0);
+    cache.deleteAbsent();
+    for (nrendered=0;(rip=cache.nextRenderItem());nrendered++)
+      tassert(rip->obj!=&seg);
+    tassert(nrendered==2);
+    // Zoom in, so that both are rerendered, and stop before they come back.
+    cache.clearPresent();
+    cache.setView(xy(30,10),6,0.01);
+    cache.checkInObject(&arch,1,0,0,0);
+    cache.checkInObject(&spiral,1,0,0,0);
+    cache.deleteAbsent();
+    tassert(cache.schedule()>0);
+    cache.stopWorkers();
+    n=nnotify;
+    this_thread::sleep_for(chrono::milliseconds(50));
+    tassert(nnotify==n);
+    tassert(cache.waitingCount()==0);
+    // Nothing more is rendered once the workers are stopped.
+    cache.clearPresent();
+    cache.setView(xy(30,10),60,1);
+    cache.checkInObject(&arch,1,0,0,0);
+    cache.schedule();
+    this_thread::sleep_for(chrono::milliseconds(50));
+    tassert(nnotify==n);
+  }
+  // A cache destroyed with renderings waiting stops its workers first.
+  {
+    RenderCache cache;
+    cache.setNotify([&nnotify](){nnotify++;});
+    cache.setView(xy(30,10),60,0.001);
+    cache.checkInObject(&seg,1,0,0,0);
+    cache.checkInObject(&arch,1,0,0,0);
+    cache.checkInObject(&spiral,1,0,0,0);
+    tassert(cache.schedule()>0);
+  }
+}
+
+void testrenderschedule()
+/* Checks that a frame sends only as many renderings as fit in the budget,
+ * where rendering everything at once would send all of them, that later
+ * frames finish the job, and that after zooming in only the objects in
+ * view are rerendered.
+ */
+{
+  int i,n,nsent;
+  vector<segment> segs;
+  RenderItem *rip;
+  RenderCache cache;
+  for (i=0;i<400;i++)
+    segs.push_back(segment(xyz(i,0,0),xyz(i,1,0)));
+  for (i=0;i<1000;i++)
+  {
+    cache.clearPresent();
+    cache.setView(xy(200,0),250,0.1);
+    for (n=0;n<segs.size();n++)
+      cache.checkInObject(&segs[n],1,0,0,0);
+    cache.deleteAbsent();
+    nsent=cache.schedule();
+    if (i==0)
+    {
+      cout<<"First frame sent "<<nsent<<" of "<<segs.size()<<" renderings\n";
+      tassert(nsent>0 && nsent<segs.size());
+    }
+    if (cache.pendingCount()==0)
+      break;
+    this_thread::sleep_for(chrono::milliseconds(10));
+  }
+  for (n=0;(rip=cache.nextRenderItem());n++)
+    tassert(rip->rendering.size() && rip->pixelScale==0.1);
+  tassert(n==segs.size());
+  // Zoom in 4× on segments 50 through 150. The others are out of view.
+  for (i=0;i<1000;i++)
+  {
+    cache.clearPresent();
+    cache.setView(xy(100,0),50,0.025);
+    for (n=0;n<segs.size();n++)
+      cache.checkInObject(&segs[n],1,0,0,0);
+    cache.deleteAbsent();
+    cache.schedule();
+    if (cache.pendingCount()==0)
+      break;
+    this_thread::sleep_for(chrono::milliseconds(10));
+  }
+  while ((rip=cache.nextRenderItem()))
+  {
+    n=dynamic_cast<segment *>(rip->obj)-&segs[0];
+    if (n>50 && n<150)
+      tassert(rip->pixelScale==0.025);
+    if (n<50 || n>150)
+      tassert(rip->pixelScale==0.1);
+  }
+}
+
 void testcogospiral1(segment *a,double a0,double a1,segment *b,double b0,double b1,bool extend,xy inter,PostScript &ps,string fname)
 {
   int i,n=0;
@@ -3144,6 +4024,9 @@ void testcurvefit()
   double straightLength;
   polyarc pa;
   xy center;
+  vector<xy> flatPoints;
+  vector<int> closeArcs;
+  vector<double> fullResid,incrResid;
   ps.open("curvefit.ps");
   doc.makepointlist(2);
   ps.setpaper(papersizes["A4 portrait"],0);
@@ -3237,6 +4120,20 @@ void testcurvefit()
   for (i=1;i<48;i++)
     points.push_back(pa.station(16*i));
   test1curvefit(points,startLine,endLine,0.0001,straightLength,ps);
+  /* Check that the residuals found starting at the closest arcs match those
+   * found by searching all arcs, after the arcs have moved a little.
+   */
+  for (i=0;i<400;i++)
+    flatPoints.push_back(pa.station(1.92*i+0.5)+cossin((int)(i*0x9e3779b9))*(i%11)*0.3);
+  fullResid=curvefitResiduals(pa,flatPoints);
+  tassert(fullResid.size()==flatPoints.size());
+  incrResid=curvefitResiduals(pa,flatPoints,closeArcs);
+  pa.setdelta(1,delta+FURMAN1*100);
+  pa.setlengths();
+  fullResid=curvefitResiduals(pa,flatPoints);
+  incrResid=curvefitResiduals(pa,flatPoints,closeArcs);
+  for (i=0;i<flatPoints.size();i++)
+    tassert(fabs(fullResid[i]-incrResid[i])<1e-9);
 }
 
 void test1manyarc(spiralarc s,PostScript &ps)
@@ -3250,6 +4147,7 @@ void test1manyarc(spiralarc s,PostScript &ps)
   vector<array<alosta,2> > crossings1;
   xy enddiff;
   int endbeardiff;
+  double toler;
   bool showCenters=false;
   BoundRect br;
   segment cubic=spiralToCubic(s);
@@ -3332,6 +4230,12 @@ void test1manyarc(spiralarc s,PostScript &ps)
       ps.spline(tickmarks[i].approx3d(0.01));
     ps.endpage();
   }
+  for (toler=1;toler>1e-4;toler/=10)
+  {
+    for (narcs=2;narcs<MANYARC_MAX && tryManyArc(s,narcs).error>toler;narcs++);
+    cout<<"Tolerance "<<toler<<": "<<narcs<<" arcs, estimated "<<manyArcCount(s,toler)<<endl;
+    tassert(narcs<MANYARC_MAX);
+  }
 }
 
 vector<double> cubicIntersections(segment cubic,segment apx)
@@ -3903,6 +4807,52 @@ void testmeasure()
   tassert(ang555.magnitude==ang50505.magnitude);
 }
 
+void testedgelod()
+/* Checks that, zoomed in, all edges near the center are drawn, and that,
+ * zoomed out, the number drawn depends on the window, not the TIN.
+ * The window is 2000 pixels across.
+ */
+{
+  EdgeLod lod;
+  map<int,edge>::iterator i;
+  set<edge *> allEdges,drawn;
+  vector<edge *> vis;
+  int j,nmissing=0,nforeign=0;
+  double pixel,nearest,shortest=INFINITY;
+  xy center(3,-2);
+  doc.makepointlist(1);
+  doc.pl[1].clear();
+  aster(doc,5972);
+  doc.pl[1].maketin();
+  lod.build(doc.pl[1]);
+  tassert(lod.size()==doc.pl[1].edges.size());
+  for (i=doc.pl[1].edges.begin();i!=doc.pl[1].edges.end();++i)
+  {
+    allEdges.insert(&i->second);
+    shortest=min(shortest,i->second.length());
+  }
+  for (pixel=1e-4;pixel<100;pixel*=4)
+  {
+    vis=lod.visibleEdges(center,1000*pixel,pixel,12);
+    drawn.clear();
+    for (j=0;j<vis.size();j++)
+    {
+      drawn.insert(vis[j]);
+      nforeign+=!allEdges.count(vis[j]);
+    }
+    for (i=doc.pl[1].edges.begin(),nearest=INFINITY;i!=doc.pl[1].edges.end();++i)
+      if (!drawn.count(&i->second))
+	nearest=min(nearest,dist(i->second.midpoint(),center));
+    cout<<"Pixel "<<pixel<<": "<<vis.size()<<" edges drawn, nearest not drawn "<<nearest<<endl;
+    tassert(drawn.size()==vis.size());
+    if (pixel*12<=shortest) // No edges are thinned.
+      nmissing+=nearest<1000*pixel;
+    tassert(vis.size()<4*LOD_REPS*sqr(2000/6.+3));
+  }
+  tassert(nmissing==0);
+  tassert(nforeign==0);
+}
+
 void testqindex()
 {
   qindex qinx;
@@ -4523,6 +5473,68 @@ void test1adjstl(array<int,3> stlSplit,array<int,3> stlMin,array<int,3> stlAdj)
   }
 }
 
+array<float,3> readStlVector(istream &file)
+{
+  array<float,3> ret;
+  int i;
+  for (i=0;i<3;i++)
+    ret[i]=readlefloat(file);
+  return ret;
+}
+
+void test1stlmesh(pointlist &pl)
+/* Writes the TIN as binary and text STL, reads the binary back, and checks
+ * that the facets form a closed surface: every side of a facet is a side of
+ * exactly one other facet, going the other way. Also checks that the top
+ * faces up and the bottom faces down, which a fan over a concave bottom
+ * would not.
+ */
+{
+  ifstream binFile;
+  int nfacets,i,j,nText=0;
+  vector<array<float,3> > corners(3);
+  map<pair<array<float,3>,array<float,3> >,int> sides;
+  map<pair<array<float,3>,array<float,3> >,int>::iterator k;
+  bool closed=true,upward=true,downward=true;
+  double area;
+  string line;
+  writeStl("hypar.stl",pl,false,1,0);
+  writeStl("hypar-text.stl",pl,true,1,0);
+  binFile.open("hypar.stl",ios::binary);
+  binFile.seekg(80);
+  nfacets=readleint(binFile);
+  cout<<"STL file has "<<nfacets<<" facets\n";
+  tassert(nfacets>pl.triangles.size());
+  tassert(fileSize(binFile)==84+50*nfacets);
+  for (i=0;i<nfacets;i++)
+  {
+    readStlVector(binFile);
+    for (j=0;j<3;j++)
+      corners[j]=readStlVector(binFile);
+    readleshort(binFile);
+    for (j=0;j<3;j++)
+      sides[make_pair(corners[j],corners[(j+1)%3])]++;
+    area=area3(xy(corners[0][0],corners[0][1]),xy(corners[1][0],corners[1][1]),
+	       xy(corners[2][0],corners[2][1]));
+    if (corners[0][2]>0 && corners[1][2]>0 && corners[2][2]>0 && area<=0)
+      upward=false;
+    if (corners[0][2]==0 && corners[1][2]==0 && corners[2][2]==0 && area>=0)
+      downward=false;
+  }
+  for (k=sides.begin();k!=sides.end();++k)
+    if (k->second!=1 || sides[make_pair(k->first.second,k->first.first)]!=1)
+      closed=false;
+  tassert(closed);
+  tassert(upward);
+  tassert(downward);
+  binFile.close();
+  binFile.open("hypar-text.stl");
+  while (getline(binFile,line))
+    if (line.find("facet normal")==0)
+      nText++;
+  tassert(nText==nfacets);
+}
+
 void teststl()
 {
   StlTriangle stltri;
@@ -4562,6 +5574,43 @@ void teststl()
   test1adjstl(stlSplit0,stlMin4,stlAdj04);
 }
 
+void teststlmesh()
+{
+  vector<array<xyz,3> > uFaces;
+  xyz corner[4];
+  double x,y;
+  int i,j;
+  doc.makepointlist(1);
+  doc.pl[1].clear();
+  setsurface(HYPAR);
+  aster(doc,100);
+  doc.pl[1].maketin();
+  doc.pl[1].makegrad(0.);
+  doc.pl[1].maketriangles();
+  doc.pl[1].setgradient();
+  doc.pl[1].makeqindex();
+  test1stlmesh(doc.pl[1]);
+  /* A U-shaped TIN, three cells wide and three high with the middle column
+   * missing above the bottom row, is not star-shaped from any point.
+   */
+  for (i=0;i<9;i++)
+    if (i<3 || i%3!=1)
+    {
+      for (j=0;j<4;j++)
+      {
+	x=(i%3+(j==1||j==2))*10;
+	y=(i/3+(j>1))*10;
+	corner[j]=xyz(x,y,5+x/10+y/20);
+      }
+      uFaces.push_back({corner[0],corner[1],corner[2]});
+      uFaces.push_back({corner[0],corner[2],corner[3]});
+    }
+  doc.pl[1].makeBareTriangles(uFaces);
+  doc.pl[1].makeEdges();
+  tassert(doc.pl[1].triangles.size()==14);
+  test1stlmesh(doc.pl[1]);
+}
+
 void testdirbound()
 {
   double bound;
@@ -4893,6 +5942,71 @@ double sepdist(xy a1,xy a2,xy a3,xy b1,xy b2,xy b3)
   return pldist(a2,b2,b2+cossin(avgdir));
 }
 
+void testpsplot()
+/* Checks that drawing many splines at once gives the same file as drawing
+ * them one at a time, and that, once the resolution is set, splines off
+ * the page are left out and tiny pieces are merged.
+ */
+{
+  int i;
+  vector<bezier3d> spls;
+  bezier3d tiny;
+  PostScript ps;
+  string oneAtATime,allAtOnce,withOffPage,unculled;
+  for (i=0;i<1000;i++)
+    spls.push_back(arc(xyz(cossin(i*0.1)*(i%37),0),xyz(cossin(i*0.1+1)*(i%41),0),i%7-3.).approx3d(0.01));
+  for (i=0;i<4;i++)
+  {
+    ps.open("psplot.ps");
+    ps.setpaper(papersizes["A4 portrait"],0);
+    ps.prolog();
+    ps.startpage();
+    ps.setscale(-40,-40,40,40,0);
+    ps.setResolution(i<3?PLOTRES:0);
+    if (i==1)
+      ps.splines(spls);
+    else
+      for (int j=0;j<spls.size();j++)
+	ps.spline(spls[j]);
+    if (i>=2)
+      ps.spline(arc(xyz(1e4,1e4,0),xyz(1e4+10,1e4,0),1.).approx3d(0.01));
+    ps.endpage();
+    ps.trailer();
+    ps.close();
+    switch (i)
+    {
+      case 0:
+	oneAtATime=readWholeFile("psplot.ps");
+	break;
+      case 1:
+	allAtOnce=readWholeFile("psplot.ps");
+	break;
+      case 2:
+	withOffPage=readWholeFile("psplot.ps");
+	break;
+      case 3:
+	unculled=readWholeFile("psplot.ps");
+	break;
+    }
+  }
+  tassert(oneAtATime==allAtOnce);
+  tassert(oneAtATime==withOffPage);
+  tassert(unculled.length()>oneAtATime.length());
+  for (i=0;i<10000;i++)
+    tiny+=segment(xyz(i*1e-5,0,0),xyz((i+1)*1e-5,0,0)).approx3d(1);
+  ps.open("psplot.ps");
+  ps.prolog();
+  ps.startpage();
+  ps.setscale(-40,-40,40,40,0);
+  ps.setResolution(PLOTRES);
+  ps.spline(tiny);
+  ps.endpage();
+  ps.close();
+  allAtOnce=readWholeFile("psplot.ps");
+  cout<<"Spline of 10000 tiny pieces takes "<<allAtOnce.length()<<" bytes\n";
+  tassert(allAtOnce.length()<2000);
+}
+
 void testbezier3d()
 {
   xyz startpoint,endpoint;
@@ -5745,7 +6859,8 @@ void testprojection()
   // It will be in a UTM zone, once transverse Mercator is implemented.
   latlong ll;
   xy grid;
-  ProjectionList plist,ncplist,pacplist;
+  ProjectionList plist,ncplist,pacplist,catlist,mixlist;
+  stringstream catStream,mixStream;
   ProjectionLabel plabel;
   Projection *proj;
   string projName;
@@ -5818,6 +6933,15 @@ void testprojection()
   grid=GeorgiaWest.latlongToGrid(llBV067202);
   cout<<grid.east()<<' '<<grid.north()<<' '<<dist(grid,xyBV067202)<<endl;
   tassert(dist(grid,xyBV067202)<0.001);
+  // A definition that can't be constructed is left out when read.
+  mixStream.str("Country:XX\nState:\nZone:Good\nVersion:\nProjection:TM\nEllipsoid:Clarke\n"
+		"Meridian:84W\nScale:0.9999\nOriginLL:30N 84W\nOriginXY:500000,0\nFoot:US\n\n"
+		"Country:XX\nState:\nZone:Bad\nVersion:\nProjection:TM\nEllipsoid:Nosuch\n"
+		"Meridian:84W\nScale:0.9999\nOriginLL:30N 84W\nOriginXY:500000,0\nFoot:US\n\n");
+  mixlist.readFile(mixStream);
+  tassert(mixlist.size()==1);
+  tassert(mixlist.nthLabel(0).zone=="Good");
+  tassert(mixlist[0]);
   if (pfile)
   {
     plist.readFile(pfile);
@@ -5827,12 +6951,20 @@ void testprojection()
     tassert(ncplist.size()==3);
     cout<<"Point 196 is in "<<pacplist.size()<<" projections\n";
     tassert(pacplist.size()==0);
+    cout<<plist.countConstructed()<<" of "<<plist.size()<<" projections constructed\n";
+    tassert(plist.countConstructed()<plist.size());
     if (ncplist.size()>=2)
     {
       distOldNewOakland=dist(ncplist[0]->latlongToGrid(llOakland),ncplist[1]->latlongToGrid(llOakland));
       cout<<"Distance from Oakland NAD27 to NAD83 is "<<distOldNewOakland<<endl;
       tassert(fabs(distOldNewOakland-7.868)<0.001);
     }
+    plist.writeCatalog(catStream);
+    tassert(catlist.readCatalog(catStream));
+    tassert(catlist.size()==plist.size());
+    tassert(catlist.countConstructed()==0);
+    tassert(catlist.cover(EWN).size()==3);
+    tassert(catlist.cover(ll196).size()==0);
     for (i=0;i<plist.size();i++)
     {
       proj=plist[i];
@@ -5955,6 +7087,8 @@ void test1contour(string contourName,xyz offset,xy tripoint,double conterval,dou
   double prec=0.0000001,along,elevError,maxElevError=0;
   histogram h(-conterval/10,conterval/10);
   manysum totalContourLength;
+  DxfStream serialDxf(true),parallelDxf(true);
+  DxfLayer contourLayer;
   triangle *tri;
   segment seg;
   xy crit,sta;
@@ -6026,6 +7160,19 @@ for (i=0;tri && i<tri->subdiv.size();i++)
     tothash+=doc.pl[1].contours[i].hash();
   }
   ps.endpage();
+  /* Write the contours to DXF one by one and in several threads. The
+   * output must be the same.
+   */
+  contourLayer.name="Contour";
+  contourLayer.number=1;
+  contourLayer.color=1;
+  for (i=0;i<doc.pl[1].contours.size();i++)
+    insertPolyline(serialDxf,doc.pl[1].contours[i],contourLayer,1);
+  insertInParallel(parallelDxf,doc.pl[1].contours.size(),[&contourLayer](DxfStream &part,size_t n)
+		   {
+		     insertPolyline(part,doc.pl[1].contours[n],contourLayer,1);
+		   },4);
+  tassert(serialDxf.take()==parallelDxf.take());
   ps.setpaper(papersizes["A4 portrait"],1);
   ps.startpage();
   along=rng.expirandom();
@@ -6329,6 +7476,66 @@ void testzigzagcontour()
   doc.writeXml(ofile);
 }
 
+void testsparseleastsquares()
+/* Compares the sparse solution with the dense one on a small random matrix,
+ * then adjusts a leveling network too big to do densely in reasonable time.
+ */
+{
+  int i,j,nan=0,nstations=10000;
+  matrix a(40,30);
+  SparseMatrix sa,net;
+  vector<double> b,xd,xs,height,obs;
+  double maxerr=0;
+  a.setzero();
+  for (i=0;i<40;i++)
+  {
+    for (j=0;j<4;j++)
+      a[i][(i+j*7)%30]=(rng.ucrandom()*2-255)/BYTERMS;
+    b.push_back((rng.ucrandom()*2-255)/BYTERMS);
+  }
+  sa=SparseMatrix(a);
+  xd=linearLeastSquares(a,b);
+  xs=linearLeastSquares(sa,b);
+  for (i=0;i<30;i++)
+    tassert(fabs(xd[i]-xs[i])<1e-9);
+  b.resize(30);
+  a=a.transpose();
+  xd=minimumNorm(a,b);
+  xs=minimumNorm(SparseMatrix(a),b);
+  for (i=0;i<40;i++)
+    tassert(fabs(xd[i]-xs[i])<1e-9);
+  /* A leveling network: stations in a loop, each tied to the next one and
+   * to one a hundred stations on, with heights differing by known amounts.
+   */
+  net.resize(2*nstations,nstations);
+  for (i=0;i<nstations;i++)
+    height.push_back(rng.usrandom()/1000.);
+  for (i=0;i<nstations;i++)
+  {
+    j=(i+1)%nstations;
+    net.add(2*i,i,-1);
+    net.add(2*i,j,1);
+    obs.push_back(height[j]-height[i]);
+    j=(i+100)%nstations;
+    net.add(2*i+1,i,-1);
+    net.add(2*i+1,j,1);
+    obs.push_back(height[j]-height[i]);
+  }
+  xs=linearLeastSquares(net,obs); // no station is fixed, so one height is NaN
+  for (i=0;i<nstations;i++)
+    nan+=std::isnan(xs[i]);
+  tassert(nan==1);
+  net.resize(2*nstations+1,nstations);
+  net.add(2*nstations,0,1);
+  obs.push_back(height[0]);
+  xs=linearLeastSquares(net,obs);
+  for (i=0;i<nstations;i++)
+    if (!(fabs(xs[i]-height[i])<maxerr))
+      maxerr=fabs(xs[i]-height[i]);
+  cout<<"Leveling network of "<<nstations<<" stations, max error "<<maxerr<<endl;
+  tassert(maxerr<1e-9);
+}
+
 void testleastsquares()
 {
   matrix a(3,2);
@@ -6358,6 +7565,7 @@ void testleastsquares()
   x=minimumNorm(a,b);
   cout<<"Minimum norm ("<<ldecimal(x[0])<<','<<ldecimal(x[1])<<','<<ldecimal(x[2])<<")\n";
   tassert(dist(xyz(x[0],x[1],x[2]),xyz(0.25,0.25,0.5))<1e-9);
+  testsparseleastsquares();
 }
 
 void clampcubic()
@@ -6575,6 +7783,111 @@ void testbicubic()
    */
 }
 
+double histoCdf(histogram &h,double x)
+// Fraction of the data below x, taking each bar's data to be spread evenly.
+{
+  int i;
+  double ret=0;
+  histobar bar;
+  for (i=0;i<h.nbars();i++)
+  {
+    bar=h.getbar(i);
+    if (x>=bar.end)
+      ret+=bar.count;
+    else if (x>bar.start)
+      ret+=bar.count*(x-bar.start)/(bar.end-bar.start);
+  }
+  return ret/h.gettotal();
+}
+
+unsigned checkbars(histogram &h)
+// Checks that the bars are in order and touch, and returns their total count.
+{
+  int i;
+  unsigned ret=0;
+  histobar bar,lastbar;
+  for (i=0;i<h.nbars();i++)
+  {
+    bar=h.getbar(i);
+    tassert(bar.start<bar.end);
+    if (i)
+      tassert(bar.start==lastbar.end);
+    ret+=bar.count;
+    lastbar=bar;
+  }
+  return ret;
+}
+
+void teststreamhisto()
+/* Fills one histogram with no limit on bars, one limited to 64 bars, and
+ * four in separate threads which are merged, and checks their intervals
+ * and distributions against the data.
+ */
+{
+  const int n=100000;
+  int i,j,inner=0,positive=0,late=0;
+  double x;
+  vector<double> data;
+  histogram whole(-0.1,0.1),capped(-0.1,0.1),merged(-0.1,0.1);
+  vector<future<histogram> > parts;
+  for (i=0;i<n;i++)
+  {
+    data.push_back(sin((double)i));
+    inner+=fabs(data[i])<=0.5;
+    positive+=data[i]>=0;
+    if (i>=n/2)
+      late+=fabs(data[i])<=0.25;
+  }
+  whole.addinterval(-0.5,0.5);
+  whole.addinterval(0,1);
+  capped.setmaxbins(64);
+  capped.addinterval(-0.5,0.5);
+  capped.addinterval(0,1);
+  merged.addinterval(-0.5,0.5);
+  merged.addinterval(0,1);
+  for (i=0;i<n;i++)
+  {
+    if (i==n/2)
+      whole.addinterval(-0.25,0.25);
+    whole<<data[i];
+    capped<<data[i];
+  }
+  for (i=0;i<4;i++)
+    parts.push_back(async(launch::async,[&data](int part)
+      {
+	histogram ret(-0.1,0.1);
+	int k;
+	ret.addinterval(-0.5,0.5);
+	ret.addinterval(0,1);
+	for (k=data.size()*part/4;k<data.size()*(part+1)/4;k++)
+	  ret<<data[k];
+	return ret;
+      },i));
+  for (i=0;i<4;i++)
+    merged.merge(parts[i].get());
+  cout<<whole.nbars()<<" bars unlimited, "<<capped.nbars()<<" limited, "
+      <<merged.nbars()<<" merged"<<endl;
+  tassert(whole.gettotal()==n && checkbars(whole)==n);
+  tassert(capped.gettotal()==n && checkbars(capped)==n);
+  tassert(merged.gettotal()==n && checkbars(merged)==n);
+  tassert(capped.nbars()<=64);
+  tassert(whole.getinterval(0).count==inner && whole.getinterval(1).count==positive);
+  tassert(whole.getinterval(2).count==late);
+  tassert(capped.getinterval(0).count==inner && capped.getinterval(1).count==positive);
+  tassert(merged.getinterval(0).count==inner && merged.getinterval(1).count==positive);
+  for (j=-9;j<=9;j+=3)
+  {
+    x=j/10.;
+    cout<<setw(5)<<x<<setw(10)<<asin(x)/M_PI+0.5<<setw(10)<<histoCdf(whole,x)
+        <<setw(10)<<histoCdf(capped,x)<<setw(10)<<histoCdf(merged,x)<<endl;
+    tassert(fabs(histoCdf(whole,x)-asin(x)/M_PI-0.5)<0.005);
+    tassert(fabs(histoCdf(capped,x)-asin(x)/M_PI-0.5)<2./64);
+    tassert(fabs(histoCdf(merged,x)-asin(x)/M_PI-0.5)<0.005);
+  }
+  merged.merge(merged);
+  tassert(merged.gettotal()==2*n && checkbars(merged)==2*n);
+}
+
 void testhistogram()
 {
   histogram histo0(-1,1),histo1(-0.1,0.1),histo2(-10,10);
@@ -6617,6 +7930,7 @@ void testhistogram()
   }
   cout<<bar.end<<endl;
   tassert(histo2.gettotal()==bartot);
+  teststreamhisto();
   ps.open("histogram.ps");
   ps.setpaper(papersizes["A4 portrait"],1);
   ps.prolog();
@@ -8113,6 +9427,14 @@ bool shoulddo(string testname)
   return ret;
 }
 
+bool shoulddoExplicit(string testname)
+/* For benchmarks, which take too long or too much memory to run every time.
+ * They are run only when named on the command line.
+ */
+{
+  return shoulddo(testname) && args.size();
+}
+
 void testlooseness()
 {
   double looseness,len,midlength;
@@ -8182,6 +9504,8 @@ int main(int argc, char *argv[])
     testmeasure();
   if (shoulddo("matrix"))
     testmatrix();
+  if (shoulddoExplicit("matrixbench"))
+    testmatrixbench();
   if (shoulddo("quaternion"))
     testquaternion();
   if (shoulddo("copytopopoints"))
@@ -8196,6 +9520,14 @@ int main(int argc, char *argv[])
     testmaketindouble();
   if (shoulddo("maketinaster"))
     testmaketinaster();
+  if (shoulddo("baretin"))
+    testbaretin();
+  if (shoulddo("tinedit"))
+    testtinedit();
+  if (shoulddo("cutfill"))
+    testcutfill();
+  if (shoulddoExplicit("cutfillbench"))
+    testcutfillbench();
   if (shoulddo("maketinbigaster"))
     testmaketinbigaster(); // >1 s
   if (shoulddo("maketinstraightrow"))
@@ -8216,6 +9548,8 @@ int main(int argc, char *argv[])
     testtripolygon();
   if (shoulddo("tindxf"))
     testtindxf();
+  if (shoulddo("scene"))
+    testscene();
   if (shoulddo("break0"))
     testbreak0();
   if (shoulddo("brent"))
@@ -8224,6 +9558,8 @@ int main(int argc, char *argv[])
     testnewton();
   if (shoulddo("manysum"))
     testmanysum(); // >2 s
+  if (shoulddoExplicit("pairwisebench"))
+    testpairwisebench();
   if (shoulddo("vcurve"))
     testvcurve();
   if (shoulddo("integertrig"))
@@ -8246,6 +9582,10 @@ int main(int argc, char *argv[])
     testproperty();
   if (shoulddo("objlist"))
     testobjlist();
+  if (shoulddo("rendercache"))
+    testrendercache();
+  if (shoulddo("renderschedule"))
+    testrenderschedule();
   if (shoulddo("cogospiral"))
     testcogospiral();
   if (shoulddo("curly"))
@@ -8258,6 +9598,8 @@ int main(int argc, char *argv[])
     testclosest();
   if (shoulddo("qindex"))
     testqindex();
+  if (shoulddo("edgelod"))
+    testedgelod();
   if (shoulddo("makegrad"))
     testmakegrad();
   if (shoulddo("derivs"))
@@ -8274,6 +9616,8 @@ int main(int argc, char *argv[])
     testdirbound();
   if (shoulddo("stl"))
     teststl();
+  if (shoulddo("stlmesh"))
+    teststlmesh();
   if (shoulddo("halton"))
     testhalton(); // 2.5 s
   if (shoulddo("polyline"))
@@ -8282,6 +9626,8 @@ int main(int argc, char *argv[])
     testalignment();
   if (shoulddo("bezier3d"))
     testbezier3d();
+  if (shoulddo("psplot"))
+    testpsplot();
   if (shoulddo("angleconv"))
     testangleconv();
   if (shoulddo("grad"))
@@ -49,6 +49,7 @@
 #include "curvefit.h"
 #include "csv.h"
 #include "ldecimal.h"
+#include "scene.h"
 
 using namespace std;
 
@@ -60,8 +61,12 @@ ProjectionList allProjections;
 
 void readAllProjections()
 {
-  ifstream pfile(string(SHARE_DIR)+"/projections.txt");
-  allProjections.readFile(pfile);
+  ifstream pcat(string(SHARE_DIR)+"/projections.cat",ios::binary);
+  if (!allProjections.readCatalog(pcat))
+  {
+    ifstream pfile(string(SHARE_DIR)+"/projections.txt");
+    allProjections.readFile(pfile);
+  }
 }
 
 void indpark(string args)
@@ -319,6 +324,7 @@ void contourdraw_i(string args)
   double w,e,s,n;
   int i,j;
   PostScript ps;
+  vector<bezier3d> spls;
   contervalstr=firstarg(args);
   try
   {
@@ -352,13 +358,18 @@ void contourdraw_i(string args)
       ps.prolog();
       ps.startpage();
       ps.setscale(w,s,e,n,0);
+      ps.setResolution(PLOTRES);
       ps.setcolor(0,0.6,0.6);
+      spls.clear();
       for (i=0;i<doc.pl[1].edges.size();i++)
-	ps.spline(doc.pl[1].edges[i].getsegment().approx3d(1));
+	spls.push_back(doc.pl[1].edges[i].getsegment().approx3d(1));
+      ps.splines(spls);
       ps.setcolor(0,1,1);
+      spls.clear();
       for (i=0;i<doc.pl[1].triangles.size();i++)
 	for (j=0;j<doc.pl[1].triangles[i].subdiv.size();j++)
-	  ps.spline(doc.pl[1].triangles[i].subdiv[j].approx3d(1));
+	  spls.push_back(doc.pl[1].triangles[i].subdiv[j].approx3d(1));
+      ps.splines(spls);
       for (i=0;i<doc.pl[1].contours.size();i++)
       {
 	switch (lrint(doc.pl[1].contours[i].getElevation()/conterval)%10)
@@ -401,6 +412,31 @@ void save_i(string args)
     cout<<"No filename specified"<<endl;
 }
 
+void savebin_i(string args)
+{
+  args=trim(args);
+  if (args.length())
+    writeScene(args,doc);
+  else
+    cout<<"No filename specified"<<endl;
+}
+
+void loadbin_i(string args)
+{
+  args=trim(args);
+  if (args.length())
+    try
+    {
+      readScene(args,doc);
+    }
+    catch (BeziExcept &e)
+    {
+      cout<<"Can't read scene file: "<<e.message().toStdString()<<endl;
+    }
+  else
+    cout<<"No filename specified"<<endl;
+}
+
 void bdiff_i(string args)
 {
   arangle bear1,bear2;
@@ -553,6 +589,8 @@ int main(int argc, char *argv[])
   commands.push_back(command("read",readpoints,"Read coordinate file: filename format"));
   commands.push_back(command("write",writepoints,"Write coordinate file: filename format"));
   commands.push_back(command("save",save_i,"Write scene file: filename.bez"));
+  commands.push_back(command("savebin",savebin_i,"Write binary scene file: filename.bzs"));
+  commands.push_back(command("loadbin",loadbin_i,"Read binary scene file: filename.bzs"));
   commands.push_back(command("maketin",maketin_i,"Make triangulated irregular network"));
   commands.push_back(command("drawtin",drawtin_i,"Draw TIN: filename.ps"));
   commands.push_back(command("curvefit",curvefit_i,"Fit curve: filename.csv"));
@@ -244,10 +244,20 @@ double readledouble(std::istream &file)
 {
   char buf[8];
   file.read(buf,8);
+  return readledouble(buf);
+}
+
+double readledouble(const char *bytes)
+// For bytes already read into a buffer, such as by a scanner.
+{
+  double ret;
+  char buf[8];
+  memcpy(buf,bytes,8);
 #ifdef BIGENDIAN
   endianflip(buf,8);
 #endif
-  return *(double *)buf;
+  memcpy(&ret,buf,8);
+  return ret;
 }
 
 void writegeint(std::ostream &file,int i)
@@ -405,6 +415,50 @@ int readgeint(std::istream &file)
   return ret;
 }
 
+void writeuvarint(ostream &file,unsigned long long i)
+/* Writes seven bits at a time, least significant first, setting the high bit
+ * of each byte but the last. Numbers less than 128 take one byte.
+ */
+{
+  char buf[10];
+  int n=0;
+  do
+  {
+    buf[n]=(i&127)|((i>127)<<7);
+    i>>=7;
+    n++;
+  } while (i);
+  file.write(buf,n);
+}
+
+unsigned long long readuvarint(istream &file)
+{
+  int ch,shift=0;
+  unsigned long long ret=0;
+  do
+  {
+    ch=file.get();
+    if (ch<0)
+      break;
+    if (shift<64)
+      ret|=(unsigned long long)(ch&127)<<shift;
+    shift+=7;
+  } while (ch&128);
+  return ret;
+}
+
+void writesvarint(ostream &file,long long i)
+// Zigzag encoding: 0, -1, 1, -2, 2 ... become 0, 1, 2, 3, 4 ...
+{
+  writeuvarint(file,((unsigned long long)i<<1)^(unsigned long long)(i>>63));
+}
+
+long long readsvarint(istream &file)
+{
+  unsigned long long u=readuvarint(file);
+  return (long long)(u>>1)^-(long long)(u&1);
+}
+
 void writeustring(ostream &file,string s)
 // FIXME: if s contains a null character, it should be written as c0 a0
 {
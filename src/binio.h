@@ -55,8 +55,13 @@ void writebedouble(std::ostream &file,double f);
 void writeledouble(std::ostream &file,double f);
 double readbedouble(std::istream &file);
 double readledouble(std::istream &file);
+double readledouble(const char *bytes);
 void writegeint(std::ostream &file,int i); // for Bezitopo's geoid files
 int readgeint(std::istream &file);
+void writeuvarint(std::ostream &file,unsigned long long i);
+unsigned long long readuvarint(std::istream &file);
+void writesvarint(std::ostream &file,long long i);
+long long readsvarint(std::istream &file);
 void writeustring(std::ostream &file,std::string s);
 std::string readustring(std::istream &file);
 
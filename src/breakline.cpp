@@ -24,7 +24,10 @@
 #include <cstring>
 #include <climits>
 #include <string>
+#include <unordered_map>
+#include <algorithm>
 #include "breakline.h"
+#include "binio.h"
 #include "except.h"
 using namespace std;
 
@@ -206,6 +209,68 @@ Breakline0 operator+(Breakline0 &a,Breakline0 &b)
   return ret;
 }
 
+vector<Breakline0> stitchBreaklines(vector<Breakline0> &pieces)
+/* Joins all the pieces that can be joined, as repeatedly adding jungible
+ * pairs does, in linear time. Each open piece has two ends, numbered
+ * 2*piece for its low end and 2*piece+1 for its high end. The ends that
+ * meet at a point are paired as they are found in a hash of unpaired ends,
+ * leaving at most one unpaired end at each point. Then each chain is
+ * followed from an unpaired end to another unpaired end, and what is left
+ * is closed chains. Pieces that aren't joined to anything are left as they
+ * are; joined ones are normalized. The result is sorted by size.
+ */
+{
+  vector<Breakline0> ret;
+  vector<int> mate(2*pieces.size(),-1);
+  vector<bool> used(pieces.size(),false);
+  unordered_map<int,int> unpaired;
+  unordered_map<int,int>::iterator k;
+  int i,node;
+  auto follow=[&](int e)
+  // Follows a chain from end e until it comes to an unpaired end or back to the start.
+  {
+    Breakline0 chain;
+    int j,npieces,first=e/2;
+    for (npieces=0;e>=0 && !used[e/2];e=mate[e^1],npieces++)
+    {
+      used[e/2]=true;
+      if (e&1)
+	for (j=pieces[e/2].nodes.size()-1-(npieces>0);j>=0;j--)
+	  chain.nodes.push_back(pieces[e/2].nodes[j]);
+      else
+	for (j=(npieces>0);j<pieces[e/2].nodes.size();j++)
+	  chain.nodes.push_back(pieces[e/2].nodes[j]);
+    }
+    if (npieces>1)
+      chain.normalize();
+    else
+      chain=pieces[first];
+    ret.push_back(chain);
+  };
+  for (i=0;i<2*pieces.size();i++)
+    if (pieces[i/2].nodes.size() && pieces[i/2].isOpen())
+    {
+      node=(i&1)?pieces[i/2].nodes.back():pieces[i/2].nodes[0];
+      k=unpaired.find(node);
+      if (k==unpaired.end())
+	unpaired[node]=i;
+      else
+      {
+	mate[i]=k->second;
+	mate[k->second]=i;
+	unpaired.erase(k);
+      }
+    }
+  for (i=0;i<2*pieces.size();i++)
+    if (pieces[i/2].nodes.size() && pieces[i/2].isOpen() && mate[i]<0 && !used[i/2])
+      follow(i);
+  for (i=0;i<pieces.size();i++)
+    if (pieces[i].nodes.size() && !used[i])
+      follow(2*i);
+  stable_sort(ret.begin(),ret.end(),[](const Breakline0 &a,const Breakline0 &b){return a.nodes.size()<b.nodes.size();});
+  return ret;
+}
+
 void Breakline0::writeText(ostream &ofile)
 {
   int i;
@@ -230,6 +295,32 @@ void Breakline0::writeXml(ostream &ofile)
   ofile<<"</break0>\n";
 }
 
+void Breakline0::writeBinary(ostream &ofile)
+// Each node is written as the difference from the previous one.
+{
+  int i;
+  writeuvarint(ofile,nodes.size());
+  for (i=0;i<nodes.size();i++)
+    writesvarint(ofile,i?(long long)nodes[i]-nodes[i-1]:nodes[i]);
+}
+
+void Breakline0::readBinary(istream &ifile)
+{
+  size_t i,n;
+  long long node=0;
+  nodes.clear();
+  n=readuvarint(ifile);
+  for (i=0;i<n && ifile.good();i++)
+  {
+    node+=readsvarint(ifile);
+    if (node<INT_MIN || node>INT_MAX)
+      throw BeziExcept(badData);
+    nodes.push_back(node);
+  }
+  if (!ifile.good())
+    throw BeziExcept(badData);
+}
+
 vector<string> parseBreakline(string line,char delim)
 {
   vector<string> ret;
@@ -50,11 +50,15 @@ public:
   std::array<int,2> operator[](int n);
   friend bool jungible(Breakline0 &a,Breakline0 &b);
   friend Breakline0 operator+(Breakline0 &a,Breakline0 &b);
+  friend std::vector<Breakline0> stitchBreaklines(std::vector<Breakline0> &pieces);
   void writeText(std::ostream &ofile);
   void writeXml(std::ostream &ofile);
+  void writeBinary(std::ostream &ofile);
+  void readBinary(std::istream &ifile);
 private:
   std::vector<int> nodes;
 };
 
+std::vector<Breakline0> stitchBreaklines(std::vector<Breakline0> &pieces);
 std::vector<std::string> parseBreakline(std::string line,char delim);
 #endif
@@ -25,6 +25,8 @@
  * word for the Euler spiral.
  */
 #include <iostream>
+#include <future>
+#include <thread>
 #include "manyarc.h"
 #include "vball.h"
 #include "cmdopt.h"
@@ -443,9 +445,13 @@ void setUnits(Measure &ms,int unit)
  */
 int main(int argc, char *argv[])
 {
-  int i;
+  int i,j;
+  static int cores=thread::hardware_concurrency();
+  int nthreads=(cores>1)?cores:1;
+  bool done=false;
+  vector<future<ManyArcTry> > tries;
+  ManyArcTry oneTry;
   spiralarc s;
-  polyarc approx;
   Measure ms;
   ms.setMetric();
   ms.setDefaultUnit(LENGTH,0.552);
@@ -508,12 +514,23 @@ int main(int argc, char *argv[])
       cout<<"<h2>Invalid spiral</h2>\n";
     }
     else
-      do
+      /* Output the approximations with 2, 3, 4... arcs until one is within
+       * 1 cm. Several counts are tried at once and output in order.
+       */
+      while (!done)
       {
-	approx=manyArc(s,i);
-	outApprox(approx,s,ms);
-	i++;
-      } while (maxError(approx,s)>0.01);
+	tries.clear();
+	for (j=0;j<nthreads;j++)
+	  tries.push_back(async(nthreads>1?launch::async:launch::deferred,tryManyArc,s,i+j));
+	for (j=0;j<nthreads;j++)
+	{
+	  oneTry=tries[j].get();
+	  if (!done)
+	    outApprox(oneTry.apx,s,ms);
+	  done=done || oneTry.error<=0.01;
+	}
+	i+=nthreads;
+      }
     endHtml();
   }
   if (commandError)
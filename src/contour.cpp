@@ -38,6 +38,7 @@
 #include "contour.h"
 #include "relprime.h"
 #include "ldecimal.h"
+#include "binio.h"
 using namespace std;
 
 float splittab[65]=
@@ -206,6 +207,22 @@ void ContourInterval::writeXml(ostream &ofile)
   ofile<<"\"/>"<<endl;
 }
 
+void ContourInterval::writeBinary(ostream &ofile)
+{
+  writeledouble(ofile,interval);
+  writeledouble(ofile,relativeTolerance);
+  writesvarint(ofile,fineRatio);
+  writesvarint(ofile,coarseRatio);
+}
+
+void ContourInterval::readBinary(istream &ifile)
+{
+  interval=readledouble(ifile);
+  relativeTolerance=readledouble(ifile);
+  fineRatio=readsvarint(ifile);
+  coarseRatio=readsvarint(ifile);
+}
+
 bool operator<(const ContourLayer &l,const ContourLayer &r)
 // For a map from ContourLayer to layer numbers
 {
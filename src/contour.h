@@ -71,6 +71,8 @@ public:
   friend bool operator==(const ContourInterval &l,const ContourInterval &r);
   friend bool operator!=(const ContourInterval &l,const ContourInterval &r);
   void writeXml(std::ostream &ofile);
+  void writeBinary(std::ostream &ofile);
+  void readBinary(std::istream &ifile);
 private:
   double interval,relativeTolerance;
   int fineRatio,coarseRatio;
@@ -177,6 +177,30 @@ vector<double> curvefitResiduals(polyarc q,vector<xy> points)
   return ret;
 }
 
+double arcResidual(polyarc &q,xy point,int &whichArc)
+/* Returns the residual of point from q, like curvefitResiduals, but starts
+ * looking at whichArc, the arc the point was closest to before q was changed
+ * a little. whichArc is set to the closest arc.
+ */
+{
+  double along=q.closestNear(point,whichArc);
+  return distanceInDirection(q.station(along),point,q.bearing(along)+DEG90);
+}
+
+vector<double> curvefitResiduals(polyarc q,const vector<xy> &points,vector<int> &closeArcs)
+/* closeArcs holds the arc each point was closest to the last time. If it's
+ * the wrong size, it is filled in by searching all the arcs.
+ */
+{
+  vector<double> ret;
+  int i;
+  if (closeArcs.size()!=points.size())
+    closeArcs.assign(points.size(),-1);
+  for (i=0;i<points.size();i++)
+    ret.push_back(arcResidual(q,points[i],closeArcs[i]));
+  return ret;
+}
+
 double curvefitSquareError(polyarc q,vector<xy> points)
 {
   vector<double> resid=curvefitResiduals(q,points);
@@ -304,20 +328,55 @@ vector<int> adjustDirs(polyarc apx,int fitDir)
   return ret;
 }
 
+int firstChangedArc(int param,int sz,bool twoD)
+/* Returns the first arc changed by adjusting the paramth parameter in
+ * adjust1step. Moving an endpoint changes the arcs on both sides of it,
+ * and, because each arc is tangent to the previous one, the deltas of all
+ * arcs after it, but none of the arcs before it.
+ */
+{
+  int d=twoD+1;
+  if (param==0 || param==sz*d+2) // startOff or startBear
+    return 0;
+  else if (param==sz*d+1) // endOff
+    return sz;
+  else
+    return (param-1)%sz;
+}
+
 FitRec adjust1step(vector<xy> points,Circle startLine,FitRec fr,Circle endLine,bool twoD)
 {
-  int i,j,sz=fr.endpoints.size(),d=twoD+1;
+  vector<int> closeArcs;
+  return adjust1step(points,startLine,fr,endLine,twoD,closeArcs);
+}
+
+FitRec adjust1step(const vector<xy> &points,Circle startLine,FitRec fr,Circle endLine,bool twoD,vector<int> &closeArcs)
+/* Computes the partial derivatives of the residuals by moving each endpoint
+ * (and the start and end offsets and start bearing) a little each way.
+ * A point closest to an arc before the first one that moves has the same
+ * residual either way, so its partial derivative is 0, and the residuals
+ * of the other points are found starting at the arc they're closest to.
+ * The derivatives are accumulated into the normal equations point by point,
+ * without making the whole matrix, which for a long trace of points has
+ * far more rows than columns, most of whose entries are 0.
+ */
+{
+  int i,j,k,sz=fr.endpoints.size(),d=twoD+1;
   vector<double> adjustment;
   vector<double> resid;
-  vector<double> plusresid,minusresid;
   polyarc apx=arcFitApprox(startLine,fr,endLine);
+  polyarc plusapx,minusapx;
   vector<int> adjdirs=adjustDirs(apx,fitDir);
   double shortDist=fr.shortDist(startLine,endLine);
   double h=shortDist*bintorad(FURMAN1);
   double maxadj=0;
+  int firstArc;
   vector<xy> hxy,hyx;
+  vector<vector<int> > rowCols(points.size());
+  vector<vector<double> > rowVals(points.size());
   FitRec plusoffsets,minusoffsets,ret;
-  matrix sidedefl(points.size(),sz*d+3);
+  NormalEquations normal(sz*d+3);
+  resid=curvefitResiduals(apx,points,closeArcs);
   for (i=0;i<sz;i++)
   {
     hxy.push_back(cossin(adjdirs[i])*h);
@@ -366,13 +425,22 @@ FitRec adjust1step(vector<xy> points,Circle startLine,FitRec fr,Circle endLine,b
     }
     else
       plusoffsets.startBear=minusoffsets.startBear=fr.startBear;
-    plusresid=curvefitResiduals(arcFitApprox(startLine,plusoffsets,endLine),points);
-    minusresid=curvefitResiduals(arcFitApprox(startLine,minusoffsets,endLine),points);
-    for (j=0;j<plusresid.size();j++)
-      sidedefl[j][i]=plusresid[j]-minusresid[j];
+    plusapx=arcFitApprox(startLine,plusoffsets,endLine);
+    minusapx=arcFitApprox(startLine,minusoffsets,endLine);
+    firstArc=firstChangedArc(i,sz,twoD);
+    for (j=0;j<points.size();j++)
+      if (closeArcs[j]>=firstArc-1)
+      {
+	rowCols[j].push_back(i);
+	k=closeArcs[j];
+	rowVals[j].push_back(arcResidual(plusapx,points[j],k));
+	k=closeArcs[j];
+	rowVals[j].back()-=arcResidual(minusapx,points[j],k);
+      }
   }
-  resid=curvefitResiduals(arcFitApprox(startLine,fr,endLine),points);
-  adjustment=linearLeastSquares(sidedefl,resid);
+  for (j=0;j<points.size();j++)
+    normal.addRow(rowCols[j],rowVals[j],resid[j]);
+  adjustment=normal.solve();
   // Limit the adjustment to 4096 furmans (22.5°) to keep close to linear.
   for (i=0;i<adjustment.size();i++)
     if (fabs(adjustment[i])>maxadj)
@@ -392,32 +460,43 @@ FitRec adjust1step(vector<xy> points,Circle startLine,FitRec fr,Circle endLine,b
 
 FitRec adjustArcs(vector<xy> points,Circle startLine,FitRec fr,Circle endLine)
 /* Adjusts the polyarc defined by startLine, fr, and endLine until the maximum
- * error stops getting better.
+ * error stops getting better. The arc each point is closest to is kept from
+ * one step to the next, since the arcs move only a little.
  */
 {
   double lastError=INFINITY,thisError=1e100;
   FitRec lastfr;
   polyarc apx;
-  int i=0,j=0;
+  vector<int> closeArcs,lastCloseArcs;
+  vector<double> resid;
+  int i=0,j=0,k;
   while (j<3 || i<5)
   {
     lastfr=fr;
+    lastCloseArcs=closeArcs;
     /* When i=0, there is often a just-split arc, where moving the new
      * endpoint along the arc produces no effect, so the matrix is singular,
      * so do a one-dimensional adjustment first.
      */
-    fr=adjust1step(points,startLine,fr,endLine,(i&255)>0);
+    fr=adjust1step(points,startLine,fr,endLine,(i&255)>0,closeArcs);
     if (fr.isnan()) // singular matrix
-      fr=adjust1step(points,startLine,lastfr,endLine,false);
+    {
+      closeArcs=lastCloseArcs;
+      fr=adjust1step(points,startLine,lastfr,endLine,false,closeArcs);
+    }
     if (fr.isnan()) // something went wrong
     {
       cerr<<"Adjustment is NaN\n";
       fr=lastfr;
+      closeArcs.clear();
     }
     stepDir();
     apx=arcFitApprox(startLine,fr,endLine);
     lastError=thisError;
-    thisError=curvefitMaxError(apx,points);
+    resid=curvefitResiduals(apx,points,closeArcs);
+    for (thisError=k=0;k<resid.size();k++)
+      if (fabs(resid[k])>thisError)
+	thisError=fabs(resid[k]);
     if (thisError>=lastError)
       j++;
     i++;
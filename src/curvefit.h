@@ -58,7 +58,10 @@ double curvefitSquareError(polyarc q,std::vector<xy> points);
 double curvefitMaxError(polyarc q,std::vector<xy> points);
 std::set<int> breakWhich(polyarc q,std::vector<xy> points);
 polyarc arcFitApprox(Circle startLine,FitRec fr,Circle endLine);
+double arcResidual(polyarc &q,xy point,int &whichArc);
+std::vector<double> curvefitResiduals(polyarc q,const std::vector<xy> &points,std::vector<int> &closeArcs);
 FitRec adjust1step(std::vector<xy> points,Circle startLine,FitRec fr,Circle endLine,bool twoD);
+FitRec adjust1step(const std::vector<xy> &points,Circle startLine,FitRec fr,Circle endLine,bool twoD,std::vector<int> &closeArcs);
 FitRec adjustArcs(std::vector<xy> points,Circle startLine,FitRec fr,Circle endLine);
 
 /* Fits a polyarc to the points. The initial polyarc is formed by fitting
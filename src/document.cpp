@@ -137,7 +137,6 @@ void document::changeOffset (xyz newOffset)
   int i;
   for (i=0;i<pl.size();i++)
     pl[i].roscat(newOffset,0,1,offset); // FIXME: roscat takes xy;
-  for (i=0;i<modelSpace.size();i++)
-    modelSpace[i].obj->roscat(newOffset,0,1,offset); // the z has to be adjusted elsewise.
+  modelSpace.roscat(newOffset,0,1,offset); // the z has to be adjusted elsewise.
   offset=newOffset;
 }
@@ -23,12 +23,20 @@
  */
 
 #include <cstring>
+#include <cstdlib>
+#include <thread>
+#include <future>
 #include "dxf.h"
 #include "binio.h"
 #include "textfile.h"
 #include "ldecimal.h"
 using namespace std;
 
+// Size of the buffer of a DxfStream before it is written to the file
+#define DXF_BUFFER 1048576
+// Number of entities encoded at once by insertInParallel
+#define DXF_BATCH 65536
+
 TagRange tagTable[]=
 {
   {0,128}, // string
@@ -334,7 +342,7 @@ GroupCode readDxfBinary(istream &file)
   return ret;
 }
 
-void writeDxfText(std::ostream &file,GroupCode code)
+void writeDxfText(std::ostream &file,const GroupCode &code)
 {
   string tagstr,datastr;
   tagstr=to_string(code.tag);
@@ -364,7 +372,7 @@ void writeDxfText(std::ostream &file,GroupCode code)
   file<<tagstr<<'\n'<<datastr<<'\n';
 }
 
-void writeDxfBinary(std::ostream &file,GroupCode code)
+void writeDxfBinary(std::ostream &file,const GroupCode &code)
 {
   writeleshort(file,code.tag);
   switch(tagFormat(code.tag))
@@ -460,6 +468,64 @@ void writeDxfGroups(ostream &file,vector<GroupCode> &codes,bool mode)
       writeDxfBinary(file,codes[i]);
 }
 
+DxfStream::DxfStream(ostream &f,bool m)
+{
+  file=&f;
+  mode=m;
+  if (!mode)
+    writeDxfMagic(buf);
+}
+
+DxfStream::DxfStream(bool m)
+{
+  file=nullptr;
+  mode=m;
+}
+
+DxfStream::~DxfStream()
+{
+  flush();
+}
+
+void DxfStream::push_back(const GroupCode &code)
+{
+  if (mode)
+    writeDxfText(buf,code);
+  else
+    writeDxfBinary(buf,code);
+  if (file && buf.tellp()>=DXF_BUFFER)
+    flush();
+}
+
+void DxfStream::append(const string &encoded)
+{
+  if (file && buf.tellp()==0)
+    file->write(encoded.data(),encoded.size());
+  else
+  {
+    buf.write(encoded.data(),encoded.size());
+    if (file && buf.tellp()>=DXF_BUFFER)
+      flush();
+  }
+}
+
+string DxfStream::take()
+{
+  string ret=buf.str();
+  buf.str("");
+  return ret;
+}
+
+void DxfStream::flush()
+{
+  string encoded;
+  if (file)
+  {
+    encoded=take();
+    file->write(encoded.data(),encoded.size());
+  }
+}
+
 vector<GroupCode> readDxfGroups(string filename)
 {
   int mode;
@@ -516,7 +582,232 @@ vector<array<xyz,3> > extractTriangles(vector<GroupCode> dxfData)
   return ret;
 }
 
-void insertXy(vector<GroupCode> &dxfData,int xtag,xy pnt)
+class DxfScanner
+/* Reads a DXF file through a large buffer, in one pass. Lines and binary
+ * values are looked at in place in the buffer, without making strings.
+ */
+{
+public:
+  DxfScanner(istream &f);
+  bool binary();
+  bool line(char *&start,size_t &n);
+  bool bytes(char *&start,size_t n);
+  bool cstring(char *&start,size_t &n);
+private:
+  istream &file;
+  vector<char> buf;
+  size_t pos,len;
+  int lineend;
+  bool fill();
+};
+
+DxfScanner::DxfScanner(istream &f):file(f)
+{
+  buf.resize(DXF_BUFFER);
+  pos=len=0;
+  lineend=-2;
+}
+
+bool DxfScanner::fill()
+// Moves what's left to the front of the buffer and reads more. Returns false at end of file.
+{
+  size_t got;
+  if (pos==0 && len==buf.size())
+    buf.resize(buf.size()*2);
+  memmove(buf.data(),buf.data()+pos,len-pos);
+  len-=pos;
+  pos=0;
+  file.read(buf.data()+len,buf.size()-len);
+  got=file.gcount();
+  len+=got;
+  return got>0;
+}
+
+bool DxfScanner::binary()
+/* Looks for DXF^M^J^Z^@ after some printable characters, as readDxfMagic
+ * does. If found, skips the magic and returns true; otherwise leaves the
+ * position at the start of the file.
+ */
+{
+  size_t i;
+  fill();
+  for (i=0;i+7<=len && buf[i]>=' ' && buf[i]<127;i++)
+    if (memcmp(buf.data()+i,"DXF\r\n\032",7)==0)
+    {
+      pos=i+7;
+      return true;
+    }
+  return false;
+}
+
+bool DxfScanner::line(char *&start,size_t &n)
+/* Finds the next line and null-terminates it. The line ends with whichever
+ * of CR and LF is seen first in the file; the other is dropped.
+ */
+{
+  char *end;
+  while (true)
+  {
+    if (lineend<0)
+      for (end=buf.data()+pos;end<buf.data()+len;end++)
+	if (*end=='\r' || *end=='\n')
+	{
+	  lineend=*end;
+	  break;
+	}
+    if (lineend>=0 && (end=(char *)memchr(buf.data()+pos,lineend,len-pos)))
+      break;
+    if (!fill())
+      return false;
+  }
+  start=buf.data()+pos;
+  n=end-start;
+  pos+=n+1;
+  if (n && (*start=='\r' || *start=='\n'))
+  {
+    start++;
+    n--;
+  }
+  if (n && (start[n-1]=='\r' || start[n-1]=='\n'))
+    n--;
+  start[n]=0;
+  return true;
+}
+
+bool DxfScanner::bytes(char *&start,size_t n)
+{
+  while (len-pos<n)
+    if (!fill())
+      return false;
+  start=buf.data()+pos;
+  pos+=n;
+  return true;
+}
+
+bool DxfScanner::cstring(char *&start,size_t &n)
+// Finds a null-terminated string.
+{
+  char *end;
+  while (!(end=(char *)memchr(buf.data()+pos,0,len-pos)))
+    if (!fill())
+      return false;
+  start=buf.data()+pos;
+  n=end-start;
+  pos+=n+1;
+  return true;
+}
+
+bool parseDxfTag(char *str,int &tag)
+// Tags in text files may have leading spaces.
+{
+  char *end;
+  long n=strtol(str,&end,10);
+  while (*end==' ')
+    end++;
+  tag=n;
+  return end>str && *end==0;
+}
+
+void addFaceCoord(array<xyz,3> &face,int &ncoords,int tag,double val,vector<array<xyz,3> > &ret)
+// Same as the middle of extractTriangles.
+{
+  int coord,ncorner;
+  if (ncoords<12 && tag>=10 && tag<40)
+  {
+    coord=tag/10;
+    ncorner=tag%10;
+    if (ncorner<3)
+      switch (coord)
+      {
+	case 1:
+	  face[ncorner]=xyz(val,face[ncorner].gety(),face[ncorner].getz());
+	  break;
+	case 2:
+	  face[ncorner]=xyz(face[ncorner].getx(),val,face[ncorner].getz());
+	  break;
+	case 3:
+	  face[ncorner]=xyz(face[ncorner].getx(),face[ncorner].gety(),val);
+	  break;
+      }
+    if (12==++ncoords)
+      ret.push_back(face);
+  }
+}
+
+vector<array<xyz,3> > readDxfTriangles(istream &file)
+/* Does the same as extractTriangles(readDxfGroups(file)), but in one pass
+ * without storing the groups. Detects whether the file is binary or text
+ * from the magic. If an invalid group is found, returns nothing; if the
+ * file ends in the middle of a group, returns what was read before.
+ */
+{
+  DxfScanner scan(file);
+  vector<array<xyz,3> > ret;
+  array<xyz,3> face;
+  int tag,fmt,ncoords=16;
+  char *str,*end;
+  size_t n;
+  double val;
+  bool valid=true,more=true;
+  if (scan.binary())
+    while (valid && more && scan.bytes(str,2))
+    {
+      tag=(short)((unsigned char)str[0]+((unsigned char)str[1]<<8));
+      fmt=tagFormat(tag);
+      switch (fmt)
+      {
+	case 1:
+	case 2:
+	case 4:
+	case 8:
+	  more=scan.bytes(str,fmt);
+	  break;
+	case 72:
+	  more=scan.bytes(str,8);
+	  if (more)
+	  {
+	    val=readledouble(str); // DXF is little-endian.
+	    addFaceCoord(face,ncoords,tag,val,ret);
+	  }
+	  break;
+	case 128:
+	case 129:
+	case 132:
+	  more=scan.cstring(str,n);
+	  if (more && tag==0 && n==6 && memcmp(str,"3DFACE",6)==0)
+	    ncoords=0;
+	  break;
+	default:
+	  valid=false;
+      }
+    }
+  else
+    while (valid && scan.line(str,n) && n)
+    {
+      valid=parseDxfTag(str,tag) && tagFormat(tag);
+      if (!valid || !scan.line(str,n))
+	break;
+      if (tag==0 && n==6 && memcmp(str,"3DFACE",6)==0)
+	ncoords=0;
+      if (ncoords<12 && tag>=10 && tag<40)
+      {
+	val=strtod(str,&end);
+	valid=end>str;
+	addFaceCoord(face,ncoords,tag,val,ret);
+      }
+    }
+  if (!valid)
+    ret.clear();
+  return ret;
+}
+
+vector<array<xyz,3> > readDxfTriangles(string filename)
+{
+  ifstream file(filename,ios::binary);
+  return readDxfTriangles(file);
+}
+
+void insertXy(DxfStream &dxfData,int xtag,xy pnt)
 // xtag is the tag of the x-coordinate
 {
   GroupCode xCode(xtag),yCode(xtag+10);
@@ -528,7 +819,7 @@ void insertXy(vector<GroupCode> &dxfData,int xtag,xy pnt)
   dxfData.push_back(yCode);
 }
 
-void insertBulge(vector<GroupCode> &dxfData,int delta)
+void insertBulge(DxfStream &dxfData,int delta)
 /* Bulge is the displacement of the midpoint of the arc from the chord,
  * divided by half the chord length.
  */
@@ -538,7 +829,7 @@ void insertBulge(vector<GroupCode> &dxfData,int delta)
   dxfData.push_back(bulgeCode);
 }
 
-void insertXyz(vector<GroupCode> &dxfData,int xtag,xyz pnt)
+void insertXyz(DxfStream &dxfData,int xtag,xyz pnt)
 // xtag is the tag of the x-coordinate
 {
   GroupCode xCode(xtag),yCode(xtag+10),zCode(xtag+20);
@@ -550,7 +841,7 @@ void insertXyz(vector<GroupCode> &dxfData,int xtag,xyz pnt)
   dxfData.push_back(zCode);
 }
 
-void dxfHeader(vector<GroupCode> &dxfData,BoundRect br)
+void dxfHeader(DxfStream &dxfData,BoundRect br)
 {
   GroupCode sectag(0),secname(2),paramtag(9),stringval(1);
   sectag.str="SECTION";
@@ -574,7 +865,7 @@ void dxfHeader(vector<GroupCode> &dxfData,BoundRect br)
   dxfData.push_back(sectag);
 }
 
-void insertLinetype(vector<GroupCode> &dxfData,string name,int n1,string desc,int n2,int n3,double penWidth)
+void insertLinetype(DxfStream &dxfData,string name,int n1,string desc,int n2,int n3,double penWidth)
 // I have no idea what n1, n2, and n3 mean. I'm just copying code from http://paulbourke.net/dataformats/dxf/min3d.html .
 {
   GroupCode ltypetag(0),ltypename(2),n1code(70),desccode(3);
@@ -595,7 +886,7 @@ void insertLinetype(vector<GroupCode> &dxfData,string name,int n1,string desc,in
   dxfData.push_back(pencode);
 }
 
-void linetypeTable(vector<GroupCode> &dxfData)
+void linetypeTable(DxfStream &dxfData)
 {
   GroupCode tabletag(0),tablename(2),nLinetypes(70);
   tabletag.str="TABLE";
@@ -609,7 +900,7 @@ void linetypeTable(vector<GroupCode> &dxfData)
   dxfData.push_back(tabletag);
 }
 
-void insertLayer(vector<GroupCode> &dxfData,string name,int n1,int color)
+void insertLayer(DxfStream &dxfData,string name,int n1,int color)
 {
   GroupCode layertag(0),layername(2),n1code(70),colorcode(62);
   GroupCode ltypecode(6),n3code(73),pencode(40);
@@ -625,7 +916,7 @@ void insertLayer(vector<GroupCode> &dxfData,string name,int n1,int color)
   dxfData.push_back(ltypecode);
 }
 
-void layerTable(vector<GroupCode> &dxfData,vector<DxfLayer> &layers)
+void layerTable(DxfStream &dxfData,vector<DxfLayer> &layers)
 {
   int i;
   GroupCode tabletag(0),tablename(2),nLayers(70);
@@ -641,7 +932,7 @@ void layerTable(vector<GroupCode> &dxfData,vector<DxfLayer> &layers)
   dxfData.push_back(tabletag);
 }
 
-void tableSection(vector<GroupCode> &dxfData,vector<DxfLayer> &layers)
+void tableSection(DxfStream &dxfData,vector<DxfLayer> &layers)
 {
   GroupCode sectag(0),secname(2);
   sectag.str="SECTION";
@@ -654,7 +945,7 @@ void tableSection(vector<GroupCode> &dxfData,vector<DxfLayer> &layers)
   dxfData.push_back(sectag);
 }
 
-void openEntitySection(vector<GroupCode> &dxfData)
+void openEntitySection(DxfStream &dxfData)
 {
   GroupCode sectag(0),secname(2);
   sectag.str="SECTION";
@@ -663,21 +954,21 @@ void openEntitySection(vector<GroupCode> &dxfData)
   dxfData.push_back(secname);
 }
 
-void closeEntitySection(vector<GroupCode> &dxfData)
+void closeEntitySection(DxfStream &dxfData)
 {
   GroupCode sectag(0);
   sectag.str="ENDSEC";
   dxfData.push_back(sectag);
 }
 
-void dxfEnd(vector<GroupCode> &dxfData)
+void dxfEnd(DxfStream &dxfData)
 {
   GroupCode sectag(0);
   sectag.str="EOF";
   dxfData.push_back(sectag);
 }
 
-void insertTriangle(vector<GroupCode> &dxfData,triangle &tri,double outUnit)
+void insertTriangle(DxfStream &dxfData,triangle &tri,double outUnit)
 {
   GroupCode entityType(0),layerName(8),colorNumber(62);
   entityType.str="3DFACE";
@@ -691,7 +982,7 @@ void insertTriangle(vector<GroupCode> &dxfData,triangle &tri,double outUnit)
   insertXyz(dxfData,13,*tri.c/outUnit); // triangle is indicated by repeating a corner.
 }
 
-void insertPolyline(vector<GroupCode> &dxfData,polyspiral &poly,DxfLayer &lay,double outUnit)
+void insertPolyline(DxfStream &dxfData,polyspiral &poly,DxfLayer &lay,double outUnit)
 /* A closed polyarc with the last segment having nonzero curvature looks
  * like this:
  * 70	//closedFlag
@@ -745,3 +1036,52 @@ void insertPolyline(vector<GroupCode> &dxfData,polyspiral &poly,DxfLayer &lay,do
     }
   }
 }
+
+void insertInParallel(DxfStream &dxfData,size_t n,function<void(DxfStream &,size_t)> insert,int nthreads)
+/* Calls insert for entities 0 through n-1. They are done in batches; each
+ * batch is split among threads, each encoding into its own buffer, and the
+ * buffers are appended in order, so the output is the same as inserting
+ * the entities one by one, and memory does not grow with n. If nthreads
+ * is 0, there are as many threads as cores.
+ *
+ * This is the only level of parallelism in writing a DXF file. insert must
+ * be safe to call from several threads at once on different entities.
+ * insertTriangle and insertPolyline are: they read the triangle or contour
+ * and write only to the DxfStream they are given. insertPolyline converts
+ * the contour with polyarc's constructor, which calls manyArc for two arcs
+ * per spiral in the calling thread; manyArc itself starts no threads. It
+ * jiggles its steps with a generator made afresh, with the same seed, on
+ * each call, so the arcs do not depend on the thread. The only global it
+ * touches is the cornu statistics histogram, whose counters are atomic and
+ * incremented with relaxed ordering.
+ */
+{
+  static int cores=thread::hardware_concurrency();
+  int i;
+  if (nthreads<1)
+    nthreads=(cores>1)?cores:1;
+  bool mode=dxfData.getMode();
+  size_t start,end;
+  vector<future<string> > parts;
+  for (start=0;start<n;start=end)
+  {
+    end=min(n,start+DXF_BATCH);
+    if (nthreads==1)
+      for (;start<end;start++)
+	insert(dxfData,start);
+    else
+    {
+      parts.clear();
+      for (i=0;i<nthreads;i++)
+	parts.push_back(async(launch::async,[&insert,mode](size_t lo,size_t hi)
+	  {
+	    DxfStream part(mode);
+	    for (;lo<hi;lo++)
+	      insert(part,lo);
+	    return part.take();
+	  },start+(end-start)*i/nthreads,start+(end-start)*(i+1)/nthreads));
+      for (i=0;i<nthreads;i++)
+	dxfData.append(parts[i].get());
+    }
+  }
+}
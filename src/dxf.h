@@ -23,8 +23,10 @@
  */
 #include <string>
 #include <fstream>
+#include <sstream>
 #include <vector>
 #include <array>
+#include <functional>
 #include "boundrect.h"
 #include "xyz.h"
 #include "bezier.h"
@@ -76,18 +78,46 @@ struct DxfLayer
   int color;
 };
 
+class DxfStream
+/* Writes group codes as they are made, in text or binary, instead of
+ * collecting them in a vector. The encoded groups are buffered and written
+ * to the file in large pieces. A DxfStream with no file only buffers;
+ * take() gets the encoded groups, which can then be appended to another.
+ */
+{
+public:
+  DxfStream(std::ostream &f,bool m);
+  explicit DxfStream(bool m);
+  ~DxfStream();
+  bool getMode()
+  {
+    return mode;
+  }
+  void push_back(const GroupCode &code);
+  void append(const std::string &encoded);
+  std::string take();
+  void flush();
+private:
+  std::ostream *file;
+  bool mode; // true for text
+  std::ostringstream buf;
+};
+
 std::string hexEncodeInt(long long num);
 GroupCode readDxfText(std::istream &file);
 GroupCode readDxfBinary(std::istream &file);
-void writeDxfText(std::ostream &file,GroupCode code);
-void writeDxfBinary(std::ostream &file,GroupCode code);
+void writeDxfText(std::ostream &file,const GroupCode &code);
+void writeDxfBinary(std::ostream &file,const GroupCode &code);
 void writeDxfGroups(std::ostream &file,std::vector<GroupCode> &codes,bool mode);
 std::vector<GroupCode> readDxfGroups(std::istream &file,bool mode);
 std::vector<GroupCode> readDxfGroups(std::string filename);
 std::vector<std::array<xyz,3> > extractTriangles(std::vector<GroupCode> dxfData);
-void tableSection(std::vector<GroupCode> &dxfData,std::vector<DxfLayer> &layers);
-void openEntitySection(std::vector<GroupCode> &dxfData);
-void closeEntitySection(std::vector<GroupCode> &dxfData);
-void dxfEnd(std::vector<GroupCode> &dxfData);
-void insertTriangle(std::vector<GroupCode> &dxfData,triangle &tri,double outUnit);
-void insertPolyline(std::vector<GroupCode> &dxfData,polyspiral &poly,DxfLayer &lay,double outUnit);
+std::vector<std::array<xyz,3> > readDxfTriangles(std::istream &file);
+std::vector<std::array<xyz,3> > readDxfTriangles(std::string filename);
+void tableSection(DxfStream &dxfData,std::vector<DxfLayer> &layers);
+void openEntitySection(DxfStream &dxfData);
+void closeEntitySection(DxfStream &dxfData);
+void dxfEnd(DxfStream &dxfData);
+void insertTriangle(DxfStream &dxfData,triangle &tri,double outUnit);
+void insertPolyline(DxfStream &dxfData,polyspiral &poly,DxfLayer &lay,double outUnit);
+void insertInParallel(DxfStream &dxfData,size_t n,std::function<void(DxfStream &,size_t)> insert,int nthreads=0);
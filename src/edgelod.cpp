@@ -0,0 +1,214 @@
+/******************************************************/
+/*                                                    */
+/* edgelod.cpp - levels of detail for drawing edges   */
+/*                                                    */
+/******************************************************/
+/* Copyright 2026 Pierre Abbat.
+ * This file is part of Bezitopo.
+ *
+ * Bezitopo is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * Bezitopo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License and Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * and Lesser General Public License along with Bezitopo. If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include <cmath>
+#include <algorithm>
+#include "edgelod.h"
+#include "pointlist.h"
+
+using namespace std;
+
+// The finest level has 2**LOD_MAX_LEVEL cells on a side.
+#define LOD_MAX_LEVEL 24
+
+struct LodEntry
+{
+  uint64_t key;
+  bool broken;
+  double length;
+  edge *e;
+};
+
+bool operator<(const LodEntry &a,const LodEntry &b)
+// Sorts by cell, then breaklines first, then longest first.
+{
+  if (a.key!=b.key)
+    return a.key<b.key;
+  if (a.broken!=b.broken)
+    return a.broken;
+  return a.length>b.length;
+}
+
+uint64_t parentKey(uint64_t key)
+{
+  return ((key>>33)<<32)|((key&0xffffffff)>>1);
+}
+
+size_t LodLevel::findCell(uint64_t k)
+{
+  return lower_bound(key.begin(),key.end(),k)-key.begin();
+}
+
+EdgeLod::EdgeLod()
+{
+  side=0;
+}
+
+void EdgeLod::clear()
+{
+  levels.clear();
+  side=0;
+}
+
+bool EdgeLod::empty()
+{
+  return levels.size()==0;
+}
+
+size_t EdgeLod::size()
+{
+  size_t ret=0;
+  int i;
+  for (i=0;i<levels.size();i++)
+    ret+=levels[i].own.size();
+  return ret;
+}
+
+void EdgeLod::build(pointlist &pl)
+{
+  map<int,edge>::iterator i;
+  int j,k,nlevels;
+  size_t m,n,c;
+  double minx=INFINITY,miny=INFINITY,maxx=-INFINITY,maxy=-INFINITY;
+  double minlen=INFINITY,len,cellSide;
+  unsigned ncells;
+  xy mid;
+  LodEntry ent;
+  vector<vector<LodEntry> > own;
+  vector<LodEntry> cand,carried;
+  clear();
+  for (i=pl.edges.begin();i!=pl.edges.end();++i)
+  {
+    minx=min(minx,min(i->second.a->east(),i->second.b->east()));
+    miny=min(miny,min(i->second.a->north(),i->second.b->north()));
+    maxx=max(maxx,max(i->second.a->east(),i->second.b->east()));
+    maxy=max(maxy,max(i->second.a->north(),i->second.b->north()));
+    len=i->second.length();
+    if (len>0 && len<minlen)
+      minlen=len;
+  }
+  if (pl.edges.size()==0)
+    return;
+  origin=xy(minx,miny);
+  side=max(maxx-minx,maxy-miny);
+  if (!(side>0))
+    side=1;
+  for (nlevels=1;nlevels<=LOD_MAX_LEVEL && ldexp(side,-nlevels)>=minlen;nlevels++);
+  own.resize(nlevels);
+  levels.resize(nlevels);
+  for (i=pl.edges.begin();i!=pl.edges.end();++i)
+  {
+    len=i->second.length();
+    if (len>0)
+      k=floor(log2(side/len));
+    else
+      k=nlevels-1;
+    if (k<0)
+      k=0;
+    if (k>=nlevels)
+      k=nlevels-1;
+    cellSide=ldexp(side,-k);
+    ncells=1<<k;
+    mid=i->second.midpoint()-origin;
+    ent.key=((uint64_t)min(ncells-1,(unsigned)max(0.,floor(mid.north()/cellSide)))<<32)+
+	    min(ncells-1,(unsigned)max(0.,floor(mid.east()/cellSide)));
+    ent.broken=i->second.broken&1;
+    ent.length=len;
+    ent.e=&i->second;
+    own[k].push_back(ent);
+  }
+  for (k=nlevels-1;k>=0;k--)
+  {
+    sort(own[k].begin(),own[k].end());
+    cand=own[k];
+    cand.insert(cand.end(),carried.begin(),carried.end());
+    sort(cand.begin(),cand.end());
+    carried.clear();
+    for (m=n=0;m<cand.size();m=c)
+    {
+      levels[k].key.push_back(cand[m].key);
+      levels[k].ownStart.push_back(n);
+      for (;n<own[k].size() && own[k][n].key==cand[m].key;n++)
+	levels[k].own.push_back(own[k][n].e);
+      for (c=m;c<cand.size() && cand[c].key==cand[m].key;c++)
+	if (c-m<LOD_REPS)
+	{
+	  levels[k].reps.push_back(cand[c].e);
+	  ent=cand[c];
+	  ent.key=parentKey(ent.key);
+	  carried.push_back(ent);
+	}
+      for (j=c-m;j<LOD_REPS;j++)
+	levels[k].reps.push_back(nullptr);
+    }
+    levels[k].ownStart.push_back(n);
+    own[k].clear();
+    own[k].shrink_to_fit();
+  }
+}
+
+void EdgeLod::addCells(vector<edge *> &ret,int level,xy center,double radius,bool repsOnly)
+/* Adds the edges in the cells within radius of center, with a margin of
+ * one cell for the edges that stick out of their cells.
+ */
+{
+  LodLevel &lev=levels[level];
+  double cellSide=ldexp(side,-level);
+  double ncells=1<<level;
+  uint64_t row,lorow,hirow,locol,hicol;
+  size_t c,j;
+  lorow=max(0.,min(ncells-1,floor((center.north()-radius-origin.north())/cellSide-1)));
+  hirow=max(0.,min(ncells-1,floor((center.north()+radius-origin.north())/cellSide+1)));
+  locol=max(0.,min(ncells-1,floor((center.east()-radius-origin.east())/cellSide-1)));
+  hicol=max(0.,min(ncells-1,floor((center.east()+radius-origin.east())/cellSide+1)));
+  for (row=lorow;row<=hirow;row++)
+    for (c=lev.findCell((row<<32)+locol);c<lev.key.size() && lev.key[c]<=(row<<32)+hicol;c++)
+      if (repsOnly)
+      {
+	for (j=0;j<LOD_REPS;j++)
+	  if (lev.reps[c*LOD_REPS+j])
+	    ret.push_back(lev.reps[c*LOD_REPS+j]);
+      }
+      else
+	for (j=lev.ownStart[c];j<lev.ownStart[c+1];j++)
+	  ret.push_back(lev.own[j]);
+}
+
+vector<edge *> EdgeLod::visibleEdges(xy center,double radius,double pixel,double spacing)
+/* Returns the edges to draw in a view of the given radius, in which a pixel
+ * is "pixel" long. Some edges may be outside the view.
+ */
+{
+  vector<edge *> ret;
+  int k;
+  for (k=0;k<levels.size();k++)
+    if (ldexp(side,-k)>=spacing*pixel)
+      addCells(ret,k,center,radius,false);
+    else
+    {
+      addCells(ret,k,center,radius,true);
+      break;
+    }
+  return ret;
+}
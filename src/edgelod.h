@@ -0,0 +1,75 @@
+/******************************************************/
+/*                                                    */
+/* edgelod.h - levels of detail for drawing edges     */
+/*                                                    */
+/******************************************************/
+/* Copyright 2026 Pierre Abbat.
+ * This file is part of Bezitopo.
+ *
+ * Bezitopo is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * Bezitopo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License and Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * and Lesser General Public License along with Bezitopo. If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef EDGELOD_H
+#define EDGELOD_H
+#include <vector>
+#include <cstdint>
+#include "tin.h"
+
+class pointlist;
+
+// Number of edges that stand in for all the edges in a cell and its subcells
+#define LOD_REPS 2
+
+struct LodLevel
+/* The cells of one level which have edges in them or in their subcells,
+ * sorted by row, then column. The edges whose midpoints are in cell i
+ * are own[ownStart[i]] through own[ownStart[i+1]-1].
+ */
+{
+  std::vector<uint64_t> key; // row in the high 32 bits, column in the low 32
+  std::vector<unsigned> ownStart;
+  std::vector<edge *> own;
+  std::vector<edge *> reps; // LOD_REPS per cell, padded with nullptr
+  size_t findCell(uint64_t k);
+};
+
+class EdgeLod
+/* A loose quadtree of the edges of a TIN. Each edge goes in the smallest
+ * level whose cells are at least as big as the edge, in the cell containing
+ * its midpoint, so it lies within half a cell of its cell. Each cell also
+ * has a few representative edges, preferring breaklines and then long
+ * edges, chosen from its own edges and those of its subcells.
+ *
+ * To draw a view, all edges are drawn in the levels whose cells are at
+ * least "spacing" pixels wide. In the first level finer than that, only the
+ * representatives of each cell are drawn, so the number of lines drawn
+ * depends on the size of the window, not the size of the TIN.
+ */
+{
+public:
+  EdgeLod();
+  void clear();
+  bool empty();
+  void build(pointlist &pl);
+  std::vector<edge *> visibleEdges(xy center,double radius,double pixel,double spacing);
+  size_t size();
+private:
+  xy origin;
+  double side;
+  std::vector<LodLevel> levels;
+  void addCells(std::vector<edge *> &ret,int level,xy center,double radius,bool repsOnly);
+};
+#endif
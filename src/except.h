@@ -59,7 +59,9 @@
 // along is out of range in a station function
 #define badabsorient 17
 // insufficient points to compute absolute orientation
-#define N_EXCEPTIONS 18
+#define nopoint 18
+// a point number is not the number of any point in the pointlist
+#define N_EXCEPTIONS 19
 
 class BeziExcept: public QException
 {
@@ -95,4 +97,4 @@ extern BeziExcept singularMatrix,unsetGeoid;
 extern BeziExcept unsetSource,badUnits,badNumber;
 extern BeziExcept badBreaklineEnd,breaklinesCross;
 extern BeziExcept badBreaklineFormat,fileError;
-extern BeziExcept stationOutOfRange,badAbsOrient;
+extern BeziExcept stationOutOfRange,badAbsOrient,noPoint;
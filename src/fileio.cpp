@@ -115,16 +115,18 @@ void writeDxf(string outputFile,pointlist &pl,bool asc,double outUnit,int flags)
  * bit 2=don't write any triangles if there are contours.
  */
 {
-  vector<GroupCode> dxfCodes;
   vector<DxfLayer> dxfLayers;
+  vector<int> contourLayerNums;
   map<ContourLayer,int> contourLayers;
-  int i,n;
+  vector<triangle *> tris;
+  int i;
   map<ContourLayer,int>::iterator j;
   map<ContourInterval,vector<polyspiral> >::iterator k;
   DxfLayer layer;
   ContourLayer cl;
   BoundRect br;
   ofstream dxfFile(outputFile,ofstream::binary|ofstream::trunc);
+  DxfStream dxfCodes(dxfFile,asc);
   br.include(&pl);
   contourLayers=pl.contourLayers();
   layer.name="TIN";
@@ -149,21 +151,26 @@ void writeDxf(string outputFile,pointlist &pl,bool asc,double outUnit,int flags)
   for (i=0;i<pl.triangles.size();i++)
     if (pl.triangles[i].ptValid())
       if (pl.shouldWrite(i,flags,contourLayers.size()))
-	insertTriangle(dxfCodes,pl.triangles[i],outUnit);
+	tris.push_back(&pl.triangles[i]);
       else;
     else
       cerr<<"Invalid triangle "<<i<<endl;
+  insertInParallel(dxfCodes,tris.size(),[&tris,outUnit](DxfStream &part,size_t n)
+		   {
+		     insertTriangle(part,*tris[n],outUnit);
+		   });
   cl.ci=pl.contourInterval;
   for (i=0;i<pl.contours.size();i++)
   {
     cl.tp=cl.ci.contourType(pl.contours[i].getElevation());
-    n=contourLayers[cl]-1;
-    layer=dxfLayers[n];
-    insertPolyline(dxfCodes,pl.contours[i],layer,outUnit);
+    contourLayerNums.push_back(contourLayers[cl]-1);
   }
+  insertInParallel(dxfCodes,pl.contours.size(),[&pl,&dxfLayers,&contourLayerNums,outUnit](DxfStream &part,size_t n)
+		   {
+		     insertPolyline(part,pl.contours[n],dxfLayers[contourLayerNums[n]],outUnit);
+		   });
   closeEntitySection(dxfCodes);
   dxfEnd(dxfCodes);
-  writeDxfGroups(dxfFile,dxfCodes,asc);
 }
 
 void writeStl(string outputFile,pointlist &pl,bool asc,double outUnit,int flags)
@@ -175,12 +182,8 @@ void writeStl(string outputFile,pointlist &pl,bool asc,double outUnit,int flags)
  */
 {
   ofstream stlFile(outputFile,asc?ios::trunc:(ios::binary|ios::trunc));
-  double bear;
-  vector<StlTriangle> stltri;
-  //bear=turnFitInPrinter(pl,printer3d);
-  //stltri=stlMesh(printer3d,false,false);
-  /*if (asc)
-    writeStlText(stlFile,stltri);
-  else
-    writeStlBinary(stlFile,stltri);*/
+  Printer3dSize printer=printer3d;
+  printer.scaleNum=1;
+  printer.scaleDenom=stlScale(pl,printer,outUnit,flags&1);
+  writeStlMesh(stlFile,pl,printer,asc);
 }
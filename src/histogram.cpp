@@ -21,7 +21,9 @@
  * and Lesser General Public License along with Bezitopo. If not, see
  * <http://www.gnu.org/licenses/>.
  */
-#include <cstring>
+#include <cmath>
+#include <algorithm>
+#include <iterator>
 #include <iostream>
 #include <iomanip>
 #include <set>
@@ -78,7 +80,7 @@ histogram::histogram()
   bin.push_back(1);
   count.push_back(0);
   discrete=0;
-  total=0;
+  total=maxbins=0;
 }
 
 histogram::histogram(double least,double most)
@@ -87,7 +89,7 @@ histogram::histogram(double least,double most)
   bin.push_back(most);
   count.push_back(0);
   discrete=0;
-  total=0;
+  total=maxbins=0;
 }
 
 void histogram::clear()
@@ -95,13 +97,7 @@ void histogram::clear()
   double least,most;
   least=bin[0];
   most=bin[count.size()];
-  bin.clear();
-  count.clear();
-  intervals.clear();
-  bin.push_back(least);
-  bin.push_back(most);
-  count.push_back(0);
-  total=0;
+  clear(least,most);
 }
 
 void histogram::setdiscrete(double d)
@@ -109,11 +105,25 @@ void histogram::setdiscrete(double d)
   discrete=d;
 }
 
+void histogram::setmaxbins(unsigned n)
+/* Fewer than four bins can't be compacted by merging pairs, so the least
+ * limit is four.
+ */
+{
+  if (n && n<4)
+    n=4;
+  maxbins=n;
+  if (maxbins && count.size()>maxbins)
+    compact(maxbins-maxbins/4);
+}
+
 void histogram::clear(double least,double most)
 {
   bin.clear();
   count.clear();
   intervals.clear();
+  pieceEnd.clear();
+  pieceCount.clear();
   bin.push_back(least);
   bin.push_back(most);
   count.push_back(0);
@@ -125,29 +135,112 @@ void histogram::clearcount()
   int i;
   for (i=0;i<count.size();i++)
     count[i]=0;
+  for (i=0;i<pieceCount.size();i++)
+    pieceCount[i]=0;
   for (i=0;i<intervals.size();i++)
     intervals[i].count=0;
   total=0;
 }
 
+void histogram::addPieceEnd(double x)
+/* A new end splits a piece. Its count stays with the lower part, which is
+ * all right, because all intervals that contain part of the old piece
+ * contain all of it.
+ */
+{
+  int i=upper_bound(pieceEnd.begin(),pieceEnd.end(),x)-pieceEnd.begin();
+  if (i==0 || pieceEnd[i-1]<x)
+  {
+    pieceEnd.insert(pieceEnd.begin()+i,x);
+    pieceCount.insert(pieceCount.begin()+i,0);
+  }
+}
+
+unsigned histogram::countPieces(double start,double end)
+{
+  int i,last;
+  unsigned ret=0;
+  i=lower_bound(pieceEnd.begin(),pieceEnd.end(),start)-pieceEnd.begin();
+  last=lower_bound(pieceEnd.begin(),pieceEnd.end(),nextafter(end,INFINITY))-pieceEnd.begin();
+  for (;i<last;i++)
+    ret+=pieceCount[i];
+  return ret;
+}
+
 void histogram::addinterval(double start,double end)
+/* The count of an interval includes both ends. Values added before the
+ * interval are not counted in it.
+ */
 {
   histobar newhb;
+  addPieceEnd(start);
+  addPieceEnd(nextafter(end,INFINITY));
   newhb.start=start;
   newhb.end=end;
-  newhb.count=0;
+  newhb.count=countPieces(start,end);
   intervals.push_back(newhb);
 }
 
-void histogram::split(int n)
+bool histogram::split(int n)
 {
-  bin.push_back(0);
-  count.push_back(0);
-  memmove(&bin[n+1],&bin[n],sizeof(double)*(bin.size()-n-1));
-  memmove(&count[n+1],&count[n],sizeof(unsigned)*(count.size()-n-1));
-  count[n+1]=count[n]/2;
-  count[n]-=count[n+1];
-  bin[n+1]=(bin[n]*count[n+1]+bin[n+2]*count[n])/(count[n]+count[n+1]);
+  unsigned lo,hi;
+  double mid;
+  hi=count[n]/2;
+  lo=count[n]-hi;
+  mid=(bin[n]*hi+bin[n+1]*lo)/(lo+hi);
+  if (mid>bin[n] && mid<bin[n+1])
+  {
+    bin.insert(bin.begin()+n+1,mid);
+    count.insert(count.begin()+n+1,hi);
+    count[n]=lo;
+    return true;
+  }
+  else
+    return false;
+}
+
+void histogram::compact(unsigned target)
+/* Merges disjoint pairs of adjacent bars, least populated first, until
+ * there are at most target bars. This takes O(nbars×log(nbars)) time, but
+ * when called from operator<<, happens only after a quarter of maxbins
+ * splits.
+ */
+{
+  int i,j,nmerge;
+  vector<pair<unsigned,int> > pairs;
+  vector<bool> used,mergeNext;
+  vector<double> newbin;
+  vector<unsigned> newcount;
+  while (count.size()>target)
+  {
+    pairs.clear();
+    for (i=0;i<count.size()-1;i++)
+      pairs.push_back(make_pair(count[i]+count[i+1],i));
+    sort(pairs.begin(),pairs.end());
+    used.assign(count.size(),false);
+    mergeNext.assign(count.size(),false);
+    for (i=nmerge=0;i<pairs.size() && nmerge<count.size()-target;i++)
+    {
+      j=pairs[i].second;
+      if (!used[j] && !used[j+1])
+      {
+	used[j]=used[j+1]=mergeNext[j]=true;
+	nmerge++;
+      }
+    }
+    newbin.clear();
+    newcount.clear();
+    for (i=0;i<count.size();i++)
+    {
+      newbin.push_back(bin[i]);
+      newcount.push_back(count[i]);
+      if (mergeNext[i])
+	newcount.back()+=count[++i];
+    }
+    newbin.push_back(bin.back());
+    bin.swap(newbin);
+    count.swap(newcount);
+  }
 }
 
 int histogram::find(double val)
@@ -168,12 +261,18 @@ int histogram::find(double val)
 }
 
 histogram& histogram::operator<<(double val)
+// Values that aren't finite are ignored.
 {
   int i,theBin;
   double newlimit;
-  for (i=0;i<intervals.size();i++)
-    if (val>=intervals[i].start && val<=intervals[i].end)
-      intervals[i].count++;
+  if (!isfinite(val))
+    return *this;
+  if (pieceEnd.size())
+  {
+    i=upper_bound(pieceEnd.begin(),pieceEnd.end(),val)-pieceEnd.begin();
+    if (i)
+      pieceCount[i-1]++;
+  }
   theBin=find(val);
   if (theBin>=count.size() && theBin>0) // count.size() is unsigned; comparing -1 to it results in error
   {
@@ -184,21 +283,83 @@ histogram& histogram::operator<<(double val)
   if (theBin<0)
   {
     newlimit=val+(bin[0]-bin[1]);
-    bin.push_back(0);
-    count.push_back(0);
-    memmove(&bin[1],&bin[0],sizeof(double)*(bin.size()-1));
-    memmove(&count[1],&count[0],sizeof(unsigned)*(count.size()-1));
-    bin[0]=newlimit;
-    count[0]=0;
+    bin.insert(bin.begin(),newlimit);
+    count.insert(count.begin(),0);
     theBin=0;
   }
   count[theBin]++;
   total++;
-  if (sqr(count[theBin])>total && bin[theBin+1]-bin[theBin]>discrete)
-    split(theBin);
+  if (sqr(count[theBin])>total && bin[theBin+1]-bin[theBin]>discrete &&
+      split(theBin) && maxbins && count.size()>maxbins)
+    compact(maxbins-maxbins/4);
   return *this;
 }
 
+void spreadBars(const vector<double> &ends,vector<unsigned> &counts,
+                const vector<double> &fromEnds,const vector<unsigned> &fromCounts)
+/* ends includes all of fromEnds. Each count in fromCounts is divided among
+ * the bars that make up its bar in proportion to their widths, rounded so
+ * that the shares add up to the count.
+ */
+{
+  int i,j=0;
+  unsigned done,cum;
+  for (i=0;i<fromCounts.size();i++)
+  {
+    while (ends[j]<fromEnds[i])
+      j++;
+    for (done=0;done<fromCounts[i];j++)
+    {
+      if (ends[j+1]>=fromEnds[i+1])
+	cum=fromCounts[i];
+      else
+	cum=rint(fromCounts[i]*(ends[j+1]-fromEnds[i])/(fromEnds[i+1]-fromEnds[i]));
+      counts[j]+=cum-done;
+      done=cum;
+    }
+  }
+}
+
+void histogram::merge(const histogram &other)
+/* Adds other's data to this histogram, so that each thread can fill its
+ * own and they can be merged at the end. The bars are cut at the ends of
+ * both histograms' bars, then the least populated pairs are merged until
+ * there are about twice the square root of the total. Interval counts are
+ * exact if both histograms had the same intervals added before any data.
+ */
+{
+  int i,j;
+  unsigned target;
+  vector<double> ends;
+  vector<unsigned> counts;
+  if (&other==this)
+  {
+    histogram copy(other);
+    merge(copy);
+    return;
+  }
+  for (j=0;j<other.pieceEnd.size();j++)
+  {
+    i=upper_bound(pieceEnd.begin(),pieceEnd.end(),other.pieceEnd[j])-pieceEnd.begin();
+    if (i)
+      pieceCount[i-1]+=other.pieceCount[j];
+  }
+  for (i=0;i<intervals.size() && i<other.intervals.size();i++)
+    intervals[i].count+=other.intervals[i].count;
+  set_union(bin.begin(),bin.end(),other.bin.begin(),other.bin.end(),back_inserter(ends));
+  counts.resize(ends.size()-1,0);
+  spreadBars(ends,counts,bin,count);
+  spreadBars(ends,counts,other.bin,other.count);
+  bin.swap(ends);
+  count.swap(counts);
+  total+=other.total;
+  target=2*ceil(sqrt(total))+1;
+  if (maxbins && target>maxbins-maxbins/4)
+    target=maxbins-maxbins/4;
+  if (count.size()>target)
+    compact(target);
+}
+
 unsigned histogram::nbars()
 {
   return count.size();
@@ -217,7 +378,10 @@ histobar histogram::getinterval(unsigned n)
 {
   histobar ret;
   if (n<intervals.size())
+  {
     ret=intervals[n];
+    ret.count=countPieces(ret.start,ret.end)-intervals[n].count;
+  }
   else
   {
     ret.start=0;
@@ -35,24 +35,39 @@ struct histobar
 };
 
 class histogram
+/* Finding a bar is a binary search. A bar splits when its count exceeds
+ * the square root of the total, so there are about sqrt(total) bars and
+ * a split, which moves the bars after it, happens about once every
+ * sqrt(total) values; inserting takes amortized O(log(nbars)) time. If
+ * maxbins is set, or when merging, the least populated pairs of adjacent
+ * bars are merged to keep the number down. Intervals are counted in the
+ * pieces between their ends, which are found by binary search too.
+ */
 {
 private:
   std::vector<double> bin;
   std::vector<unsigned> count;
   double discrete;
-  unsigned total;
-  std::vector<histobar> intervals;
-  void split(int n);
+  unsigned total,maxbins;
+  std::vector<histobar> intervals; // count is the count when the interval was added
+  std::vector<double> pieceEnd;
+  std::vector<unsigned> pieceCount;
+  bool split(int n);
+  void compact(unsigned target);
+  void addPieceEnd(double x);
+  unsigned countPieces(double start,double end);
 public:
   histogram();
   histogram(double least,double most);
   void setdiscrete(double d);
+  void setmaxbins(unsigned n); // 0 means no limit
   void clear(); // leaves least and most intact, makes a single empty bin
   void clear(double least,double most);
   void clearcount(); // leaves bin widths intact, just clears all their counts
   void addinterval(double start,double end);
   int find(double val);
   histogram& operator<<(double val);
+  void merge(const histogram &other);
   unsigned nbars();
   histobar getbar(unsigned n);
   histobar getinterval(unsigned n);
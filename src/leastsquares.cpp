@@ -70,3 +70,74 @@ vector<double> minimumNorm(matrix m,vector<double> v)
   mtv=mt*vmat;
   return mtv;
 }
+
+vector<double> linearLeastSquares(SparseMatrix m,vector<double> v)
+/* Solves the normal equations by sparse LDLᵀ factorization. In a traverse
+ * or network adjustment, each measurement involves only two or three points,
+ * so AᵀA has few nonzeros per row, and with a minimum-degree ordering its
+ * factor has few more.
+ */
+{
+  SparseMatrix mt=m.transpose();
+  SparseMatrix mtm=mt.transmult();
+  SparseLdl ldl(mtm);
+  return ldl.solve(mt*v);
+}
+
+vector<double> minimumNorm(SparseMatrix m,vector<double> v)
+{
+  SparseMatrix mmt=m.transmult();
+  SparseLdl ldl(mmt);
+  vector<double> y=ldl.solve(v);
+  int i;
+  /* A row of m which is a combination of others gives a zero pivot. The
+   * dense version would give NaN; this drops the row instead.
+   */
+  for (i=0;i<y.size();i++)
+    if (std::isnan(y[i]))
+      y[i]=0;
+  return m.transpose()*y;
+}
+
+void addCompensated(double &sum,double &comp,double x)
+// Neumaier's variant of Kahan summation
+{
+  double t=sum+x;
+  if (fabs(sum)>=fabs(x))
+    comp+=(sum-t)+x;
+  else
+    comp+=(x-t)+sum;
+  sum=t;
+}
+
+NormalEquations::NormalEquations(int ncolumns):ata(ncolumns,ncolumns),ataComp(ncolumns,ncolumns),atb(ncolumns,1),atbComp(ncolumns,1)
+{
+}
+
+void NormalEquations::addRow(const vector<int> &cols,const vector<double> &vals,double rhs)
+{
+  int i,j;
+  for (i=0;i<cols.size();i++)
+  {
+    for (j=0;j<cols.size();j++)
+      addCompensated(ata[cols[i]][cols[j]],ataComp[cols[i]][cols[j]],vals[i]*vals[j]);
+    addCompensated(atb[cols[i]][0],atbComp[cols[i]][0],vals[i]*rhs);
+  }
+}
+
+vector<double> NormalEquations::solve()
+{
+  matrix mtm(ata),mtv(atb);
+  int i,j;
+  for (i=0;i<mtm.getrows();i++)
+  {
+    for (j=0;j<mtm.getcolumns();j++)
+      mtm[i][j]+=ataComp[i][j];
+    mtv[i][0]+=atbComp[i][0];
+  }
+  mtm.gausselim(mtv);
+  for (i=0;i<mtm.getcolumns();i++)
+    if (mtm[i][i]==0)
+      mtv[i][0]=NAN;
+  return mtv;
+}
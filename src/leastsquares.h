@@ -24,6 +24,7 @@
 
 #include <vector>
 #include "matrix.h"
+#include "sparse.h"
 #include "quaternion.h"
 #include "xyz.h"
 
@@ -49,3 +50,26 @@ public:
 
 std::vector<double> linearLeastSquares(matrix m,std::vector<double> v);
 std::vector<double> minimumNorm(matrix m,std::vector<double> v);
+/* The sparse versions are used only when called with a SparseMatrix. They
+ * treat a pivot as zero if it is tiny compared to its diagonal entry, where
+ * the dense versions look for an exact zero, so an almost singular system
+ * may come out differently.
+ */
+std::vector<double> linearLeastSquares(SparseMatrix m,std::vector<double> v);
+std::vector<double> minimumNorm(SparseMatrix m,std::vector<double> v);
+
+class NormalEquations
+/* Accumulates the normal equations of a least-squares problem one row at a
+ * time, so that the whole matrix, which may have many more rows than columns
+ * and mostly zeros, need not be stored. A row is given as the columns and
+ * values of its nonzero entries. The sums are compensated, as pairwisesum
+ * is in linearLeastSquares.
+ */
+{
+public:
+  NormalEquations(int ncolumns);
+  void addRow(const std::vector<int> &cols,const std::vector<double> &vals,double rhs);
+  std::vector<double> solve();
+private:
+  matrix ata,ataComp,atb,atbComp;
+};
@@ -24,6 +24,7 @@
 #include <iostream>
 #include <cassert>
 #include <array>
+#include <random>
 #include "manyarc.h"
 #include "rootfind.h"
 #include "ps.h"
@@ -268,41 +269,42 @@ polyarc manyArcApprox3(spiralarc a,vector<Circle> lines,vector<double> offs)
   return ret;
 }
 
-vector<double> adjust1step3(spiralarc a,vector<Circle> lines,vector<double> offs)
+vector<double> adjust1step3(spiralarc a,vector<Circle> lines,vector<double> offs,minstd_rand &jiggle)
+/* Moving one point along its line changes the directions of only the two
+ * chords on either side of it. The end direction is an alternating sum of
+ * chord directions, so the partial derivatives of the end direction error are
+ * computed from those two chords, instead of recomputing all the points and
+ * chords for each one, which took time quadratic in the number of arcs.
+ */
 {
   int nlines=lines.size();
-  int i,j,ederr;
+  int i,ederr,plusdiff,minusdiff,diff;
   double randmul;
   double sidepull=a.length()/(nlines-1)/2e3;
-  vector<double> plusoffsets,minusoffsets,adjustment,ret;
+  vector<double> adjustment,ret;
   vector<double> deflection;
+  vector<xyz> ps=pointSeq(lines,offs);
+  xy pluspoint,minuspoint;
   matrix sidedefl(1,nlines-2);
   for (i=1;i<nlines-1;i++)
   {
-    plusoffsets.clear();
-    minusoffsets.clear();
-    for (j=0;j<nlines;j++)
-      if (j==i)
-      {
-	plusoffsets.push_back(offs[j]+sidepull);
-	minusoffsets.push_back(offs[j]-sidepull);
-      }
-      else
-      {
-	plusoffsets.push_back(offs[j]);
-	minusoffsets.push_back(offs[j]);
-      }
-    sidedefl[0][i-1]=(endDirectionError(a,pointSeq(lines,plusoffsets))-
-		      endDirectionError(a,pointSeq(lines,minusoffsets)))/sidepull/2;
+    pluspoint=lines[i].station(offs[i]+sidepull);
+    minuspoint=lines[i].station(offs[i]-sidepull);
+    plusdiff=twicedir(xy(ps[i-1]),pluspoint)-twicedir(pluspoint,xy(ps[i+1]));
+    minusdiff=twicedir(xy(ps[i-1]),minuspoint)-twicedir(minuspoint,xy(ps[i+1]));
+    diff=plusdiff-minusdiff;
+    if ((nlines-1-i)&1)
+      diff=-diff;
+    sidedefl[0][i-1]=diff/sidepull/2;
   }
-  ederr=endDirectionError(a,pointSeq(lines,offs));
+  ederr=endDirectionError(a,ps);
   deflection.push_back(ederr);
   adjustment=minimumNorm(sidedefl,deflection);
   ret.push_back(offs[0]);
   if (ederr>-3 && ederr<3)
   for (i=1;i<nlines-1;i++)
   {
-    randmul=(rng.ucrandom()+0.5)/256;
+    randmul=(jiggle()%256+0.5)/256;
     ret.push_back(offs[i]-adjustment[i-1]*randmul);
   }
   else
@@ -313,14 +315,19 @@ vector<double> adjust1step3(spiralarc a,vector<Circle> lines,vector<double> offs
 }
 
 vector<double> adjustManyArc3(spiralarc a,vector<Circle> lines,vector<double> offs)
+/* The steps are jiggled by a generator which starts with the same seed
+ * every time, so that the same spiral always gives the same arcs, whatever
+ * thread it's done in. rng is not safe to call from several threads.
+ */
 {
   int i,err;
+  minstd_rand jiggle;
   for (i=0;i<55;i++)
   {
     err=endDirectionError(a,pointSeq(lines,offs));
     if (err==0)
       break;
-    offs=adjust1step3(a,lines,offs);
+    offs=adjust1step3(a,lines,offs,jiggle);
   }
   return offs;
 }
@@ -732,7 +739,8 @@ void showMethod3(spiralarc a,vector<Circle> lines,vector<double> offs)
 
 polyarc manyArc(spiralarc a,int narcs)
 {
-  showThisMethod=SHOW_METHOD && narcs==5 && a.chordbearing()==0 && a.getdelta()>DEG30;
+  if (SHOW_METHOD) // clotilde calls this in several threads at once
+    showThisMethod=narcs==5 && a.chordbearing()==0 && a.getdelta()>DEG30;
   if (showThisMethod)
     cout<<"This is the curve to show the method of\n";
 #if APX_METHOD==1
@@ -799,3 +807,27 @@ double maxError(polyarc apx,spiralarc a)
   }
   return firstError;
 }
+
+int manyArcCount(spiralarc a,double toler)
+/* Estimates how many arcs are needed to approximate a within toler, using
+ * the empirical formula for the maximum error of a cubic in testmanyarc and
+ * the estimated throw, which is the difference in curvature times the square
+ * of the length divided by 24.
+ */
+{
+  double estThrow=fabs(a.curvature(a.length())-a.curvature(0))*sqr(a.length())/24;
+  double n=cbrt(estThrow/toler/sqrt(6.75))+0.230201;
+  if (!(n>2))
+    return 2;
+  if (n>MANYARC_MAX)
+    return MANYARC_MAX;
+  return ceil(n);
+}
+
+ManyArcTry tryManyArc(spiralarc a,int narcs)
+{
+  ManyArcTry ret;
+  ret.apx=manyArc(a,narcs);
+  ret.error=maxError(ret.apx,a);
+  return ret;
+}
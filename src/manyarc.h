@@ -21,9 +21,20 @@
  * and Lesser General Public License along with Bezitopo. If not, see
  * <http://www.gnu.org/licenses/>.
  */
+#ifndef MANYARC_H
+#define MANYARC_H
 
 #include "polyline.h"
 
+#define MANYARC_MAX 1024
+
+struct ManyArcTry
+{
+  polyarc apx;
+  double error;
+};
+
+
 segment spiralToCubic(spiralarc a);
 double manyArcTrimFunc(double p,double n);
 double manyArcTrimDeriv(double p,double n);
@@ -34,4 +45,7 @@ double meanSquareDistance(polyarc apx,spiralarc a);
 std::vector<double> weightedDistance(polyarc apx,spiralarc a);
 polyarc manyArcUnadjusted(spiralarc a,int narcs);
 polyarc manyArc(spiralarc a,int narcs);
+int manyArcCount(spiralarc a,double toler);
+ManyArcTry tryManyArc(spiralarc a,int narcs);
 double maxError(polyarc apx,spiralarc a);
+#endif
@@ -29,15 +29,131 @@
 #include "manysum.h"
 using namespace std;
 
-double pairwisesum(double *a,unsigned n)
+/* The SIMD kernels add a block of 128 numbers as a tree of depth 7, the same
+ * depth as pairwisesum's own tree over 128 numbers, so the error bound
+ * is unchanged. The block is 16 rows of 8; the rows are added pairwise
+ * in vector registers, then the 8 lanes of the one row left are added
+ * pairwise. Only the order of additions differs from the scalar code.
+ */
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define PAIRWISE_X86
+#include <immintrin.h>
+
+/* rows2 through rows16 add 2 to 16 rows of 8 pairwise, for 4 or 8 columns
+ * starting at a.
+ */
+__attribute__((target("avx2"))) inline __m256d rows2avx2(double *a)
+{
+  return _mm256_add_pd(_mm256_loadu_pd(a),_mm256_loadu_pd(a+8));
+}
+
+__attribute__((target("avx2"))) inline __m256d rows4avx2(double *a)
+{
+  return _mm256_add_pd(rows2avx2(a),rows2avx2(a+16));
+}
+
+__attribute__((target("avx2"))) inline __m256d rows8avx2(double *a)
+{
+  return _mm256_add_pd(rows4avx2(a),rows4avx2(a+32));
+}
+
+__attribute__((target("avx2"))) inline __m256d rows16avx2(double *a)
+{
+  return _mm256_add_pd(rows8avx2(a),rows8avx2(a+64));
+}
+
+__attribute__((target("avx2"))) double sum128avx2(double *a)
+{
+  double ret;
+  __m256d row;
+  __m128d half;
+  row=_mm256_add_pd(rows16avx2(a),rows16avx2(a+4));
+  half=_mm_add_pd(_mm256_castpd256_pd128(row),_mm256_extractf128_pd(row,1));
+  ret=_mm_cvtsd_f64(_mm_add_sd(half,_mm_unpackhi_pd(half,half)));
+  _mm256_zeroupper(); // The caller is SSE code.
+  return ret;
+}
+
+__attribute__((target("avx512f"))) inline __m512d rows2avx512(double *a)
+{
+  return _mm512_add_pd(_mm512_loadu_pd(a),_mm512_loadu_pd(a+8));
+}
+
+__attribute__((target("avx512f"))) inline __m512d rows4avx512(double *a)
+{
+  return _mm512_add_pd(rows2avx512(a),rows2avx512(a+16));
+}
+
+__attribute__((target("avx512f"))) inline __m512d rows8avx512(double *a)
+{
+  return _mm512_add_pd(rows4avx512(a),rows4avx512(a+32));
+}
+
+__attribute__((target("avx512f"))) double sum128avx512(double *a)
+{
+  double ret;
+  __m512d row;
+  __m256d quarter;
+  __m128d half;
+  row=_mm512_add_pd(rows8avx512(a),rows8avx512(a+64));
+  quarter=_mm256_add_pd(_mm512_castpd512_pd256(row),_mm512_extractf64x4_pd(row,1));
+  half=_mm_add_pd(_mm256_castpd256_pd128(quarter),_mm256_extractf128_pd(quarter,1));
+  ret=_mm_cvtsd_f64(_mm_add_sd(half,_mm_unpackhi_pd(half,half)));
+  _mm256_zeroupper(); // The caller is SSE code.
+  return ret;
+}
+#endif
+
+int bestKernel()
+{
+#ifdef PAIRWISE_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx512f"))
+    return PS_AVX512;
+  if (__builtin_cpu_supports("avx2"))
+    return PS_AVX2;
+#endif
+  return PS_SCALAR;
+}
+
+int pairwisesumKernel()
+// Returns the fastest kernel this processor can run.
+{
+  static int kernel=bestKernel();
+  return kernel;
+}
+
+double pairwisesum(double *a,unsigned n,int kernel)
 /* Adds up n numbers at a pairwise, for less roundoff error.
  * i^(i+1) is 1 if i is even, 3 if i%4==1, 7 if i%8==3, etc.
  * i^(i+8) is 8 if i%16==0, 24 if i%32==16, etc.
+ * If kernel is a SIMD kernel, whole blocks of 128 are added by it,
+ * and the rest by groups of 8 and singly as usual.
  */
 {
-  unsigned i,j,b;
-  double sums[32],sum=0;
-  for (i=0;i+7<n;i+=8) // Add up groups of 8, leaving 0 to 7 numbers at the end
+  unsigned i=0,j,b;
+  double sums[32],sum=0,block;
+#ifdef PAIRWISE_X86
+  if (kernel==PS_AVX2 || kernel==PS_AVX512)
+    for (;i+127<n;i+=128) // Add up blocks of 128, leaving 0 to 127 numbers
+    {
+      if (kernel==PS_AVX512)
+	block=sum128avx512(a+i);
+      else
+	block=sum128avx2(a+i);
+      b=i^(i+128);
+      if (b==128)
+	sums[7]=block;
+      else
+      {
+	sums[7]+=block;
+	for (j=8;b>>(j+1);j++)
+	  sums[j]+=sums[j-1];
+	sums[j]=sums[j-1];
+      }
+    }
+#endif
+  for (;i+7<n;i+=8) // Add up groups of 8, leaving 0 to 7 numbers at the end
   {
     b=i^(i+8);
     if (b==8)
@@ -69,6 +185,11 @@ double pairwisesum(double *a,unsigned n)
   return sum;
 }
 
+double pairwisesum(double *a,unsigned n)
+{
+  return pairwisesum(a,n,pairwisesumKernel());
+}
+
 long double pairwisesum(long double *a,unsigned n)
 {
   unsigned i,j,b;
@@ -142,6 +263,17 @@ long double pairwisesum(vector<long double> &a)
     return 0;
 }
 
+inline void twoSum(double a,double b,double &s,double &e)
+/* s is a+b rounded, and e is the roundoff, so that s+e is exactly a+b.
+ * No branch, so the lanes of manysum::add can run in vector registers.
+ */
+{
+  double bv;
+  s=a+b;
+  bv=s-a;
+  e=(a-(s-bv))+(b-bv);
+}
+
 manysum::manysum()
 {
   clear();
@@ -149,44 +281,23 @@ manysum::manysum()
 
 void manysum::clear()
 {
-  count=0;
-  memset(stage0,0,sizeof(stage0));
-  memset(stage1,0,sizeof(stage1));
-  memset(stage2,0,sizeof(stage2));
-  memset(stage3,0,sizeof(stage3));
-  memset(stage4,0,sizeof(stage4));
+  sum=err=err2=0;
 }
 
 double manysum::total()
 {
-  return pairwisesum(stage0,8192)+pairwisesum(stage1,8192)+pairwisesum(stage2,8192)+
-	 pairwisesum(stage3,8192)+pairwisesum(stage4,4096);
+  if (std::isfinite(sum))
+    return sum+(err+err2);
+  else
+    return sum; // The errors are NaN if an infinity was added.
 }
 
 manysum& manysum::operator+=(double x)
 {
-  stage0[count&8191]=x;
-  if ((count&8191)==8191)
-  {
-    stage1[(count>>13)&8191]=pairwisesum(stage0,8192);
-    memset(stage0,0,sizeof(stage0));
-  }
-  if ((count&0x3ffffff)==0x3ffffff)
-  {
-    stage2[(count>>26)&8191]=pairwisesum(stage1,8192);
-    memset(stage1,0,sizeof(stage1));
-  }
-  if ((count&0x7fffffffff)==0x7fffffffff)
-  {
-    stage3[(count>>39)&8191]=pairwisesum(stage2,8192);
-    memset(stage2,0,sizeof(stage2));
-  }
-  if ((count&0xfffffffffffff)==0xfffffffffffff)
-  {
-    stage4[(count>>52)&8191]=pairwisesum(stage3,8192);
-    memset(stage3,0,sizeof(stage2));
-  }
-  count++;
+  double e,ee;
+  twoSum(sum,x,sum,e);
+  twoSum(err,e,err,ee);
+  err2+=ee;
   return *this;
 }
 
@@ -194,3 +305,48 @@ manysum& manysum::operator-=(double x)
 {
   return operator+=(-x);
 }
+
+#define LANES 4
+
+void manysum::add(const double *a,size_t n)
+/* Adds n numbers. They are dealt out to four independent sums, which the
+ * compiler can put in one vector register each, and merged at the end.
+ */
+{
+  size_t i;
+  int j;
+  double s[LANES],e[LANES],ee[LANES],e1,ee1;
+  for (j=0;j<LANES;j++)
+    s[j]=e[j]=ee[j]=0;
+  for (i=0;i+LANES<=n;i+=LANES)
+    for (j=0;j<LANES;j++)
+    {
+      twoSum(s[j],a[i+j],s[j],e1);
+      twoSum(e[j],e1,e[j],ee1);
+      ee[j]+=ee1;
+    }
+  for (;i<n;i++)
+    operator+=(a[i]);
+  for (j=0;j<LANES;j++)
+  {
+    operator+=(s[j]);
+    operator+=(e[j]);
+    operator+=(ee[j]);
+  }
+}
+
+void manysum::add(const vector<double> &a)
+{
+  if (a.size())
+    add(&a[0],a.size());
+}
+
+void manysum::merge(const manysum &other)
+/* Adds another partial sum to this one, such as one made by another thread.
+ * Both sums' errors are kept, so nothing is lost by splitting the numbers.
+ */
+{
+  operator+=(other.sum);
+  operator+=(other.err);
+  operator+=(other.err2);
+}
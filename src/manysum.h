@@ -28,11 +28,21 @@
 #include <cmath>
 /* Adds together many numbers (like millions) accurately.
  * pairwisesum takes an array or vector with the numbers already computed.
- * manysum stores numbers as they are computed in a buffer, then calls pairwisesum
- * when the buffer is full, and stores the result in the next buffer.
+ * manysum adds numbers as they are computed, keeping the roundoff error of
+ * the sum and the roundoff error of that, so its total is as accurate as
+ * pairwisesum's or better. It is three doubles, so it's cheap to make and
+ * clear; partial sums made in different threads can be merged.
  * See matrix.cpp and spiral.cpp for examples of pairwisesum.
+ * pairwisesum on doubles uses AVX2 or AVX-512, if the processor has it,
+ * for blocks of 128; kernel can be given to compare them.
  */
 
+#define PS_SCALAR 0
+#define PS_AVX2 1
+#define PS_AVX512 2
+
+int pairwisesumKernel();
+double pairwisesum(double *a,unsigned n,int kernel);
 double pairwisesum(double *a,unsigned n);
 double pairwisesum(std::vector<double> &a);
 long double pairwisesum(long double *a,unsigned n);
@@ -41,13 +51,14 @@ long double pairwisesum(std::vector<long double> &a);
 class manysum
 {
 private:
-  size_t count;
-  double stage0[8192],stage1[8192],stage2[8192],
-         stage3[8192],stage4[4096];
+  double sum,err,err2;
 public:
   manysum();
   void clear();
   double total();
+  void add(const double *a,size_t n);
+  void add(const std::vector<double> &a);
+  void merge(const manysum &other);
   manysum& operator+=(double x);
   manysum& operator-=(double x);
 };
@@ -27,6 +27,9 @@
 #include <utility>
 #include <iostream>
 #include <iomanip>
+#include <functional>
+#include <future>
+#include <thread>
 #include "matrix.h"
 #include "except.h"
 #include "manysum.h"
@@ -35,6 +38,56 @@
 
 using namespace std;
 
+/* Number of doubles in a block of rows of the right operand of a product,
+ * which is kept in cache while every row of the left operand is multiplied
+ * by it. Also the number of doubles in a tile of a transpose.
+ */
+#define MATRIX_BLOCK 16384
+#define TRANSPOSE_TILE 32
+
+int matrixThreads=0;
+
+int threadCount(double work)
+{
+  static int cores=thread::hardware_concurrency();
+  int n=matrixThreads;
+  if (n<1)
+    n=cores;
+  if (n<1 || work<MATRIX_PARALLEL)
+    n=1;
+  return n;
+}
+
+void splitRows(unsigned startRow,unsigned endRow,double work,bool triangular,function<void(unsigned,unsigned)> f)
+/* Calls f on consecutive ranges of rows covering startRow to endRow-1.
+ * If there's enough work, the ranges are done in separate threads.
+ * If triangular, the work on each row is proportional to its number,
+ * so the ranges are made shorter toward the end.
+ */
+{
+  int i,n=threadCount(work);
+  unsigned len=endRow-startRow;
+  vector<unsigned> bounds;
+  vector<future<void> > futures;
+  if (n>len)
+    n=len;
+  if (n<=1)
+  {
+    f(startRow,endRow);
+    return;
+  }
+  for (i=0;i<=n;i++)
+    if (triangular)
+      bounds.push_back(lrint(sqrt((double)i/n*(sqr(endRow)-sqr(startRow))+sqr(startRow))));
+    else
+      bounds.push_back(startRow+(double)len*i/n);
+  for (i=1;i<n;i++)
+    futures.push_back(async(launch::async,f,bounds[i],bounds[i+1]));
+  f(bounds[0],bounds[1]);
+  for (i=0;i<futures.size();i++)
+    futures[i].get();
+}
+
 matrix::matrix()
 {
   rows=columns=0;
@@ -171,22 +224,45 @@ matrix matrix::operator-(matrix& b)
   return ret;
 }
 
-matrix matrix::operator*(matrix &b)
+void matrix::multiplyRows(matrix &bt,matrix &ret,unsigned startRow,unsigned endRow)
+/* Computes rows startRow to endRow-1 of this times the transpose of bt.
+ * Both operands are then read along rows, and the products can be
+ * computed several at a time.
+ */
 {
-  if (columns!=b.rows)
-    throw BeziExcept(matrixMismatch);
-  matrix ret(rows,b.columns);
-  int h,i,j,k;
-  double *sum;
+  unsigned i,j,k,jb,blockSize,blockEnd;
+  double *sum,*arow,*brow;
   sum=new double[columns];
-  for (i=0;i<rows;i++)
-    for (j=0;j<b.columns;j++)
+  blockSize=MATRIX_BLOCK/(columns+1)+1;
+  for (jb=0;jb<bt.rows;jb+=blockSize)
+  {
+    blockEnd=jb+blockSize;
+    if (blockEnd>bt.rows)
+      blockEnd=bt.rows;
+    for (i=startRow;i<endRow;i++)
     {
-      for (k=0;k<columns;k++)
-	sum[k]=(*this)[i][k]*b[k][j];
-      ret[i][j]=pairwisesum(sum,columns);
+      arow=entry+i*columns;
+      for (j=jb;j<blockEnd;j++)
+      {
+	brow=bt.entry+j*columns;
+	for (k=0;k<columns;k++)
+	  sum[k]=arow[k]*brow[k];
+	ret.entry[i*ret.columns+j]=pairwisesum(sum,columns);
+      }
     }
+  }
   delete[] sum;
+}
+
+matrix matrix::operator*(matrix &b)
+{
+  if (columns!=b.rows)
+    throw BeziExcept(matrixMismatch);
+  matrix ret(rows,b.columns),bt=b.transpose();
+  splitRows(0,rows,(double)rows*columns*b.columns,false,[&](unsigned startRow,unsigned endRow)
+	    {
+	      multiplyRows(bt,ret,startRow,endRow);
+	    });
   return ret;
 }
 
@@ -204,27 +280,47 @@ double matrix::trace()
 matrix matrix::transpose()
 {
   matrix ret(columns,rows);
-  int i,j;
-  for (i=0;i<rows;i++)
-    for (j=0;j<columns;j++)
-      ret.entry[j*rows+i]=entry[i*columns+j];
+  int i,j,ib,jb;
+  for (ib=0;ib<rows;ib+=TRANSPOSE_TILE)
+    for (jb=0;jb<columns;jb+=TRANSPOSE_TILE)
+      for (i=ib;i<ib+TRANSPOSE_TILE && i<rows;i++)
+	for (j=jb;j<jb+TRANSPOSE_TILE && j<columns;j++)
+	  ret.entry[j*rows+i]=entry[i*columns+j];
   return ret;
 }
 
-matrix matrix::transmult()
+void matrix::transmultRows(matrix &ret,unsigned startRow,unsigned endRow)
+// Computes rows startRow to endRow-1 of the lower triangle and their mirror images.
 {
-  matrix ret(rows,rows);
-  int i,j,k;
-  double *sum;
+  unsigned i,j,k,jb,blockSize,blockEnd;
+  double *sum,*arow,*brow;
   sum=new double[columns];
-  for (i=0;i<rows;i++)
-    for (j=0;j<=i;j++)
+  blockSize=MATRIX_BLOCK/(columns+1)+1;
+  for (jb=0;jb<endRow;jb+=blockSize)
+  {
+    blockEnd=jb+blockSize;
+    for (i=startRow;i<endRow;i++)
     {
-      for (k=0;k<columns;k++)
-	sum[k]=(*this)[i][k]*(*this)[j][k];
-      ret[i][j]=ret[j][i]=pairwisesum(sum,columns);
+      arow=entry+i*columns;
+      for (j=jb;j<blockEnd && j<=i;j++)
+      {
+	brow=entry+j*columns;
+	for (k=0;k<columns;k++)
+	  sum[k]=arow[k]*brow[k];
+	ret.entry[i*rows+j]=ret.entry[j*rows+i]=pairwisesum(sum,columns);
+      }
     }
+  }
   delete[] sum;
+}
+
+matrix matrix::transmult()
+{
+  matrix ret(rows,rows);
+  splitRows(0,rows,(double)rows*rows*columns/2,true,[&](unsigned startRow,unsigned endRow)
+	    {
+	      transmultRows(ret,startRow,endRow);
+	    });
   return ret;
 }
 
@@ -268,10 +364,6 @@ rowsult matrix::rowop(matrix &b,int row0,int row1,int piv)
   int i;
   double *temp,*rw0,*rw1,*rwb0,*rwb1;
   double slope,minslope=INFINITY;
-  i=columns;
-  if (b.columns>i)
-    i=b.columns;
-  temp=new double[i];
   rw0=(*this)[row0];
   rw1=(*this)[row1];
   if (this==&b)
@@ -310,6 +402,10 @@ rowsult matrix::rowop(matrix &b,int row0,int row1,int piv)
   ret.flags&=1;
   if (ret.flags)
   {
+    i=columns;
+    if (b.columns>i)
+      i=b.columns;
+    temp=new double[i];
     memcpy(temp,rw0,sizeof(double)*columns);
     memcpy(rw0,rw1,sizeof(double)*columns);
     memcpy(rw1,temp,sizeof(double)*columns);
@@ -319,6 +415,7 @@ rowsult matrix::rowop(matrix &b,int row0,int row1,int piv)
       memcpy(rwb0,rwb1,sizeof(double)*b.columns);
       memcpy(rwb1,temp,sizeof(double)*b.columns);
     }
+    delete[] temp;
   }
   if (ret.pivot<0)
     ret.detfactor=0;
@@ -344,35 +441,74 @@ rowsult matrix::rowop(matrix &b,int row0,int row1,int piv)
   }
   if (ret.flags&1)
     ret.detfactor=-ret.detfactor;
-  delete[] temp;
   return ret;
 }
 
+void matrix::eliminateRows(matrix &b,int pivotRow,int startRow,int endRow)
+{
+  int j;
+  for (j=startRow;j<endRow;j++)
+    if (j!=pivotRow)
+      rowop(b,pivotRow,j,pivotRow);
+}
+
+void matrix::eliminate(matrix &b,int pivotRow,int startRow,int endRow)
+/* Subtracts multiples of pivotRow from rows startRow to endRow-1 to clear
+ * the pivot column. The pivot must already be 1, so that rowop changes
+ * only the row it subtracts from, and the rows can be done in any order.
+ */
+{
+  double work=(double)(endRow-startRow)*columns;
+  if (&b!=this)
+    work+=(double)(endRow-startRow)*b.columns;
+  splitRows(startRow,endRow,work,false,[&](unsigned start,unsigned end)
+	    {
+	      eliminateRows(b,pivotRow,start,end);
+	    });
+}
+
 void matrix::gausselim(matrix &b)
 {
   int i,j;
-  //dump();
-  /*for (i=1;i<rows;i*=2)
-    for (j=0;j+i<rows;j++)
-      if ((j&i)==0)
-	rowop(b,j,j+i,-1);*/
   for (i=0;i<rows;i++)
   {
     findpivot(b,i,i);
-    for (j=0;j<rows;j++)
-      rowop(b,i,j,i);
-    //cout<<endl;
-    //dump();
+    if (i<columns && (*this)[i][i]!=0)
+    {
+      rowop(b,i,i,i);
+      eliminate(b,i,0,rows);
+    }
+    else
+      for (j=0;j<rows;j++)
+	rowop(b,i,j,i);
   }
   for (i=rows-1;i>=0;i--)
   {
-    for (j=0;j<i;j++)
-      rowop(b,i,j,i);
-    //cout<<endl;
-    //dump();
+    if (i<columns && (*this)[i][i]==1)
+      eliminate(b,i,0,i);
+    else
+      for (j=0;j<i;j++)
+	rowop(b,i,j,i);
   }
-  //cout<<endl;
-  //b.dump();
+}
+
+void matrix::pivotRatios(double *ratios,int startRow,int endRow,int column)
+/* For each row, computes the ratio of the square of the entry in column
+ * to the sum of the squares of the entries to its right.
+ */
+{
+  int i,j;
+  double *squares,*thisrow;
+  squares=new double[columns];
+  for (i=startRow;i<endRow;i++)
+  {
+    thisrow=(*this)[i];
+    memset(squares,0,columns*sizeof(double));
+    for (j=column+1;j<columns;j++)
+      squares[j-column-1]=sqr(thisrow[j]);
+    ratios[i]=sqr(thisrow[column])/pairwisesum(squares,columns-column);
+  }
+  delete[] squares;
 }
 
 bool matrix::findpivot(matrix &b,int row,int column)
@@ -382,26 +518,22 @@ bool matrix::findpivot(matrix &b,int row,int column)
  * This tells _determinant to multiply by -1.
  */
 {
-  int i,j,k,pivotrow;
-  double *squares,*ratios,*thisrow,maxratio;
-  squares=new double[columns];
+  int i,pivotrow;
+  double *ratios,maxratio;
   ratios=new double[rows];
   for (pivotrow=-1,maxratio=0;pivotrow<row && column<columns;column++)
   {
     memset(ratios,0,rows*sizeof(double));
+    splitRows(row,rows,(double)(rows-row)*(columns-column),false,[&](unsigned start,unsigned end)
+	      {
+		pivotRatios(ratios,start,end,column);
+	      });
     for (i=row;i<rows;i++)
-    {
-      thisrow=(*this)[i];
-      memset(squares,0,columns*sizeof(double));
-      for (j=column+1;j<columns;j++)
-	squares[j-column-1]=sqr(thisrow[j]);
-      ratios[i]=sqr(thisrow[column])/pairwisesum(squares,columns-column);
       if (ratios[i]>maxratio)
       {
 	pivotrow=i;
 	maxratio=ratios[i];
       }
-    }
   }
   if (pivotrow>row)
   {
@@ -410,35 +542,32 @@ bool matrix::findpivot(matrix &b,int row,int column)
       b.swaprows(pivotrow,row);
   }
   delete[] ratios;
-  delete[] squares;
   return pivotrow>row;
 }
 
 double matrix::_determinant()
 {
-  int i,j,lastpivot=-1,runlen;
+  int i,j;
   vector<double> factors;
   rowsult rsult;
   for (i=0;i<rows;i++)
   {
     if (findpivot(*this,i,i))
       factors.push_back(-1);
-    for (j=i+1;j<rows;j++)
-    {
-      rsult=rowop(*this,i,j,i);
+    if (i+1<rows && i<columns && (*this)[i][i]!=0)
+    { // The first rowop divides row i by the pivot; the rest only subtract.
+      rsult=rowop(*this,i,i+1,i);
       if (rsult.detfactor!=1)
 	factors.push_back(rsult.detfactor);
-      if (i!=j)
+      eliminate(*this,i,i+2,rows);
+    }
+    else
+      for (j=i+1;j<rows;j++)
       {
-	if (rsult.pivot==lastpivot)
-	  runlen++;
-	else
-	  runlen=0;
-	lastpivot=rsult.pivot;
+	rsult=rowop(*this,i,j,i);
+	if (rsult.detfactor!=1)
+	  factors.push_back(rsult.detfactor);
       }
-    }
-    //cout<<endl;
-    //dump();
   }
   if (rows)
     factors.push_back((*this)[rows-1][columns-1]);
@@ -31,6 +31,14 @@
  * doubled and offset to center
  */
 
+/* Products and eliminations with at least this many multiply-adds are split
+ * among threads. Below this, starting threads takes longer than it saves.
+ */
+#define MATRIX_PARALLEL 262144
+/* Number of threads to use for big matrices. 0 means one per core;
+ * 1 means do everything in the calling thread.
+ */
+extern int matrixThreads;
 
 struct rowsult
 {
@@ -47,6 +55,11 @@ protected:
   rowsult rowop(matrix &b,int row0,int row1,int piv);
   double _determinant();
   bool findpivot(matrix &b,int row,int column);
+  void pivotRatios(double *ratios,int startRow,int endRow,int column);
+  void multiplyRows(matrix &bt,matrix &ret,unsigned startRow,unsigned endRow);
+  void transmultRows(matrix &ret,unsigned startRow,unsigned endRow);
+  void eliminateRows(matrix &b,int pivotRow,int startRow,int endRow);
+  void eliminate(matrix &b,int pivotRow,int startRow,int endRow);
 public:
   matrix();
   matrix(unsigned r,unsigned c);
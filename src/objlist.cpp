@@ -23,14 +23,23 @@
  */
 
 #include <cassert>
+#include <climits>
+#include <algorithm>
 #include "objlist.h"
 #include "document.h"
+#include "boundrect.h"
 #include "penwidth.h"
 #include "layer.h"
 #include "color.h"
 
 using namespace std;
 
+/* Range of levels of the object index. Cells of the smallest level are
+ * about a nanometer, of the largest bigger than anything on Earth.
+ */
+#define INDEX_MIN_LEVEL -30
+#define INDEX_MAX_LEVEL 60
+
 objrec::objrec()
 {
   //obj=nullptr;
@@ -104,6 +113,7 @@ int ObjectList::insert(drawobj *obj)
     forward[newhandle].colr=SAMECOLOR;
     forward[newhandle].thik=SAMEWIDTH;
     reverse[obj]=newhandle;
+    index.insert(newhandle,obj);
     return newhandle;
   }
 }
@@ -111,18 +121,18 @@ int ObjectList::insert(drawobj *obj)
 void ObjectList::erase(drawobj *obj)
 {
   if (reverse.count(obj))
-  {
-    int handle=reverse[obj];
-    reverse.erase(obj);
-    forward.erase(handle);
-  }
+    erase(reverse[obj]);
 }
 
 void ObjectList::erase(int handle)
 {
+  int i;
   if (forward.count(handle))
   {
     objrec *rec=&forward[handle];
+    for (i=0;i<rec->references.size();i++)
+      backRefs.erase(make_pair(rec->references[i],handle));
+    index.erase(handle);
     reverse.erase(rec->obj.get());
     forward.erase(handle);
   }
@@ -158,14 +168,173 @@ vector<int> ObjectList::allHandles()
   return ret;
 }
 
+void ObjectList::addReference(int handle,int target)
+// Records that the object handle refers to the object target.
+{
+  if (forward.count(handle))
+  {
+    forward[handle].references.push_back(target);
+    backRefs.insert(make_pair(target,handle));
+  }
+}
+
 vector<int> ObjectList::referrers(int handle)
 {
-  map<int,objrec>::iterator i;
-  int j;
+  set<pair<int,int> >::iterator i;
   vector<int> ret;
+  for (i=backRefs.lower_bound(make_pair(handle,INT_MIN));i!=backRefs.end() && i->first==handle;++i)
+    ret.push_back(i->second);
+  return ret;
+}
+
+void ObjectList::moved(int handle)
+{
+  if (forward.count(handle))
+  {
+    index.erase(handle);
+    index.insert(handle,forward[handle].obj.get());
+  }
+}
+
+void ObjectList::roscat(xy tfrom,int ro,double sca,xy tto)
+{
+  map<int,objrec>::iterator i;
+  index.clear();
   for (i=forward.begin();i!=forward.end();++i)
-    for (j=0;j<i->second.references.size();j++)
-      if (i->second.references[j]==handle)
-	ret.push_back(i->first);
+  {
+    i->second.obj->roscat(tfrom,ro,sca,tto);
+    index.insert(i->first,i->second.obj.get());
+  }
+}
+
+vector<int> ObjectList::inBox(double minx,double miny,double maxx,double maxy)
+/* Returns the handles of the objects whose bounding boxes overlap the box,
+ * in order. The objects themselves may not overlap it.
+ */
+{
+  return index.inBox(minx,miny,maxx,maxy);
+}
+
+vector<int> ObjectList::nearby(xy pnt,double radius)
+/* Returns the handles of the objects whose bounding boxes are within radius
+ * of pnt. Use this to find candidates for hit testing.
+ */
+{
+  vector<int> box=index.inBox(pnt.east()-radius,pnt.north()-radius,pnt.east()+radius,pnt.north()+radius);
+  vector<int> ret;
+  double minx,miny,maxx,maxy;
+  int i;
+  for (i=0;i<box.size();i++)
+    if (!index.getBox(box[i],minx,miny,maxx,maxy) ||
+	hypot(max(0.,max(minx-pnt.east(),pnt.east()-maxx)),max(0.,max(miny-pnt.north(),pnt.north()-maxy)))<=radius)
+      ret.push_back(box[i]);
+  return ret;
+}
+
+void ObjectIndex::clear()
+{
+  boxes.clear();
+  cells.clear();
+  unbounded.clear();
+}
+
+void ObjectIndex::insert(int handle,drawobj *obj)
+{
+  BoundRect br;
+  IndexedBox box;
+  double side;
+  br.include(obj);
+  box.minx=br.left();
+  box.miny=br.bottom();
+  box.maxx=br.right();
+  box.maxy=br.top();
+  if (!(std::isfinite(box.minx) && std::isfinite(box.miny) && std::isfinite(box.maxx) && std::isfinite(box.maxy)))
+  {
+    unbounded.insert(handle);
+    return;
+  }
+  side=max(box.maxx-box.minx,box.maxy-box.miny);
+  if (side>0)
+    box.level=max(INDEX_MIN_LEVEL,min(INDEX_MAX_LEVEL,(int)ceil(log2(side))));
+  else
+    box.level=INDEX_MIN_LEVEL;
+  side=ldexp(1,box.level);
+  box.cell=make_pair((long long)floor((box.miny+box.maxy)/2/side),(long long)floor((box.minx+box.maxx)/2/side));
+  boxes[handle]=box;
+  cells[box.level][box.cell].push_back(handle);
+}
+
+void ObjectIndex::erase(int handle)
+{
+  map<int,IndexedBox>::iterator i=boxes.find(handle);
+  vector<int> *cell;
+  unbounded.erase(handle);
+  if (i!=boxes.end())
+  {
+    cell=&cells[i->second.level][i->second.cell];
+    cell->erase(find(cell->begin(),cell->end(),handle));
+    if (cell->size()==0)
+    {
+      cells[i->second.level].erase(i->second.cell);
+      if (cells[i->second.level].size()==0)
+	cells.erase(i->second.level);
+    }
+    boxes.erase(i);
+  }
+}
+
+bool ObjectIndex::getBox(int handle,double &minx,double &miny,double &maxx,double &maxy)
+// Returns false if the object has no bounds.
+{
+  map<int,IndexedBox>::iterator i=boxes.find(handle);
+  if (i==boxes.end())
+    return false;
+  minx=i->second.minx;
+  miny=i->second.miny;
+  maxx=i->second.maxx;
+  maxy=i->second.maxy;
+  return true;
+}
+
+void ObjectIndex::addOverlapping(vector<int> &ret,vector<int> &cell,double minx,double miny,double maxx,double maxy)
+{
+  int i;
+  IndexedBox *box;
+  for (i=0;i<cell.size();i++)
+  {
+    box=&boxes[cell[i]];
+    if (box->maxx>=minx && box->minx<=maxx && box->maxy>=miny && box->miny<=maxy)
+      ret.push_back(cell[i]);
+  }
+}
+
+vector<int> ObjectIndex::inBox(double minx,double miny,double maxx,double maxy)
+/* In each level, looks in the cells within a cell of the box. If there are
+ * more of those than there are cells with objects in the level, looks in
+ * all cells of the level instead.
+ */
+{
+  map<int,map<pair<long long,long long>,vector<int> > >::iterator i;
+  map<pair<long long,long long>,vector<int> >::iterator j;
+  double side,lorow,hirow,locol,hicol;
+  long long row;
+  vector<int> ret(unbounded.begin(),unbounded.end());
+  for (i=cells.begin();i!=cells.end();++i)
+  {
+    side=ldexp(1,i->first);
+    lorow=floor(miny/side)-1;
+    hirow=floor(maxy/side)+1;
+    locol=floor(minx/side)-1;
+    hicol=floor(maxx/side)+1;
+    if ((hirow-lorow+1)*(hicol-locol+1)<i->second.size())
+      for (row=lorow;row<=hirow;row++)
+	for (j=i->second.lower_bound(make_pair(row,(long long)locol));
+	     j!=i->second.end() && j->first<=make_pair(row,(long long)hicol);++j)
+	  addOverlapping(ret,j->second,minx,miny,maxx,maxy);
+    else
+      for (j=i->second.begin();j!=i->second.end();++j)
+	addOverlapping(ret,j->second,minx,miny,maxx,maxy);
+  }
+  sort(ret.begin(),ret.end());
   return ret;
 }
@@ -25,6 +25,7 @@
 #ifndef OBJLIST_H
 #define OBJLIST_H
 #include <map>
+#include <set>
 #include <memory>
 #include <vector>
 #include "drawobj.h"
@@ -49,11 +50,42 @@ public:
   unsigned short getthickness(document *doc);
 };
 
+struct IndexedBox
+{
+  double minx,miny,maxx,maxy;
+  int level;
+  std::pair<long long,long long> cell;
+};
+
+class ObjectIndex
+/* A loose quadtree of the bounding boxes of drawing objects. The cells of
+ * level k are 2**k on a side. Each object goes in the smallest level whose
+ * cells are as big as its box, in the cell containing the center of the box,
+ * so it lies within half a cell of its cell. Only cells with objects in them
+ * are stored, so objects can be anywhere and of any size. Objects with no
+ * bounds, such as those whose dirbound returns infinity, are always found.
+ */
+{
+public:
+  void clear();
+  void insert(int handle,drawobj *obj);
+  void erase(int handle);
+  std::vector<int> inBox(double minx,double miny,double maxx,double maxy);
+  bool getBox(int handle,double &minx,double &miny,double &maxx,double &maxy);
+private:
+  std::map<int,IndexedBox> boxes;
+  std::map<int,std::map<std::pair<long long,long long>,std::vector<int> > > cells;
+  std::set<int> unbounded;
+  void addOverlapping(std::vector<int> &ret,std::vector<int> &cell,double minx,double miny,double maxx,double maxy);
+};
+
 class ObjectList
 {
 private:
   std::map<int,objrec> forward;
   std::map<drawobj *,int> reverse;
+  ObjectIndex index;
+  std::set<std::pair<int,int> > backRefs; // (referred to, referrer)
   int curlayer;
 public:
   void setCurrentLayer(int layer);
@@ -63,9 +95,19 @@ public:
   void erase(drawobj *obj); // These do not check for references,
   void erase(int handle);   // so they can leave dangling references.
   objrec operator[](int handle);
+  /* operator[] returns a copy of the objrec, but the object is shared.
+   * If you change the object through it, call moved() afterwards, or the
+   * index will still have the old bounding box, and inBox and nearby may
+   * miss the object.
+   */
   std::vector<int> allHandles();
   int findHandle(drawobj *obj);
+  void addReference(int handle,int target);
   std::vector<int> referrers(int handle);
+  void moved(int handle); // Call after changing the object in place.
+  void roscat(xy tfrom,int ro,double sca,xy tto);
+  std::vector<int> inBox(double minx,double miny,double maxx,double maxy);
+  std::vector<int> nearby(xy pnt,double radius);
 };
 
 #endif
@@ -23,6 +23,12 @@
  */
 
 #include <cmath>
+#include <sstream>
+#include <algorithm>
+#include <functional>
+#include <future>
+#include <thread>
+#include <atomic>
 #include "angle.h"
 #include "globals.h"
 #include "pointlist.h"
@@ -32,9 +38,13 @@
 #include "except.h"
 #include "stl.h"
 #include "dxf.h"
+#include "binio.h"
 
 using namespace std;
 
+// Fewest items checked by one thread
+#define CHECK_BLOCK 4096
+
 criterion::criterion()
 {
   lo=hi=0;
@@ -64,6 +74,26 @@ void criterion::writeXml(ostream &ofile)
   ofile<<"\"/>"<<endl;
 }
 
+void criterion::writeBinary(ostream &ofile)
+{
+  writeustring(ofile,str);
+  writesvarint(ofile,lo);
+  writesvarint(ofile,hi);
+  writeledouble(ofile,elo);
+  writeledouble(ofile,ehi);
+  ofile.put(istopo);
+}
+
+void criterion::readBinary(istream &ifile)
+{
+  str=readustring(ifile);
+  lo=readsvarint(ifile);
+  hi=readsvarint(ifile);
+  elo=readledouble(ifile);
+  ehi=readledouble(ifile);
+  istopo=ifile.get()>0;
+}
+
 pointlist::pointlist()
 {
   initStlTable();
@@ -76,13 +106,16 @@ void pointlist::clear()
   edges.clear();
   points.clear();
   revpoints.clear();
-  triPolyLog.clear();
+  spokes.clear();
+  qinxLeaves.clear();
 }
 
 void pointlist::clearTin()
 {
   triangles.clear();
   edges.clear();
+  spokes.clear();
+  qinxLeaves.clear();
 }
 
 map<ContourLayer,int> pointlist::contourLayers()
@@ -130,199 +163,325 @@ void pointlist::clearmarks()
     e->second.clearmarks();
 }
 
-int symhash(int a,int b)
-/* symhash(a,b)=symhash(b,a). Otherwise similar to skewsym.
+struct CheckPart
+{
+  bool ok;
+  size_t count;
+  string messages;
+};
+
+bool checkInParallel(size_t n,function<bool(size_t,ostream &,size_t &)> check,bool stopEarly,size_t &count)
+/* Runs check on items 0 through n-1, split among the threads. check returns
+ * false if the item is inconsistent, writes why, and may add to count.
+ * The messages are written to cerr in order, as if it were done on one
+ * thread. If stopEarly is set, all threads stop soon after one finds
+ * something wrong, so that a bad TIN is reported quickly.
  */
 {
-  int a1,a2,b1,b2;
-  a1=a*0x69969669;
-  a2=a*PHITURN;
-  b1=b*0x69969669;
-  b2=b*PHITURN;
-  a1=((a1&0xffe00000)>>21)|(a1&0x1ff800)|((a1&0x7ff)<<21);
-  a2=((a2&0xffff0000)>>16)|((a2&0xffff)<<16);
-  b1=((b1&0xffe00000)>>21)|(b1&0x1ff800)|((b1&0x7ff)<<21);
-  b2=((b2&0xffff0000)>>16)|((b2&0xffff)<<16);
-  return (a*b1*a2)^(b*a1*b2);
+  static int cores=thread::hardware_concurrency();
+  int i,nthreads=(cores>1)?cores:1;
+  size_t lo,hi,step;
+  vector<future<CheckPart> > parts;
+  CheckPart part;
+  atomic<bool> failed(false);
+  bool ret=true;
+  step=max((size_t)CHECK_BLOCK,(n+nthreads-1)/nthreads);
+  for (lo=0;lo<n;lo=hi)
+  {
+    hi=min(n,lo+step);
+    parts.push_back(async((nthreads>1 && n>step)?launch::async:launch::deferred,[&check,&failed,stopEarly](size_t lo,size_t hi)
+	{
+	  CheckPart part;
+	  ostringstream msg;
+	  part.ok=true;
+	  part.count=0;
+	  for (;lo<hi && !(stopEarly && failed);lo++)
+	    if (!check(lo,msg,part.count))
+	    {
+	      part.ok=false;
+	      failed=true;
+	    }
+	  part.messages=msg.str();
+	  return part;
+	},lo,hi));
+  }
+  count=0;
+  for (i=0;i<parts.size();i++)
+  {
+    part=parts[i].get();
+    cerr<<part.messages;
+    ret=ret && part.ok;
+    count+=part.count;
+  }
+  return ret;
 }
 
+int pointlist::pointNumber(point *pnt)
+// Like revpoints[pnt], but doesn't insert, so it can be used by many threads.
+{
+  revptlist::iterator i=revpoints.find(pnt);
+  return (i==revpoints.end())?0:i->second;
+}
 
-bool pointlist::checkTinConsistency()
+bool pointlist::checkTinConsistency(bool stopEarly)
 {
-  bool ret=true;
-  int i,j,n,nInteriorEdges=0,nNeighborTriangles=0,turn1;
-  double a;
-  long long totturn;
+  vector<point *> pts;
+  vector<int> ptNums,edgeNums,triNums;
+  vector<edge *> edgs;
+  vector<triangle *> tris;
   ptlist::iterator p;
-  vector<int> edgebearings;
-  array<int,2> orderedEdge;
-  map<int,vector<array<int,2> > > edgeHash;
-  map<int,vector<array<int,2> > >::iterator eh;
+  map<int,edge>::iterator e;
+  map<int,triangle>::iterator t;
+  for (p=points.begin();p!=points.end();++p)
+  {
+    pts.push_back(&p->second);
+    ptNums.push_back(p->first);
+  }
+  for (e=edges.begin();e!=edges.end();++e)
+  {
+    edgs.push_back(&e->second);
+    edgeNums.push_back(e->first);
+  }
+  for (t=triangles.begin();t!=triangles.end();++t)
+  {
+    tris.push_back(&t->second);
+    triNums.push_back(t->first);
+  }
+  return checkTinArrays(pts,ptNums,edgs,edgeNums,tris,triNums,true,stopEarly);
+}
+
+bool pointlist::checkTinConsistency(vector<point *> region,bool stopEarly)
+/* Checks only the points in region, the edges around them, and the
+ * triangles on those edges, such as after changing the TIN locally. The
+ * check that the numbers of interior edges and neighbor triangles match,
+ * which needs the whole TIN, is not done. The edges are found by walking
+ * the lists through edge::next, not from the spoke array, which may be
+ * invalid after a local change; like the whole check, this changes nothing.
+ */
+{
+  vector<int> ptNums,edgeNums,triNums;
+  vector<edge *> edgs;
+  vector<triangle *> tris;
   edge *ed;
-  for (p=points.begin();p!=points.end();p++)
+  int i,n;
+  sort(region.begin(),region.end());
+  region.erase(unique(region.begin(),region.end()),region.end());
+  for (i=0;i<region.size();i++)
   {
-    ed=p->second.line;
-    if (ed==nullptr || (ed->a!=&p->second && ed->b!=&p->second))
-    {
-      ret=false;
-      cerr<<"Point "<<p->first<<" line pointer is wrong.\n";
-    }
-    edgebearings.clear();
-    do
-    {
-      if (ed)
-	ed=ed->next(&p->second);
-      if (ed)
-	edgebearings.push_back(ed->bearing(&p->second));
-    } while (ed && ed!=p->second.line && edgebearings.size()<=edges.size());
-    if (edgebearings.size()>=edges.size())
-    {
-      ret=false;
-      cerr<<"Point "<<p->first<<" next pointers do not return to line pointer.\n";
-    }
-    for (totturn=i=0;i<edgebearings.size();i++)
-    {
-      turn1=(edgebearings[(i+1)%edgebearings.size()]-edgebearings[i])&(DEG360-1);
-      totturn+=turn1;
-      if (turn1==0)
-      {
-	ret=false;
-	cerr<<"Point "<<p->first<<" has two equal bearings.\n";
-      }
-    }
-    if (totturn!=(long long)DEG360) // DEG360 is construed as positive when cast to long long
+    ptNums.push_back(pointNumber(region[i]));
+    ed=region[i]->line;
+    for (n=0;ed && (ed->a==region[i] || ed->b==region[i]) && (n==0 || ed!=region[i]->line) && n<=edges.size();n++)
     {
-      ret=false;
-      cerr<<"Point "<<p->first<<" bearings do not wind once counterclockwise.\n";
+      edgs.push_back(ed);
+      ed=ed->next(region[i]);
     }
   }
-  for (i=0;i<edges.size();i++)
+  sort(edgs.begin(),edgs.end());
+  edgs.erase(unique(edgs.begin(),edgs.end()),edgs.end());
+  for (i=0;i<edgs.size();i++)
   {
-    if (edges[i].isinterior())
-      nInteriorEdges++;
-    if ((edges[i].tria!=nullptr)+(edges[i].trib!=nullptr)!=1+edges[i].isinterior())
-    {
-      ed=&edges[i];
-      ret=false;
-      cerr<<"Edge "<<i<<" has wrong number of adjacent triangles.\n";
-      cerr<<"a "<<revpoints[ed->a]<<" b "<<revpoints[ed->b]<<endl;
-      cerr<<"tria "<<ed->tria<<" trib "<<ed->trib<<" isinterior "<<ed->isinterior()<<endl;
-    }
-    if (edges[i].tria)
+    edgeNums.push_back(-1);
+    if (edgs[i]->tria)
+      tris.push_back(edgs[i]->tria);
+    if (edgs[i]->trib)
+      tris.push_back(edgs[i]->trib);
+  }
+  sort(tris.begin(),tris.end());
+  tris.erase(unique(tris.begin(),tris.end()),tris.end());
+  triNums.resize(tris.size(),-1);
+  return checkTinArrays(region,ptNums,edgs,edgeNums,tris,triNums,false,stopEarly);
+}
+
+bool pointlist::checkTinArrays(vector<point *> &pts,vector<int> &ptNums,
+			       vector<edge *> &edgs,vector<int> &edgeNums,
+			       vector<triangle *> &tris,vector<int> &triNums,
+			       bool whole,bool stopEarly)
+/* Checks the invariants of points, edges, and triangles, each kind in
+ * parallel. Edges and triangles numbered -1 are named by their corners.
+ */
+{
+  bool ret;
+  size_t i,nInteriorEdges=0,nNeighborTriangles=0,nPointsCounted;
+  vector<array<point *,2> > sides;
+  auto edgeName=[this,&edgs,&edgeNums](size_t i)
+  {
+    if (edgeNums[i]>=0)
+      return to_string(edgeNums[i]);
+    else
+      return to_string(pointNumber(edgs[i]->a))+'-'+to_string(pointNumber(edgs[i]->b));
+  };
+  auto triName=[this,&tris,&triNums](size_t i)
+  {
+    if (triNums[i]>=0)
+      return to_string(triNums[i]);
+    else
+      return to_string(pointNumber(tris[i]->a))+'-'+to_string(pointNumber(tris[i]->b))+'-'+to_string(pointNumber(tris[i]->c));
+  };
+  ret=checkInParallel(pts.size(),[this,&pts,&ptNums](size_t i,ostream &msg,size_t &count)
     {
-      a=n=0;
-      if (edges[i].tria->a==edges[i].a || edges[i].tria->a==edges[i].b)
-        n++;
-      else
-        a+=area3(*edges[i].a,*edges[i].b,*edges[i].tria->a);
-      if (edges[i].tria->b==edges[i].a || edges[i].tria->b==edges[i].b)
-        n++;
-      else
-        a+=area3(*edges[i].a,*edges[i].b,*edges[i].tria->b);
-      if (edges[i].tria->c==edges[i].a || edges[i].tria->c==edges[i].b)
-        n++;
-      else
-        a+=area3(*edges[i].a,*edges[i].b,*edges[i].tria->c);
-      if (n!=2)
+      bool ok=true;
+      int j,turn1;
+      long long totturn;
+      vector<int> edgebearings;
+      point *pnt=pts[i];
+      edge *ed=pnt->line;
+      if (ed==nullptr || (ed->a!=pnt && ed->b!=pnt))
       {
-        ret=false;
-        cerr<<"Edge "<<i<<" triangle a does not have edge as a side.\n";
+	ok=false;
+	msg<<"Point "<<ptNums[i]<<" line pointer is wrong.\n";
       }
-      if (a>=0)
+      do
+      {
+	if (ed)
+	  ed=ed->next(pnt);
+	if (ed)
+	  edgebearings.push_back(ed->bearing(pnt));
+      } while (ed && ed!=pnt->line && edgebearings.size()<=edges.size());
+      if (edgebearings.size()>=edges.size())
       {
-        ret=false;
-        cerr<<"Edge "<<i<<" triangle a is on the wrong side.\n";
+	ok=false;
+	msg<<"Point "<<ptNums[i]<<" next pointers do not return to line pointer.\n";
       }
-    }
-    if (edges[i].trib)
-    {
-      a=n=0;
-      if (edges[i].trib->a==edges[i].a || edges[i].trib->a==edges[i].b)
-        n++;
-      else
-        a+=area3(*edges[i].a,*edges[i].b,*edges[i].trib->a);
-      if (edges[i].trib->b==edges[i].a || edges[i].trib->b==edges[i].b)
-        n++;
-      else
-        a+=area3(*edges[i].a,*edges[i].b,*edges[i].trib->b);
-      if (edges[i].trib->c==edges[i].a || edges[i].trib->c==edges[i].b)
-        n++;
-      else
-        a+=area3(*edges[i].a,*edges[i].b,*edges[i].trib->c);
-      if (n!=2)
+      for (totturn=j=0;j<edgebearings.size();j++)
       {
-        ret=false;
-        cerr<<"Edge "<<i<<" triangle b does not have edge as a side.\n";
+	turn1=(edgebearings[(j+1)%edgebearings.size()]-edgebearings[j])&(DEG360-1);
+	totturn+=turn1;
+	if (turn1==0)
+	{
+	  ok=false;
+	  msg<<"Point "<<ptNums[i]<<" has two equal bearings.\n";
+	}
       }
-      if (a<=0)
+      if (totturn!=(long long)DEG360) // DEG360 is construed as positive when cast to long long
       {
-        ret=false;
-        cerr<<"Edge "<<i<<" triangle b is on the wrong side.\n";
+	ok=false;
+	msg<<"Point "<<ptNums[i]<<" bearings do not wind once counterclockwise.\n";
       }
-    }
-  }
-  for (i=0;i<triangles.size();i++)
+      return ok;
+    },stopEarly,nPointsCounted);
+  if (whole && spokes.valid() && !spokes.matches(*this))
   {
-    if (triangles[i].aneigh)
-    {
-      nNeighborTriangles++;
-      if ( triangles[i].aneigh->iscorner(triangles[i].a) ||
-          !triangles[i].aneigh->iscorner(triangles[i].b) ||
-          !triangles[i].aneigh->iscorner(triangles[i].c))
+    ret=false;
+    cerr<<"Spoke arrays do not match the edges around the points.\n";
+  }
+  if (ret || !stopEarly)
+    ret=checkInParallel(edgs.size(),[this,&edgs,&edgeName](size_t i,ostream &msg,size_t &count)
       {
-        ret=false;
-        cerr<<"Triangle "<<i<<" neighbor a is wrong.\n";
-      }
-    }
-    if (triangles[i].bneigh)
-    {
-      nNeighborTriangles++;
-      if (!triangles[i].bneigh->iscorner(triangles[i].a) ||
-           triangles[i].bneigh->iscorner(triangles[i].b) ||
-          !triangles[i].bneigh->iscorner(triangles[i].c))
+	bool ok=true;
+	int n,side;
+	double a;
+	edge *ed=edgs[i];
+	triangle *tri;
+	if (ed->isinterior())
+	  count++;
+	if ((ed->tria!=nullptr)+(ed->trib!=nullptr)!=1+ed->isinterior())
+	{
+	  ok=false;
+	  msg<<"Edge "<<edgeName(i)<<" has wrong number of adjacent triangles.\n";
+	  msg<<"a "<<pointNumber(ed->a)<<" b "<<pointNumber(ed->b)<<endl;
+	  msg<<"tria "<<ed->tria<<" trib "<<ed->trib<<" isinterior "<<ed->isinterior()<<endl;
+	}
+	for (side=0;side<2;side++)
+	{
+	  tri=side?ed->trib:ed->tria;
+	  if (!tri)
+	    continue;
+	  a=n=0;
+	  if (tri->a==ed->a || tri->a==ed->b)
+	    n++;
+	  else
+	    a+=area3(*ed->a,*ed->b,*tri->a);
+	  if (tri->b==ed->a || tri->b==ed->b)
+	    n++;
+	  else
+	    a+=area3(*ed->a,*ed->b,*tri->b);
+	  if (tri->c==ed->a || tri->c==ed->b)
+	    n++;
+	  else
+	    a+=area3(*ed->a,*ed->b,*tri->c);
+	  if (n!=2)
+	  {
+	    ok=false;
+	    msg<<"Edge "<<edgeName(i)<<" triangle "<<(side?'b':'a')<<" does not have edge as a side.\n";
+	  }
+	  if (side?(a<=0):(a>=0))
+	  {
+	    ok=false;
+	    msg<<"Edge "<<edgeName(i)<<" triangle "<<(side?'b':'a')<<" is on the wrong side.\n";
+	  }
+	}
+	return ok;
+      },stopEarly,nInteriorEdges) && ret;
+  if (ret || !stopEarly)
+    ret=checkInParallel(tris.size(),[&tris,&triName](size_t i,ostream &msg,size_t &count)
       {
-        ret=false;
-        cerr<<"Triangle "<<i<<" neighbor b is wrong.\n";
-      }
-    }
-    if (triangles[i].cneigh)
+	bool ok=true;
+	triangle *tri=tris[i];
+	if (tri->aneigh)
+	{
+	  count++;
+	  if ( tri->aneigh->iscorner(tri->a) ||
+	      !tri->aneigh->iscorner(tri->b) ||
+	      !tri->aneigh->iscorner(tri->c))
+	  {
+	    ok=false;
+	    msg<<"Triangle "<<triName(i)<<" neighbor a is wrong.\n";
+	  }
+	}
+	if (tri->bneigh)
+	{
+	  count++;
+	  if (!tri->bneigh->iscorner(tri->a) ||
+	       tri->bneigh->iscorner(tri->b) ||
+	      !tri->bneigh->iscorner(tri->c))
+	  {
+	    ok=false;
+	    msg<<"Triangle "<<triName(i)<<" neighbor b is wrong.\n";
+	  }
+	}
+	if (tri->cneigh)
+	{
+	  count++;
+	  if (!tri->cneigh->iscorner(tri->a) ||
+	      !tri->cneigh->iscorner(tri->b) ||
+	       tri->cneigh->iscorner(tri->c))
+	  {
+	    ok=false;
+	    msg<<"Triangle "<<triName(i)<<" neighbor c is wrong.\n";
+	  }
+	}
+	return ok;
+      },stopEarly,nNeighborTriangles) && ret;
+  /* Checks whether two triangles share an edge in the same direction, by
+   * sorting the sides of all triangles.
+   * This is less stringent than the edge check in readPtin, which requires
+   * that another triangle have the same edge in the opposite direction,
+   * unless the edge is in the convex hull.
+   * It is possible for this to fail even if the rest of checkTinConsistency passes.
+   * For example, arrange points 1-8 counterclockwise and make these triangles:
+   * (1 2 3), (1 2 4), (1 4 5), (1 5 6), (1 6 7), (1 7 8).
+   */
+  if (ret || !stopEarly)
+  {
+    sides.resize(3*tris.size());
+    for (i=0;i<tris.size();i++)
     {
-      nNeighborTriangles++;
-      if (!triangles[i].cneigh->iscorner(triangles[i].a) ||
-          !triangles[i].cneigh->iscorner(triangles[i].b) ||
-           triangles[i].cneigh->iscorner(triangles[i].c))
+      sides[3*i][0]=tris[i]->a;
+      sides[3*i][1]=tris[i]->b;
+      sides[3*i+1][0]=tris[i]->b;
+      sides[3*i+1][1]=tris[i]->c;
+      sides[3*i+2][0]=tris[i]->c;
+      sides[3*i+2][1]=tris[i]->a;
+    }
+    sort(sides.begin(),sides.end());
+    for (i=1;i<sides.size();i++)
+      if (sides[i]==sides[i-1])
       {
-        ret=false;
-        cerr<<"Triangle "<<i<<" neighbor c is wrong.\n";
+	ret=false;
+	cerr<<"Two triangles have edge "<<pointNumber(sides[i][0])<<"->"<<pointNumber(sides[i][1])<<" in common.\n";
       }
-    }
-    /* Checks whether two triangles share an edge in the same direction.
-     * This is less stringent than the edge check in readPtin, which requires
-     * that another triangle have the same edge in the opposite direction,
-     * unless the edge is in the convex hull.
-     * It is possible for this to fail even if the rest of checkTinConsistency passes.
-     * For example, arrange points 1-8 counterclockwise and make these triangles:
-     * (1 2 3), (1 2 4), (1 4 5), (1 5 6), (1 6 7), (1 7 8).
-     */
-    orderedEdge[0]=revpoints[triangles[i].a];
-    orderedEdge[1]=revpoints[triangles[i].b];
-    edgeHash[symhash(orderedEdge[0],orderedEdge[1])].push_back(orderedEdge);
-    orderedEdge[0]=revpoints[triangles[i].b];
-    orderedEdge[1]=revpoints[triangles[i].c];
-    edgeHash[symhash(orderedEdge[0],orderedEdge[1])].push_back(orderedEdge);
-    orderedEdge[0]=revpoints[triangles[i].c];
-    orderedEdge[1]=revpoints[triangles[i].a];
-    edgeHash[symhash(orderedEdge[0],orderedEdge[1])].push_back(orderedEdge);
   }
-  for (eh=edgeHash.begin();eh!=edgeHash.end();eh++)
-    for (i=1;i<eh->second.size();i++)
-      for (j=0;j<i;j++)
-	if (eh->second[i][0]==eh->second[j][0] && eh->second[i][1]==eh->second[j][1])
-	{
-	  ret=false;
-	  cerr<<"Two triangles have edge "<<eh->second[i][0]<<"->"<<eh->second[i][1]<<" in common.\n";
-	}
-  if (nInteriorEdges*2!=nNeighborTriangles)
+  if (whole && (ret || !stopEarly) && nInteriorEdges*2!=nNeighborTriangles)
   {
     ret=false;
     cerr<<"Interior edges and neighbor triangles don't match.\n";
@@ -361,16 +520,6 @@ bool pointlist::shouldWrite(int n,int flags,bool contours)
   return true;
 }
 
-void pointlist::logTriPoly(vector<point *> loop,int a,int b,int c)
-{
-  TriPolyLogEntry entry;
-  entry.loop=loop;
-  entry.tri[0]=a;
-  entry.tri[1]=b;
-  entry.tri[2]=c;
-  triPolyLog.push_back(entry);
-}
-
 int1loop pointlist::toInt1loop(vector<point *> ptrLoop)
 {
   int i;
@@ -504,6 +653,7 @@ void pointlist::addpoint(int numb,point pnt,bool overwrite)
  else
     points[a=numb]=pnt;
  revpoints[&(points[a])]=a;
+ spokes.clear();
  }
 
 int pointlist::addtriangle(int n)
@@ -523,6 +673,7 @@ void pointlist::makeqindex()
   vector<xy> plist;
   ptlist::iterator i;
   qinx.clear();
+  qinxLeaves.clear();
   for (i=points.begin();i!=points.end();i++)
     plist.push_back(i->second);
   qinx.sizefit(plist);
@@ -537,6 +688,7 @@ void pointlist::updateqindex()
  * some edges.
  */
 {
+  qinxLeaves.clear();
   if (triangles.size())
     qinx.settri(&triangles[0]);
 }
@@ -658,7 +810,7 @@ bool pointlist::join2break0()
 
 void pointlist::joinBreaklines()
 {
-  while (join2break0());
+  type0Breaklines=stitchBreaklines(type0Breaklines);
 }
 
 void pointlist::edgesToBreaklines()
@@ -755,8 +907,8 @@ void pointlist::setLocalSets(xy pnt,double radius)
   set<point *>::iterator i;
   set<edge *>::iterator j;
   set<triangle *>::iterator k;
-  int n;
-  vector<edge *> pointEdges;
+  edge *ed;
+  int n,r;
   set<triangle *> addenda;
   localTriangles.clear();
   localEdges.clear();
@@ -791,12 +943,25 @@ void pointlist::setLocalSets(xy pnt,double radius)
       localPoints.insert((*k)->b);
       localPoints.insert((*k)->c);
     }
+    /* The spoke array is only read here. If it is invalid, walk the lists
+     * through edge::next, which are always right, instead of building it.
+     */
     for (i=localPoints.begin();i!=localPoints.end();++i)
-    {
-      pointEdges=(*i)->incidentEdges();
-      for (n=0;n<pointEdges.size();n++)
-	localEdges.insert(pointEdges[n]);
-    }
+      if (spokes.valid())
+      {
+	r=spokes.row(*i);
+	for (n=0;r>=0 && n<spokes.degree(r);n++)
+	  localEdges.insert(spokes.spoke(r,n));
+      }
+      else
+      {
+	ed=(*i)->line;
+	for (n=0;ed && (n==0 || ed!=(*i)->line) && n<=edges.size();n++)
+	{
+	  localEdges.insert(ed);
+	  ed=ed->next(*i);
+	}
+      }
     for (j=localEdges.begin();j!=localEdges.end();++j)
     { // localTriangles() usually doesn't find all triangles, and may even miss a point.
       if ((*j)->tria)
@@ -29,6 +29,7 @@
 #include <vector>
 #include <array>
 #include <set>
+#include <unordered_map>
 #include "point.h"
 #include "tin.h"
 #include "bezier.h"
@@ -36,6 +37,8 @@
 #include "polyline.h"
 #include "contour.h"
 #include "breakline.h"
+#include "segindex.h"
+#include "spokes.h"
 #include "intloop.h"
 
 #ifdef _MSC_VER
@@ -56,6 +59,8 @@ public:
   double elo,ehi; // elevation range
   bool istopo;
   void writeXml(std::ostream &ofile);
+  void writeBinary(std::ostream &ofile);
+  void readBinary(std::istream &ifile);
 };
 
 typedef std::vector<criterion> criteria;
@@ -63,16 +68,11 @@ typedef std::vector<criterion> criteria;
  * is included in the topo. If none matches, it is not included.
  */
 
-struct TriPolyLogEntry
-{
-  std::vector<point *> loop;
-  std::array<int,3> tri; // indices to loop
-};
-
 class pointlist
 {
 private:
   std::vector<segment> break0;
+  SegmentIndex break0Index;
 public:
   ptlist points;
   revptlist revpoints;
@@ -101,7 +101,9 @@ public:
    * 3: both are valid (you just made a TIN, or you just saved breaklines to a file).
    */
   qindex qinx;
-  std::vector<TriPolyLogEntry> triPolyLog;
+  std::unordered_multimap<triangle *,qindex *> qinxLeaves;
+  // Leaves of qinx by triangle, filled in by the first local edit.
+  SpokeArray spokes;
   pointlist();
   void addpoint(int numb,point pnt,bool overwrite=false);
   int addtriangle(int n=1);
@@ -112,10 +114,11 @@ public:
   void clearmarks();
   void clearTin();
   std::map<ContourLayer,int> contourLayers();
-  bool checkTinConsistency();
+  int pointNumber(point *pnt);
+  bool checkTinConsistency(bool stopEarly=false);
+  bool checkTinConsistency(std::vector<point *> region,bool stopEarly=false);
   bool checkFlower();
   bool shouldWrite(int n,int flags,bool contours);
-  void logTriPoly(std::vector<point *> loop,int a,int b,int c);
   int1loop toInt1loop(std::vector<point *> ptrLoop);
   std::vector<point *> fromInt1loop(int1loop intLoop);
   intloop boundary();
@@ -138,27 +141,42 @@ public:
   virtual void writeXml(std::ofstream &ofile);
   // the following methods are in tin.cpp
 private:
+  bool checkTinArrays(std::vector<point *> &pts,std::vector<int> &ptNums,
+		      std::vector<edge *> &edgs,std::vector<int> &edgeNums,
+		      std::vector<triangle *> &tris,std::vector<int> &triNums,
+		      bool whole,bool stopEarly);
   void dumpedges();
   void dumpnext_ps(PostScript &ps);
+  edge *newEdge(point *a,point *b);
+  std::vector<point *> legalize(std::vector<edge *> suspects);
+  void removeDead(std::vector<edge *> deadEdges,std::vector<triangle *> deadTris,triangle *heir);
 public:
   void dumpedges_ps(PostScript &ps,bool colorfibaster);
   void dumptriangles();
   void splitBreaklines();
   int checkBreak0(edge &e);
   bool shouldFlip(edge &e);
+  void forceBreaklines();
   bool tryStartPoint(PostScript &ps,xy &startpnt);
   int1loop convexHull();
   int flipPass(PostScript &ps,bool colorfibaster);
-  void maketin(std::string filename="",bool colorfibaster=false);
+  void maketin(std::string filename="",bool colorfibaster=false,bool constrained=false);
   void makegrad(double corr);
   void maketriangles();
   void makeqindex();
   void updateqindex();
   void makeBareTriangles(std::vector<std::array<xyz,3> > bareTriangles);
   void triangulatePolygon(std::vector<point *> poly);
+  edge *findEdge(point *pnt,point *other);
   void makeEdges();
+  void makeEdgesBulk();
   void deleteOrphanPoints();
-  void fillInBareTin();
+  void fillInBareTin(std::string filename="");
+  std::vector<point *> insertPoint(int numb,point pnt);
+  std::vector<point *> deletePoint(int numb);
+  std::vector<point *> movePoint(int numb,xyz newPlace);
+  void retouch(std::vector<point *> changed,double corr);
+  std::vector<int> contoursNear(std::vector<point *> changed);
   double totalEdgeLength();
   double elevation(xy location);
   double dirbound(int angle);
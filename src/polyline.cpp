@@ -37,6 +37,8 @@
 #include "relprime.h"
 #include "ldecimal.h"
 #include "manyarc.h"
+#include "binio.h"
+#include "except.h"
 using namespace std;
 int bendlimit=DEG180;
 
@@ -740,6 +742,55 @@ double polyarc::closest(xy topoint,bool offends)
   return ret;
 }
 
+double polyarc::closestNear(xy topoint,int &whichArc)
+/* Like closest, but first walks from whichArc to neighboring arcs as long
+ * as they are closer. This usually finds the closest arc at once, so the
+ * bounding circles of nearly all the other arcs show them to be too far.
+ * All arcs are still checked, since the walk can stop at an arc that is
+ * closer than its neighbors but not the closest. If whichArc is not an arc,
+ * all arcs are searched as in closest. whichArc is set to the closest arc.
+ */
+{
+  int i,k,sz=lengths.size();
+  double alo,segclose,closesofar=INFINITY,ret=0;
+  int walked=-2;
+  arc si;
+  while (whichArc>=0 && whichArc<sz)
+  {
+    walked=whichArc;
+    for (k=whichArc-1;k<=whichArc+1;k++)
+      if (k>=0 && k<sz && (k!=walked || closesofar==INFINITY))
+      {
+	si=getarc(k);
+	alo=si.closest(topoint,closesofar,true);
+	segclose=dist(si.station(alo),topoint);
+	if (segclose<closesofar)
+	{
+	  closesofar=segclose;
+	  ret=alo+(cumLengths[k]-lengths[k]);
+	  walked=k;
+	}
+      }
+    if (walked==whichArc)
+      break;
+    whichArc=walked;
+  }
+  for (i=0;i<sz;i++)
+    if (abs(i-walked)>1 && dist(boundCircles[i].center,topoint)-boundCircles[i].radius<closesofar)
+    {
+      si=getarc(i);
+      alo=si.closest(topoint,closesofar,true);
+      segclose=dist(si.station(alo),topoint);
+      if (segclose<closesofar)
+      {
+	closesofar=segclose;
+	ret=alo+(cumLengths[i]-lengths[i]);
+	whichArc=i;
+      }
+    }
+  return ret;
+}
+
 double polyspiral::closest(xy topoint,bool offends)
 {
   int i,n,step,sz;
@@ -1198,6 +1249,151 @@ void polyspiral::writeXml(ofstream &ofile)
   ofile<<"</delta2s></polyspiral>"<<endl;
 }
 
+void writeBinaryVector(ostream &ofile,vector<double> &v)
+{
+  int i;
+  writeuvarint(ofile,v.size());
+  for (i=0;i<v.size();i++)
+    writeledouble(ofile,v[i]);
+}
+
+void writeBinaryVector(ostream &ofile,vector<int> &v)
+{
+  int i;
+  writeuvarint(ofile,v.size());
+  for (i=0;i<v.size();i++)
+    writesvarint(ofile,v[i]);
+}
+
+void writeBinaryVector(ostream &ofile,vector<xy> &v)
+{
+  int i;
+  writeuvarint(ofile,v.size());
+  for (i=0;i<v.size();i++)
+  {
+    writeledouble(ofile,v[i].getx());
+    writeledouble(ofile,v[i].gety());
+  }
+}
+
+size_t readBinarySize(istream &ifile)
+/* Reads the size of a vector. If the file is truncated or the size is
+ * absurd, throws, rather than trying to allocate the memory.
+ */
+{
+  unsigned long long n=readuvarint(ifile);
+  if (!ifile.good() || n>fileSize(ifile))
+    throw BeziExcept(badData);
+  return n;
+}
+
+void readBinaryVector(istream &ifile,vector<double> &v)
+{
+  size_t i;
+  v.resize(readBinarySize(ifile));
+  for (i=0;i<v.size();i++)
+    v[i]=readledouble(ifile);
+}
+
+void readBinaryVector(istream &ifile,vector<int> &v)
+{
+  size_t i;
+  v.resize(readBinarySize(ifile));
+  for (i=0;i<v.size();i++)
+    v[i]=readsvarint(ifile);
+}
+
+void readBinaryVector(istream &ifile,vector<xy> &v)
+{
+  size_t i;
+  double x;
+  v.resize(readBinarySize(ifile));
+  for (i=0;i<v.size();i++)
+  {
+    x=readledouble(ifile);
+    v[i]=xy(x,readledouble(ifile));
+  }
+}
+
+void polyline::writeBinary(ostream &ofile)
+/* Writes everything, including the lengths and bounding circles, so that
+ * reading it back gives the same polyline without recomputing anything.
+ */
+{
+  int i;
+  writeledouble(ofile,elevation);
+  writeBinaryVector(ofile,endpoints);
+  writeBinaryVector(ofile,lengths);
+  writeBinaryVector(ofile,cumLengths);
+  writeuvarint(ofile,boundCircles.size());
+  for (i=0;i<boundCircles.size();i++)
+  {
+    writeledouble(ofile,boundCircles[i].center.getx());
+    writeledouble(ofile,boundCircles[i].center.gety());
+    writeledouble(ofile,boundCircles[i].radius);
+  }
+}
+
+void polyline::readBinary(istream &ifile)
+{
+  size_t i;
+  double x,y;
+  elevation=readledouble(ifile);
+  readBinaryVector(ifile,endpoints);
+  readBinaryVector(ifile,lengths);
+  readBinaryVector(ifile,cumLengths);
+  boundCircles.resize(readBinarySize(ifile));
+  for (i=0;i<boundCircles.size();i++)
+  {
+    x=readledouble(ifile);
+    y=readledouble(ifile);
+    boundCircles[i].center=xy(x,y);
+    boundCircles[i].radius=readledouble(ifile);
+  }
+  if (!ifile.good())
+    throw BeziExcept(badData);
+}
+
+void polyarc::writeBinary(ostream &ofile)
+{
+  polyline::writeBinary(ofile);
+  writeBinaryVector(ofile,deltas);
+}
+
+void polyarc::readBinary(istream &ifile)
+{
+  polyline::readBinary(ifile);
+  readBinaryVector(ifile,deltas);
+  if (!ifile.good())
+    throw BeziExcept(badData);
+}
+
+void polyspiral::writeBinary(ostream &ofile)
+{
+  polyarc::writeBinary(ofile);
+  writeBinaryVector(ofile,bearings);
+  writeBinaryVector(ofile,delta2s);
+  writeBinaryVector(ofile,midbearings);
+  writeBinaryVector(ofile,midpoints);
+  writeBinaryVector(ofile,clothances);
+  writeBinaryVector(ofile,curvatures);
+  ofile.put(curvy);
+}
+
+void polyspiral::readBinary(istream &ifile)
+{
+  polyarc::readBinary(ifile);
+  readBinaryVector(ifile,bearings);
+  readBinaryVector(ifile,delta2s);
+  readBinaryVector(ifile,midbearings);
+  readBinaryVector(ifile,midpoints);
+  readBinaryVector(ifile,clothances);
+  readBinaryVector(ifile,curvatures);
+  curvy=ifile.get()>0;
+  if (!ifile.good())
+    throw BeziExcept(badData);
+}
+
 int alignment::type()
 {
   return OBJ_ALIGNMENT;
@@ -90,6 +90,8 @@ public:
   virtual double dirbound(int angle,double boundsofar=INFINITY);
   virtual bool hasProperty(int prop);
   virtual void writeXml(std::ofstream &ofile);
+  virtual void writeBinary(std::ostream &ofile);
+  virtual void readBinary(std::istream &ifile);
   virtual void _roscat(xy tfrom,int ro,double sca,xy cis,xy tto);
 };
 
@@ -116,9 +118,12 @@ public:
   virtual xyz station(double along);
   virtual int bearing(double along);
   virtual double closest(xy topoint,bool offends=false);
+  double closestNear(xy topoint,int &whichArc);
   virtual double area();
   virtual double dirbound(int angle,double boundsofar=INFINITY);
   virtual void writeXml(std::ofstream &ofile);
+  virtual void writeBinary(std::ostream &ofile);
+  virtual void readBinary(std::istream &ifile);
 };
 
 class polyspiral: public polyarc
@@ -155,6 +160,8 @@ public:
   virtual double area();
   virtual double dirbound(int angle,double boundsofar=INFINITY);
   virtual void writeXml(std::ofstream &ofile);
+  virtual void writeBinary(std::ostream &ofile);
+  virtual void readBinary(std::istream &ifile);
   virtual void _roscat(xy tfrom,int ro,double sca,xy cis,xy tto);
 };
 
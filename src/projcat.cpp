@@ -0,0 +1,63 @@
+/******************************************************/
+/*                                                    */
+/* projcat.cpp - compile the projection catalog      */
+/*                                                    */
+/******************************************************/
+/* Copyright 2026 Pierre Abbat.
+ * This file is part of Bezitopo.
+ *
+ * Bezitopo is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * Bezitopo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License and Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * and Lesser General Public License along with Bezitopo. If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+/* Reads projections.txt and writes projections.cat, which has the labels
+ * and boundary caps precomputed, so that programs can find the projections
+ * they need without parsing every definition.
+ *
+ * Usage: projcat [projections.txt [projections.cat]]
+ */
+#include <iostream>
+#include "config.h"
+#include "projection.h"
+#include "ellipsoid.h"
+
+using namespace std;
+
+int main(int argc, char *argv[])
+{
+  string inName("projections.txt"),outName("projections.cat");
+  ProjectionList plist;
+  if (argc>1)
+    inName=argv[1];
+  if (argc>2)
+    outName=argv[2];
+  ifstream pfile(inName);
+  if (!pfile)
+  {
+    cerr<<"Can't open "<<inName<<endl;
+    return 1;
+  }
+  readTmCoefficients();
+  plist.readFile(pfile);
+  ofstream pcat(outName,ios::binary);
+  plist.writeCatalog(pcat);
+  pcat.close();
+  if (!pcat)
+  {
+    cerr<<"Can't write "<<outName<<endl;
+    return 1;
+  }
+  cout<<plist.size()<<" projections read from "<<inName<<endl;
+  return 0;
+}
@@ -24,7 +24,9 @@
 #include <cmath>
 #include <iostream>
 #include <set>
+#include <sstream>
 #include "projection.h"
+#include "binio.h"
 #include "rootfind.h"
 #include "ldecimal.h"
 
@@ -74,6 +76,10 @@ Projection::Projection()
   scale=1;
 }
 
+Projection::~Projection()
+{
+}
+
 void Projection::setBoundary(g1boundary boundary)
 {
   flatBdy=flatten(boundary);
@@ -1047,7 +1053,10 @@ g1boundary parseBoundary(string bdy)
   return ret;
 }
 
-Projection *readProjection(istream &file)
+Projection *readProjection(istream &file,bool withBoundary)
+/* If withBoundary is false, the boundary is skipped, which saves flattening
+ * it when all that's wanted is to know whether the definition is good.
+ */
 {
   int fieldsSeen=0,projectionType=0;
   size_t hashpos,colonpos;
@@ -1117,7 +1126,8 @@ Projection *readProjection(istream &file)
 	value=line.substr(colonpos+1);
 	if (ret && tag=="Boundary")
 	{
-	  ret->setBoundary(parseBoundary(value));
+	  if (withBoundary)
+	    ret->setBoundary(parseBoundary(value));
 	  fieldsSeen|=1;
 	}
 	else if (ret && tag=="Foot")
@@ -1131,29 +1141,146 @@ Projection *readProjection(istream &file)
   return ret;
 }
 
+string readProjectionText(istream &file)
+/* Reads the definition of a projection, from the Projection: line to the
+ * blank line after it, without parsing it. Backslash continuations are
+ * joined, so each line of the result is one tag and value.
+ */
+{
+  string line,ret;
+  while (file.good())
+  {
+    line=getLineBackslash(file);
+    if (line=="" || line[0]=='#')
+      break;
+    ret+=line+'\n';
+  }
+  return ret;
+}
+
+ProjectionEntry::ProjectionEntry()
+{
+  capCenter=xyz(0,0,0);
+  capCos=-2;
+}
+
+void ProjectionEntry::setCap(g1boundary boundary)
+/* Computes a cap containing the boundary. A cap smaller than a hemisphere
+ * is convex, so if it contains all the vertices, it contains the geodesics
+ * between them. The inside of the boundary is then either inside the cap or
+ * contains everything outside it; the gnomonic projection about the center of
+ * the cap, which maps geodesics to straight lines, tells which.
+ */
+{
+  int i;
+  vector<xyz> corners;
+  xyz sum(0,0,0),across,up;
+  vector<double> xs,ys;
+  double minCos=1,area;
+  for (i=0;i<boundary.size();i++)
+  {
+    corners.push_back(decodedir(boundary[i]));
+    corners.back().normalize();
+    sum+=corners.back();
+  }
+  capCos=-2;
+  if (corners.size()>2 && sum.length()>0)
+  {
+    capCenter=sum/sum.length();
+    for (i=0;i<corners.size();i++)
+      if (dot(corners[i],capCenter)<minCos)
+	minCos=dot(corners[i],capCenter);
+    across=cross(capCenter,xyz(0,0,1));
+    if (across.length()<0.5)
+      across=cross(capCenter,xyz(1,0,0));
+    across.normalize();
+    up=cross(capCenter,across);
+    for (i=0;i<corners.size();i++)
+    {
+      xs.push_back(dot(corners[i],across)/dot(corners[i],capCenter));
+      ys.push_back(dot(corners[i],up)/dot(corners[i],capCenter));
+    }
+    for (area=i=0;i<corners.size();i++)
+      area+=xs[i]*ys[(i+1)%corners.size()]-ys[i]*xs[(i+1)%corners.size()];
+    if (minCos>0.1 && area>0)
+      capCos=minCos-1e-9;
+  }
+}
+
+bool ProjectionEntry::mayContain(xyz geoc)
+{
+  return capCos<-1 || dot(geoc,capCenter)>=capCos*geoc.length();
+}
+
+bool validDefinition(string definition)
+// Returns true if a projection can be constructed from the definition.
+{
+  istringstream defStream(definition);
+  shared_ptr<Projection> proj(readProjection(defStream,false));
+  return (bool)proj;
+}
+
+Projection *ProjectionEntry::get()
+{
+  if (!proj && definition.length())
+  {
+    istringstream defStream(definition);
+    proj=shared_ptr<Projection>(readProjection(defStream));
+  }
+  return proj.get();
+}
+
 void ProjectionList::insert(ProjectionLabel label,Projection *proj)
 /* Takes ownership of proj. Do not delete proj; the ProjectionList will delete
  * it when the last ProjectionList containing it is destroyed.
  */
 {
-  projList[label]=shared_ptr<Projection>(proj);
+  shared_ptr<ProjectionEntry> entry(new ProjectionEntry);
+  entry->proj=shared_ptr<Projection>(proj);
+  entry->setCap(proj->getBoundary());
+  projList[label]=entry;
+}
+
+bool ProjectionList::insert(ProjectionLabel label,string definition)
+/* Inserts a projection which will be constructed from its definition
+ * when it is first asked for. If the definition is bad, inserts nothing
+ * and returns false, so that every projection in the list can be
+ * constructed.
+ */
+{
+  shared_ptr<ProjectionEntry> entry(new ProjectionEntry);
+  istringstream defStream(definition);
+  string line;
+  size_t colonpos;
+  if (!validDefinition(definition))
+    return false;
+  entry->definition=definition;
+  while (defStream.good())
+  {
+    getline(defStream,line);
+    colonpos=line.find(':');
+    if (colonpos<line.length() && line.substr(0,colonpos)=="Boundary")
+      entry->setCap(parseBoundary(line.substr(colonpos+1)));
+  }
+  projList[label]=entry;
+  return true;
 }
 
 Projection *ProjectionList::operator[](int n)
 {
   Projection *ret=nullptr;
-  map<ProjectionLabel,shared_ptr<Projection> >::iterator i;
+  map<ProjectionLabel,shared_ptr<ProjectionEntry> >::iterator i;
   int j;
   for (i=projList.begin(),j=0;i!=projList.end();i++,j++)
     if (j==n)
-      ret=i->second.get();
+      ret=i->second->get();
   return ret;
 }
 
 ProjectionLabel ProjectionList::nthLabel(int n)
 {
   ProjectionLabel ret;
-  map<ProjectionLabel,shared_ptr<Projection> >::iterator i;
+  map<ProjectionLabel,shared_ptr<ProjectionEntry> >::iterator i;
   int j;
   for (i=projList.begin(),j=0;i!=projList.end();i++,j++)
     if (j==n)
@@ -1164,7 +1291,7 @@ ProjectionLabel ProjectionList::nthLabel(int n)
 ProjectionList ProjectionList::matches(ProjectionLabel pattern)
 {
   ProjectionList ret;
-  map<ProjectionLabel,shared_ptr<Projection> >::iterator i;
+  map<ProjectionLabel,shared_ptr<ProjectionEntry> >::iterator i;
   for (i=projList.begin();i!=projList.end();i++)
     if (pattern.match(i->first))
       ret.projList[i->first]=i->second;
@@ -1175,9 +1302,10 @@ ProjectionList ProjectionList::cover(latlong ll)
 // Returns a list of projections whose boundaries contain the given point.
 {
   ProjectionList ret;
-  map<ProjectionLabel,shared_ptr<Projection> >::iterator i;
+  xyz geoc=Sphere.geoc(ll,0);
+  map<ProjectionLabel,shared_ptr<ProjectionEntry> >::iterator i;
   for (i=projList.begin();i!=projList.end();i++)
-    if (i->second->in(ll))
+    if (i->second->mayContain(geoc) && i->second->get() && i->second->get()->in(ll))
       ret.projList[i->first]=i->second;
   return ret;
 }
@@ -1185,9 +1313,10 @@ ProjectionList ProjectionList::cover(latlong ll)
 ProjectionList ProjectionList::cover(vball v)
 {
   ProjectionList ret;
-  map<ProjectionLabel,shared_ptr<Projection> >::iterator i;
+  xyz geoc=decodedir(v);
+  map<ProjectionLabel,shared_ptr<ProjectionEntry> >::iterator i;
   for (i=projList.begin();i!=projList.end();i++)
-    if (i->second->in(v))
+    if ((v.face==0 || i->second->mayContain(geoc)) && i->second->get() && i->second->get()->in(v))
       ret.projList[i->first]=i->second;
   return ret;
 }
@@ -1195,16 +1324,95 @@ ProjectionList ProjectionList::cover(vball v)
 void ProjectionList::readFile(istream &file)
 {
   ProjectionLabel label;
-  Projection *proj;
+  string definition;
   while (file.good())
   {
     label=readProjectionLabel(file);
-    proj=readProjection(file);
-    if (proj)
-      insert(label,proj);
+    definition=readProjectionText(file);
+    if (definition.length())
+      insert(label,definition);
   }
 }
 
+/* Format of the projection catalog:
+ * "ProjCatalog" null-terminated
+ * 2 bytes version, 0
+ * geint number of projections
+ * For each projection:
+ * country, province, zone, and version, null-terminated
+ * 8 bytes each x, y, and z of the cap center, and cosine of cap radius
+ * definition, null-terminated
+ * All numbers are big-endian. Projections inserted as objects have no
+ * definition and are left out. Those inserted as definitions were checked
+ * when inserted, and reading the catalog checks them again.
+ */
+
+void ProjectionList::writeCatalog(ostream &file)
+{
+  map<ProjectionLabel,shared_ptr<ProjectionEntry> >::iterator i;
+  vector<map<ProjectionLabel,shared_ptr<ProjectionEntry> >::iterator> good;
+  int j;
+  for (i=projList.begin();i!=projList.end();i++)
+    if (i->second->definition.length())
+      good.push_back(i);
+  writeustring(file,"ProjCatalog");
+  writebeshort(file,0);
+  writegeint(file,good.size());
+  for (j=0;j<good.size();j++)
+  {
+    writeustring(file,good[j]->first.country);
+    writeustring(file,good[j]->first.province);
+    writeustring(file,good[j]->first.zone);
+    writeustring(file,good[j]->first.version);
+    writebedouble(file,good[j]->second->capCenter.getx());
+    writebedouble(file,good[j]->second->capCenter.gety());
+    writebedouble(file,good[j]->second->capCenter.getz());
+    writebedouble(file,good[j]->second->capCos);
+    writeustring(file,good[j]->second->definition);
+  }
+}
+
+bool ProjectionList::readCatalog(istream &file)
+/* Returns false if the file isn't a projection catalog. The labels and caps
+ * are read now; the projections are constructed when they're needed.
+ * Entries whose definitions are bad are skipped.
+ */
+{
+  int i,n;
+  double x,y,z;
+  ProjectionLabel label;
+  shared_ptr<ProjectionEntry> entry;
+  if (!file.good() || readustring(file)!="ProjCatalog" || readbeshort(file)!=0)
+    return false;
+  n=readgeint(file);
+  for (i=0;i<n && file.good();i++)
+  {
+    entry=shared_ptr<ProjectionEntry>(new ProjectionEntry);
+    label.country=readustring(file);
+    label.province=readustring(file);
+    label.zone=readustring(file);
+    label.version=readustring(file);
+    x=readbedouble(file);
+    y=readbedouble(file);
+    z=readbedouble(file);
+    entry->capCenter=xyz(x,y,z);
+    entry->capCos=readbedouble(file);
+    entry->definition=readustring(file);
+    if (file.good() && validDefinition(entry->definition))
+      projList[label]=entry;
+  }
+  return file.good();
+}
+
+int ProjectionList::countConstructed()
+{
+  map<ProjectionLabel,shared_ptr<ProjectionEntry> >::iterator i;
+  int ret=0;
+  for (i=projList.begin();i!=projList.end();i++)
+    ret+=(bool)i->second->proj;
+  return ret;
+}
+
 vector<string> setToVector(set<string> s)
 {
   set<string>::iterator i;
@@ -1216,7 +1424,7 @@ vector<string> setToVector(set<string> s)
 
 vector<string> ProjectionList::listCountries()
 {
-  map<ProjectionLabel,shared_ptr<Projection> >::iterator i;
+  map<ProjectionLabel,shared_ptr<ProjectionEntry> >::iterator i;
   set<string> ret;
   for (i=projList.begin();i!=projList.end();i++)
     ret.insert(i->first.country);
@@ -1225,7 +1433,7 @@ vector<string> ProjectionList::listCountries()
 
 vector<string> ProjectionList::listProvinces()
 {
-  map<ProjectionLabel,shared_ptr<Projection> >::iterator i;
+  map<ProjectionLabel,shared_ptr<ProjectionEntry> >::iterator i;
   set<string> ret;
   for (i=projList.begin();i!=projList.end();i++)
     ret.insert(i->first.province);
@@ -1234,7 +1442,7 @@ vector<string> ProjectionList::listProvinces()
 
 vector<string> ProjectionList::listZones()
 {
-  map<ProjectionLabel,shared_ptr<Projection> >::iterator i;
+  map<ProjectionLabel,shared_ptr<ProjectionEntry> >::iterator i;
   set<string> ret;
   for (i=projList.begin();i!=projList.end();i++)
     ret.insert(i->first.zone);
@@ -1243,7 +1451,7 @@ vector<string> ProjectionList::listZones()
 
 vector<string> ProjectionList::listVersions()
 {
-  map<ProjectionLabel,shared_ptr<Projection> >::iterator i;
+  map<ProjectionLabel,shared_ptr<ProjectionEntry> >::iterator i;
   set<string> ret;
   for (i=projList.begin();i!=projList.end();i++)
     ret.insert(i->first.version);
@@ -57,6 +57,7 @@ class Projection
 {
 public:
   Projection();
+  virtual ~Projection();
   virtual latlong gridToLatlong(xy grid)=0;
   virtual xyz gridToGeocentric(xy grid)=0;
   virtual xy geocentricToGrid(xyz geoc)=0;
@@ -242,14 +243,43 @@ public:
 };
 
 ProjectionLabel readProjectionLabel(std::istream &file);
-Projection *readProjection(std::istream &file);
+Projection *readProjection(std::istream &file,bool withBoundary=true);
+std::string readProjectionText(std::istream &file);
+
+class ProjectionEntry
+/* Holds one projection of a ProjectionList. Constructing a projection
+ * flattens its boundary, which takes much longer than reading it, and
+ * a program usually needs only the projections covering one site, so the
+ * definition is kept as text and parsed the first time it's needed.
+ * The cap is a circle on the sphere containing the whole boundary, so
+ * cover() can skip a projection without constructing it. capCos is the
+ * cosine of the cap's radius; if it is less than -1, the cap is unknown
+ * and the projection has to be constructed to tell what it covers.
+ */
+{
+public:
+  std::string definition;
+  std::shared_ptr<Projection> proj;
+  xyz capCenter;
+  double capCos;
+  ProjectionEntry();
+  void setCap(g1boundary boundary);
+  bool mayContain(xyz geoc);
+  Projection *get();
+};
 
 class ProjectionList
+/* Projections can be read from the text file projections.txt, or from
+ * the catalog projections.cat, which projcat compiles from the text file.
+ * The catalog has the labels, boundary caps, and definitions, so reading
+ * it requires no parsing at all.
+ */
 {
 private:
-  std::map<ProjectionLabel,std::shared_ptr<Projection> > projList;
+  std::map<ProjectionLabel,std::shared_ptr<ProjectionEntry> > projList;
 public:
   void insert(ProjectionLabel label,Projection *proj);
+  bool insert(ProjectionLabel label,std::string definition);
   int size()
   {
     return projList.size();
@@ -260,6 +290,9 @@ public:
   ProjectionList cover(latlong ll);
   ProjectionList cover(vball v);
   void readFile(std::istream &file);
+  void writeCatalog(std::ostream &file);
+  bool readCatalog(std::istream &file);
+  int countConstructed();
   std::vector<std::string> listCountries(),listProvinces(),listZones(),listVersions();
 };
 #endif
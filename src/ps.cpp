@@ -29,6 +29,9 @@
 #include <string>
 #include <cassert>
 #include <iomanip>
+#include <sstream>
+#include <thread>
+#include <future>
 #include "ldecimal.h"
 #include "config.h"
 #include "ps.h"
@@ -38,6 +41,8 @@
 using namespace std;
 
 #define PAPERRES 0.004
+// Number of splines formatted at once by writeInParallel
+#define PS_BATCH 16384
 
 char rscales[]={10,12,15,20,25,30,40,50,60,80};
 const double PSPoint=25.4/72;
@@ -89,6 +94,7 @@ PostScript::PostScript()
   paper=xy(210,297);
   scale=1;
   orientation=pages=0;
+  resolution=0;
   indocument=inpage=inlin=false;
   psfile=nullptr;
 }
@@ -214,12 +220,12 @@ int PostScript::getPages()
   return pages;
 }
 
-double PostScript::xscale(double x)
+double PostScript::xscale(double x) const
 {
   return scale*(x-modelcenter.east())+paper.getx()/2;
 }
 
-double PostScript::yscale(double y)
+double PostScript::yscale(double y) const
 {
   return scale*(y-modelcenter.north())+paper.gety()/2;
 }
@@ -285,6 +291,27 @@ double PostScript::getscale()
   return scale;
 }
 
+void PostScript::setResolution(double res)
+/* res is in millimeters on paper. If it is positive, splines entirely off
+ * the page are left out and tiny pieces are merged; PLOTRES is a good
+ * value for plots of large sites. 0, the default, draws every spline
+ * exactly as given.
+ */
+{
+  resolution=res;
+}
+
+bool PostScript::offPage(double minx,double miny,double maxx,double maxy) const
+/* Takes a box in paper coordinates. The page may be rotated about its
+ * center, so this checks against the square that holds the page in any
+ * orientation.
+ */
+{
+  double half=max(paper.getx(),paper.gety())/2;
+  return maxx<paper.getx()/2-half || minx>paper.getx()/2+half ||
+	 maxy<paper.gety()/2-half || miny>paper.gety()/2+half;
+}
+
 void PostScript::dot(xy pnt,string comment)
 {
   assert(psfile);
@@ -394,35 +421,114 @@ void PostScript::endline(bool closed)
   inlin=false;
 }
 
-void PostScript::spline(bezier3d spl,bool fill)
+void PostScript::writeSpline(ostream &out,bezier3d &spl,bool fill) const
+/* If the resolution is set, splines entirely off the page are left out,
+ * and a piece of a spline whose control points are all within the
+ * resolution of the last point drawn is skipped, except the last piece,
+ * so that a spline of many tiny pieces is drawn with few.
+ */
 {
   int i,j,n;
   vector<xyz> seg;
-  xy pnt;
+  xy pnt,last,pap[4];
+  double minx=INFINITY,miny=INFINITY,maxx=-INFINITY,maxy=-INFINITY;
+  bool near;
   n=spl.size();
+  for (i=0;resolution>0 && i<n;i++)
+  {
+    seg=spl[i];
+    for (j=0;j<4;j++)
+    {
+      pnt=turn(xy(seg[j]),orientation);
+      minx=min(minx,xscale(pnt.east()));
+      miny=min(miny,yscale(pnt.north()));
+      maxx=max(maxx,xscale(pnt.east()));
+      maxy=max(maxy,yscale(pnt.north()));
+    }
+  }
+  if (n==0 || (resolution>0 && offPage(minx,miny,maxx,maxy)))
+    return;
   pnt=turn(xy(spl[0][0]),orientation);
-  *psfile<<ldecimal(xscale(pnt.east()),PAPERRES)<<' '<<ldecimal(yscale(pnt.north()),PAPERRES)<<" m\n";
+  last=xy(xscale(pnt.east()),yscale(pnt.north()));
+  out<<ldecimal(last.east(),PAPERRES)<<' '<<ldecimal(last.north(),PAPERRES)<<" m\n";
   for (i=0;i<n;i++)
   {
     seg=spl[i];
-    if (isstraight(seg))
+    for (j=1,near=resolution>0 && i<n-1;j<4;j++)
     {
-      pnt=turn(xy(seg[3]),orientation);
-      *psfile<<ldecimal(xscale(pnt.east()),PAPERRES)<<' '<<ldecimal(yscale(pnt.north()),PAPERRES)<<' '<<"l\n";
+      pnt=turn(xy(seg[j]),orientation);
+      if (pnt.isnan())
+        cerr<<"NaN point"<<endl;
+      pap[j]=xy(xscale(pnt.east()),yscale(pnt.north()));
+      if (!(dist(pap[j],last)<resolution))
+	near=false;
     }
+    if (near)
+      continue;
+    if (isstraight(seg))
+      out<<ldecimal(pap[3].east(),PAPERRES)<<' '<<ldecimal(pap[3].north(),PAPERRES)<<' '<<"l\n";
     else
     {
       for (j=1;j<4;j++)
-      {
-        pnt=turn(xy(seg[j]),orientation);
-        if (pnt.isnan())
-          cerr<<"NaN point"<<endl;
-        *psfile<<ldecimal(xscale(pnt.east()),PAPERRES)<<' '<<ldecimal(yscale(pnt.north()),PAPERRES)<<' ';
-      }
-      *psfile<<"c\n";
+        out<<ldecimal(pap[j].east(),PAPERRES)<<' '<<ldecimal(pap[j].north(),PAPERRES)<<' ';
+      out<<"c\n";
+    }
+    last=pap[3];
+  }
+  out<<(fill?"fill":"s")<<'\n';
+}
+
+void PostScript::writeInParallel(size_t n,function<void(ostream &,size_t)> write)
+/* Calls write for items 0 through n-1, in batches. Each batch is split
+ * among threads, each formatting into its own buffer, and the buffers
+ * are written in order, so the file is the same as if written serially.
+ * The file is flushed after each batch rather than after each item.
+ */
+{
+  static int cores=thread::hardware_concurrency();
+  int i,nthreads=(cores>1)?cores:1;
+  size_t start,end;
+  vector<future<string> > parts;
+  for (start=0;start<n;start=end)
+  {
+    end=min(n,start+PS_BATCH);
+    if (nthreads==1)
+      for (;start<end;start++)
+	write(*psfile,start);
+    else
+    {
+      parts.clear();
+      for (i=0;i<nthreads;i++)
+	parts.push_back(async(launch::async,[&write](size_t lo,size_t hi)
+	  {
+	    ostringstream part;
+	    for (;lo<hi;lo++)
+	      write(part,lo);
+	    return part.str();
+	  },start+(end-start)*i/nthreads,start+(end-start)*(i+1)/nthreads));
+      for (i=0;i<nthreads;i++)
+	*psfile<<parts[i].get();
     }
+    psfile->flush();
   }
-  *psfile<<(fill?"fill":"s")<<endl;
+}
+
+void PostScript::spline(bezier3d spl,bool fill)
+/* Flushes after each spline, like the other drawing methods, so that
+ * a debugging drawing is complete up to where the program crashed.
+ */
+{
+  writeSpline(*psfile,spl,fill);
+  psfile->flush();
+}
+
+void PostScript::splines(vector<bezier3d> &spls,bool fill)
+// Draws many splines in the current color, formatting them in parallel.
+{
+  writeInParallel(spls.size(),[this,&spls,fill](ostream &out,size_t i)
+		  {
+		    writeSpline(out,spls[i],fill);
+		  });
 }
 
 void PostScript::widen(double factor)
@@ -26,12 +26,20 @@
 #include <string>
 #include <iostream>
 #include <map>
+#include <vector>
+#include <functional>
 #include "bezier3d.h"
 #include "document.h"
 #include "tin.h"
 #include "boundrect.h"
 class pointlist;
 
+/* Pieces of curves smaller than this, in millimeters on paper, need not be
+ * drawn separately. It is about a dot of a 2400 dpi printer. Pass it to
+ * setResolution to simplify plots.
+ */
+#define PLOTRES 0.01
+
 struct papersize
 {
   int width,height; // in micrometers
@@ -47,8 +55,12 @@ protected:
   double scale; // paper size is in millimeters, but model space is in meters
   int orientation,pageorientation;
   double oldr,oldg,oldb;
+  double resolution; // in millimeters on paper
   xy paper,modelcenter;
   pointlist *pl;
+  bool offPage(double minx,double miny,double maxx,double maxy) const;
+  void writeSpline(std::ostream &out,bezier3d &spl,bool fill) const;
+  void writeInParallel(size_t n,std::function<void(std::ostream &,size_t)> write);
 public:
   PostScript();
   ~PostScript();
@@ -64,13 +76,14 @@ public:
   void setDoc(document &docu);
   void setPointlist(pointlist &plist);
   int getPages();
-  double xscale(double x);
-  double yscale(double y);
+  double xscale(double x) const;
+  double yscale(double y) const;
   std::string escape(std::string text);
   void setcolor(double r,double g,double b);
   void setscale(double minx,double miny,double maxx,double maxy,int ori=0);
   void setscale(BoundRect br);
   double getscale();
+  void setResolution(double res);
   void dot(xy pnt,std::string comment="");
   void circle(xy pnt,double radius);
   void line(edge lin,int num,int colorwhat,bool directed=false);
@@ -79,6 +92,7 @@ public:
   void lineto(xy pnt);
   void endline(bool closed=false);
   void spline(bezier3d spl,bool fill=false);
+  void splines(std::vector<bezier3d> &spls,bool fill=false);
   void widen(double factor);
   void write(xy pnt,std::string text);
   void centerWrite(xy pnt,std::string text);
@@ -40,74 +40,34 @@ PtinHeader::PtinHeader()
 
 void CoordCheck::clear()
 {
+  int i;
   count=0;
-  memset(stage0,0,sizeof(stage0));
-  memset(stage1,0,sizeof(stage1));
-  memset(stage2,0,sizeof(stage2));
-  memset(stage3,0,sizeof(stage3));
-  memset(stage4,0,sizeof(stage4));
+  for (i=0;i<6;i++)
+    low[i].clear();
+  block.clear();
+  for (i=0;i<58;i++)
+    high[i].clear();
 }
 
 CoordCheck& CoordCheck::operator<<(double val)
 {
   int i;
-  double lastStageSum;
-  for (i=0;i<13;i++)
+  double blockSum;
+  for (i=0;i<6;i++)
     if ((count>>i)&1)
-      stage0[i][count&8191]=-val;
+      low[i]-=val;
     else
-      stage0[i][count&8191]=val;
-  stage0[13][count&8191]=val;
-  if ((count&8191)==8191)
-  {
-    for (i=0;i<13;i++)
-      stage1[i][(count>>13)&8191]=pairwisesum(stage0[i],8192);
-    lastStageSum=pairwisesum(stage0[13],8192);
-    for (i=13;i<26;i++)
-      if ((count>>i)&1)
-	stage1[i][(count>>13)&8191]=-lastStageSum;
-      else
-	stage1[i][(count>>13)&8191]=lastStageSum;
-    stage1[26][(count>>13)&8191]=lastStageSum;
-    memset(stage0,0,sizeof(stage0));
-  }
-  if ((count&0x3ffffff)==0x3ffffff)
-  {
-    for (i=0;i<26;i++)
-      stage2[i][(count>>26)&8191]=pairwisesum(stage1[i],8192);
-    lastStageSum=pairwisesum(stage1[26],8192);
-    for (i=26;i<39;i++)
-      if ((count>>i)&1)
-	stage2[i][(count>>26)&8191]=-lastStageSum;
-      else
-	stage2[i][(count>>26)&8191]=lastStageSum;
-    stage2[39][(count>>26)&8191]=lastStageSum;
-    memset(stage1,0,sizeof(stage1));
-  }
-  if ((count&0x7fffffffff)==0x7fffffffff)
-  {
-    for (i=0;i<39;i++)
-      stage3[i][(count>>39)&8191]=pairwisesum(stage2[i],8192);
-    lastStageSum=pairwisesum(stage2[39],8192);
-    for (i=39;i<52;i++)
-      if ((count>>i)&1)
-	stage3[i][(count>>39)&8191]=-lastStageSum;
-      else
-	stage3[i][(count>>39)&8191]=lastStageSum;
-    stage3[52][(count>>39)&8191]=lastStageSum;
-    memset(stage2,0,sizeof(stage2));
-  }
-  if ((count&0xfffffffffffff)==0xfffffffffffff)
+      low[i]+=val;
+  block+=val;
+  if ((count&63)==63)
   {
-    for (i=0;i<52;i++)
-      stage4[i][(count>>52)&8191]=pairwisesum(stage3[i],8192);
-    lastStageSum=pairwisesum(stage3[52],8192);
-    for (i=52;i<64;i++)
-      if ((count>>i)&1)
-	stage4[i][(count>>52)&8191]=-lastStageSum;
+    blockSum=block.total();
+    for (i=0;i<58;i++)
+      if ((count>>(i+6))&1)
+	high[i]-=blockSum;
       else
-	stage4[i][(count>>52)&8191]=lastStageSum;
-    memset(stage3,0,sizeof(stage3));
+	high[i]+=blockSum;
+    block.clear();
   }
   count++;
   return *this;
@@ -115,31 +75,12 @@ CoordCheck& CoordCheck::operator<<(double val)
 
 double CoordCheck::operator[](int n)
 {
-  int n0=n,n1=n,n2=n,n3=n;
-  int s0=1,s1=1,s2=1,s3=1;
-  if (n0>13)
-  {
-    n0=13;
-    s0=1-2*((count>>n)&1);
-  }
-  if (n1>26)
-  {
-    n1=26;
-    s1=1-2*((count>>n)&1);
-  }
-  if (n2>39)
-  {
-    n2=39;
-    s2=1-2*((count>>n)&1);
-  }
-  if (n3>52)
-  {
-    n3=52;
-    s3=1-2*((count>>n)&1);
-  }
-  return pairwisesum(stage0[n0],8192)*s0+pairwisesum(stage1[n1],8192)*s1+
-	 pairwisesum(stage2[n2],8192)*s2+pairwisesum(stage3[n3],8192)*s3+
-         pairwisesum(stage4[n],4096);
+  if (n<6)
+    return low[n].total();
+  else if ((count>>n)&1)
+    return high[n-6].total()-block.total();
+  else
+    return high[n-6].total()+block.total();
 }
 
 xyz readPoint(istream &file)
@@ -58,11 +58,15 @@ struct PtinHeader
 };
 
 class CoordCheck
+/* Adds up the z coordinates 64 ways. Sum n negates the k'th coordinate
+ * if bit n of k is set. The signs of sums 0 through 5 change within
+ * a block of 64 coordinates; the others are the same throughout a block,
+ * so each block is summed, then added to them.
+ */
 {
 private:
   size_t count;
-  double stage0[14][8192],stage1[27][8192],stage2[40][8192],
-         stage3[53][8192],stage4[64][4096];
+  manysum low[6],block,high[58];
 public:
   void clear();
   CoordCheck& operator<<(double val);
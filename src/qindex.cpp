@@ -333,6 +333,41 @@ void qindex::settri(triangle *starttri)
   }
 }
 
+void qindex::replaceTri(map<triangle *,triangle *> &repl,unordered_multimap<triangle *,qindex *> &leaves)
+/* Changes leaves pointing to triangles that have been removed or moved.
+ * leaves holds the leaves of this tree by the triangle they point to, so
+ * that only those pointing to a replaced triangle are looked at. If it is
+ * empty, the whole tree is traversed once to fill it in.
+ */
+{
+  int i;
+  vector<qindex *> chain;
+  vector<pair<qindex *,triangle *> > changes;
+  map<triangle *,triangle *>::iterator j;
+  unordered_multimap<triangle *,qindex *>::iterator k;
+  pair<unordered_multimap<triangle *,qindex *>::iterator,unordered_multimap<triangle *,qindex *>::iterator> range;
+  if (leaves.empty())
+  {
+    chain=traverse();
+    for (i=0;i<chain.size();i++)
+      if (chain[i]->tri)
+	leaves.insert(make_pair(chain[i]->tri,chain[i]));
+  }
+  // Collect all changes first, as a replaced triangle can be a replacement.
+  for (j=repl.begin();j!=repl.end();++j)
+  {
+    range=leaves.equal_range(j->first);
+    for (k=range.first;k!=range.second;++k)
+      changes.push_back(make_pair(k->second,j->second));
+    leaves.erase(range.first,range.second);
+  }
+  for (i=0;i<changes.size();i++)
+  {
+    changes[i].first->tri=changes[i].second;
+    leaves.insert(make_pair(changes[i].second,changes[i].first));
+  }
+}
+
 set<triangle *> qindex::localTriangles(xy center,double radius,int max)
 /* Returns up to max pointers to triangles, the leaves of the tree whose centers
  * are within radius of center. If there are more than max in the circle, returns
@@ -27,6 +27,8 @@
 #define QINDEX_H
 #include <vector>
 #include <set>
+#include <map>
+#include <unordered_map>
 #include "pointlist.h"
 #include "bezier.h"
 #include "ps.h"
@@ -60,6 +62,7 @@ public:
   void draw(PostScript &ps,bool root=true);
   std::vector<qindex*> traverse(int dir=0);
   void settri(triangle *starttri);
+  void replaceTri(std::map<triangle *,triangle *> &repl,std::unordered_multimap<triangle *,qindex *> &leaves);
   std::set<triangle *> localTriangles(xy center,double radius,int max);
   qindex();
   ~qindex();
@@ -21,73 +21,388 @@
  * and Lesser General Public License along with Bezitopo. If not, see
  * <http://www.gnu.org/licenses/>.
  */
+#include <cmath>
+#include <chrono>
+#include <algorithm>
 #include "rendercache.h"
 using namespace std;
 
+// Most threads to render in. The GUI thread is left a core of its own.
+#define MAX_RENDER_THREADS 4
+
+vector<QPainterPath> renderPaths(const vector<drawingElement> &rendering)
+/* Builds the paths in world coordinates. The canvas draws them through a
+ * transform, so they need not be rebuilt when the view is panned.
+ */
+{
+  vector<QPainterPath> ret;
+  vector<xyz> beziseg;
+  bezier3d b3d;
+  int i,k;
+  for (i=0;i<rendering.size();i++)
+  {
+    b3d=rendering[i].path;
+    ret.push_back(QPainterPath());
+    for (k=0;k<b3d.size();k++)
+    {
+      beziseg=b3d[k];
+      if (k==0)
+	ret.back().moveTo(beziseg[0].getx(),beziseg[0].gety());
+      ret.back().cubicTo(beziseg[1].getx(),beziseg[1].gety(),
+			 beziseg[2].getx(),beziseg[2].gety(),
+			 beziseg[3].getx(),beziseg[3].gety());
+    }
+    if (!b3d.isopen())
+      ret.back().closeSubpath();
+  }
+  return ret;
+}
+
+void renderBounds(RenderJob &job)
+// A Bézier curve is within the convex hull of its control points.
+{
+  int i,j,k;
+  bezier3d b3d;
+  vector<xyz> beziseg;
+  job.minx=job.miny=INFINITY;
+  job.maxx=job.maxy=-INFINITY;
+  for (i=0;i<job.rendering.size();i++)
+  {
+    b3d=job.rendering[i].path;
+    for (k=0;k<b3d.size();k++)
+    {
+      beziseg=b3d[k];
+      for (j=0;j<beziseg.size();j++)
+      {
+	job.minx=min(job.minx,beziseg[j].getx());
+	job.miny=min(job.miny,beziseg[j].gety());
+	job.maxx=max(job.maxx,beziseg[j].getx());
+	job.maxy=max(job.maxy,beziseg[j].gety());
+      }
+    }
+  }
+}
+
+RenderCache::RenderCache()
+{
+  stopping=false;
+  next=0;
+  costSum=0;
+  costCount=0;
+  viewRadius=INFINITY;
+  viewScale=1;
+}
+
+RenderCache::~RenderCache()
+{
+  stopWorkers();
+}
+
+void RenderCache::stopWorkers()
+/* Stops the worker threads and waits for them, so that notify isn't called
+ * afterward. The owner of the cache must call this in its destructor if
+ * notify uses the owner. Workers are not started again.
+ */
+{
+  int i;
+  {
+    lock_guard<mutex> lock(jobMutex);
+    stopping=true;
+    jobs.clear();
+  }
+  jobCond.notify_all();
+  for (i=0;i<workers.size();i++)
+    workers[i].join();
+  workers.clear();
+}
+
+void RenderCache::setNotify(function<void()> func)
+{
+  notify=func;
+}
+
+void RenderCache::setView(xy center,double radius,double pixelScale)
+{
+  viewCenter=center;
+  viewRadius=radius;
+  viewScale=pixelScale;
+}
+
 void RenderCache::clear()
 {
-  renderMap.clear();
+  {
+    lock_guard<mutex> lock(jobMutex);
+    jobs.clear();
+  }
+  items.clear();
+  where.clear();
+  candidates.clear();
+  next=0;
+}
+
+void RenderCache::collectDone()
+/* Puts finished renderings in the cache, unless the object has changed again
+ * or gone away since the rendering was requested.
+ */
+{
+  deque<RenderJob> finished;
+  unordered_map<drawobj *,size_t>::iterator i;
+  {
+    lock_guard<mutex> lock(doneMutex);
+    finished.swap(done);
+  }
+  for (;finished.size();finished.pop_front())
+  {
+    RenderJob &job=finished.front();
+    costSum+=job.cost;
+    costCount++;
+    i=where.find(job.obj);
+    if (i!=where.end() && items[i->second].pending && items[i->second].pendingHash==job.hash)
+    {
+      RenderItem &item=items[i->second];
+      item.rendering.swap(job.rendering);
+      item.paths.swap(job.paths);
+      item.pixelScale=job.pixelScale;
+      item.hash=job.hash;
+      item.cost=job.cost;
+      item.minx=job.minx;
+      item.miny=job.miny;
+      item.maxx=job.maxx;
+      item.maxy=job.maxy;
+      item.pending=false;
+    }
+  }
 }
 
 void RenderCache::clearPresent()
 {
-  map<drawobj *,RenderItem>::iterator i;
-  int j,nsteps;
-  for (i=renderMap.begin();i!=renderMap.end();i++)
-    i->second.present=false;
-  nsteps=rng.ucrandom();
-  for (j=0;j<nsteps;j++)
-    subrand.scalar(1);
+  int i;
+  collectDone();
+  for (i=0;i<items.size();i++)
+    items[i].present=false;
+  candidates.clear();
 }
 
 void RenderCache::deleteAbsent()
 {
-  map<drawobj *,RenderItem>::iterator i;
-  int j;
-  vector<drawobj *> delenda;
-  for (i=renderMap.begin();i!=renderMap.end();i++)
-    if (!i->second.present)
-      delenda.push_back(i->first);
-  for (j=0;j<delenda.size();j++)
-    renderMap.erase(delenda[j]);
-  next=renderMap.begin();
+  size_t i,j;
+  for (i=j=0;i<items.size();i++)
+    if (items[i].present)
+    {
+      if (i>j)
+	items[j]=move(items[i]);
+      j++;
+    }
+  if (j<items.size())
+  {
+    items.resize(j);
+    where.clear();
+    for (i=0;i<items.size();i++)
+      where[items[i].obj]=i;
+  }
+  next=0;
 }
 
-bool RenderCache::shouldRerender(double oldScale,double newScale)
+double RenderCache::estCost(RenderItem &item)
 {
-  double ratio=oldScale/newScale;
-  double prob=ratio*exp(1-ratio);
-  return prob<1 && subrand.scalar(1)>=prob;
+  if (!std::isnan(item.cost))
+    return item.cost;
+  else if (costCount)
+    return costSum/costCount;
+  else
+    return RENDER_COST_GUESS;
 }
 
-void RenderCache::checkInObject(drawobj *obj,double pixelScale,int layr,int colr,int thik,int ltype)
+double RenderCache::renderValue(RenderItem &item,unsigned objHash)
+/* Returns 0 if the rendering is good enough or is already being redone.
+ * Otherwise new and changed objects in view come first, then objects in view
+ * whose scale is off, then new and changed objects out of view; objects out
+ * of view whose scale is off wait until they come into view. Within each
+ * tier, the more pixels an object covers and the farther off its scale, the
+ * sooner it is rendered.
+ */
 {
-  unsigned objHash;
-  if (!renderMap.count(obj))
-    renderMap[obj].pixelScale=INFINITY;
-  renderMap[obj].colr=colr;
-  renderMap[obj].thik=thik;
-  renderMap[obj].ltype=ltype;
-  renderMap[obj].present=true;
-  objHash=obj->hash(); // Computing the hash of a large polyspiral takes 1/20 as much time as rendering it.
-  if (shouldRerender(renderMap[obj].pixelScale,pixelScale) ||
-      objHash!=renderMap[obj].hash)
+  const double tier=1e9;
+  double pixels,ratio,err=1;
+  bool visible=true,changed;
+  if (item.pending && item.pendingHash==objHash)
+    return 0;
+  changed=item.pixelScale==INFINITY || objHash!=item.hash;
+  if (std::isnan(item.minx) || item.minx>item.maxx)
+    pixels=viewRadius/viewScale;
+  else
+  {
+    pixels=hypot(item.maxx-item.minx,item.maxy-item.miny)/viewScale+1;
+    visible=item.maxx>=viewCenter.getx()-viewRadius && item.minx<=viewCenter.getx()+viewRadius &&
+	    item.maxy>=viewCenter.gety()-viewRadius && item.miny<=viewCenter.gety()+viewRadius;
+  }
+  if (pixels>tier/100)
+    pixels=tier/100;
+  if (!changed)
   {
-    renderMap[obj].rendering=obj->render3d(pixelScale,layr,colr,thik,ltype);
-    renderMap[obj].pixelScale=pixelScale;
-    renderMap[obj].hash=objHash;
+    ratio=item.pixelScale/viewScale;
+    if (ratio>1) // Zooming in. The rendering is too coarse.
+      err=log(ratio);
+    else // Zooming out. The rendering is finer than needed, which is less bad.
+      err=-log(ratio)/4;
+    if (err<log(RENDER_SCALE_TOLER) || !visible)
+      return 0;
   }
+  return (changed?(visible?3:1):2)*tier+pixels*err;
 }
 
-RenderItem RenderCache::nextRenderItem()
+void RenderCache::checkIn(drawobj *obj,int layr,int colr,int thik,int ltype,function<shared_ptr<drawobj>()> copy)
 {
-  RenderItem ret;
-  if (next==renderMap.end())
-    ret.present=false;
-  else
+  RenderCandidate cand;
+  unordered_map<drawobj *,size_t>::iterator i=where.find(obj);
+  if (i==where.end())
+  {
+    i=where.insert(make_pair(obj,items.size())).first;
+    items.push_back(RenderItem());
+    items.back().obj=obj;
+    items.back().pixelScale=INFINITY;
+    items.back().pending=false;
+    items.back().hash=items.back().pendingHash=0;
+    items.back().cost=items.back().minx=items.back().miny=items.back().maxx=items.back().maxy=NAN;
+  }
+  RenderItem &item=items[i->second];
+  item.colr=colr;
+  item.thik=thik;
+  item.ltype=ltype;
+  item.present=true;
+  cand.hash=obj->hash();
+  cand.value=renderValue(item,cand.hash);
+  if (cand.value>0)
+  {
+    cand.obj=obj;
+    cand.layr=layr;
+    cand.copy=copy;
+    candidates.push_back(cand);
+  }
+}
+
+bool operator<(const RenderCandidate &a,const RenderCandidate &b)
+{
+  return a.value>b.value;
+}
+
+int RenderCache::schedule()
+/* Sends the most valuable renderings to the workers, as long as the
+ * estimated time of those waiting stays within the budget. If none are
+ * waiting, at least one is sent. Those not sent will be candidates again
+ * when the workers finish and the canvas is repainted.
+ * Returns the number sent.
+ */
+{
+  int i,n=0;
+  double waiting=0,cost;
+  startWorkers();
+  for (i=0;i<items.size();i++)
+    if (items[i].pending)
+      waiting+=estCost(items[i]);
+  stable_sort(candidates.begin(),candidates.end());
+  for (i=0;i<candidates.size();i++)
   {
-    ret=next->second;
-    ++next;
+    RenderItem &item=items[where[candidates[i].obj]];
+    cost=estCost(item);
+    if (waiting>0 && waiting+cost>RENDER_BUDGET*workers.size())
+      break;
+    submit(item,candidates[i]);
+    waiting+=cost;
+    n++;
   }
+  candidates.clear();
+  return n;
+}
+
+void RenderCache::startWorkers()
+{
+  int i,nthreads;
+  if (workers.size()==0 && !stopping)
+  {
+    nthreads=thread::hardware_concurrency()-1;
+    if (nthreads<1)
+      nthreads=1;
+    if (nthreads>MAX_RENDER_THREADS)
+      nthreads=MAX_RENDER_THREADS;
+    for (i=0;i<nthreads;i++)
+      workers.push_back(thread(&RenderCache::work,this));
+  }
+}
+
+void RenderCache::submit(RenderItem &item,RenderCandidate &cand)
+/* The object is copied in the same frame it was checked in, so the hash
+ * computed then is the hash of the copy.
+ */
+{
+  RenderJob job;
+  item.pending=true;
+  item.pendingHash=cand.hash;
+  job.obj=item.obj;
+  job.copy=cand.copy();
+  job.hash=item.pendingHash;
+  job.pixelScale=viewScale;
+  job.layr=cand.layr;
+  job.colr=item.colr;
+  job.thik=item.thik;
+  job.ltype=item.ltype;
+  {
+    lock_guard<mutex> lock(jobMutex);
+    jobs.push_back(move(job));
+  }
+  jobCond.notify_one();
+}
+
+void RenderCache::work()
+{
+  RenderJob job;
+  chrono::steady_clock::time_point start;
+  while (true)
+  {
+    {
+      unique_lock<mutex> lock(jobMutex);
+      jobCond.wait(lock,[this]{return stopping || jobs.size()>0;});
+      if (stopping)
+	return;
+      job=move(jobs.front());
+      jobs.pop_front();
+    }
+    start=chrono::steady_clock::now();
+    job.rendering=job.copy->render3d(job.pixelScale,job.layr,job.colr,job.thik,job.ltype);
+    job.copy.reset();
+    job.paths=renderPaths(job.rendering);
+    renderBounds(job);
+    job.cost=chrono::duration<double>(chrono::steady_clock::now()-start).count();
+    {
+      lock_guard<mutex> lock(doneMutex);
+      done.push_back(move(job));
+    }
+    if (notify)
+      notify();
+  }
+}
+
+int RenderCache::pendingCount()
+{
+  int i,ret=0;
+  for (i=0;i<items.size();i++)
+    ret+=items[i].pending;
+  return ret;
+}
+
+int RenderCache::waitingCount()
+// Returns the number of renderings sent but not yet started.
+{
+  lock_guard<mutex> lock(jobMutex);
+  return jobs.size();
+}
+
+RenderItem *RenderCache::nextRenderItem()
+{
+  RenderItem *ret;
+  if (next>=items.size())
+    ret=nullptr;
+  else
+    ret=&items[next++];
   return ret;
 }
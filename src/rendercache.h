@@ -23,18 +23,35 @@
  */
 #ifndef RENDERCACHE_H
 #define RENDERCACHE_H
-#include <map>
+#include <vector>
+#include <deque>
+#include <unordered_map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <functional>
+#include <QPainterPath>
 #include "drawobj.h"
-#include "halton.h"
-#include "random.h"
 
 /* The RenderCache is used for all objects visible in a canvas EXCEPT:
  * • points, which are drawn as three concentric circles sized in pixels;
  * • edges, which are not drawing objects and which are drawn as just one (sp)line.
  * If an object hasn't changed (as shown by its hash), and the pixel scale
  * is the same as when it was last rendered, the rendering is left alone.
- * If the scale has changed, it is rerendered with a probability depending
- * on the ratio. If the object has changed, it is always rerendered.
+ * If the object has changed, or is new, it is always rerendered. If the
+ * scale has changed, it is a candidate for rerendering, valued by how far
+ * the scale is off, how big it is on the screen, and whether it is in view.
+ * 
+ * Rendering is done in worker threads on a copy of the object, so that
+ * painting doesn't wait for it. Until the new rendering comes back, the old
+ * one, if any, is drawn. When a rendering is done, the notify function is
+ * called (in the worker thread), which should schedule a repaint.
+ * 
+ * Each frame, schedule() sends the most valuable renderings to the workers,
+ * up to a budget of estimated rendering time; the rest wait for a later
+ * frame. Items are kept in a vector in the order they were first checked
+ * in, so the drawing order doesn't depend on addresses.
  * 
  * This works well, except in some cases involving blocks. If a block in the
  * drawing layer has a line in the setback layer, and you hide the setback
@@ -42,30 +59,99 @@
  * block is rerendered because the scale changes.
  */
 
+/* Seconds of rendering, per worker thread, that may be waiting at once.
+ * At 30 ms, each repaint triggered by finished renderings has new ones.
+ */
+#define RENDER_BUDGET 0.03
+// Renderings whose scale is off by less than this factor are kept.
+#define RENDER_SCALE_TOLER 1.189207115002721
+// Used as the cost of a rendering until some renderings have been timed
+#define RENDER_COST_GUESS 0.001
+
 class RenderItem
 {
 public:
+  drawobj *obj;
   unsigned short colr;
   short thik;
   unsigned short ltype;
   bool present;
+  bool pending; // A rendering has been requested and hasn't come back.
+  unsigned hash,pendingHash;
+  double pixelScale;
+  double cost; // seconds the last rendering took, or NAN
+  double minx,miny,maxx,maxy; // bounds of the rendering
+  std::vector<drawingElement> rendering;
+  std::vector<QPainterPath> paths; // in world coordinates, one per drawingElement
+};
+
+struct RenderJob
+{
+  drawobj *obj;
+  std::shared_ptr<drawobj> copy;
   unsigned hash;
   double pixelScale;
+  int layr,colr,thik,ltype;
+  double cost;
+  double minx,miny,maxx,maxy;
   std::vector<drawingElement> rendering;
+  std::vector<QPainterPath> paths;
+};
+
+struct RenderCandidate
+{
+  drawobj *obj;
+  double value;
+  unsigned hash; // computed when checked in, so that submit needn't hash again
+  int layr;
+  std::function<std::shared_ptr<drawobj>()> copy;
 };
 
 class RenderCache
 {
 private:
-  halton subrand;
-  std::map<drawobj *,RenderItem> renderMap;
-  bool shouldRerender(double oldScale,double newScale);
-  std::map<drawobj *,RenderItem>::iterator next;
+  std::vector<RenderItem> items;
+  std::unordered_map<drawobj *,size_t> where;
+  std::vector<RenderCandidate> candidates;
+  size_t next;
+  xy viewCenter;
+  double viewRadius,viewScale;
+  double costSum;
+  int costCount;
+  std::vector<std::thread> workers;
+  std::mutex jobMutex,doneMutex;
+  std::condition_variable jobCond;
+  std::deque<RenderJob> jobs,done;
+  bool stopping;
+  std::function<void()> notify;
+  double renderValue(RenderItem &item,unsigned objHash);
+  double estCost(RenderItem &item);
+  void checkIn(drawobj *obj,int layr,int colr,int thik,int ltype,std::function<std::shared_ptr<drawobj>()> copy);
+  void submit(RenderItem &item,RenderCandidate &cand);
+  void startWorkers();
+  void collectDone();
+  void work();
 public:
+  RenderCache();
+  ~RenderCache();
+  void setNotify(std::function<void()> func);
+  void stopWorkers();
+  void setView(xy center,double radius,double pixelScale);
   void clear();
   void clearPresent();
   void deleteAbsent();
-  void checkInObject(drawobj *obj,double pixelScale,int layr,int colr,int thik,int ltype);
-  RenderItem nextRenderItem();
+  template <class T> void checkInObject(T *obj,int layr,int colr,int thik,int ltype)
+  /* T must be the actual class of obj, as obj is copied to be rendered.
+   * The pixel scale is the one last passed to setView, once per frame.
+   */
+  {
+    checkIn(obj,layr,colr,thik,ltype,[obj](){return std::make_shared<T>(*obj);});
+  }
+  int schedule();
+  RenderItem *nextRenderItem();
+  int pendingCount();
+  int waitingCount();
 };
+
+std::vector<QPainterPath> renderPaths(const std::vector<drawingElement> &rendering);
 #endif
@@ -0,0 +1,536 @@
+/******************************************************/
+/*                                                    */
+/* scene.cpp - binary chunked scene files             */
+/*                                                    */
+/******************************************************/
+/* Copyright 2026 Pierre Abbat.
+ * This file is part of Bezitopo.
+ *
+ * Bezitopo is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * Bezitopo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License and Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * and Lesser General Public License along with Bezitopo. If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include <cstring>
+#include <climits>
+#include <set>
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include <future>
+#include <functional>
+#include <QByteArray>
+#include "scene.h"
+#include "binio.h"
+#include "except.h"
+using namespace std;
+
+#define SCENE_VERSION 1
+#define SCENE_HEADER_SIZE 24
+
+const char sceneMagic[]="bezscene";
+
+struct SceneSettings
+{
+  criteria crit;
+  ContourInterval contourInterval;
+};
+
+struct ScenePoint
+/* A point as read from a file. It isn't a point, because copying a point
+ * doesn't copy its gradient.
+ */
+{
+  int num;
+  xyz pnt;
+  xy gradient;
+  string note;
+};
+
+struct TriangleCorners
+{
+  int a,b,c;
+  double ctrl[7];
+};
+
+void writeXorDouble(ostream &file,double x,double &prev)
+{
+  uint64_t bits,prevBits,diff;
+  int n;
+  char buf[9];
+  memcpy(&bits,&x,sizeof(bits));
+  memcpy(&prevBits,&prev,sizeof(prevBits));
+  diff=bits^prevBits;
+  prev=x;
+  for (n=0;n<8 && (diff>>(8*n));n++)
+    buf[n+1]=diff>>(8*n);
+  buf[0]=n;
+  file.write(buf,n+1);
+}
+
+double readXorDouble(istream &file,double &prev)
+{
+  uint64_t bits,diff=0;
+  int i,n;
+  n=file.get();
+  if (n<0 || n>8)
+    throw BeziExcept(badData);
+  for (i=0;i<n;i++)
+    diff|=(uint64_t)(file.get()&255)<<(8*i);
+  memcpy(&bits,&prev,sizeof(bits));
+  bits^=diff;
+  memcpy(&prev,&bits,sizeof(prev));
+  return prev;
+}
+
+void writeChunkHeader(ostream &file,const SceneChunk &chunk)
+{
+  file.write(chunk.tag.data(),4);
+  writeleint(file,chunk.plnum);
+  writeleint(file,chunk.encoding);
+  writeleint(file,chunk.count);
+  writelelong(file,chunk.length);
+}
+
+SceneChunk readChunkHeader(istream &file)
+{
+  SceneChunk ret;
+  char tag[4];
+  ret.offset=file.tellg();
+  file.read(tag,4);
+  ret.tag=string(tag,4);
+  ret.plnum=readleint(file);
+  ret.encoding=readleint(file);
+  ret.count=readleint(file);
+  ret.length=readlelong(file);
+  if (!file.good())
+    throw BeziExcept(badData);
+  return ret;
+}
+
+string deflatePayload(const string &payload)
+{
+  QByteArray packed=qCompress(QByteArray(payload.data(),payload.size()));
+  return string(packed.constData(),packed.size());
+}
+
+string inflatePayload(const string &payload)
+// qUncompress returns an empty array if the data are damaged.
+{
+  QByteArray unpacked=qUncompress(QByteArray(payload.data(),payload.size()));
+  if (unpacked.size()==0 && payload.size()>4 && (payload[0]|payload[1]|payload[2]|payload[3]))
+    throw BeziExcept(badData);
+  return string(unpacked.constData(),unpacked.size());
+}
+
+void writeChunks(ostream &file,vector<SceneChunk> &dir,string tag,int plnum,int encoding,
+		 size_t n,function<void(ostream &,size_t,size_t)> encode)
+/* Encodes items 0 through n-1 in chunks of SCENE_BLOCK items. As many
+ * chunks as there are threads are encoded (and compressed, if the encoding
+ * says so) at once, then written in order.
+ */
+{
+  static int cores=thread::hardware_concurrency();
+  int i,nthreads=(cores>1)?cores:1;
+  size_t start,end,lo,hi;
+  vector<future<string> > parts;
+  string payload;
+  SceneChunk chunk;
+  chunk.tag=tag;
+  chunk.plnum=plnum;
+  chunk.encoding=encoding;
+  for (start=0;start<n;start=end)
+  {
+    end=min(n,start+(size_t)SCENE_BLOCK*nthreads);
+    parts.clear();
+    for (lo=start;lo<end;lo=hi)
+    {
+      hi=min(end,lo+SCENE_BLOCK);
+      parts.push_back(async(nthreads>1?launch::async:launch::deferred,[&encode,encoding](size_t lo,size_t hi)
+	{
+	  ostringstream part;
+	  encode(part,lo,hi);
+	  if (encoding&SCENE_DEFLATE)
+	    return deflatePayload(part.str());
+	  return part.str();
+	},lo,hi));
+    }
+    for (i=0,lo=start;i<parts.size();i++,lo+=SCENE_BLOCK)
+    {
+      payload=parts[i].get();
+      chunk.count=min(end,lo+SCENE_BLOCK)-lo;
+      chunk.offset=file.tellp();
+      chunk.length=payload.size();
+      writeChunkHeader(file,chunk);
+      file.write(payload.data(),payload.size());
+      dir.push_back(chunk);
+    }
+  }
+}
+
+void writePointlist(ostream &file,vector<SceneChunk> &dir,pointlist &pl,int plnum,int deflate)
+// deflate is SCENE_DEFLATE or 0.
+{
+  vector<point *> pnts;
+  vector<triangle *> tris;
+  ptlist::iterator p;
+  map<int,triangle>::iterator t;
+  for (p=pl.points.begin();p!=pl.points.end();++p)
+    pnts.push_back(&p->second);
+  for (t=pl.triangles.begin();t!=pl.triangles.end();++t)
+    tris.push_back(&t->second);
+  writeChunks(file,dir,"PLST",plnum,SCENE_VARINT|deflate,1,[&pl](ostream &part,size_t lo,size_t hi)
+	      {
+		int i;
+		writeuvarint(part,pl.crit.size());
+		for (i=0;i<pl.crit.size();i++)
+		  pl.crit[i].writeBinary(part);
+		pl.contourInterval.writeBinary(part);
+	      });
+  writeChunks(file,dir,"PNTS",plnum,SCENE_VARINT|SCENE_XOR|deflate,pnts.size(),[&pl,&pnts](ostream &part,size_t lo,size_t hi)
+	      {
+		int lastNum=0,num;
+		double prev[5]={0,0,0,0,0};
+		for (;lo<hi;lo++)
+		{
+		  num=pl.revpoints.at(pnts[lo]);
+		  writesvarint(part,(long long)num-lastNum);
+		  lastNum=num;
+		  writeXorDouble(part,pnts[lo]->getx(),prev[0]);
+		  writeXorDouble(part,pnts[lo]->gety(),prev[1]);
+		  writeXorDouble(part,pnts[lo]->getz(),prev[2]);
+		  writeXorDouble(part,pnts[lo]->gradient.getx(),prev[3]);
+		  writeXorDouble(part,pnts[lo]->gradient.gety(),prev[4]);
+		  writeustring(part,pnts[lo]->note);
+		}
+	      });
+  writeChunks(file,dir,"TINS",plnum,SCENE_VARINT|SCENE_XOR|deflate,tris.size(),[&pl,&tris](ostream &part,size_t lo,size_t hi)
+	      {
+		int lastA=0,a,i;
+		double prev[7]={0,0,0,0,0,0,0};
+		for (;lo<hi;lo++)
+		{
+		  a=pl.revpoints.at(tris[lo]->a);
+		  writesvarint(part,(long long)a-lastA);
+		  writesvarint(part,(long long)pl.revpoints.at(tris[lo]->b)-a);
+		  writesvarint(part,(long long)pl.revpoints.at(tris[lo]->c)-a);
+		  lastA=a;
+		  for (i=0;i<7;i++)
+#ifdef FLATTRIANGLE
+		    writeXorDouble(part,NAN,prev[i]);
+#else
+		    writeXorDouble(part,tris[lo]->ctrl[i],prev[i]);
+#endif
+		}
+	      });
+  writeChunks(file,dir,"BRK0",plnum,SCENE_VARINT|deflate,pl.type0Breaklines.size(),[&pl](ostream &part,size_t lo,size_t hi)
+	      {
+		for (;lo<hi;lo++)
+		  pl.type0Breaklines[lo].writeBinary(part);
+	      });
+  writeChunks(file,dir,"CONT",plnum,SCENE_VARINT|deflate,pl.contours.size(),[&pl](ostream &part,size_t lo,size_t hi)
+	      {
+		for (;lo<hi;lo++)
+		  pl.contours[lo].writeBinary(part);
+	      });
+}
+
+void writeScene(ostream &file,document &doc,bool deflate)
+/* Writes the header, the chunks of each pointlist, then the directory,
+ * then the position of the directory, so that the directory can be found
+ * by seeking to the end. If deflate is true, each chunk is compressed.
+ */
+{
+  vector<SceneChunk> dir;
+  SceneChunk dirChunk;
+  ostringstream dirData;
+  int i;
+  file.write(sceneMagic,8);
+  writeleint(file,SCENE_VERSION);
+  for (i=0;i<doc.pl.size();i++)
+    writePointlist(file,dir,doc.pl[i],i,deflate?SCENE_DEFLATE:0);
+  for (i=0;i<dir.size();i++)
+  {
+    dirData.write(dir[i].tag.data(),4);
+    writeleint(dirData,dir[i].plnum);
+    writeleint(dirData,dir[i].encoding);
+    writeleint(dirData,dir[i].count);
+    writelelong(dirData,dir[i].offset);
+    writelelong(dirData,dir[i].length);
+  }
+  dirChunk.tag="DIR ";
+  dirChunk.plnum=dirChunk.encoding=0;
+  dirChunk.count=dir.size();
+  dirChunk.offset=file.tellp();
+  dirChunk.length=dirData.str().size();
+  writeChunkHeader(file,dirChunk);
+  file<<dirData.str();
+  writelelong(file,dirChunk.offset);
+  file.write(sceneMagic,8);
+}
+
+void writeScene(string fileName,document &doc,bool deflate)
+{
+  ofstream file(fileName,ios::binary|ios::trunc);
+  writeScene(file,doc,deflate);
+}
+
+vector<SceneChunk> readSceneDirectory(istream &file)
+/* Checks the header and trailer and reads the directory. Throws badHeader
+ * if the file is not a scene file and badData if it is damaged.
+ */
+{
+  vector<SceneChunk> ret;
+  SceneChunk dirChunk,chunk;
+  char magic[8];
+  uint64_t dirOffset,size;
+  int i;
+  size=fileSize(file);
+  file.seekg(0);
+  file.read(magic,8);
+  if (!file.good() || memcmp(magic,sceneMagic,8) || readleint(file)!=SCENE_VERSION || size<64)
+    throw BeziExcept(badHeader);
+  file.seekg(size-16);
+  dirOffset=readlelong(file);
+  file.read(magic,8);
+  if (!file.good() || memcmp(magic,sceneMagic,8) || dirOffset>size-16-SCENE_HEADER_SIZE)
+    throw BeziExcept(badData);
+  file.seekg(dirOffset);
+  dirChunk=readChunkHeader(file);
+  if (dirChunk.tag!="DIR " || dirChunk.length!=size-16-SCENE_HEADER_SIZE-dirOffset ||
+      dirChunk.length!=(uint64_t)dirChunk.count*32)
+    throw BeziExcept(badData);
+  for (i=0;i<dirChunk.count;i++)
+  {
+    char tag[4];
+    file.read(tag,4);
+    chunk.tag=string(tag,4);
+    chunk.plnum=readleint(file);
+    chunk.encoding=readleint(file);
+    chunk.count=readleint(file);
+    chunk.offset=readlelong(file);
+    chunk.length=readlelong(file);
+    if (chunk.offset>dirOffset || chunk.length>dirOffset-chunk.offset-SCENE_HEADER_SIZE ||
+	chunk.plnum>=dirChunk.count)
+      throw BeziExcept(badData);
+    ret.push_back(chunk);
+  }
+  return ret;
+}
+
+string readChunkPayload(istream &file,const SceneChunk &chunk)
+{
+  SceneChunk header;
+  string ret;
+  file.seekg(chunk.offset);
+  header=readChunkHeader(file);
+  if (header.tag!=chunk.tag || header.plnum!=chunk.plnum || header.encoding!=chunk.encoding ||
+      header.count!=chunk.count || header.length!=chunk.length)
+    throw BeziExcept(badData);
+  ret.resize(chunk.length);
+  file.read(&ret[0],chunk.length);
+  if (!file.good())
+    throw BeziExcept(badData);
+  return ret;
+}
+
+template <typename T>
+vector<T> readChunks(istream &file,vector<SceneChunk> &dir,string tag,int plnum,int encoding,
+		     function<void(istream &,vector<T> &,size_t)> decode)
+/* Reads the chunks with the given tag and pointlist number and decodes
+ * as many at once as there are threads. A chunk in an encoding other than
+ * the one expected, compressed or not, can't be read.
+ */
+{
+  static int cores=thread::hardware_concurrency();
+  int nthreads=(cores>1)?cores:1;
+  size_t i,j;
+  vector<SceneChunk> chunks;
+  vector<future<vector<T> > > parts;
+  vector<T> ret,part;
+  for (i=0;i<dir.size();i++)
+    if (dir[i].tag==tag && dir[i].plnum==plnum)
+    {
+      if ((dir[i].encoding&~SCENE_DEFLATE)!=encoding)
+	throw BeziExcept(badData);
+      chunks.push_back(dir[i]);
+    }
+  for (i=0;i<chunks.size();i+=nthreads)
+  {
+    parts.clear();
+    for (j=i;j<chunks.size() && j<i+nthreads;j++)
+      parts.push_back(async(nthreads>1?launch::async:launch::deferred,[&decode](string payload,size_t count,int encoding)
+	{
+	  if (encoding&SCENE_DEFLATE)
+	    payload=inflatePayload(payload);
+	  istringstream part(payload);
+	  vector<T> items;
+	  decode(part,items,count);
+	  if (!part.good() || (size_t)part.tellg()!=payload.size())
+	    throw BeziExcept(badData);
+	  return items;
+	},readChunkPayload(file,chunks[j]),chunks[j].count,chunks[j].encoding));
+    for (j=0;j<parts.size();j++)
+    {
+      part=parts[j].get();
+      ret.insert(ret.end(),part.begin(),part.end());
+    }
+  }
+  return ret;
+}
+
+void readPointlist(istream &file,vector<SceneChunk> &dir,pointlist &pl,int plnum,int sections)
+{
+  vector<ScenePoint> pnts;
+  vector<TriangleCorners> tris;
+  vector<SceneSettings> settings;
+  triangle newtri;
+  size_t i;
+  int j;
+  if (sections&SCENE_SETTINGS)
+  {
+    settings=readChunks<SceneSettings>(file,dir,"PLST",plnum,SCENE_VARINT,[](istream &part,vector<SceneSettings> &items,size_t count)
+	{
+	  SceneSettings set;
+	  criterion crit;
+	  size_t n=readuvarint(part);
+	  for (;n>0 && part.good();n--)
+	  {
+	    crit.readBinary(part);
+	    set.crit.push_back(crit);
+	  }
+	  set.contourInterval.readBinary(part);
+	  items.push_back(set);
+	});
+    if (settings.size())
+    {
+      pl.crit=settings[0].crit;
+      pl.contourInterval=settings[0].contourInterval;
+    }
+  }
+  if (sections&SCENE_POINTS)
+  {
+    pnts=readChunks<ScenePoint>(file,dir,"PNTS",plnum,SCENE_VARINT|SCENE_XOR,[](istream &part,vector<ScenePoint> &items,size_t count)
+	{
+	  long long num=0;
+	  double prev[5]={0,0,0,0,0};
+	  double x,y,z,gx,gy;
+	  ScenePoint pnt;
+	  for (;count>0 && part.good();count--)
+	  {
+	    num+=readsvarint(part);
+	    if (num<INT_MIN || num>INT_MAX)
+	      throw BeziExcept(badData);
+	    x=readXorDouble(part,prev[0]);
+	    y=readXorDouble(part,prev[1]);
+	    z=readXorDouble(part,prev[2]);
+	    gx=readXorDouble(part,prev[3]);
+	    gy=readXorDouble(part,prev[4]);
+	    pnt.num=num;
+	    pnt.pnt=xyz(x,y,z);
+	    pnt.gradient=xy(gx,gy);
+	    pnt.note=readustring(part);
+	    items.push_back(pnt);
+	  }
+	});
+    for (i=0;i<pnts.size();i++)
+    {
+      pl.points[pnts[i].num]=point(pnts[i].pnt,pnts[i].note);
+      pl.points[pnts[i].num].gradient=pnts[i].gradient;
+      pl.revpoints[&pl.points[pnts[i].num]]=pnts[i].num;
+    }
+  }
+  if (sections&SCENE_TIN)
+  {
+    tris=readChunks<TriangleCorners>(file,dir,"TINS",plnum,SCENE_VARINT|SCENE_XOR,[](istream &part,vector<TriangleCorners> &items,size_t count)
+	{
+	  TriangleCorners tri;
+	  long long a=0;
+	  double prev[7]={0,0,0,0,0,0,0};
+	  int i;
+	  for (;count>0 && part.good();count--)
+	  {
+	    a+=readsvarint(part);
+	    tri.a=a;
+	    tri.b=a+readsvarint(part);
+	    tri.c=a+readsvarint(part);
+	    for (i=0;i<7;i++)
+	      tri.ctrl[i]=readXorDouble(part,prev[i]);
+	    items.push_back(tri);
+	  }
+	});
+    for (i=0;i<tris.size();i++)
+    {
+      if (!pl.points.count(tris[i].a) || !pl.points.count(tris[i].b) || !pl.points.count(tris[i].c))
+	throw BeziExcept(badData);
+      newtri.a=&pl.points[tris[i].a];
+      newtri.b=&pl.points[tris[i].b];
+      newtri.c=&pl.points[tris[i].c];
+      newtri.flatten();
+#ifndef FLATTRIANGLE
+      for (j=0;j<7;j++)
+	newtri.ctrl[j]=tris[i].ctrl[j];
+#endif
+      pl.triangles[i]=newtri;
+    }
+    if (tris.size())
+      pl.makeEdges();
+  }
+  if (sections&SCENE_BREAKLINES)
+    pl.type0Breaklines=readChunks<Breakline0>(file,dir,"BRK0",plnum,SCENE_VARINT,[](istream &part,vector<Breakline0> &items,size_t count)
+	{
+	  size_t i;
+	  items.resize(count);
+	  for (i=0;i<count;i++)
+	    items[i].readBinary(part);
+	});
+  if (sections&SCENE_CONTOURS)
+    pl.contours=readChunks<polyspiral>(file,dir,"CONT",plnum,SCENE_VARINT,[](istream &part,vector<polyspiral> &items,size_t count)
+	{
+	  size_t i;
+	  items.resize(count);
+	  for (i=0;i<count;i++)
+	    items[i].readBinary(part);
+	});
+}
+
+void readScene(istream &file,document &doc,int sections)
+/* Replaces each pointlist in the file with the sections read from it.
+ * The TIN cannot be read without the points, so they are read too.
+ */
+{
+  vector<SceneChunk> dir=readSceneDirectory(file);
+  set<int> plnums;
+  set<int>::iterator i;
+  size_t j;
+  if (sections&SCENE_TIN)
+    sections|=SCENE_POINTS;
+  for (j=0;j<dir.size();j++)
+    plnums.insert(dir[j].plnum);
+  for (i=plnums.begin();i!=plnums.end();++i)
+  {
+    doc.makepointlist(*i);
+    doc.pl[*i].clear();
+    doc.pl[*i].crit.clear();
+    doc.pl[*i].contourInterval=ContourInterval();
+    doc.pl[*i].type0Breaklines.clear();
+    readPointlist(file,dir,doc.pl[*i],*i,sections);
+  }
+}
+
+void readScene(string fileName,document &doc,int sections)
+{
+  ifstream file(fileName,ios::binary);
+  readScene(file,doc,sections);
+}
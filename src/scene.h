@@ -0,0 +1,81 @@
+/******************************************************/
+/*                                                    */
+/* scene.h - binary chunked scene files               */
+/*                                                    */
+/******************************************************/
+/* Copyright 2026 Pierre Abbat.
+ * This file is part of Bezitopo.
+ *
+ * Bezitopo is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * Bezitopo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License and Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * and Lesser General Public License along with Bezitopo. If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SCENE_H
+#define SCENE_H
+#include <string>
+#include <vector>
+#include <iostream>
+#include <cstdint>
+#include "document.h"
+
+/* A scene file holds the same things as the pointlists in an XML file, in
+ * binary. It consists of a header, chunks, a directory of the chunks, and
+ * a trailer pointing to the directory, so that a reader can go straight to
+ * the sections it wants. Each section (points, TIN, breaklines, contours,
+ * and settings) of each pointlist is split into chunks of at most
+ * SCENE_BLOCK items, which are encoded and decoded in parallel.
+ *
+ * All numbers are little-endian. Each chunk begins with a four-letter tag,
+ * the pointlist number, the encoding, the number of items, and the length
+ * of the rest of the chunk. The encoding is a set of bits telling how
+ * numbers are compressed; a reader that doesn't know a bit must not read
+ * the chunk.
+ */
+
+#define SCENE_BLOCK 65536
+
+// Sections, used to choose which to read
+#define SCENE_SETTINGS 1
+#define SCENE_POINTS 2
+#define SCENE_TIN 4
+#define SCENE_BREAKLINES 8
+#define SCENE_CONTOURS 16
+#define SCENE_ALL 31
+
+// Encodings
+#define SCENE_VARINT 1
+// Integers are written as differences from the previous one in variable length.
+#define SCENE_XOR 2
+/* Coordinates are exclusive-ored with the previous one of the same kind,
+ * and only the bytes that are not zero are written.
+ */
+#define SCENE_DEFLATE 4
+/* The payload, after being encoded as above, is compressed with qCompress,
+ * which is zlib's deflate preceded by the length, big-endian, in four bytes.
+ */
+
+struct SceneChunk
+{
+  std::string tag;
+  uint32_t plnum,encoding,count;
+  uint64_t offset,length; // offset of the chunk header, length of the payload
+};
+
+void writeScene(std::ostream &file,document &doc,bool deflate=true);
+void writeScene(std::string fileName,document &doc,bool deflate=true);
+std::vector<SceneChunk> readSceneDirectory(std::istream &file);
+void readScene(std::istream &file,document &doc,int sections=SCENE_ALL);
+void readScene(std::string fileName,document &doc,int sections=SCENE_ALL);
+#endif
@@ -0,0 +1,148 @@
+/******************************************************/
+/*                                                    */
+/* segindex.cpp - grid index of line segments         */
+/*                                                    */
+/******************************************************/
+/* Copyright 2026 Pierre Abbat.
+ * This file is part of Bezitopo.
+ *
+ * Bezitopo is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * Bezitopo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License and Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * and Lesser General Public License along with Bezitopo. If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <cmath>
+#include <algorithm>
+#include "segindex.h"
+
+using namespace std;
+
+SegmentIndex::SegmentIndex()
+{
+  clear();
+}
+
+void SegmentIndex::clear()
+{
+  ncols=nrows=0;
+  cellSide=1;
+  stamp=0;
+  cellStart.clear();
+  seg.clear();
+  mark.clear();
+}
+
+bool SegmentIndex::empty()
+{
+  return seg.size()==0;
+}
+
+void SegmentIndex::cellRange(xy a,xy b,int &locol,int &hicol,int &lorow,int &hirow)
+/* Finds the cells touched by the bounding box of ab. If the box misses the
+ * grid, locol>hicol or lorow>hirow.
+ */
+{
+  double lox=(min(a.east(),b.east())-origin.east())/cellSide;
+  double hix=(max(a.east(),b.east())-origin.east())/cellSide;
+  double loy=(min(a.north(),b.north())-origin.north())/cellSide;
+  double hiy=(max(a.north(),b.north())-origin.north())/cellSide;
+  locol=max(0.,floor(lox));
+  hicol=min(ncols-1.,floor(hix));
+  lorow=max(0.,floor(loy));
+  hirow=min(nrows-1.,floor(hiy));
+  if (!(hix>=0) || !(lox<ncols))
+    hicol=locol-1;
+  if (!(hiy>=0) || !(loy<nrows))
+    hirow=lorow-1;
+}
+
+void SegmentIndex::build(vector<segment> &segs)
+/* Makes cells about as big as the average segment, or big enough that
+ * there are about as many cells as segments, whichever is bigger.
+ */
+{
+  int i,r,c,locol,hicol,lorow,hirow;
+  double minx=INFINITY,miny=INFINITY,maxx=-INFINITY,maxy=-INFINITY,totlen=0;
+  vector<unsigned> count;
+  xy a,b;
+  clear();
+  if (segs.size()==0)
+    return;
+  for (i=0;i<segs.size();i++)
+  {
+    a=segs[i].getstart();
+    b=segs[i].getend();
+    minx=min(minx,min(a.east(),b.east()));
+    miny=min(miny,min(a.north(),b.north()));
+    maxx=max(maxx,max(a.east(),b.east()));
+    maxy=max(maxy,max(a.north(),b.north()));
+    totlen+=dist(a,b);
+  }
+  origin=xy(minx,miny);
+  cellSide=max(totlen/segs.size(),sqrt((maxx-minx)*(maxy-miny)/segs.size()));
+  while ((maxx-minx)/cellSide*(maxy-miny)/cellSide>4.*segs.size()+16)
+    cellSide*=2;
+  if (!(cellSide>0))
+    cellSide=1;
+  ncols=floor((maxx-minx)/cellSide)+1;
+  nrows=floor((maxy-miny)/cellSide)+1;
+  count.resize(ncols*nrows+1);
+  for (i=0;i<segs.size();i++)
+  {
+    cellRange(segs[i].getstart(),segs[i].getend(),locol,hicol,lorow,hirow);
+    for (r=lorow;r<=hirow;r++)
+      for (c=locol;c<=hicol;c++)
+	count[r*ncols+c+1]++;
+  }
+  for (i=0;i<ncols*nrows;i++)
+    count[i+1]+=count[i];
+  cellStart=count;
+  seg.resize(count.back());
+  for (i=0;i<segs.size();i++)
+  {
+    cellRange(segs[i].getstart(),segs[i].getend(),locol,hicol,lorow,hirow);
+    for (r=lorow;r<=hirow;r++)
+      for (c=locol;c<=hicol;c++)
+	seg[count[r*ncols+c]++]=i;
+  }
+  mark.resize(segs.size());
+}
+
+vector<int> SegmentIndex::nearby(xy a,xy b)
+/* Returns the segments that may intersect ab, each once, in the order
+ * they were found.
+ */
+{
+  vector<int> ret;
+  int r,c,locol,hicol,lorow,hirow;
+  unsigned j;
+  if (empty())
+    return ret;
+  cellRange(a,b,locol,hicol,lorow,hirow);
+  if (++stamp==0)
+  {
+    fill(mark.begin(),mark.end(),0);
+    stamp=1;
+  }
+  for (r=lorow;r<=hirow;r++)
+    for (c=locol;c<=hicol;c++)
+      for (j=cellStart[r*ncols+c];j<cellStart[r*ncols+c+1];j++)
+	if (mark[seg[j]]!=stamp)
+	{
+	  mark[seg[j]]=stamp;
+	  ret.push_back(seg[j]);
+	}
+  return ret;
+}
@@ -0,0 +1,56 @@
+/******************************************************/
+/*                                                    */
+/* segindex.h - grid index of line segments           */
+/*                                                    */
+/******************************************************/
+/* Copyright 2026 Pierre Abbat.
+ * This file is part of Bezitopo.
+ *
+ * Bezitopo is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * Bezitopo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License and Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * and Lesser General Public License along with Bezitopo. If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef SEGINDEX_H
+#define SEGINDEX_H
+#include <vector>
+#include "segment.h"
+
+class SegmentIndex
+/* A uniform grid over a set of segments, such as the type-0 breaklines.
+ * Each segment is listed in every cell its bounding box touches, so any
+ * segment that intersects a line is listed in some cell touched by the
+ * line's bounding box. The cells are stored as in a compressed sparse row
+ * matrix: the segments in cell i are seg[cellStart[i]] through
+ * seg[cellStart[i+1]-1].
+ */
+{
+public:
+  SegmentIndex();
+  void clear();
+  bool empty();
+  void build(std::vector<segment> &segs);
+  std::vector<int> nearby(xy a,xy b);
+private:
+  xy origin;
+  double cellSide;
+  int ncols,nrows;
+  std::vector<unsigned> cellStart;
+  std::vector<int> seg;
+  std::vector<unsigned> mark;
+  unsigned stamp;
+  void cellRange(xy a,xy b,int &locol,int &hicol,int &lorow,int &hirow);
+};
+#endif
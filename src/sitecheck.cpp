@@ -33,8 +33,12 @@ ProjectionList allProjections;
 
 void readAllProjections()
 {
-  ifstream pfile(string(SHARE_DIR)+"/projections.txt");
-  allProjections.readFile(pfile);
+  ifstream pcat(string(SHARE_DIR)+"/projections.cat",ios::binary);
+  if (!allProjections.readCatalog(pcat))
+  {
+    ifstream pfile(string(SHARE_DIR)+"/projections.txt");
+    allProjections.readFile(pfile);
+  }
 }
 
 int main(int argc, char *argv[])
@@ -0,0 +1,371 @@
+/******************************************************/
+/*                                                    */
+/* sparse.cpp - sparse matrices                       */
+/*                                                    */
+/******************************************************/
+/* Copyright 2026 Pierre Abbat.
+ * This file is part of Bezitopo.
+ *
+ * Bezitopo is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * Bezitopo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License and Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * and Lesser General Public License along with Bezitopo. If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include <cmath>
+#include <set>
+#include <algorithm>
+#include "sparse.h"
+#include "except.h"
+#include "manysum.h"
+
+using namespace std;
+
+/* A pivot less than this times the diagonal entry it started as is taken
+ * as zero. The diagonal of AᵀA is the sum of squares of a column of A,
+ * so this is about the square of the relative precision of a measurement
+ * that could distinguish the column from a combination of others.
+ */
+#define LDL_TOLER 1e-12
+
+bool operator<(const SparseEntry &a,const SparseEntry &b)
+{
+  return a.column<b.column;
+}
+
+SparseMatrix::SparseMatrix()
+{
+  rows=columns=0;
+  consolidated=true;
+}
+
+SparseMatrix::SparseMatrix(unsigned r,unsigned c)
+{
+  rows=r;
+  columns=c;
+  entries.resize(rows);
+  consolidated=true;
+}
+
+SparseMatrix::SparseMatrix(matrix &m)
+{
+  int i,j;
+  SparseEntry ent;
+  rows=m.getrows();
+  columns=m.getcolumns();
+  entries.resize(rows);
+  for (i=0;i<rows;i++)
+    for (j=0;j<columns;j++)
+      if (m[i][j]!=0)
+      {
+	ent.column=j;
+	ent.value=m[i][j];
+	entries[i].push_back(ent);
+      }
+  consolidated=true;
+}
+
+void SparseMatrix::resize(unsigned newrows,unsigned newcolumns)
+{
+  int i,j;
+  rows=newrows;
+  columns=newcolumns;
+  entries.resize(rows);
+  for (i=0;i<rows;i++)
+  {
+    for (j=entries[i].size()-1;j>=0;j--)
+      if (entries[i][j].column>=columns)
+	entries[i].erase(entries[i].begin()+j);
+  }
+}
+
+size_t SparseMatrix::nonzeros()
+{
+  size_t ret=0;
+  int i;
+  consolidate();
+  for (i=0;i<rows;i++)
+    ret+=entries[i].size();
+  return ret;
+}
+
+void SparseMatrix::add(unsigned row,unsigned column,double value)
+{
+  SparseEntry ent;
+  if (row>=rows || column>=columns)
+    throw BeziExcept(matrixMismatch);
+  ent.column=column;
+  ent.value=value;
+  if (entries[row].size() && entries[row].back().column>=column)
+    consolidated=false;
+  entries[row].push_back(ent);
+}
+
+void SparseMatrix::consolidate()
+/* Sorts each row by column and adds together entries in the same column.
+ * The entries in one place are added with pairwisesum, as in matrix::transmult.
+ */
+{
+  int i,j,k;
+  vector<double> same;
+  vector<SparseEntry> merged;
+  SparseEntry ent;
+  if (consolidated)
+    return;
+  for (i=0;i<rows;i++)
+  {
+    stable_sort(entries[i].begin(),entries[i].end());
+    merged.clear();
+    for (j=0;j<entries[i].size();j=k)
+    {
+      same.clear();
+      for (k=j;k<entries[i].size() && entries[i][k].column==entries[i][j].column;k++)
+	same.push_back(entries[i][k].value);
+      ent.column=entries[i][j].column;
+      ent.value=pairwisesum(same);
+      if (ent.value!=0)
+	merged.push_back(ent);
+    }
+    entries[i].swap(merged);
+  }
+  consolidated=true;
+}
+
+vector<SparseEntry> &SparseMatrix::operator[](unsigned row)
+{
+  consolidate();
+  return entries[row];
+}
+
+SparseMatrix SparseMatrix::transpose()
+{
+  SparseMatrix ret(columns,rows);
+  int i,j;
+  SparseEntry ent;
+  consolidate();
+  for (i=0;i<rows;i++)
+    for (j=0;j<entries[i].size();j++)
+    {
+      ent.column=i;
+      ent.value=entries[i][j].value;
+      ret.entries[entries[i][j].column].push_back(ent);
+    }
+  return ret;
+}
+
+SparseMatrix SparseMatrix::transmult()
+/* Computes this times its transpose, as matrix::transmult does. Every pair
+ * of rows with an entry in the same column contributes to the result, so
+ * it is done by going through the columns.
+ */
+{
+  SparseMatrix ret(rows,rows),tr=transpose();
+  int i,j,k;
+  vector<SparseEntry> *col;
+  for (i=0;i<columns;i++)
+  {
+    col=&tr.entries[i];
+    for (j=0;j<col->size();j++)
+      for (k=0;k<col->size();k++)
+	ret.add((*col)[j].column,(*col)[k].column,(*col)[j].value*(*col)[k].value);
+  }
+  ret.consolidate();
+  return ret;
+}
+
+vector<double> SparseMatrix::operator*(const vector<double> &v)
+{
+  vector<double> ret,products;
+  int i,j;
+  if (v.size()!=columns)
+    throw BeziExcept(matrixMismatch);
+  consolidate();
+  ret.resize(rows);
+  for (i=0;i<rows;i++)
+  {
+    products.resize(entries[i].size());
+    for (j=0;j<entries[i].size();j++)
+      products[j]=entries[i][j].value*v[entries[i][j].column];
+    ret[i]=pairwisesum(products);
+  }
+  return ret;
+}
+
+vector<unsigned> minimumDegreeOrder(SparseMatrix &m)
+/* Orders the rows and columns of a symmetric matrix so that eliminating
+ * them in that order creates little fill. At each step it eliminates the
+ * row with the fewest neighbors, then joins its neighbors into a clique.
+ * Ties are broken by the lowest row number, so the order is reproducible.
+ */
+{
+  int i,j;
+  unsigned v,n=m.getrows();
+  vector<vector<unsigned> > adj(n);
+  vector<unsigned> nbr,merged,ret;
+  vector<bool> done(n,false);
+  set<pair<unsigned,unsigned> > queue;
+  if (m.getcolumns()!=n)
+    throw BeziExcept(matrixMismatch);
+  for (i=0;i<n;i++)
+  {
+    for (j=0;j<m[i].size();j++)
+      if (m[i][j].column!=i)
+	adj[i].push_back(m[i][j].column);
+    queue.insert(make_pair((unsigned)adj[i].size(),(unsigned)i));
+  }
+  while (queue.size())
+  {
+    v=queue.begin()->second;
+    queue.erase(queue.begin());
+    done[v]=true;
+    ret.push_back(v);
+    nbr.clear();
+    for (i=0;i<adj[v].size();i++)
+      if (!done[adj[v][i]])
+	nbr.push_back(adj[v][i]);
+    for (i=0;i<nbr.size();i++)
+    {
+      queue.erase(make_pair((unsigned)adj[nbr[i]].size(),nbr[i]));
+      merged.clear();
+      set_union(adj[nbr[i]].begin(),adj[nbr[i]].end(),nbr.begin(),nbr.end(),back_inserter(merged));
+      adj[nbr[i]].clear();
+      for (j=0;j<merged.size();j++)
+	if (merged[j]!=nbr[i] && !done[merged[j]])
+	  adj[nbr[i]].push_back(merged[j]);
+      queue.insert(make_pair((unsigned)adj[nbr[i]].size(),nbr[i]));
+    }
+    adj[v].clear();
+    adj[v].shrink_to_fit();
+  }
+  return ret;
+}
+
+SparseLdl::SparseLdl(SparseMatrix &m)
+/* Up-looking LDLᵀ factorization. Row k of L is found by solving a
+ * triangular system whose nonzero pattern is the set of ancestors, in the
+ * elimination tree, of the nonzeros in row k of the permuted matrix.
+ */
+{
+  int i,k,len,top;
+  size_t p;
+  vector<int> flag;
+  vector<size_t> lnz;
+  vector<unsigned> pattern;
+  vector<double> y,diag;
+  double yi,lki;
+  n=m.getrows();
+  if (m.getcolumns()!=n)
+    throw BeziExcept(matrixMismatch);
+  perm=minimumDegreeOrder(m);
+  invperm.resize(n);
+  for (i=0;i<n;i++)
+    invperm[perm[i]]=i;
+  parent.resize(n);
+  flag.resize(n);
+  lnz.resize(n);
+  for (k=0;k<n;k++) // Compute the elimination tree and the column counts of L.
+  {
+    parent[k]=-1;
+    flag[k]=k;
+    lnz[k]=0;
+    for (p=0;p<m[perm[k]].size();p++)
+    {
+      i=invperm[m[perm[k]][p].column];
+      for (;i<k && flag[i]!=k;i=parent[i])
+      {
+	if (parent[i]==-1)
+	  parent[i]=k;
+	lnz[i]++;
+	flag[i]=k;
+      }
+    }
+  }
+  lp.resize(n+1);
+  lp[0]=0;
+  for (k=0;k<n;k++)
+    lp[k+1]=lp[k]+lnz[k];
+  li.resize(lp[n]);
+  lx.resize(lp[n]);
+  d.resize(n);
+  zeroPivot.resize(n);
+  y.resize(n);
+  pattern.resize(n);
+  diag.resize(n);
+  for (k=0;k<n;k++) // Compute the entries of L and D.
+  {
+    y[k]=0;
+    top=n;
+    flag[k]=k;
+    lnz[k]=0;
+    for (p=0;p<m[perm[k]].size();p++)
+    {
+      i=invperm[m[perm[k]][p].column];
+      if (i<=k)
+      {
+	y[i]+=m[perm[k]][p].value;
+	for (len=0;flag[i]!=k;i=parent[i])
+	{
+	  pattern[len++]=i;
+	  flag[i]=k;
+	}
+	while (len>0)
+	  pattern[--top]=pattern[--len];
+      }
+    }
+    diag[k]=d[k]=y[k];
+    y[k]=0;
+    for (;top<n;top++)
+    {
+      i=pattern[top];
+      yi=y[i];
+      y[i]=0;
+      for (p=lp[i];p<lp[i]+lnz[i];p++)
+	y[li[p]]-=lx[p]*yi;
+      lki=zeroPivot[i]?0:yi/d[i];
+      d[k]-=lki*yi;
+      li[p]=k;
+      lx[p]=lki;
+      lnz[i]++;
+    }
+    zeroPivot[k]=d[k]<=LDL_TOLER*diag[k];
+    if (zeroPivot[k])
+      d[k]=0;
+  }
+}
+
+vector<double> SparseLdl::solve(vector<double> b)
+{
+  vector<double> x(n),ret(n);
+  int j;
+  size_t p;
+  if (b.size()!=n)
+    throw BeziExcept(matrixMismatch);
+  for (j=0;j<n;j++)
+    x[j]=b[perm[j]];
+  for (j=0;j<n;j++)
+    for (p=lp[j];p<lp[j+1];p++)
+      x[li[p]]-=lx[p]*x[j];
+  for (j=0;j<n;j++)
+    x[j]=zeroPivot[j]?0:x[j]/d[j];
+  for (j=n-1;j>=0;j--)
+    for (p=lp[j];p<lp[j+1];p++)
+      x[j]-=lx[p]*x[li[p]];
+  for (j=0;j<n;j++)
+    ret[perm[j]]=zeroPivot[j]?NAN:x[j];
+  return ret;
+}
+
+bool SparseLdl::singular(unsigned column)
+{
+  return zeroPivot[invperm[column]];
+}
@@ -0,0 +1,95 @@
+/******************************************************/
+/*                                                    */
+/* sparse.h - sparse matrices                         */
+/*                                                    */
+/******************************************************/
+/* Copyright 2026 Pierre Abbat.
+ * This file is part of Bezitopo.
+ *
+ * Bezitopo is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * Bezitopo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License and Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * and Lesser General Public License along with Bezitopo. If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SPARSE_H
+#define SPARSE_H
+#include <vector>
+#include "matrix.h"
+
+struct SparseEntry
+{
+  unsigned column;
+  double value;
+};
+
+class SparseMatrix
+/* Stores only the nonzero entries of each row. Entries may be added in any
+ * order and more than once to the same place; consolidate() sorts each row
+ * and adds duplicates together. All other methods consolidate first.
+ */
+{
+protected:
+  unsigned rows,columns;
+  bool consolidated;
+  std::vector<std::vector<SparseEntry> > entries;
+public:
+  SparseMatrix();
+  SparseMatrix(unsigned r,unsigned c);
+  SparseMatrix(matrix &m);
+  void resize(unsigned newrows,unsigned newcolumns);
+  unsigned getrows()
+  {
+    return rows;
+  }
+  unsigned getcolumns()
+  {
+    return columns;
+  }
+  size_t nonzeros();
+  void add(unsigned row,unsigned column,double value);
+  void consolidate();
+  std::vector<SparseEntry> &operator[](unsigned row);
+  SparseMatrix transpose();
+  SparseMatrix transmult();
+  std::vector<double> operator*(const std::vector<double> &v);
+};
+
+std::vector<unsigned> minimumDegreeOrder(SparseMatrix &m);
+
+class SparseLdl
+/* Factors a symmetric positive semidefinite sparse matrix as PᵀLDLᵀP, where
+ * P is a minimum-degree permutation, which keeps L from filling in much
+ * when the matrix comes from a network of points joined by measurements.
+ * A pivot which is zero, or nearly so compared to its diagonal entry,
+ * is marked singular; the corresponding unknown is NaN in the solution.
+ */
+{
+public:
+  SparseLdl(SparseMatrix &m);
+  std::vector<double> solve(std::vector<double> b);
+  bool singular(unsigned column);
+  size_t fill()
+  {
+    return li.size();
+  }
+private:
+  unsigned n;
+  std::vector<unsigned> perm,invperm;
+  std::vector<int> parent;
+  std::vector<size_t> lp;
+  std::vector<unsigned> li;
+  std::vector<double> lx,d;
+  std::vector<bool> zeroPivot;
+};
+#endif
@@ -57,6 +57,7 @@
 #include <cstdio>
 #include <iostream>
 #include <cfloat>
+#include <atomic>
 #include "spiral.h"
 #include "angle.h"
 #include "vcurve.h"
@@ -72,7 +73,12 @@ using namespace std;
 // When computing area, if the curve exceeds either of these, it will split it.
 #define CURLTEST 4
 // Number of points to try in the too curly test. 2 doesn't work, but 4 appears to.
-vector<int> cornuhisto;
+#define CORNUHISTO 64
+/* cornu is called in several threads at once, so the counts are atomic and
+ * incremented without ordering. Iteration counts from CORNUHISTO-1 up are
+ * counted together in the last bucket.
+ */
+atomic<int> cornuhisto[CORNUHISTO];
 
 xy cornu(double t)
 /* If |t|>=6, it returns the limit points rather than a value with no precision.
@@ -95,9 +101,7 @@ xy cornu(double t)
     imagparts.push_back(-facpower/(8*i+7));
     facpower*=t2/(4*i+4);
   }
-  if (i>=cornuhisto.size())
-    cornuhisto.resize(i+1);
-  cornuhisto[i]++;
+  cornuhisto[i<CORNUHISTO?i:CORNUHISTO-1].fetch_add(1,memory_order_relaxed);
   for (i=realparts.size()-1,bigpart=0;i>=0;i--)
   {
     if (fabsl(realparts[i])>bigpart)
@@ -180,10 +184,11 @@ xy cornu(double t,double curvature,double clothance)
 
 void cornustats()
 {
-  int i;
+  int i,n;
   cout<<"Cornu statistics"<<endl;
-  for (i=0;i<cornuhisto.size();i++)
-    cout<<i<<' '<<cornuhisto[i]<<endl;
+  for (n=CORNUHISTO;n>0 && cornuhisto[n-1].load()==0;n--);
+  for (i=0;i<n;i++)
+    cout<<i<<' '<<cornuhisto[i].load()<<endl;
 }
 /* It should be possible to fit a spiral to be tangent to two given circular
  * or straight curves by successive approximation using these functions.
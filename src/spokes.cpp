@@ -0,0 +1,150 @@
+/******************************************************/
+/*                                                    */
+/* spokes.cpp - arrays of edges around points         */
+/*                                                    */
+/******************************************************/
+/* Copyright 2026 Pierre Abbat.
+ * This file is part of Bezitopo.
+ *
+ * Bezitopo is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * Bezitopo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License and Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * and Lesser General Public License along with Bezitopo. If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "spokes.h"
+#include "pointlist.h"
+
+using namespace std;
+
+SpokeArray::SpokeArray()
+{
+  isValid=false;
+}
+
+void SpokeArray::clear()
+{
+  isValid=false;
+  start.clear();
+  count.clear();
+  spokes.clear();
+  rows.clear();
+}
+
+bool SpokeArray::valid()
+{
+  return isValid;
+}
+
+unsigned SpokeArray::fill(int r,point *pnt)
+/* Copies the edges around pnt into row r, as far as there's room, and
+ * returns how many there are.
+ */
+{
+  unsigned n=0,room=start[r+1]-start[r];
+  edge *e=pnt->line;
+  if (e)
+    do
+    {
+      if (n<room)
+	spokes[start[r]+n]=e;
+      n++;
+      e=e->next(pnt);
+    } while (e!=pnt->line && n<=spokes.size());
+  return n;
+}
+
+void SpokeArray::build(pointlist &pl)
+{
+  ptlist::iterator i;
+  int r;
+  clear();
+  start.push_back(0);
+  for (i=pl.points.begin();i!=pl.points.end();++i)
+  {
+    rows[&i->second]=count.size();
+    count.push_back(i->second.valence());
+    start.push_back(start.back()+count.back()+SPOKE_SLACK);
+  }
+  spokes.resize(start.back());
+  for (i=pl.points.begin(),r=0;i!=pl.points.end();++i,++r)
+    fill(r,&i->second);
+  isValid=true;
+}
+
+bool SpokeArray::refresh(point *pnt)
+/* Copies the edges around pnt again after they've changed. If there isn't
+ * room, or pnt wasn't there when the array was built, the array is invalid.
+ */
+{
+  int r=row(pnt);
+  if (r>=0)
+  {
+    count[r]=fill(r,pnt);
+    if (count[r]>start[r+1]-start[r])
+      r=-1;
+  }
+  if (r<0)
+    clear();
+  return isValid;
+}
+
+int SpokeArray::row(point *pnt)
+// Returns -1 if pnt has no row.
+{
+  unordered_map<point *,unsigned>::iterator i;
+  if (!isValid)
+    return -1;
+  i=rows.find(pnt);
+  if (i==rows.end())
+    return -1;
+  return i->second;
+}
+
+edge *SpokeArray::neighbor(point *pnt,point *other)
+/* Returns the edge between pnt and other, or nullptr if they aren't
+ * neighbors. Unlike point::isNeighbor, it doesn't change pnt->line.
+ */
+{
+  int r=row(pnt);
+  unsigned i;
+  edge *e;
+  for (i=0;r>=0 && i<count[r];i++)
+  {
+    e=spokes[start[r]+i];
+    if (e->a==other || e->b==other)
+      return e;
+  }
+  return nullptr;
+}
+
+bool SpokeArray::matches(pointlist &pl)
+// Checks that each row has the same edges in the same cyclic order as the list.
+{
+  ptlist::iterator i;
+  int r;
+  unsigned j,k;
+  bool ret=isValid && rows.size()==pl.points.size();
+  for (i=pl.points.begin();ret && i!=pl.points.end();++i)
+  {
+    r=row(&i->second);
+    ret=r>=0 && count[r]==i->second.valence();
+    for (k=0;ret && k<count[r] && spokes[start[r]+k]!=i->second.line;k++);
+    if (ret && count[r])
+      ret=k<count[r];
+    for (j=1;ret && j<count[r];j++)
+      ret=spokes[start[r]+(k+j)%count[r]]==spokes[start[r]+(k+j-1)%count[r]]->next(&i->second);
+  }
+  return ret;
+}
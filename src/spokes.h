@@ -0,0 +1,74 @@
+/******************************************************/
+/*                                                    */
+/* spokes.h - arrays of edges around points           */
+/*                                                    */
+/******************************************************/
+/* Copyright 2026 Pierre Abbat.
+ * This file is part of Bezitopo.
+ *
+ * Bezitopo is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * Bezitopo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License and Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * and Lesser General Public License along with Bezitopo. If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef SPOKES_H
+#define SPOKES_H
+#include <vector>
+#include <unordered_map>
+
+class point;
+class edge;
+class pointlist;
+
+// Room for this many more spokes in each row, so that flipping can insert
+#define SPOKE_SLACK 2
+
+class SpokeArray
+/* The edges around each point, in the same counterclockwise order as the
+ * circular lists through edge::next, starting at point::line when the row
+ * was made, stored in one array like a compressed sparse row matrix. Row r
+ * is spoke[start[r]] through spoke[start[r]+count[r]-1], and has room for
+ * SPOKE_SLACK more edges. The lists through edge::next are the real thing;
+ * this is a copy for fast reading, made after making a TIN or its edges.
+ * Flipping an edge redoes the rows of the four points involved; if a row
+ * runs out of room, or a point is added or deleted, the whole array is
+ * marked invalid until it is built again.
+ */
+{
+public:
+  SpokeArray();
+  void clear();
+  bool valid();
+  void build(pointlist &pl);
+  bool refresh(point *pnt);
+  int row(point *pnt);
+  unsigned degree(int r)
+  {
+    return count[r];
+  }
+  edge *spoke(int r,unsigned i)
+  {
+    return spokes[start[r]+i];
+  }
+  edge *neighbor(point *pnt,point *other);
+  bool matches(pointlist &pl);
+private:
+  bool isValid;
+  std::vector<unsigned> start,count;
+  std::vector<edge *> spokes;
+  std::unordered_map<point *,unsigned> rows;
+  unsigned fill(int r,point *pnt);
+};
+#endif
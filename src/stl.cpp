@@ -22,20 +22,40 @@
  * <http://www.gnu.org/licenses/>.
  */
 
+#include <cmath>
+#include <algorithm>
+#include <sstream>
+#include <thread>
+#include <future>
+#include <functional>
+#include <unordered_map>
 #include "stl.h"
 #include "smooth5.h"
+#include "pointlist.h"
+#include "binio.h"
+#include "ldecimal.h"
 using namespace std;
 
-/* The STL polyhedron consists of three kinds of face: bottom, side, and top.
- * The bottom is a convex polygon which is triangulated. The sides are
- * trapezoids, each of which is drawn as two triangles. The top is the
- * TIN surface. Each edge is split into some number of pieces which is a
- * 5-smooth number, enough to make it smooth at the printing scale, then some
- * are split into more pieces because every triangle must have one side that
- * is split into a number of pieces that is a multiple of the number of
- * pieces that the other two sides are split into, which must be equal.
+/* The STL polyhedron consists of three kinds of face: top, bottom, and side.
+ * Each edge is split into some number of pieces which is a 5-smooth number,
+ * enough to stay within STL_RESOLUTION of the curve on the print.
+ * The top is the TIN surface. Each triangle is meshed with an inner grid as
+ * fine as its most split side, and each side is zipped to the grid using
+ * the side's own points, so triangles sharing an edge share its vertices.
+ * The bottom is the TIN flattened to z=0, so it has the same shape as the
+ * TIN, whether or not it is convex. It is one facet under each triangle,
+ * or a fan from the triangle's centroid if a boundary side is split.
+ * The sides are walls under the boundary edges, two facets under each
+ * piece of the edge.
  */
 
+// Largest deviation, in millimeters on the print, of the mesh from the TIN
+#define STL_RESOLUTION 0.05
+// Number of triangles and boundary edges meshed at once by writeStlMesh
+#define STL_BATCH 4096
+
+Printer3dSize printer3d={P3D_RECTANGULAR,200,200,200,1,1,3};
+
 vector<int> stltable;
 vector<short> stlfac;
 
@@ -132,3 +152,421 @@ StlTriangle::StlTriangle(xyz A,xyz B,xyz C)
   normal=cross(a-b,b-c);
   normal.normalize();
 }
+
+struct StlFrame
+/* Converts coordinates of the TIN to coordinates on the print, in millimeters.
+ * The bottom of the print is at z=0.
+ */
+{
+  xyz origin;
+  double factor,base;
+  xyz toPrint(xyz pnt) const
+  {
+    return xyz((pnt.east()-origin.east())*factor,(pnt.north()-origin.north())*factor,
+	       (pnt.elev()-origin.elev())*factor+base);
+  }
+};
+
+vector<array<edge *,3> > triangleSides(pointlist &pl,vector<triangle *> &tris)
+/* Returns the edges of each triangle. Side i is opposite corner i and goes
+ * counterclockwise from corner i+1 to corner i+2.
+ */
+{
+  vector<array<edge *,3> > ret;
+  unordered_map<triangle *,size_t> inx;
+  map<int,edge>::iterator i;
+  triangle *t;
+  int j;
+  ret.resize(tris.size());
+  for (j=0;j<tris.size();j++)
+    inx[tris[j]]=j;
+  for (i=pl.edges.begin();i!=pl.edges.end();++i)
+    for (j=0;j<2;j++)
+    {
+      t=j?i->second.trib:i->second.tria;
+      if (t && inx.count(t))
+      {
+	if (!t->iscorner(i->second.a) || !t->iscorner(i->second.b))
+	  continue;
+	if (t->a!=i->second.a && t->a!=i->second.b)
+	  ret[inx[t]][0]=&i->second;
+	else if (t->b!=i->second.a && t->b!=i->second.b)
+	  ret[inx[t]][1]=&i->second;
+	else
+	  ret[inx[t]][2]=&i->second;
+      }
+    }
+  return ret;
+}
+
+void splitEdgesForStl(pointlist &pl,double maxError)
+/* Sets stlsplit of every edge to the fewest pieces, from the table of smooth
+ * numbers, that keep it within maxError of the curve. The edges are not
+ * made to fit the pattern of two equal sides and a multiple, because raising
+ * one edge to fit one triangle makes its neighbor misfit, and this cascades
+ * across the TIN; stlTopFacets instead meshes any three splits.
+ */
+{
+  map<int,edge>::iterator i;
+  for (i=pl.edges.begin();i!=pl.edges.end();++i)
+  {
+    i->second.stlSplit(maxError);
+    i->second.stlsplit=i->second.stlmin;
+  }
+}
+
+unsigned stlScale(pointlist &pl,Printer3dSize &printer,double outUnit,bool roundScale)
+/* Returns x such that the TIN at 1:x fits in the printer, including the base.
+ * If roundScale, x is a round number: 1, 2, 2.5, or 5 times a power of 10,
+ * or, if outUnit is feet, 12 times 1, 2, 4, or 5 times a power of 10.
+ */
+{
+  map<int,point>::iterator i;
+  double minx=INFINITY,miny=INFINITY,minz=INFINITY,maxx=-INFINITY,maxy=-INFINITY,maxz=-INFINITY;
+  double exact,height;
+  double metric[]={1,2,2.5,5},feet[]={12,24,48,60};
+  double *steps;
+  bool isFeet=fabs(outUnit-0.3048)<0.001;
+  unsigned ret;
+  int j;
+  for (i=pl.points.begin();i!=pl.points.end();++i)
+  {
+    minx=min(minx,i->second.east());
+    miny=min(miny,i->second.north());
+    minz=min(minz,i->second.elev());
+    maxx=max(maxx,i->second.east());
+    maxy=max(maxy,i->second.north());
+    maxz=max(maxz,i->second.elev());
+  }
+  if (pl.points.size()==0)
+    return 1;
+  if (printer.shape==P3D_CIRCULAR)
+    exact=hypot(maxx-minx,maxy-miny)*1000/printer.x;
+  else
+    exact=max((maxx-minx)*1000/printer.x,(maxy-miny)*1000/printer.y);
+  height=printer.z-printer.minBase;
+  if (height>0)
+    exact=max(exact,(maxz-minz)*1000/height);
+  if (!(exact>=1))
+    exact=1;
+  if (roundScale)
+  {
+    steps=isFeet?feet:metric;
+    for (ret=0,j=0;ret==0;j++)
+      if (steps[j%4]*pow(10,j/4)>=exact)
+	ret=lrint(steps[j%4]*pow(10,j/4));
+  }
+  else if (isFeet)
+    ret=ceil(exact/12)*12;
+  else
+    ret=ceil(exact);
+  return ret;
+}
+
+vector<xyz> stlSidePoints(edge *e,point *from,const StlFrame &frame)
+// Returns the ends of the pieces of an edge, starting at from.
+{
+  segment seg=e->getsegment();
+  double len=seg.length();
+  int j,m=stltable[e->stlsplit];
+  vector<xyz> ret;
+  ret.push_back(frame.toPrint(*e->a));
+  for (j=1;j<m;j++)
+    ret.push_back(frame.toPrint(seg.station(len*j/m)));
+  ret.push_back(frame.toPrint(*e->b));
+  if (from!=e->a)
+    reverse(ret.begin(),ret.end());
+  return ret;
+}
+
+void zipStrip(vector<StlTriangle> &facets,vector<xyz> &above,vector<xyz> &below)
+/* Fills the strip between two parallel rows of points, both going left to
+ * right with the strip to the right of above, advancing along whichever
+ * row's next point is nearer in proportion.
+ */
+{
+  size_t top,bot,ntop=above.size()-1,nbot=below.size()-1;
+  for (top=bot=0;top<ntop || bot<nbot;)
+    if (bot==nbot || (top<ntop && (top+1)*nbot<(bot+1)*ntop))
+    {
+      facets.push_back(StlTriangle(above[top],below[bot],above[top+1]));
+      top++;
+    }
+    else
+    {
+      facets.push_back(StlTriangle(above[top],below[bot],below[bot+1]));
+      bot++;
+    }
+}
+
+int stlPieces(array<edge *,3> &sides)
+{
+  return max(stltable[sides[0]->stlsplit],max(stltable[sides[1]->stlsplit],stltable[sides[2]->stlsplit]));
+}
+
+size_t stlTopCount(array<edge *,3> &sides)
+{
+  int n=stlPieces(sides),m=max(n-3,0),s;
+  size_t ret=(size_t)m*m;
+  if (n==1)
+    return 1;
+  for (s=0;s<3;s++)
+    ret+=stltable[sides[s]->stlsplit]+m;
+  return ret;
+}
+
+void stlTopFacets(vector<StlTriangle> &facets,triangle &tri,array<edge *,3> &sides,const StlFrame &frame)
+/* Splits a triangle into facets. If n is the most pieces any side is split
+ * into, the points whose barycentric coordinates are all at least 1/n form
+ * a smaller triangle, which is split into a regular grid of m=n-3 pieces
+ * on a side (or is just the centroid if n<3). Each side of the triangle,
+ * which may be split into fewer than n pieces, is zipped to the side of the
+ * small triangle parallel to it. Row i of the grid, counting from corner a,
+ * goes from side c to side b.
+ */
+{
+  point *corner[3]={tri.a,tri.b,tri.c};
+  int n=stlPieces(sides),m=max(n-3,0),i,j,s;
+  double wb,wc;
+  xy pnt;
+  vector<vector<xyz> > grid;
+  vector<xyz> outer,inner;
+  if (n==1)
+  {
+    facets.push_back(StlTriangle(frame.toPrint(*tri.a),frame.toPrint(*tri.b),frame.toPrint(*tri.c)));
+    return;
+  }
+  grid.resize(m+1);
+  for (i=0;i<=m;i++)
+    for (j=0;j<=i;j++)
+    {
+      if (n<3)
+	wb=wc=1/3.;
+      else
+      {
+	wb=(double)(i-j+1)/n;
+	wc=(double)(j+1)/n;
+      }
+      pnt=xy(*tri.a)+(xy(*tri.b)-xy(*tri.a))*wb+(xy(*tri.c)-xy(*tri.a))*wc;
+      grid[i].push_back(frame.toPrint(xyz(pnt,tri.elevation(pnt))));
+    }
+  for (i=1;i<=m;i++)
+    zipStrip(facets,grid[i-1],grid[i]);
+  for (s=0;s<3;s++)
+  {
+    outer=stlSidePoints(sides[s],corner[(s+1)%3],frame);
+    inner.clear();
+    for (i=0;i<=m;i++)
+      switch (s)
+      {
+	case 0:
+	  inner.push_back(grid[m][i]);
+	  break;
+	case 1:
+	  inner.push_back(grid[m-i][m-i]);
+	  break;
+	case 2:
+	  inner.push_back(grid[i][0]);
+	  break;
+      }
+    zipStrip(facets,inner,outer);
+  }
+}
+
+bool stlBoundary(edge *e)
+{
+  return (e->tria==nullptr)!=(e->trib==nullptr);
+}
+
+size_t stlBottomCount(array<edge *,3> &sides)
+{
+  size_t ret=3;
+  int s;
+  for (s=0;s<3;s++)
+    if (stlBoundary(sides[s]))
+      ret+=stltable[sides[s]->stlsplit]-1;
+  return (ret>3)?ret:1;
+}
+
+void stlBottomFacets(vector<StlTriangle> &facets,triangle &tri,array<edge *,3> &sides,const StlFrame &frame)
+/* Makes the bottom under a triangle, facing down. A side on the boundary is
+ * split as the wall under it is; if any is split, the bottom is a fan from
+ * the centroid, else it is one facet. Interior sides are not split, as the
+ * bottom under the triangle on the other side has the same side.
+ */
+{
+  point *corner[3]={tri.a,tri.b,tri.c};
+  vector<xyz> rim,pts;
+  xyz center;
+  int i,j,s;
+  for (i=0;i<3;i++)
+  {
+    s=(i+2)%3; // side s goes from corner i to corner i+1
+    if (stlBoundary(sides[s]))
+    {
+      pts=stlSidePoints(sides[s],corner[i],frame);
+      for (j=0;j<pts.size()-1;j++)
+	rim.push_back(xyz(xy(pts[j]),0));
+    }
+    else
+      rim.push_back(xyz(xy(frame.toPrint(*corner[i])),0));
+  }
+  if (rim.size()==3)
+    facets.push_back(StlTriangle(rim[0],rim[2],rim[1]));
+  else
+  {
+    center=xyz(xy(frame.toPrint(xyz(tri.centroid(),0))),0);
+    for (i=0;i<rim.size();i++)
+      facets.push_back(StlTriangle(center,rim[(i+1)%rim.size()],rim[i]));
+  }
+}
+
+void stlEdgeFacets(vector<StlTriangle> &facets,edge *e,triangle *tri,const StlFrame &frame)
+/* Makes the side wall under a boundary edge. The walls follow the boundary
+ * of the TIN, including any concavities and holes.
+ */
+{
+  point *from;
+  vector<xyz> pts;
+  xyz b0,b1;
+  int j;
+  if (tri->a!=e->a && tri->a!=e->b)
+    from=tri->b;
+  else if (tri->b!=e->a && tri->b!=e->b)
+    from=tri->c;
+  else
+    from=tri->a;
+  pts=stlSidePoints(e,from,frame);
+  for (j=0;j<pts.size()-1;j++)
+  {
+    b0=xyz(xy(pts[j]),0);
+    b1=xyz(xy(pts[j+1]),0);
+    facets.push_back(StlTriangle(b0,b1,pts[j+1]));
+    facets.push_back(StlTriangle(b0,pts[j+1],pts[j]));
+  }
+}
+
+void writeStlText(ostream &file,const StlTriangle &tri)
+{
+  file<<"facet normal "<<ldecimal(tri.normal.getx())<<' '<<ldecimal(tri.normal.gety())<<' '<<ldecimal(tri.normal.getz())<<'\n';
+  file<<"  outer loop\n";
+  file<<"    vertex "<<ldecimal(tri.a.getx())<<' '<<ldecimal(tri.a.gety())<<' '<<ldecimal(tri.a.getz())<<'\n';
+  file<<"    vertex "<<ldecimal(tri.b.getx())<<' '<<ldecimal(tri.b.gety())<<' '<<ldecimal(tri.b.getz())<<'\n';
+  file<<"    vertex "<<ldecimal(tri.c.getx())<<' '<<ldecimal(tri.c.gety())<<' '<<ldecimal(tri.c.getz())<<'\n';
+  file<<"  endloop\n";
+  file<<"endfacet\n";
+}
+
+void writeStlBinary(ostream &file,const StlTriangle &tri)
+{
+  writelefloat(file,tri.normal.getx());
+  writelefloat(file,tri.normal.gety());
+  writelefloat(file,tri.normal.getz());
+  writelefloat(file,tri.a.getx());
+  writelefloat(file,tri.a.gety());
+  writelefloat(file,tri.a.getz());
+  writelefloat(file,tri.b.getx());
+  writelefloat(file,tri.b.gety());
+  writelefloat(file,tri.b.getz());
+  writelefloat(file,tri.c.getx());
+  writelefloat(file,tri.c.gety());
+  writelefloat(file,tri.c.getz());
+  writeleshort(file,0);
+}
+
+size_t writeStlMesh(ostream &file,pointlist &pl,Printer3dSize &printer,bool asc)
+/* Writes the TIN as a solid, at the scale in printer, in text or binary.
+ * The number of facets is known from the splits before any is made, so the
+ * binary header is written first; then the triangles and boundary edges are
+ * meshed in batches, each split among threads, and written in order.
+ * Returns the number of facets.
+ */
+{
+  static int cores=thread::hardware_concurrency();
+  int nthreads=(cores>1)?cores:1;
+  StlFrame frame;
+  vector<triangle *> tris;
+  vector<array<edge *,3> > sides;
+  vector<edge *> bdy;
+  vector<triangle *> bdyTri;
+  map<int,point>::iterator i;
+  map<int,triangle>::iterator k;
+  map<int,edge>::iterator e;
+  vector<future<string> > parts;
+  size_t nfacets=0,start,end,n;
+  int j;
+  string header;
+  function<void(vector<StlTriangle> &,size_t)> mesh;
+  frame.origin=xyz(INFINITY,INFINITY,INFINITY);
+  for (i=pl.points.begin();i!=pl.points.end();++i)
+    frame.origin=xyz(min(frame.origin.east(),i->second.east()),
+		     min(frame.origin.north(),i->second.north()),
+		     min(frame.origin.elev(),i->second.elev()));
+  frame.factor=1000.*printer.scaleNum/printer.scaleDenom;
+  frame.base=printer.minBase;
+  splitEdgesForStl(pl,STL_RESOLUTION/frame.factor);
+  for (k=pl.triangles.begin();k!=pl.triangles.end();++k)
+    tris.push_back(&k->second);
+  sides=triangleSides(pl,tris);
+  for (j=0;j<tris.size();j++)
+    if (sides[j][0] && sides[j][1] && sides[j][2])
+      nfacets+=stlTopCount(sides[j])+stlBottomCount(sides[j]);
+  for (e=pl.edges.begin();e!=pl.edges.end();++e)
+    if (stlBoundary(&e->second))
+    {
+      bdy.push_back(&e->second);
+      bdyTri.push_back(e->second.tria?e->second.tria:e->second.trib);
+      nfacets+=2*stltable[e->second.stlsplit];
+    }
+  header="Bezitopo TIN at 1:"+to_string(printer.scaleDenom/printer.scaleNum);
+  if (asc)
+    file<<"solid "<<header<<'\n';
+  else
+  {
+    header.resize(80,' ');
+    file<<header;
+    writeleint(file,nfacets);
+  }
+  mesh=[&](vector<StlTriangle> &facets,size_t item)
+  {
+    if (item<tris.size())
+    {
+      if (sides[item][0] && sides[item][1] && sides[item][2])
+      {
+	stlTopFacets(facets,*tris[item],sides[item],frame);
+	stlBottomFacets(facets,*tris[item],sides[item],frame);
+      }
+    }
+    else
+      stlEdgeFacets(facets,bdy[item-tris.size()],bdyTri[item-tris.size()],frame);
+  };
+  n=tris.size()+bdy.size();
+  for (start=0;start<n;start=end)
+  {
+    end=min(n,start+STL_BATCH*nthreads);
+    parts.clear();
+    for (j=0;j<nthreads;j++)
+      parts.push_back(async(nthreads>1?launch::async:launch::deferred,[&mesh,asc](size_t lo,size_t hi)
+	{
+	  ostringstream part;
+	  vector<StlTriangle> facets;
+	  size_t f;
+	  for (;lo<hi;lo++)
+	  {
+	    facets.clear();
+	    mesh(facets,lo);
+	    for (f=0;f<facets.size();f++)
+	      if (asc)
+		writeStlText(part,facets[f]);
+	      else
+		writeStlBinary(part,facets[f]);
+	  }
+	  return part.str();
+	},start+(end-start)*j/nthreads,start+(end-start)*(j+1)/nthreads));
+    for (j=0;j<nthreads;j++)
+      file<<parts[j].get();
+  }
+  if (asc)
+    file<<"endsolid "<<header<<'\n';
+  return nfacets;
+}
@@ -22,11 +22,18 @@
  * <http://www.gnu.org/licenses/>.
  */
 
+#ifndef STL_H
+#define STL_H
 #include <array>
 #include <vector>
+#include <string>
+#include <ostream>
 #include "point.h"
 #include "config.h"
 
+#define P3D_RECTANGULAR 0
+#define P3D_CIRCULAR 1
+
 extern std::vector<int> stltable; // used in bezier.cpp
 void initStlTable();
 std::array<int,3> adjustStlSplit(std::array<int,3> stlSplit,std::array<int,3> stlMin);
@@ -46,3 +53,12 @@ struct Printer3dSize
   unsigned scaleNum,scaleDenom;
   double minBase;
 };
+
+extern Printer3dSize printer3d;
+
+void splitEdgesForStl(pointlist &pl,double maxError);
+unsigned stlScale(pointlist &pl,Printer3dSize &printer,double outUnit,bool roundScale);
+void writeStlText(std::ostream &file,const StlTriangle &tri);
+void writeStlBinary(std::ostream &file,const StlTriangle &tri);
+size_t writeStlMesh(std::ostream &file,pointlist &pl,Printer3dSize &printer,bool asc);
+#endif
@@ -68,4 +68,5 @@ void rotate(document &doc,int n);
 void movesideways(document &doc,double sw);
 void moveup(document &doc,double sw);
 void enlarge(document &doc,double sc);
+extern double (*testsurface)(xy pnt);
 extern xy (*testsurfacegrad)(xy pnt);
@@ -23,6 +23,10 @@
  */
 
 #include <map>
+#include <set>
+#include <unordered_map>
+#include <deque>
+#include <algorithm>
 #include <cmath>
 #include <iostream>
 #include "globals.h"
@@ -37,6 +41,7 @@
 #include "smooth5.h"
 #include "relprime.h"
 #include "stl.h"
+#include "boundrect.h"
 
 #define THR 16777216
 //threshold for goodcenter to determine if a point is sufficiently
@@ -138,6 +143,7 @@ void edge::flip(pointlist *topopoints)
  */
 {
   edge *temp1,*temp2;
+  point *olda=a,*oldb=b;
   int i,size;
   size=topopoints->points.size();
   for (i=0;i<size && a->line->next(a)!=this;i++)
@@ -212,6 +218,13 @@ void edge::flip(pointlist *topopoints)
   setNeighbors();
   broken&=~4; // checkBreak0 has to recompute bits 0 and 1
   flipcnt++;
+  if (topopoints->spokes.valid())
+  {
+    topopoints->spokes.refresh(olda);
+    topopoints->spokes.refresh(oldb);
+    topopoints->spokes.refresh(a);
+    topopoints->spokes.refresh(b);
+  }
 }
 
 void edge::reverse()
@@ -360,6 +373,7 @@ void pointlist::splitBreaklines()
         throw BeziExcept(badBreaklineEnd);
       break0.push_back(segment(points[bl[0]],points[bl[1]]));
     }
+  break0Index.build(break0);
 }
 
 double edge::length()
@@ -492,18 +506,21 @@ bool goodcenter(xy a,xy b,xy c,xy d)
 }
 
 int pointlist::checkBreak0(edge &e)
+// Only the breakline segments near the edge are checked.
 {
   int i;
   segment s;
+  vector<int> near;
   if ((e.broken&4)==0)
   {
     e.broken&=-4;
     s=e.getsegment();
-    for (i=0;i<break0.size();i++)
+    near=break0Index.nearby(*e.a,*e.b);
+    for (i=0;i<near.size();i++)
     {
-      if (intersection_type(s,break0[i])==ACXBD)
+      if (intersection_type(s,break0[near[i]])==ACXBD)
         e.broken|=2;
-      if (sameXyz(s,break0[i]))
+      if (sameXyz(s,break0[near[i]]))
         e.broken|=1;
     }
     e.broken|=4;
@@ -534,6 +551,46 @@ bool pointlist::shouldFlip(edge &e)
   return ret;
 }
 
+void pointlist::forceBreaklines()
+/* Inserts the type-0 breaklines into the TIN by flipping the edges that
+ * cross them, as in Sloan's constrained Delaunay triangulation, instead of
+ * waiting for flipPass to come across them. An edge that crosses a
+ * breakline but is not the diagonal of a convex quadrilateral is put back
+ * in the queue; flipping the others eventually makes it flippable. If the
+ * queue goes all the way around without flipping anything, the rest is
+ * left to flipPass, which throws if breaklines cross.
+ */
+{
+  deque<edge *> crossing;
+  map<int,edge>::iterator i;
+  edge *e;
+  size_t stuck=0;
+  if (break0.size()==0)
+    return;
+  for (i=edges.begin();i!=edges.end();++i)
+    if (checkBreak0(i->second)==2)
+      crossing.push_back(&i->second);
+  while (crossing.size() && stuck<crossing.size())
+  {
+    e=crossing.front();
+    crossing.pop_front();
+    if (checkBreak0(*e)!=2)
+      continue;
+    if (e->isFlippable())
+    {
+      e->flip(this);
+      stuck=0;
+      if (checkBreak0(*e)==2)
+        crossing.push_back(e);
+    }
+    else
+    {
+      crossing.push_back(e);
+      stuck++;
+    }
+  }
+}
+
 bool pointlist::tryStartPoint(PostScript &ps,xy &startpnt)
 /* This is the sweep-hull algorithm (http://s-hull.org), except that the
  * startpoint is random instead of the circumcenter of three points.
@@ -549,6 +606,7 @@ bool pointlist::tryStartPoint(PostScript &ps,xy &startpnt)
   bool fail;
   maxedges=3*points.size()-6;
   edges.clear();
+  spokes.clear();
   convexhull.clear();
   for (m=0;m<100;m++)
   {
@@ -735,154 +793,47 @@ bool pointlist::tryStartPoint(PostScript &ps,xy &startpnt)
   return fail;
 }
 
+bool xyLess(point *l,point *r)
+{
+  return l->east()<r->east() || (l->east()==r->east() && l->north()<r->north());
+}
+
 int1loop pointlist::convexHull()
 /* This is used when reading a bare TIN from a DXF file. The difference between
  * the convex hull and the boundary is a region that must be filled in
  * with triangles.
+ *
+ * This is Andrew's monotone chain: the points are sorted by x and y, then
+ * the lower and upper halves of the hull are made in one pass each, popping
+ * points where the hull turns clockwise. Points on a side of the hull are
+ * kept, as they are on the boundary of the TIN too. The hull goes
+ * counterclockwise.
  */
 {
-  int m,n,val,maxedges,edgeoff;
-  double maxdist,mindist,idist,minx,miny,maxx,maxy;
-  xy startpnt,A,B,C,farthest;
-  multimap<double,point*>::iterator j,k,inspos,left,right;
-  vector<point*> visible; // points of convex hull visible from new point
-  int1loop ret;
+  vector<point *> sorted,hull;
   ptlist::iterator i;
-  vector<double> xsum,ysum;
-  maxedges=3*points.size()-6;
-  convexhull.clear();
+  int j,lower;
+  int1loop ret;
   for (i=points.begin();i!=points.end();i++)
+    sorted.push_back(&i->second);
+  sort(sorted.begin(),sorted.end(),xyLess);
+  for (j=0;j<sorted.size();j++)
   {
-    xsum.push_back(i->second.east());
-    ysum.push_back(i->second.north());
+    while (hull.size()>=2 && area3(*hull[hull.size()-2],*hull.back(),*sorted[j])<0)
+      hull.pop_back();
+    hull.push_back(sorted[j]);
   }
-  startpnt=xy(pairwisesum(xsum)/xsum.size(),pairwisesum(ysum)/ysum.size());
-  for (m=0;m<100;m++)
+  lower=hull.size();
+  for (j=(int)sorted.size()-2;j>=0;j--)
   {
-    outward.clear();
-    for (i=points.begin();i!=points.end();i++)
-      outward.insert(ipoint(dist(startpnt,i->second),&i->second));
-    for (j=outward.begin(),n=0;j!=outward.end();j++,n++)
-    {
-      if (n==0)
-        A=*(j->second);
-      if (n==1)
-        B=*(j->second);
-      if (n==2)
-        C=*(j->second);
-      farthest=*(j->second);
-    }
-    //printf("m=%d startpnt=(%f,%f)\n",m,startpnt.east(),startpnt.north());
-    if (m>0 && goodcenter(startpnt,A,B,C))
-    {
-      //printf("m=%d found good center\n",m);
-      break;
-    }
-    if (m&4)
-      startpnt=rand2p(startpnt,farthest);
-    else
-      startpnt=rand2p(startpnt,C);
-  }
-  j=outward.begin();
-  convexhull.insert(ipoint(dir(startpnt,*(j->second)),j->second));
-  j++;
-  convexhull.insert(ipoint(dir(startpnt,*(j->second)),j->second));
-  //printf("edges %d\n",edges.size());
-  /* Before:
-   * A-----B
-   * |    /|
-   * |   / |
-   * |  /  |
-   * | /   |
-   * |/    |
-   * C-----D
-   *
-   *          E
-   * outward=(D,C,B,A,E)
-   * edges=(DC,BD,BC,AB,AC)
-   * After:
-   * edges=(DC,BD,BC,AB,AC,EC,ED,EB)
-   */
-  for (j++;j!=outward.end();j++)
-  {
-    convexhull.insert(ipoint(dir(startpnt,*(j->second)),j->second));
-    inspos=convexhull.find(dir(startpnt,*(j->second)));
-    /* First find how much the convex hull subtends as seen from the new point,
-     * expressed as distance from the startpnt to the line between an old point
-     * and the new point.
-     */
-    mindist=dist(startpnt,*(j->second));
-    maxdist=-mindist;
-    for (left=inspos,idist=n=0;/*idist>=maxdist && */n<convexhull.size();left--,n++)
-    {
-      if (left->second==j->second)
-        idist=0;
-      else
-      { // i points to a list of points, j to a map of pointers to points
-        idist=pldist(startpnt,*(left->second),*(j->second));
-        if (idist>maxdist)
-          maxdist=idist;
-      }
-      if (left==convexhull.begin())
-        left=convexhull.end();
-    }
-    for (right=inspos,idist=n=0;/*idist<=mindist && */n<convexhull.size();right++,n++)
-    {
-      if (right==convexhull.end())
-        right=convexhull.begin();
-      if (right->second==j->second)
-        idist=0;
-      else
-      {
-        idist=pldist(startpnt,*(right->second),*(j->second));
-        if (idist<mindist)
-          mindist=idist;
-      }
-    }
-    //printf("maxdist=%f mindist=%f\n",maxdist,mindist);
-    /* Then find which convex hull points are the rightmost and leftmost
-     * that can be seen from the new point.
-     */
-    for (left=inspos,idist=n=0;n<2||idist<maxdist;left--,n++)
-    {
-      if (left->second==j->second)
-        idist=0;
-      else
-        idist=pldist(startpnt,*(left->second),*(j->second));
-      if (left==convexhull.begin())
-        left=convexhull.end();
-    }
-    left++;
-    for (right=inspos,idist=n=0;n<2||idist>mindist;right++,n++)
-    {
-      if (right==convexhull.end())
-        right=convexhull.begin();
-      if (right->second==j->second)
-        idist=0;
-      else
-        idist=pldist(startpnt,*(right->second),*(j->second));
-    }
-    right--;
-    //putchar('\n');
-    // Now make a list of the visible points. There are 3 on average.
-    visible.clear();
-    edgeoff=edges.size();
-    for (k=left,n=0,m=1;m;k++,n++,m++)
-    {
-      if (k==convexhull.end())
-        k=convexhull.begin();
-      if (k!=inspos) // skip the point just added
-        visible.push_back(k->second);
-      if (k==right || n==maxedges)
-        m=-1;
-    }
-    val=--n; // subtract one for the point itself
-    // Now delete old convex hull points that are now in the interior.
-    for (m=1;m+1<visible.size();m++)
-      convexhull.erase(dir(startpnt,*visible[m]));
+    while (hull.size()>lower && area3(*hull[hull.size()-2],*hull.back(),*sorted[j])<0)
+      hull.pop_back();
+    hull.push_back(sorted[j]);
   }
-  for (j=convexhull.begin();j!=convexhull.end();j++)
-    ret.push_back(revpoints[j->second]);
+  if (hull.size()>1)
+    hull.pop_back(); // the first point again
+  for (j=0;j<hull.size();j++)
+    ret.push_back(revpoints[hull[j]]);
   return ret;
 }
 
@@ -924,10 +875,11 @@ int pointlist::flipPass(PostScript &ps,bool colorfibaster)
   return m;
 }
 
-void pointlist::maketin(string filename,bool colorfibaster)
+void pointlist::maketin(string filename,bool colorfibaster,bool constrained)
 /* Makes a triangulated irregular network. If <3 points, throws noTriangle without altering
  * the existing TIN. If two points are equal, or close enough to likely cause problems,
  * throws samePoints; the TIN is partially constructed and will have to be destroyed.
+ * If constrained is true, the breaklines are forced in before flipping for Delaunay.
  */
 {
   ptlist::iterator i;
@@ -972,6 +924,8 @@ void pointlist::maketin(string filename,bool colorfibaster)
     ps.dot(startpnt);
     ps.endpage();
   }
+  if (constrained)
+    forceBreaklines();
   flipcount=passcount=0;
   //debugdel=1;
   /* The flipping algorithm can take quadratic time, but usually does not
@@ -990,6 +944,7 @@ void pointlist::maketin(string filename,bool colorfibaster)
     passcount++;
   } while (m && passcount*3<=points.size());
   //printf("Total %d edges flipped in %d passes\n",flipcount,passcount);
+  spokes.build(*this);
   if (ps.isOpen())
   {
     ps.startpage();
@@ -1001,71 +956,95 @@ void pointlist::maketin(string filename,bool colorfibaster)
   }
 }
 
+class GradientSums
+/* Sums for fitting the gradient at a point to the points around it, each
+ * extrapolated toward the point along its own gradient by corr.
+ */
+{
+public:
+  GradientSums()
+  {
+    sum1=sumx=sumy=sumz=sumxx=sumxy=sumxz=sumzz=sumyy=sumyz=0;
+  }
+  void add(point &pnt,edge *e,double corr);
+  bool empty()
+  {
+    return sum1==0;
+  }
+  xy gradient();
+private:
+  double sum1,sumx,sumy,sumz,sumxx,sumxy,sumxz,sumzz,sumyy,sumyz;
+};
+
+void GradientSums::add(point &pnt,edge *e,double corr)
+{
+  double zdiff,zxtrap,zthere;
+  xy gradthere,diff;
+  if (e->broken&8)
+    return;
+  gradthere=e->otherend(&pnt)->gradient;
+  diff=(xy)(*e->otherend(&pnt))-(xy)pnt;
+  zdiff=e->otherend(&pnt)->elev()-pnt.elev();
+  zxtrap=zdiff-dot(gradthere,diff);
+  zthere=zdiff+corr*zxtrap;
+  sum1+=1;
+  sumx+=diff.east();
+  sumy+=diff.north();
+  sumz+=zthere;
+  sumxx+=diff.east()*diff.east();
+  sumyy+=diff.north()*diff.north();
+  sumzz+=zthere*zthere;
+  sumxy+=diff.east()*diff.north();
+  sumxz+=diff.east()*zthere;
+  sumyz+=diff.north()*zthere;
+}
+
+xy GradientSums::gradient()
+{
+  sum1++; //add the point itself to the set
+  sumx/=sum1;
+  sumy/=sum1;
+  sumz/=sum1;
+  sumxx/=sum1;
+  sumyy/=sum1;
+  sumzz/=sum1;
+  sumxy/=sum1;
+  sumxz/=sum1;
+  sumyz/=sum1;
+  sumxx-=sumx*sumx;
+  sumyy-=sumy*sumy;
+  sumzz-=sumz*sumz;
+  sumxy-=sumx*sumy;
+  sumxz-=sumx*sumz;
+  sumyz-=sumy*sumz;
+  /* Gradient is computed by this matrix equation:
+  (xx xy)   (gradx)
+  (     ) × (     ) = (xz yz)
+  (xy yy)   (grady) */
+  return xy(sumxz/sumxx,sumyz/sumyy);
+}
+
 void pointlist::makegrad(double corr)
 // Compute the gradient at each point.
 // corr is a correlation factor which is how much the slope
 // at one end of an edge affects the slope at the other.
 {
   ptlist::iterator i;
-  int n,m;
-  edge *e;
-  double zdiff,zxtrap,zthere;
-  xy gradthere,diff;
-  double sum1,sumx,sumy,sumz,sumxx,sumxy,sumxz,sumzz,sumyy,sumyz;
+  int n,m,r;
+  if (!spokes.valid())
+    spokes.build(*this);
   for (i=points.begin();i!=points.end();i++)
     i->second.gradient=xy(0,0);
   for (n=0;n<10;n++)
   {
     for (i=points.begin();i!=points.end();i++)
     {
-      //i->second.gradient=xy(0,0);
-      sum1=sumx=sumy=sumz=sumxx=sumxy=sumxz=sumzz=sumyy=sumyz=0;
-      for (m=0,e=i->second.line;m==0 || e!=i->second.line;m++,e=e->next(&i->second))
-      if (!(e->broken&8))
-      {
-	gradthere=e->otherend(&i->second)->gradient;
-	diff=(xy)(*e->otherend(&i->second))-(xy)i->second;
-	zdiff=e->otherend(&i->second)->elev()-i->second.elev();
-	zxtrap=zdiff-dot(gradthere,diff);
-	zthere=zdiff+corr*zxtrap;
-	sum1+=1;
-	sumx+=diff.east();
-	sumy+=diff.north();
-	sumz+=zthere;
-	sumxx+=diff.east()*diff.east();
-	sumyy+=diff.north()*diff.north();
-	sumzz+=zthere*zthere;
-	sumxy+=diff.east()*diff.north();
-	sumxz+=diff.east()*zthere;
-	sumyz+=diff.north()*zthere;
-      }
-      //printf("point %d sum1=%f zdiff=%f zthere=%f\n",i->first,sum1,zdiff,zthere);
-      if (sum1)
-      {
-	sum1++; //add the point i to the set
-	sumx/=sum1;
-	sumy/=sum1;
-	sumz/=sum1;
-	sumxx/=sum1;
-	sumyy/=sum1;
-	sumzz/=sum1;
-	sumxy/=sum1;
-	sumxz/=sum1;
-	sumyz/=sum1;
-	sumxx-=sumx*sumx;
-	sumyy-=sumy*sumy;
-	sumzz-=sumz*sumz;
-	sumxy-=sumx*sumy;
-	sumxz-=sumx*sumz;
-	sumyz-=sumy*sumz;
-	/* Gradient is computed by this matrix equation:
-	(xx xy)   (gradx)
-	(     ) × (     ) = (xz yz)
-	(xy yy)   (grady) */
-	i->second.newgradient=xy(sumxz/sumxx,sumyz/sumyy);
-	/*if (i->first==63)
-	printf("sumxz %f sumxx %f sumyz %f sumyy %f\n",sumxz,sumxx,sumyz,sumyy);*/
-      }
+      GradientSums sums;
+      r=spokes.row(&i->second);
+      for (m=0;r>=0 && m<spokes.degree(r);m++)
+	sums.add(i->second,spokes.spoke(r,m),corr);
+      if (!sums.empty())
+	i->second.newgradient=sums.gradient();
       else
 	fprintf(stderr,"Warning: point at address %p has no edges that don't cross breaklines\n",static_cast<void*>(&i->second));
     }
@@ -1137,174 +1116,322 @@ void pointlist::maketriangles()
     edges[i].setNeighbors();
 }
 
+struct ExactXyHash
+{
+  size_t operator()(const xy &pnt) const
+  {
+    double coords[2]={pnt.getx()+0.,pnt.gety()+0.}; // +0. turns -0 into 0
+    return memHash(coords,sizeof(coords));
+  }
+};
+
 void pointlist::makeBareTriangles(vector<array<xyz,3> > bareTriangles)
 /* Assigns point numbers to the corners of the triangles. Makes a qindex and
- * a map of triangles, but no edges. Can throw samePoints or badData.
+ * a map of triangles, but no edges. Can throw badData.
+ *
+ * Corners are matched by exact horizontal position in a hash table, so
+ * this takes linear time. Points are numbered in the order their corners
+ * first appear; a corner with the same x and y as an earlier one, but a
+ * different z, is the same point.
  */
 {
   int i,j;
   vector<xy> corners;
-  point *pont[3];
+  vector<point *> pont;
+  unordered_map<xy,int,ExactXyHash> number;
+  unordered_map<xy,int,ExactXyHash>::iterator k;
   triangle newtri;
   clear();
+  number.reserve(bareTriangles.size());
+  pont.reserve(bareTriangles.size()*3);
   for (i=0;i<bareTriangles.size();i++)
+  {
     for (j=0;j<3;j++)
-    {
       if (outOfGeoRange(bareTriangles[i][j].east(),
 			bareTriangles[i][j].north(),
 			bareTriangles[i][j].elev()))
 	throw BeziExcept(badData);
-      corners.push_back(bareTriangles[i][j]);
-    }
-  qinx.sizefit(corners);
-  qinx.split(corners);
-  for (i=0;i<bareTriangles.size();i++)
-  {
     if (area3(bareTriangles[i][0],bareTriangles[i][1],bareTriangles[i][2])<0)
       swap(bareTriangles[i][0],bareTriangles[i][2]);
     for (j=0;j<3;j++)
     {
-      pont[j]=qinx.findp(bareTriangles[i][j]);
-      if (!pont[j])
+      k=number.find(bareTriangles[i][j]);
+      if (k==number.end())
       {
-	addpoint(1,point(bareTriangles[i][j],""));
-	pont[j]=&points[points.size()];
-	qinx.insertPoint(pont[j]);
+	k=number.insert(make_pair(xy(bareTriangles[i][j]),(int)corners.size()+1)).first;
+	corners.push_back(bareTriangles[i][j]);
+	addpoint(k->second,point(bareTriangles[i][j],""));
       }
+      pont.push_back(&points[k->second]);
     }
-    newtri.a=pont[0];
-    newtri.b=pont[1];
-    newtri.c=pont[2];
+  }
+  number.clear();
+  for (i=0;i<bareTriangles.size();i++)
+  {
+    newtri.a=pont[3*i];
+    newtri.b=pont[3*i+1];
+    newtri.c=pont[3*i+2];
     newtri.flatten();
-    triangles[triangles.size()]=newtri;
+    triangles[i]=newtri;
   }
-  qinx.clearLeaves();
+  qinxLeaves.clear();
+  qinx.sizefit(corners);
+  qinx.split(corners);
+}
+
+bool inOrOn(xy pnt,xy a,xy b,xy c)
+// True if pnt is in the triangle abc or on its boundary, but not on a corner.
+{
+  return area3(a,b,pnt)>=0 && area3(b,c,pnt)>=0 && area3(c,a,pnt)>=0 &&
+         pnt!=a && pnt!=b && pnt!=c;
 }
 
 void pointlist::triangulatePolygon(vector<point *> poly)
 /* Given a polygon, triangulates it, adding the triangles to pointlist::triangles.
  * The polygon results from reading in a TIN as bare triangles. It is the space
  * between the triangles and their convex hull, or enclosed by the triangles
- * if not simply connected.
+ * if not simply connected. It goes counterclockwise and may touch itself
+ * at pinch points.
+ *
+ * The polygon is first split at pinch points into simple pieces. Ears are
+ * then clipped off each piece one at a time. What is left of a piece is
+ * a ring of indices in two flat arrays. A corner is an ear if it turns left
+ * and no corner that doesn't is in or on the triangle it would cut off.
+ * Only the two corners next to a clipped ear can change, so the walk backs
+ * up one corner after each clip and stops when it has gone all the way
+ * around without one.
  */
 {
-  int h,i,j,a,b,c,ai,bi,ci,sz=poly.size(),ba,bb,bc;
-  double da,db,dc;
-  vector<point *> subpoly;
-  vector<double> coords;
-  multimap<double,int> outwardMap;
-  vector<int> outwardVec;
-  multimap<double,int>::iterator k;
-  double xmean,ymean;
-  xy startpnt,centroid;
-  bool found=false;
+  int i,j,sz,left,sinceClip,nReflex;
+  vector<vector<point *> > pieces(1,poly);
+  map<point *,int> seen;
+  vector<int> prv,nxt,reflex;
+  vector<char> isReflex;
+  bool ear;
   triangle newtri;
-  for (i=0;i<sz;i++)
-    coords.push_back(poly[i]->getx());
-  xmean=pairwisesum(coords)/sz;
-  coords.clear();
-  for (i=0;i<sz;i++)
-    coords.push_back(poly[i]->gety());
-  ymean=pairwisesum(coords)/sz;
-  coords.clear();
-  startpnt=xy(xmean,ymean);
-  j=0;
-  /* Try to find a start point that is inside the polygon. It doesn't have to be,
-   * but it is likely to speed up the search for a triangle.
-   */
-  while (sz>2 && startpnt.isfinite() && j<sz*7)
+  while (pieces.size())
   {
-    if (isInside(startpnt,poly))
-      break;
-    startpnt=(startpnt+*poly[rng.usrandom()%sz])/2;
-    j++;
-  }
-  // List the points in order of distance from the start point.
-  for (i=0;i<sz;i++)
-    outwardMap.insert(pair<double,int>(dist(startpnt,*poly[i]),i));
-  for (k=outwardMap.begin();k!=outwardMap.end();++k)
-    outwardVec.push_back(k->second);
-  outwardMap.clear();
-  assert(outwardVec.size()==sz);
-  /* Find a triangle with these properties:
-   * • Its corners are in order around the polygon.
-   * • Its area is positive.
-   * • The other points are outside the triangle or coincide with the corners.
-   *   (It can happen that two points of the polygon are equal; that's called
-   *    a pinch point.)
-   * • The three remainders all have nonnegative area.
-   * • No side of the polygon crosses the triangle.
-   */
-  for (ai=0;ai<sz && !found;ai++)
-    for (bi=0;bi<ai && !found;bi++)
-      for (ci=0;ci<bi && !found;ci++)
+    poly.swap(pieces.back());
+    pieces.pop_back();
+    sz=poly.size();
+    seen.clear();
+    for (i=0;i<sz && seen.count(poly[i])==0;i++)
+      seen[poly[i]]=i;
+    if (i<sz)
+    {
+      j=seen[poly[i]];
+      pieces.push_back(vector<point *>(poly.begin()+j,poly.begin()+i));
+      pieces.push_back(vector<point *>(poly.begin()+i,poly.end()));
+      pieces.back().insert(pieces.back().end(),poly.begin(),poly.begin()+j);
+      continue;
+    }
+    if (sz<3)
+      continue;
+    prv.resize(sz);
+    nxt.resize(sz);
+    isReflex.resize(sz);
+    reflex.clear();
+    for (i=0;i<sz;i++)
+    {
+      prv[i]=(i+sz-1)%sz;
+      nxt[i]=(i+1)%sz;
+    }
+    for (i=0;i<sz;i++)
+      if ((isReflex[i]=area3(*poly[prv[i]],*poly[i],*poly[nxt[i]])<=0))
+	reflex.push_back(i);
+    nReflex=reflex.size();
+    for (i=0,left=sz,sinceClip=0;left>3 && sinceClip<=left;)
+    {
+      ear=!isReflex[i];
+      for (j=0;ear && j<reflex.size();j++)
+	if (isReflex[reflex[j]] && reflex[j]!=prv[i] && reflex[j]!=nxt[i] &&
+	    inOrOn(*poly[reflex[j]],*poly[prv[i]],*poly[i],*poly[nxt[i]]))
+	  ear=false;
+      if (ear)
       {
-	a=outwardVec[ai];
-	b=outwardVec[bi];
-	c=outwardVec[ci];
-	if ((b+sz-a)%sz+(c+sz-b)%sz>sz)
-	  swap(b,c);
-	ba=dir(xy(*poly[b]),xy(*poly[c]));
-	bb=dir(xy(*poly[c]),xy(*poly[a]));
-	bc=dir(xy(*poly[a]),xy(*poly[b]));
-	if (area3(*poly[a],*poly[b],*poly[c])<=0 ||
-	    abs(foldangle(ba-bb+DEG180))<2 ||
-	    abs(foldangle(bb-bc+DEG180))<2 ||
-	    abs(foldangle(bc-ba+DEG180))<2)
-	  continue;
-	if (polyPartArea(poly,a,b)<0 || polyPartArea(poly,b,c)<0 || polyPartArea(poly,c,a)<0)
-	  continue;
-	centroid=(xy(*poly[a])+xy(*poly[b])+xy(*poly[c]))/3;
-	if (!isInside(centroid,poly))
-	  continue;
-	found=true;
-	for (i=0;found && i<sz;i++)
-	{
-	  if (poly[i]!=poly[a] && poly[i]!=poly[b] && poly[i]!=poly[c])
+	newtri.a=poly[prv[i]];
+	newtri.b=poly[i];
+	newtri.c=poly[nxt[i]];
+	newtri.flatten();
+	triangles[triangles.size()]=newtri;
+	nxt[prv[i]]=nxt[i];
+	prv[nxt[i]]=prv[i];
+	left--;
+	i=prv[i];
+	for (j=0;j<2;j++,i=nxt[i])
+	  if (isReflex[i] && area3(*poly[prv[i]],*poly[i],*poly[nxt[i]])>0)
 	  {
-	    if (in3(*poly[i],*poly[a],*poly[b],*poly[c]))
-	      found=false;
-	    ba=dir(xy(*poly[i]),xy(*poly[a]));
-	    bb=dir(xy(*poly[i]),xy(*poly[b]));
-	    bc=dir(xy(*poly[i]),xy(*poly[c]));
-	    da=dist(xy(*poly[i]),xy(*poly[a]));
-	    db=dist(xy(*poly[i]),xy(*poly[b]));
-	    dc=dist(xy(*poly[i]),xy(*poly[c]));
-	    if ((abs(foldangle(ba-bb+DEG180))<2 ||
-		 abs(foldangle(bb-bc+DEG180))<2 ||
-		 abs(foldangle(bc-ba+DEG180))<2) &&
-	        da>0 && db>0 && dc>0)
-	      found=false;
+	    isReflex[i]=false;
+	    nReflex--;
 	  }
-	  if (crossTriangle(*poly[i],*poly[(i+1)%sz],*poly[a],*poly[b],*poly[c]))
-	    found=false;
+	i=prv[prv[i]];
+	sinceClip=0;
+	if (nReflex*2<reflex.size())
+	{ // Most of the list is corners that are no longer reflex. Weed them out.
+	  for (j=reflex.size()-1;j>=0;j--)
+	    if (!isReflex[reflex[j]])
+	    {
+	      reflex[j]=reflex.back();
+	      reflex.pop_back();
+	    }
 	}
       }
-  if (found)
-  { // Add the triangle to the pointlist and call yourself recursively on the remainders.
-    logTriPoly(poly,a,b,c);
-    newtri.a=poly[a];
-    newtri.b=poly[b];
-    newtri.c=poly[c];
-    newtri.flatten();
-    triangles[triangles.size()]=newtri;
-    for (i=a;i!=b;i=(i+1)%sz)
-      subpoly.push_back(poly[i]);
-    subpoly.push_back(poly[b]);
-    triangulatePolygon(subpoly);
-    subpoly.clear();
-    for (i=b;i!=c;i=(i+1)%sz)
-      subpoly.push_back(poly[i]);
-    subpoly.push_back(poly[c]);
-    triangulatePolygon(subpoly);
-    subpoly.clear();
-    for (i=c;i!=a;i=(i+1)%sz)
-      subpoly.push_back(poly[i]);
-    subpoly.push_back(poly[a]);
-    triangulatePolygon(subpoly);
+      else
+      {
+	i=nxt[i];
+	sinceClip++;
+      }
+    }
+    if (left==3 && area3(*poly[prv[i]],*poly[i],*poly[nxt[i]])>0)
+    {
+      newtri.a=poly[prv[i]];
+      newtri.b=poly[i];
+      newtri.c=poly[nxt[i]];
+      newtri.flatten();
+      triangles[triangles.size()]=newtri;
+    }
   }
 }
 
+struct HalfEdge
+{
+  point *lo,*hi;
+  int tri,side;
+};
+
+bool operator<(const HalfEdge &l,const HalfEdge &r)
+{
+  if (l.lo!=r.lo)
+    return l.lo<r.lo;
+  if (l.hi!=r.hi)
+    return l.hi<r.hi;
+  return l.tri<r.tri;
+}
+
+struct Spoke
+{
+  point *pnt;
+  int bearing;
+  int order; // order in which the edge was made
+  edge *edg;
+};
+
+bool operator<(const Spoke &l,const Spoke &r)
+{
+  if (l.pnt!=r.pnt)
+    return l.pnt<r.pnt;
+  return l.bearing<r.bearing;
+}
+
+void pointlist::makeEdgesBulk()
+/* Makes all edges at once when there are none, giving the same edges,
+ * in the same order, as adding them one triangle at a time. The sides
+ * of all triangles are sorted by their ends, so that both sides of an edge
+ * are together, and the edges around each point are sorted by bearing and
+ * linked, instead of inserting each one into a ring.
+ */
+{
+  int i,j,n,first,sz=triangles.size();
+  point *corner[3];
+  vector<HalfEdge> sides;
+  vector<int> edgeOf(3*sz);
+  vector<Spoke> fan;
+  vector<edge *> made;
+  HalfEdge side;
+  Spoke spoke;
+  edge newedge;
+  edge *edg;
+  sides.reserve(3*sz);
+  for (i=0;i<sz;i++)
+  {
+    corner[0]=triangles[i].a;
+    corner[1]=triangles[i].b;
+    corner[2]=triangles[i].c;
+    for (j=0;j<3;j++)
+    {
+      side.lo=min(corner[j],corner[(j+1)%3]);
+      side.hi=max(corner[j],corner[(j+1)%3]);
+      side.tri=i;
+      side.side=j;
+      sides.push_back(side);
+    }
+  }
+  sort(sides.begin(),sides.end());
+  // Each side gets the number of the first side with the same ends.
+  for (i=0;i<sides.size();i=j)
+    for (j=i;j<sides.size() && sides[j].lo==sides[i].lo && sides[j].hi==sides[i].hi;j++)
+      edgeOf[3*sides[j].tri+sides[j].side]=3*sides[i].tri+sides[i].side;
+  sides.clear();
+  sides.shrink_to_fit();
+  for (i=0;i<sz;i++)
+  {
+    if (triangles[i].sarea<1e-6)
+      cerr<<"tiny triangle "<<triangles[i].a<<' '<<triangles[i].b<<' '<<triangles[i].c<<'\n';
+    corner[0]=triangles[i].a;
+    corner[1]=triangles[i].b;
+    corner[2]=triangles[i].c;
+    for (j=0;j<3;j++)
+    {
+      if (edgeOf[3*i+j]==3*i+j)
+      {
+	newedge.a=corner[j];
+	newedge.b=corner[(j+1)%3];
+	n=edges.size();
+	edges[n]=newedge;
+	made.push_back(&edges[n]);
+	edgeOf[3*i+j]=-made.size();
+      }
+      else
+	edgeOf[3*i+j]=edgeOf[edgeOf[3*i+j]];
+      edg=made[-edgeOf[3*i+j]-1];
+      if (edg->a==corner[j])
+	edg->trib=&triangles[i];
+      else
+	edg->tria=&triangles[i];
+    }
+  }
+  for (i=0;i<made.size();i++)
+  {
+    spoke.edg=made[i];
+    spoke.order=i;
+    spoke.pnt=made[i]->a;
+    spoke.bearing=made[i]->bearing(spoke.pnt);
+    fan.push_back(spoke);
+    spoke.pnt=made[i]->b;
+    spoke.bearing=made[i]->bearing(spoke.pnt);
+    fan.push_back(spoke);
+  }
+  sort(fan.begin(),fan.end());
+  for (i=0;i<fan.size();i=j)
+  {
+    first=i;
+    for (j=i;j<fan.size() && fan[j].pnt==fan[i].pnt;j++)
+    {
+      if (j>i && fan[j].bearing==fan[j-1].bearing)
+	throw BeziExcept(flatTriangle);
+      if (fan[j].order<fan[first].order)
+	first=j;
+    }
+    for (n=i;n<j;n++)
+      fan[n].edg->setnext(fan[n].pnt,fan[(n+1<j)?n+1:i].edg);
+    fan[i].pnt->line=fan[first].edg;
+  }
+  for (i=0;i<made.size();i++)
+    made[i]->setNeighbors();
+  spokes.build(*this);
+}
+
+edge *pointlist::findEdge(point *pnt,point *other)
+/* Returns the edge between pnt and other, or nullptr. Looks in the spoke
+ * array if pnt has a row, else goes around the list.
+ */
+{
+  if (spokes.row(pnt)>=0)
+    return spokes.neighbor(pnt,other);
+  else
+    return pnt->isNeighbor(other);
+}
+
 void pointlist::makeEdges()
 /* The points and triangles are present, but the edges are not, or some
  * triangles have been added to make the TIN convex, but their edges haven't.
@@ -1315,53 +1442,65 @@ void pointlist::makeEdges()
   edge newedge;
   edge *edg;
   //dumptriangles();
+  if (edges.size()==0)
+  {
+    makeEdgesBulk();
+    return;
+  }
   for (i=0;i<triangles.size();i++)
   {
     if (triangles[i].sarea<1e-6)
       cerr<<"tiny triangle "<<triangles[i].a<<' '<<triangles[i].b<<' '<<triangles[i].c<<'\n';
-    if (!triangles[i].a->isNeighbor(triangles[i].b))
+    if (!findEdge(triangles[i].a,triangles[i].b))
     {
       newedge.a=triangles[i].a;
       newedge.b=triangles[i].b;
       edges[edges.size()]=newedge;
       triangles[i].a->insertEdge(&edges[edges.size()-1]);
       triangles[i].b->insertEdge(&edges[edges.size()-1]);
+      spokes.refresh(triangles[i].a);
+      spokes.refresh(triangles[i].b);
     }
-    if (!triangles[i].b->isNeighbor(triangles[i].c))
+    if (!findEdge(triangles[i].b,triangles[i].c))
     {
       newedge.a=triangles[i].b;
       newedge.b=triangles[i].c;
       edges[edges.size()]=newedge;
       triangles[i].b->insertEdge(&edges[edges.size()-1]);
       triangles[i].c->insertEdge(&edges[edges.size()-1]);
+      spokes.refresh(triangles[i].b);
+      spokes.refresh(triangles[i].c);
     }
-    if (!triangles[i].c->isNeighbor(triangles[i].a))
+    if (!findEdge(triangles[i].c,triangles[i].a))
     {
       newedge.a=triangles[i].c;
       newedge.b=triangles[i].a;
       edges[edges.size()]=newedge;
       triangles[i].c->insertEdge(&edges[edges.size()-1]);
       triangles[i].a->insertEdge(&edges[edges.size()-1]);
+      spokes.refresh(triangles[i].c);
+      spokes.refresh(triangles[i].a);
     }
-    edg=triangles[i].a->isNeighbor(triangles[i].b);
+    edg=findEdge(triangles[i].a,triangles[i].b);
     if (edg->a==triangles[i].a)
       edg->trib=&triangles[i];
     else
       edg->tria=&triangles[i];
     edg->setNeighbors();
-    edg=triangles[i].b->isNeighbor(triangles[i].c);
+    edg=findEdge(triangles[i].b,triangles[i].c);
     if (edg->a==triangles[i].b)
       edg->trib=&triangles[i];
     else
       edg->tria=&triangles[i];
     edg->setNeighbors();
-    edg=triangles[i].c->isNeighbor(triangles[i].a);
+    edg=findEdge(triangles[i].c,triangles[i].a);
     if (edg->a==triangles[i].c)
       edg->trib=&triangles[i];
     else
       edg->tria=&triangles[i];
     edg->setNeighbors();
   }
+  spokes.build(*this);
 }
 
 void pointlist::deleteOrphanPoints()
@@ -1381,14 +1520,16 @@ void pointlist::deleteOrphanPoints()
     }
   for (i=0;i<delenda.size();i++)
     points.erase(delenda[i]);
+  spokes.clear();
 }
 
-void pointlist::fillInBareTin()
+void pointlist::fillInBareTin(string filename)
 /* Call this after makeBareTriangles or reading in a TIN from a .bez file.
  * It makes edges, fills in any gaps with arbitrary triangles, makes edges
  * again, and makes the quadtree index. The result is a convex TIN with
  * a quad index, just as if it were made with maketin (but the filled-in areas
- * are unlikely to be Delaunay).
+ * are unlikely to be Delaunay). If filename is given, the filled-in TIN
+ * is drawn to it for debugging.
  */
 {
   intloop holes;
@@ -1396,13 +1537,6 @@ void pointlist::fillInBareTin()
   int i,j;
   PostScript ps;
   BoundRect br;
-  ps.open("fillInBareTin.ps");
-  ps.setpaper(papersizes["A4 portrait"],0);
-  ps.prolog();
-  ps.setPointlist(*this);
-  br.include(this);
-  ps.startpage();
-  ps.setscale(br);
   makeEdges();
   deleteOrphanPoints();
   holes=boundary();
@@ -1414,6 +1548,472 @@ void pointlist::fillInBareTin()
   }
   makeEdges();
   updateqindex();
+  if (filename.length())
+  {
+    ps.open(filename);
+    ps.setpaper(papersizes["A4 portrait"],0);
+    ps.prolog();
+    ps.setPointlist(*this);
+    br.include(this);
+    ps.startpage();
+    ps.setscale(br);
+    for (i=0;i<edges.size();i++)
+      ps.line(edges[i],i,0); // black if it needs flipping, else blue
+    ps.endpage();
+    ps.trailer();
+    ps.close();
+  }
+}
+
+/* Local editing of a TIN. Each of insertPoint, deletePoint, and movePoint
+ * changes only the triangles whose circumcircles the edit touches, keeps
+ * edges and triangles numbered from 0 to size()-1, and returns the points
+ * whose surroundings changed. Pass them to retouch to refit the surface
+ * there, and to contoursNear to find which contours to trace again.
+ * The spoke array is invalidated; makegrad builds it again when needed.
+ */
+
+void attachTriangle(edge *e,triangle *t)
+/* t's corners go counterclockwise, so t is on the left of each side
+ * going from one corner to the next.
+ */
+{
+  if ((e->a==t->a && e->b==t->b) || (e->a==t->b && e->b==t->c) || (e->a==t->c && e->b==t->a))
+    e->trib=t;
+  else
+    e->tria=t;
+}
+
+void resetTriangle(triangle *t,point *a,point *b,point *c)
+{
+  *t=triangle();
+  t->a=a;
+  t->b=b;
+  t->c=c;
+  t->flatten();
+}
+
+edge *ringBefore(point *pnt,edge *e)
+// Returns the edge whose next edge counterclockwise about pnt is e.
+{
+  edge *f;
+  for (f=e;f->next(pnt)!=e;f=f->next(pnt));
+  return f;
+}
+
+edge *pointlist::newEdge(point *a,point *b)
+{
+  edge *ret=&edges[edges.size()];
+  ret->a=a;
+  ret->b=b;
+  return ret;
+}
+
+vector<point *> pointlist::legalize(vector<edge *> suspects)
+/* Flips suspect edges that aren't Delaunay, and the edges around them in
+ * turn, as after adding a point. Edges in breaklines are not flipped.
+ * Returns the ends of flipped edges.
+ */
+{
+  vector<point *> ret;
+  edge *e;
+  point *olda,*oldb;
+  size_t nflips=0;
+  while (suspects.size() && nflips<=edges.size())
+  {
+    e=suspects.back();
+    suspects.pop_back();
+    if (e->isinterior() && checkBreak0(*e)!=1 && !e->delaunay())
+    {
+      olda=e->a;
+      oldb=e->b;
+      e->flip(this);
+      nflips++;
+      suspects.push_back(e->a->isNeighbor(olda));
+      suspects.push_back(e->a->isNeighbor(oldb));
+      suspects.push_back(e->b->isNeighbor(olda));
+      suspects.push_back(e->b->isNeighbor(oldb));
+      ret.push_back(olda);
+      ret.push_back(oldb);
+      ret.push_back(e->a);
+      ret.push_back(e->b);
+    }
+  }
+  return ret;
+}
+
+vector<point *> pointlist::insertPoint(int numb,point pnt)
+/* Adds a point inside the TIN, splits the triangle it's in, and flips
+ * edges around it until the TIN is Delaunay again. If numb is already
+ * used, the point is numbered as by addpoint. Throws noTriangle if the
+ * point is outside the TIN or on its boundary, and samePoints if it is
+ * on another point. The new point is first in the returned list.
+ */
+{
+  triangle *t=nullptr,*t1,*t2;
+  point *p,*A,*B,*C;
+  edge *eAB,*eBC,*eCA,*eA,*eB,*eC;
+  vector<point *> ret,flipped;
+  bool fresh=!points.count(numb);
+  int i;
+  if (triangles.size()==0)
+    throw BeziExcept(noTriangle);
+  if (qinx.size())
+    t=qinx.findt(pnt,true);
+  if (!t)
+    t=&triangles[0];
+  t=t->findt(pnt);
+  if (!t)
+    throw BeziExcept(noTriangle);
+  A=t->a;
+  B=t->b;
+  C=t->c;
+  if (xy(pnt)==xy(*A) || xy(pnt)==xy(*B) || xy(pnt)==xy(*C))
+    throw BeziExcept(samePoints);
+  eAB=A->isNeighbor(B);
+  eBC=B->isNeighbor(C);
+  eCA=C->isNeighbor(A);
+  if ((area3(*A,*B,pnt)<=0 && !eAB->isinterior()) ||
+      (area3(*B,*C,pnt)<=0 && !eBC->isinterior()) ||
+      (area3(*C,*A,pnt)<=0 && !eCA->isinterior()))
+    throw BeziExcept(noTriangle);
+  addpoint(numb,pnt);
+  if (fresh)
+    p=&points[numb];
+  else
+    p=(numb<0)?&points.begin()->second:&points.rbegin()->second;
+  eA=newEdge(p,A);
+  eB=newEdge(p,B);
+  eC=newEdge(p,C);
+  eA->nexta=eB;
+  eB->nexta=eC;
+  eC->nexta=eA;
+  p->line=eA;
+  eAB->setnext(A,eA);
+  eA->nextb=eCA;
+  eBC->setnext(B,eB);
+  eB->nextb=eAB;
+  eCA->setnext(C,eC);
+  eC->nextb=eBC;
+  t1=&triangles[addtriangle()];
+  t2=&triangles[addtriangle()];
+  resetTriangle(t,A,B,p);
+  resetTriangle(t1,B,C,p);
+  resetTriangle(t2,C,A,p);
+  attachTriangle(eAB,t);
+  attachTriangle(eA,t);
+  attachTriangle(eB,t);
+  attachTriangle(eBC,t1);
+  attachTriangle(eB,t1);
+  attachTriangle(eC,t1);
+  attachTriangle(eCA,t2);
+  attachTriangle(eC,t2);
+  attachTriangle(eA,t2);
+  eAB->setNeighbors();
+  eBC->setNeighbors();
+  eCA->setNeighbors();
+  eA->setNeighbors();
+  eB->setNeighbors();
+  eC->setNeighbors();
+  flipped=legalize(vector<edge *>{eAB,eBC,eCA});
+  ret.push_back(p);
+  ret.push_back(A);
+  ret.push_back(B);
+  ret.push_back(C);
+  for (i=0;i<flipped.size();i++)
+    ret.push_back(flipped[i]);
+  sort(ret.begin()+1,ret.end());
+  ret.erase(unique(ret.begin()+1,ret.end()),ret.end());
+  localPoints.clear();
+  localEdges.clear();
+  localTriangles.clear();
+  return ret;
+}
+
+void pointlist::removeDead(vector<edge *> deadEdges,vector<triangle *> deadTris,triangle *heir)
+/* Removes edges and triangles which are no longer linked into the TIN,
+ * keeping the maps numbered from 0 by moving the last ones into the holes.
+ * Pointers to a moved edge or triangle are changed to point to its new
+ * place; quad index leaves pointing to a removed triangle point to heir.
+ */
+{
+  set<edge *> deadE(deadEdges.begin(),deadEdges.end());
+  set<triangle *> deadT(deadTris.begin(),deadTris.end());
+  map<triangle *,triangle *> moved;
+  edge *last,*hole,*f;
+  triangle *lastT,*holeT,*n;
+  point *ends[2];
+  int i,j;
+  while (deadE.size())
+  {
+    last=&edges[edges.size()-1];
+    if (deadE.count(last))
+      deadE.erase(last);
+    else
+    {
+      hole=*deadE.begin();
+      deadE.erase(deadE.begin());
+      *hole=*last;
+      ends[0]=hole->a;
+      ends[1]=hole->b;
+      for (j=0;j<2;j++)
+      {
+	if (ends[j]->line==last)
+	  ends[j]->line=hole;
+	for (f=hole;f->next(ends[j])!=last;f=f->next(ends[j]));
+	f->setnext(ends[j],hole);
+      }
+    }
+    edges.erase(edges.size()-1);
+  }
+  while (deadT.size())
+  {
+    lastT=&triangles[triangles.size()-1];
+    if (deadT.count(lastT))
+      deadT.erase(lastT);
+    else
+    {
+      holeT=*deadT.begin();
+      deadT.erase(deadT.begin());
+      *holeT=*lastT;
+      moved[lastT]=holeT;
+      if (heir==lastT)
+	heir=holeT;
+      for (j=0;j<3;j++)
+      {
+	f=(j==0)?holeT->b->isNeighbor(holeT->c):((j==1)?holeT->c->isNeighbor(holeT->a):holeT->a->isNeighbor(holeT->b));
+	if (f->tria==lastT)
+	  f->tria=holeT;
+	if (f->trib==lastT)
+	  f->trib=holeT;
+	n=(j==0)?holeT->aneigh:((j==1)?holeT->bneigh:holeT->cneigh);
+	if (n)
+	  n->setneighbor(holeT);
+      }
+    }
+    triangles.erase(triangles.size()-1);
+  }
+  for (i=0;i<deadTris.size();i++)
+    moved[deadTris[i]]=heir;
+  qinx.replaceTri(moved,qinxLeaves);
+}
+
+vector<point *> pointlist::deletePoint(int numb)
+/* Removes a point inside the TIN. Edges around it are flipped away until
+ * it has three, then it and they are removed, leaving one triangle, and
+ * the hole is made Delaunay. Throws noPoint if there is no such point,
+ * noTriangle if the point is on the boundary, and badBreaklineEnd if it
+ * is the end of a type-0 breakline.
+ */
+{
+  point *p,*q[3];
+  edge *e,*spoke[3],*outer[3];
+  triangle *tri[3];
+  vector<point *> ret,flipped;
+  vector<edge *> suspects;
+  int i,j,val;
+  if (!points.count(numb))
+    throw BeziExcept(noPoint);
+  p=&points[numb];
+  for (i=0;i<type0Breaklines.size();i++)
+    for (j=0;j<type0Breaklines[i].size();j++)
+      if (type0Breaklines[i][j][0]==numb || type0Breaklines[i][j][1]==numb)
+	throw BeziExcept(badBreaklineEnd);
+  if (p->line)
+  {
+    val=p->valence();
+    e=p->line;
+    for (i=0;i<val;i++,e=e->next(p))
+      if (!e->isinterior())
+	throw BeziExcept(noTriangle);
+    e=p->line;
+    for (i=0;val>3 && i<2*val;i++)
+    {
+      if (e->isFlippable())
+      {
+	p->line=e->next(p);
+	e->flip(this);
+	val--;
+	suspects.push_back(e);
+	ret.push_back(e->a);
+	ret.push_back(e->b);
+	i=0;
+	e=p->line;
+      }
+      else
+	e=e->next(p);
+    }
+    if (val>3)
+      throw BeziExcept(flatTriangle);
+    spoke[0]=p->line;
+    spoke[1]=spoke[0]->next(p);
+    spoke[2]=spoke[1]->next(p);
+    for (i=0;i<3;i++)
+    {
+      q[i]=spoke[i]->otherend(p);
+      tri[i]=spoke[i]->tri(q[i]); // between spoke[i] and spoke[i+1]
+    }
+    for (i=0;i<3;i++)
+    {
+      outer[i]=q[i]->isNeighbor(q[(i+1)%3]);
+      e=ringBefore(q[i],spoke[i]);
+      e->setnext(q[i],spoke[i]->next(q[i]));
+      if (q[i]->line==spoke[i])
+	q[i]->line=e;
+    }
+    resetTriangle(tri[0],q[0],q[1],q[2]);
+    for (i=0;i<3;i++)
+    {
+      attachTriangle(outer[i],tri[0]);
+      ret.push_back(q[i]);
+    }
+    for (i=0;i<3;i++)
+      outer[i]->setNeighbors();
+    for (i=0;i<3;i++)
+      suspects.push_back(outer[i]);
+    flipped=legalize(suspects);
+    for (i=0;i<flipped.size();i++)
+      ret.push_back(flipped[i]);
+    removeDead(vector<edge *>{spoke[0],spoke[1],spoke[2]},vector<triangle *>{tri[1],tri[2]},tri[0]);
+  }
+  ret.erase(remove(ret.begin(),ret.end(),p),ret.end());
+  sort(ret.begin(),ret.end());
+  ret.erase(unique(ret.begin(),ret.end()),ret.end());
+  revpoints.erase(p);
+  points.erase(numb);
+  spokes.clear();
+  localPoints.clear();
+  localEdges.clear();
+  localTriangles.clear();
+  return ret;
+}
+
+vector<point *> pointlist::movePoint(int numb,xyz newPlace)
+/* Moves a point inside the TIN. If only its elevation changes, the TIN is
+ * unchanged; else the point is deleted and inserted again with the same
+ * number. If it can't be put in the new place, it is put back and the
+ * exception is thrown again. The moved point is first in the list. Throws
+ * noPoint if there is no such point.
+ */
+{
+  point pnt,*p;
+  vector<point *> ret,near;
+  edge *e;
+  int i;
+  if (!points.count(numb))
+    throw BeziExcept(noPoint);
+  p=&points[numb];
+  if (xy(newPlace)==xy(*p))
+  {
+    p->setelev(newPlace.elev());
+    ret.push_back(p);
+    for (e=p->line,i=0;e && (i==0 || e!=p->line);e=e->next(p),i++)
+      ret.push_back(e->otherend(p));
+    return ret;
+  }
+  pnt=*p;
+  near=deletePoint(numb);
+  try
+  {
+    ret=insertPoint(numb,point(newPlace,pnt.note));
+  }
+  catch (...)
+  {
+    insertPoint(numb,pnt);
+    throw;
+  }
+  ret.insert(ret.end(),near.begin(),near.end());
+  sort(ret.begin()+1,ret.end());
+  ret.erase(unique(ret.begin()+1,ret.end()),ret.end());
+  return ret;
+}
+
+void pointlist::retouch(vector<point *> changed,double corr)
+/* Refits the surface after a local edit. The gradients of the changed
+ * points and their neighbors are refitted as by makegrad, holding the
+ * gradients of points farther out; then the control points, critical
+ * points, and subdivisions of the triangles around them, and the extrema
+ * of the edges around them, are redone.
+ */
+{
+  set<point *> refit(changed.begin(),changed.end());
+  set<edge *> sides;
+  set<triangle *> tris;
+  set<point *>::iterator i;
+  set<edge *>::iterator j;
+  set<triangle *>::iterator k;
+  edge *e;
+  int n,m;
+  for (n=0;n<changed.size();n++)
+    for (e=changed[n]->line,m=0;e && (m==0 || e!=changed[n]->line);e=e->next(changed[n]),m++)
+      refit.insert(e->otherend(changed[n]));
+  for (n=0;n<10;n++)
+  {
+    for (i=refit.begin();i!=refit.end();++i)
+    {
+      GradientSums sums;
+      for (e=(*i)->line,m=0;e && (m==0 || e!=(*i)->line);e=e->next(*i),m++)
+	sums.add(**i,e,corr);
+      if (!sums.empty())
+	(*i)->newgradient=sums.gradient();
+    }
+    for (i=refit.begin();i!=refit.end();++i)
+    {
+      (*i)->oldgradient=(*i)->gradient;
+      (*i)->gradient=(*i)->newgradient;
+    }
+  }
+  for (i=refit.begin();i!=refit.end();++i)
+    for (e=(*i)->line,m=0;e && (m==0 || e!=(*i)->line);e=e->next(*i),m++)
+    {
+      sides.insert(e);
+      if (e->tria)
+	tris.insert(e->tria);
+      if (e->trib)
+	tris.insert(e->trib);
+    }
+  for (k=tris.begin();k!=tris.end();++k)
+  {
+    (*k)->setgradient(*(*k)->a,(*k)->a->gradient);
+    (*k)->setgradient(*(*k)->b,(*k)->b->gradient);
+    (*k)->setgradient(*(*k)->c,(*k)->c->gradient);
+    (*k)->setcentercp();
+    (*k)->peri=(*k)->perimeter();
+  }
+  for (j=sides.begin();j!=sides.end();++j)
+    (*j)->findextrema();
+  for (k=tris.begin();k!=tris.end();++k)
+  {
+    (*k)->findcriticalpts();
+    (*k)->subdivide();
+  }
+}
+
+vector<int> pointlist::contoursNear(vector<point *> changed)
+/* Returns the numbers of the contours whose bounding rectangles overlap
+ * that of the triangles around the changed points. These are the ones
+ * that may have to be traced again.
+ */
+{
+  BoundRect region,br;
+  vector<int> ret;
+  edge *e;
+  int i,m;
+  for (i=0;i<changed.size();i++)
+  {
+    region.include(*changed[i]);
+    for (e=changed[i]->line,m=0;e && (m==0 || e!=changed[i]->line);e=e->next(changed[i]),m++)
+      region.include(*e->otherend(changed[i]));
+  }
+  for (i=0;i<contours.size();i++)
+  {
+    br.clear();
+    br.include(&contours[i]);
+    if (br.left()<=region.right() && region.left()<=br.right() &&
+	br.bottom()<=region.top() && region.bottom()<=br.top())
+      ret.push_back(i);
+  }
+  return ret;
 }
 
 double pointlist::totalEdgeLength()
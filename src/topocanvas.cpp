@@ -82,6 +82,7 @@ TopoCanvas::TopoCanvas(QWidget *parent):QWidget(parent)
   progressDialog->reset();
   ciDialog=new ContourIntervalDialog(this);
   timer=new QTimer(this);
+  contourCache.setNotify([this](){QMetaObject::invokeMethod(this,"update",Qt::QueuedConnection);});
   plnum=-1;
   goal=DONE;
   rotation=0;
@@ -96,6 +97,12 @@ TopoCanvas::TopoCanvas(QWidget *parent):QWidget(parent)
   contoursShouldBeCurvy=true;
 }
 
+TopoCanvas::~TopoCanvas()
+{
+  // The workers' notify function uses this, so stop them before anything is destroyed.
+  contourCache.stopWorkers();
+}
+
 QPointF TopoCanvas::worldToWindow(xy pnt)
 {
   pnt.roscat(worldCenter,rotation,zoomratio(scale)*windowSize,windowCenter);
@@ -103,6 +110,19 @@ QPointF TopoCanvas::worldToWindow(xy pnt)
   return ret;
 }
 
+QTransform TopoCanvas::worldTransform()
+/* The same transformation as worldToWindow, for drawing paths that are
+ * in world coordinates.
+ */
+{
+  QPointF o=worldToWindow(worldCenter);
+  QPointF ex=worldToWindow(worldCenter+xy(1,0))-o;
+  QPointF ey=worldToWindow(worldCenter+xy(0,1))-o;
+  return QTransform(ex.x(),ex.y(),ey.x(),ey.y(),
+		    o.x()-ex.x()*worldCenter.getx()-ey.x()*worldCenter.gety(),
+		    o.y()-ex.y()*worldCenter.getx()-ey.y()*worldCenter.gety());
+}
+
 xy TopoCanvas::windowToWorld(QPointF pnt)
 {
   xy ret(pnt.x(),height()-pnt.y());
@@ -321,6 +341,7 @@ void TopoCanvas::open()
     unit=doc.ms.toCoherent(1,LENGTH);
     setCursor(Qt::WaitCursor);
     readResult=readTinFile(doc.pl[1],fileName,unit);
+    tinLod.clear();
     plnum=1;
     sizeToFit();
     setCursor(Qt::ArrowCursor);
@@ -387,6 +408,7 @@ void TopoCanvas::testPatternAster()
 {
   doc.pl.clear();
   doc.makepointlist(1);
+  tinLod.clear();
   plnum=1;
   aster(doc,100);
   sizeToFit();
@@ -410,6 +432,7 @@ void TopoCanvas::importPnezd()
     // TODO check whether there are unsaved changes to breaklines
     doc.pl.clear();
     doc.makepointlist(0);
+    tinLod.clear();
     try
     {
       doc.readpnezd(fileName);
@@ -572,6 +595,7 @@ void TopoCanvas::makeTin()
 {
   //cout<<"makeTin"<<endl;
   doc.makepointlist(1);
+  tinLod.clear();
   if ((doc.pl[1].size()==0 && doc.pl[0].size()>0) || !pointsValid)
   {
     if (doc.pl[1].crit.size()==0)
@@ -697,6 +721,7 @@ void TopoCanvas::redoSurface()
   {
     doc.pl[plnum].makegrad(0.15);
     doc.pl[plnum].maketriangles();
+    tinLod.clear();
     doc.pl[plnum].setgradient(!trianglesShouldBeCurvy);
     doc.pl[plnum].makeqindex();           // These five are all fast. It's finding the
     doc.pl[plnum].findedgecriticalpts();  // critical points of a triangle that's slow.
@@ -749,11 +774,13 @@ void TopoCanvas::makeTinFinish()
   { // TODO: translate the thrown error into something intelligible
     QString msg=tr("Can't make TIN. Error: ")+translateException(tinerror);
     doc.pl[plnum].clearTin();
+    tinLod.clear();
     errorMessage->showMessage(msg);
   }
   else
   {
     doc.pl[plnum].addperimeter();
+    tinLod.clear();
     doc.pl[plnum].whichBreak0Valid=3;
   }
   update();
@@ -985,20 +1012,41 @@ void TopoCanvas::dump()
   }
 }
 
+void TopoCanvas::addEdgeLine(edge *e,vector<QLineF> edgeLines[3])
+/* Adds the edge, if it's in the window and longer than a pixel, to the
+ * lines to be drawn with the normal, break, or flip pen. Drawing each batch
+ * with one call is much faster than setting the pen for each line.
+ */
+{
+  segment seg=e->getsegment();
+  int pen;
+  if (seg.length()>pixelScale() && fabs(pldist(worldCenter,seg.getstart(),seg.getend()))<viewableRadius())
+  {
+    if (!showDelaunay || e->delaunay())
+      pen=e->broken&1;
+    else
+      pen=2;
+    edgeLines[pen].push_back(QLineF(worldToWindow(seg.getstart()),worldToWindow(seg.getend())));
+  }
+}
+
 void TopoCanvas::paintEvent(QPaintEvent *event)
 {
   int i,k,contourType,renderTime=0,pathTime=0,strokeTime=0;
-  double r;
   bezier3d b3d;
   ptlist::iterator j;
   set<edge *>::iterator e;
-  RenderItem ri;
+  RenderItem *rip;
   QElapsedTimer paintTime,subTime;
   QPen itemPen;
+  double r;
   QPainter painter(this);
   QPainterPath path;
   vector<xyz> beziseg;
-  segment seg;
+  vector<edge *> lodEdges;
+  vector<QLineF> edgeLines[3];
+  vector<drawingElement> uncached;
+  vector<QPainterPath> uncachedPaths;
   paintTime.start();
   painter.setBrush(brush);
   painter.setRenderHint(QPainter::Antialiasing,true);
@@ -1006,38 +1054,25 @@ void TopoCanvas::paintEvent(QPaintEvent *event)
   {
     doc.pl[plnum].setLocalSets(worldCenter,viewableRadius());
     if (doc.pl[plnum].triangles.size())
+    {
       if (doc.pl[plnum].localEdges.count(nullptr))
-	for (i=0;plnum>=0 && i<doc.pl[plnum].edges.size();i++)
-	{
-	  seg=doc.pl[plnum].edges[i].getsegment();
-	  if (seg.length()>pixelScale() && fabs(pldist(worldCenter,seg.getstart(),seg.getend()))<viewableRadius())
-	  {
-	    if (!showDelaunay || doc.pl[plnum].edges[i].delaunay())
-	      if (doc.pl[plnum].edges[i].broken&1)
-		painter.setPen(breakEdgePen);
-	      else
-		painter.setPen(normalEdgePen);
-	    else
-	      painter.setPen(flipEdgePen);
-	    painter.drawLine(worldToWindow(seg.getstart()),worldToWindow(seg.getend()));
-	  }
-	}
+      {
+	if (tinLod.empty())
+	  tinLod.build(doc.pl[plnum]);
+	lodEdges=tinLod.visibleEdges(worldCenter,viewableRadius(),pixelScale(),LOD_SPACING);
+	for (i=0;i<lodEdges.size();i++)
+	  addEdgeLine(lodEdges[i],edgeLines);
+      }
       else
 	for (e=doc.pl[plnum].localEdges.begin();e!=doc.pl[plnum].localEdges.end();++e)
-	{
-	  seg=(*e)->getsegment();
-	  if (seg.length()>pixelScale() && fabs(pldist(worldCenter,seg.getstart(),seg.getend()))<viewableRadius())
-	  {
-	    if (!showDelaunay || (*e)->delaunay())
-	      if ((*e)->broken&1)
-		painter.setPen(breakEdgePen);
-	      else
-		painter.setPen(normalEdgePen);
-	    else
-	      painter.setPen(flipEdgePen);
-	    painter.drawLine(worldToWindow(seg.getstart()),worldToWindow(seg.getend()));
-	  }
-	}
+	  addEdgeLine(*e,edgeLines);
+      painter.setPen(normalEdgePen);
+      painter.drawLines(edgeLines[0].data(),edgeLines[0].size());
+      painter.setPen(flipEdgePen);
+      painter.drawLines(edgeLines[2].data(),edgeLines[2].size());
+      painter.setPen(breakEdgePen);
+      painter.drawLines(edgeLines[1].data(),edgeLines[1].size());
+    }
     else
       for (j=doc.pl[plnum].points.begin();j!=doc.pl[plnum].points.end();++j)
         for (i=0;i<3;i++)
@@ -1047,43 +1082,7 @@ void TopoCanvas::paintEvent(QPaintEvent *event)
           // The radius variation is so that, if two points coincide, it's obvious.
           painter.drawEllipse(worldToWindow(j->second),r,r);
         }
-#ifdef CACHEDRAW
-    contourCache.clearPresent();
-    subTime.start();
-    for (i=0;i<doc.pl[plnum].contours.size();i++)
-    {
-      contourType=doc.pl[plnum].contourInterval.contourType(doc.pl[plnum].contours[i].getElevation());
-      contourCache.checkInObject(&doc.pl[plnum].contours[i],pixelScale(),
-                                 -1,contourColor[contourType&31],contourThickness[contourType>>8],contourLineType[contourType>>8]);
-    }
-    contourCache.deleteAbsent();
-    renderTime+=subTime.elapsed();
-    do
-    {
-      ri=contourCache.nextRenderItem();
-      for (i=0;ri.present && i<ri.rendering.size();i++)
-      {
-        setColor(itemPen,ri.rendering[i].color);
-        setWidth(itemPen,ri.rendering[i].width);
-        setLineType(itemPen,ri.rendering[i].linetype);
-        b3d=ri.rendering[i].path;
-        subTime.start();
-        path=QPainterPath();
-        for (k=0;k<b3d.size();k++)
-        {
-          beziseg=b3d[k];
-          if (k==0)
-            path.moveTo(worldToWindow(beziseg[0]));
-          path.cubicTo(worldToWindow(beziseg[1]),worldToWindow(beziseg[2]),worldToWindow(beziseg[3]));
-        }
-        if (!b3d.isopen())
-          path.closeSubpath();
-        pathTime+=subTime.restart();
-        painter.strokePath(path,itemPen);
-        strokeTime+=subTime.elapsed();
-      }
-    } while (ri.present);
-#else
+#ifndef CACHEDRAW
     for (i=0;i<doc.pl[plnum].contours.size();i++)
     {
       b3d=doc.pl[plnum].contours[i].approx3d(pixelScale());
@@ -1102,8 +1101,44 @@ void TopoCanvas::paintEvent(QPaintEvent *event)
     }
 #endif
   }
-  else
-    ; // nothing to paint, since plnum is not the index of a pointlist
+#ifdef CACHEDRAW
+  contourCache.clearPresent();
+  contourCache.setView(worldCenter,viewableRadius(),pixelScale());
+  subTime.start();
+  if (plnum<doc.pl.size() && plnum>=0)
+    for (i=0;i<doc.pl[plnum].contours.size();i++)
+    {
+      contourType=doc.pl[plnum].contourInterval.contourType(doc.pl[plnum].contours[i].getElevation());
+      contourCache.checkInObject(&doc.pl[plnum].contours[i],-1,
+                                 contourColor[contourType&31],contourThickness[contourType>>8],contourLineType[contourType>>8]);
+    }
+  checkInModelSpace(uncached);
+  contourCache.deleteAbsent();
+  contourCache.schedule();
+  uncachedPaths=renderPaths(uncached);
+  renderTime+=subTime.restart();
+  painter.save();
+  painter.setTransform(worldTransform());
+  while ((rip=contourCache.nextRenderItem()))
+    for (i=0;i<rip->rendering.size();i++)
+    {
+      setColor(itemPen,rip->rendering[i].color);
+      setWidth(itemPen,rip->rendering[i].width);
+      setLineType(itemPen,rip->rendering[i].linetype);
+      itemPen.setCosmetic(true); // width is in pixels, not world units
+      painter.strokePath(rip->paths[i],itemPen);
+    }
+  for (i=0;i<uncached.size();i++)
+  {
+    setColor(itemPen,uncached[i].color);
+    setWidth(itemPen,uncached[i].width);
+    setLineType(itemPen,uncached[i].linetype);
+    itemPen.setCosmetic(true);
+    painter.strokePath(uncachedPaths[i],itemPen);
+  }
+  painter.restore();
+  strokeTime+=subTime.elapsed();
+#endif
   //cout<<"Painting took "<<paintTime.elapsed()<<" ms, rendering "<<renderTime<<", paths "<<pathTime<<", stroke "<<strokeTime<<endl;
   lastPaintTime=paintTime;
   lastPaintDuration=paintTime.elapsed();
@@ -1122,6 +1157,62 @@ void TopoCanvas::resizeEvent(QResizeEvent *event)
   QWidget::resizeEvent(event);
 }
 
+void TopoCanvas::checkInModelSpace(vector<drawingElement> &uncached)
+/* Checks into the render cache the objects in model space whose bounding
+ * boxes are in view. The box is a square around the circle in view, so it
+ * contains the window however it's rotated. Objects on hidden layers are
+ * left out, so deleteAbsent drops their renderings. Objects of a class the
+ * cache doesn't know how to copy are rendered here, into uncached.
+ */
+{
+  int i,colr,thik,ltype;
+  double r=viewableRadius();
+  objrec rec;
+  drawobj *obj;
+  vector<drawingElement> rendering;
+  vector<int> handles=doc.modelSpace.inBox(worldCenter.east()-r,worldCenter.north()-r,worldCenter.east()+r,worldCenter.north()+r);
+  for (i=0;i<handles.size();i++)
+  {
+    rec=doc.modelSpace[handles[i]];
+    if (doc.layers.isLayer(rec.layr) && !doc.layers[rec.layr].visible)
+      continue;
+    colr=rec.getcolor(&doc);
+    thik=rec.getthickness(&doc);
+    ltype=rec.getlinetype(&doc);
+    obj=rec.obj.get();
+    switch (obj->type())
+    { // The cache copies the object to render it, so it needs the actual class.
+      case OBJ_SEGMENT:
+	contourCache.checkInObject(dynamic_cast<segment *>(obj),rec.layr,colr,thik,ltype);
+	break;
+      case OBJ_ARC:
+	contourCache.checkInObject(dynamic_cast<arc *>(obj),rec.layr,colr,thik,ltype);
+	break;
+      case OBJ_SPIRALARC:
+	contourCache.checkInObject(dynamic_cast<spiralarc *>(obj),rec.layr,colr,thik,ltype);
+	break;
+      case OBJ_POLYLINE:
+	contourCache.checkInObject(dynamic_cast<polyline *>(obj),rec.layr,colr,thik,ltype);
+	break;
+      case OBJ_POLYARC:
+	contourCache.checkInObject(dynamic_cast<polyarc *>(obj),rec.layr,colr,thik,ltype);
+	break;
+      case OBJ_POLYSPIRAL:
+	contourCache.checkInObject(dynamic_cast<polyspiral *>(obj),rec.layr,colr,thik,ltype);
+	break;
+      case OBJ_ALIGNMENT:
+	contourCache.checkInObject(dynamic_cast<alignment *>(obj),rec.layr,colr,thik,ltype);
+	break;
+      case OBJ_CIRCLE:
+	contourCache.checkInObject(dynamic_cast<Circle *>(obj),rec.layr,colr,thik,ltype);
+	break;
+      default:
+	rendering=obj->render3d(pixelScale(),rec.layr,colr,thik,ltype);
+	uncached.insert(uncached.end(),rendering.begin(),rendering.end());
+    }
+  }
+}
+
 bool TopoCanvas::mouseCheckImported()
 /* If the user clicks on an edge to edit the breaklines in the TIN, but the
  * breaklines imported from a file are more recent, pops up a message box
@@ -1215,6 +1306,7 @@ void TopoCanvas::mouseReleaseEvent(QMouseEvent *event)
         if (allowFlip && hitRec.edg && hitRec.edg->isFlippable() && mouseCheckImported())
         {
           hitRec.edg->flip(&doc.pl[plnum]);
+          tinLod.clear(); // The edge may now be too long for its cell.
           updateEdgeNeighbors(hitRec.edg);
           roughContoursValid=false;
           surfaceValid=false;
@@ -34,6 +34,7 @@
 #include "cidialog.h"
 #include "factordialog.h"
 #include "rendercache.h"
+#include "edgelod.h"
 
 // goals
 #define DONE 0
@@ -41,13 +42,20 @@
 #define ROUGH_CONTOURS 2
 #define SMOOTH_CONTOURS 3
 
+/* When zoomed out too far to draw the edges near the center, edges shorter
+ * than about this many pixels are thinned out.
+ */
+#define LOD_SPACING 12
+
 class TopoCanvas: public QWidget
 {
   Q_OBJECT
 public:
   TopoCanvas(QWidget *parent=0);
+  ~TopoCanvas();
   void setBrush(const QBrush &qbrush);
   QPointF worldToWindow(xy pnt);
+  QTransform worldTransform();
   xy windowToWorld(QPointF pnt);
   double pixelScale();
   double viewableRadius();
@@ -107,6 +115,8 @@ public slots:
   void dump();
 protected:
   void setSize();
+  void addEdgeLine(edge *e,std::vector<QLineF> edgeLines[3]);
+  void checkInModelSpace(std::vector<drawingElement> &uncached);
   void paintEvent(QPaintEvent *event) Q_DECL_OVERRIDE;
   void resizeEvent(QResizeEvent *event) Q_DECL_OVERRIDE;
   void mousePressEvent(QMouseEvent *event) Q_DECL_OVERRIDE;
@@ -131,6 +141,7 @@ private:
   double conterval;
   xy windowCenter,worldCenter,dragStart;
   RenderCache contourCache;
+  EdgeLod tinLod;
   int scale;
   /* scale is the logarithm, in major thirds (see zoom), of the number of
    * windowSize lengths in a meter. It is thus usually negative.
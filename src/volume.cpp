@@ -0,0 +1,585 @@
+/******************************************************/
+/*                                                    */
+/* volume.cpp - cut and fill between two surfaces     */
+/*                                                    */
+/******************************************************/
+/* Copyright 2026 Pierre Abbat.
+ * This file is part of Bezitopo.
+ *
+ * Bezitopo is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * Bezitopo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License and Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * and Lesser General Public License along with Bezitopo. If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include <cmath>
+#include <algorithm>
+#include <thread>
+#include <future>
+#include "volume.h"
+#include "manysum.h"
+#include "halton.h"
+#include "boundrect.h"
+#include "cogo.h"
+using namespace std;
+
+/* The existing and design TINs are overlaid: each existing triangle is
+ * clipped by each design triangle it overlaps, and the resulting convex
+ * cell by the boundary. Within a cell, the difference between the surfaces
+ * is a cubic polynomial, which is integrated exactly over triangles fanned
+ * out from a corner of the cell. If the difference has the same sign all
+ * over a triangle, as shown by its Bézier control points, it is all cut or
+ * all fill. If not, the triangle is split in four, a few times, and the
+ * smallest triangles are split into cut and fill as if the difference
+ * were linear, keeping cut minus fill exact.
+ */
+
+#define VOL_DEPTH 6
+// How many times a triangle where cut meets fill is split in four
+#define VOL_CHORD 0.001
+// Farthest that a curved boundary can be from the chords replacing it
+#define VOL_OUT 0
+#define VOL_IN 1
+#define VOL_CROSS 2
+
+struct CellSums
+{
+  manysum cut,fill,area;
+};
+
+void addChords(polyline &boundary,double start,xy startPnt,double end,xy endPnt,vector<xy> &poly,int depth)
+/* Adds the points between start and end along the boundary needed so that
+ * no chord is farther than VOL_CHORD from it. A line segment needs none.
+ */
+{
+  double mid=(start+end)/2;
+  xy midPnt=boundary.station(mid);
+  if (depth<16 && fabs(pldist(midPnt,startPnt,endPnt))>VOL_CHORD)
+  {
+    addChords(boundary,start,startPnt,mid,midPnt,poly,depth+1);
+    poly.push_back(midPnt);
+    addChords(boundary,mid,midPnt,end,endPnt,poly,depth+1);
+  }
+}
+
+double polygonArea(vector<xy> &poly)
+{
+  int i;
+  manysum ret;
+  for (i=2;i<poly.size();i++)
+    ret+=area3(poly[0],poly[i-1],poly[i]);
+  return ret.total();
+}
+
+vector<xy> boundaryPolygon(polyline &boundary)
+/* Returns the boundary as a counterclockwise polygon, with arcs and spirals
+ * replaced by chords. An open boundary is closed.
+ */
+{
+  int i,sz=boundary.size();
+  vector<xy> ret;
+  for (i=0;i<sz;i++)
+  {
+    ret.push_back(boundary.getEndpoint(i));
+    if (boundary.type()!=OBJ_POLYLINE)
+      addChords(boundary,boundary.getCumLength(i),boundary.getEndpoint(i),
+		boundary.getCumLength(i+1),boundary.getEndpoint((i+1)%sz),ret,0);
+  }
+  if (polygonArea(ret)<0)
+    reverse(ret.begin(),ret.end());
+  return ret;
+}
+
+void clipLeft(vector<xy> &poly,xy a,xy b)
+/* Keeps the part of poly to the left of the line from a to b.
+ * This is Sutherland-Hodgman. If poly isn't convex, the result may run
+ * back and forth along the line, which cancels out when integrating.
+ */
+{
+  vector<xy> ret;
+  int i,sz=poly.size();
+  double s0,s1;
+  xy p,q;
+  ret.reserve(sz+1);
+  if (sz)
+    s1=area3(a,b,poly[0]);
+  for (i=0;i<sz;i++)
+  {
+    p=poly[i];
+    q=poly[(i+1)%sz];
+    s0=s1;
+    s1=area3(a,b,q);
+    if (s0>=0)
+      ret.push_back(p);
+    if ((s0>=0)!=(s1>=0))
+      ret.push_back(p+(q-p)*(s0/(s0-s1)));
+  }
+  poly.swap(ret);
+}
+
+void clipConvex(vector<xy> &poly,vector<xy> &clip)
+// clip is convex and counterclockwise.
+{
+  int i;
+  for (i=0;i<clip.size() && poly.size();i++)
+    clipLeft(poly,clip[i],clip[(i+1)%clip.size()]);
+}
+
+class BoundaryGrid
+/* The boundary's sides sorted into a grid of squares, so that a cell far
+ * from the boundary is known to be all in or all out without looking at
+ * every side. A square that no side's bounding rectangle touches is all in
+ * or all out, which is found by counting crossings along its row.
+ */
+{
+public:
+  BoundaryGrid(vector<xy> &polygon);
+  int status(BoundRect &br);
+private:
+  double left,bottom,side;
+  int nx,ny;
+  vector<char> stat;
+};
+
+BoundaryGrid::BoundaryGrid(vector<xy> &polygon)
+{
+  int i,j,k,n=polygon.size(),i0,i1,j0,j1;
+  double yc;
+  xy p,q;
+  BoundRect br;
+  vector<double> crossings;
+  for (i=0;i<n;i++)
+    br.include(polygon[i]);
+  left=br.left();
+  bottom=br.bottom();
+  k=max(1,(int)sqrt(n));
+  side=max(br.right()-left,br.top()-bottom)/k;
+  if (!(side>0))
+    side=1;
+  nx=min(k,(int)ceil((br.right()-left)/side))+1;
+  ny=min(k,(int)ceil((br.top()-bottom)/side))+1;
+  stat.resize(nx*ny,VOL_OUT);
+  for (k=0;k<n;k++)
+  {
+    p=polygon[k];
+    q=polygon[(k+1)%n];
+    i0=floor((min(p.getx(),q.getx())-left)/side);
+    i1=floor((max(p.getx(),q.getx())-left)/side);
+    j0=floor((min(p.gety(),q.gety())-bottom)/side);
+    j1=floor((max(p.gety(),q.gety())-bottom)/side);
+    for (j=max(j0,0);j<=j1 && j<ny;j++)
+      for (i=max(i0,0);i<=i1 && i<nx;i++)
+	stat[j*nx+i]=VOL_CROSS;
+  }
+  for (j=0;j<ny;j++)
+  {
+    yc=bottom+(j+0.5)*side;
+    crossings.clear();
+    for (k=0;k<n;k++)
+    {
+      p=polygon[k];
+      q=polygon[(k+1)%n];
+      if ((p.gety()>yc)!=(q.gety()>yc))
+	crossings.push_back(p.getx()+(yc-p.gety())*(q.getx()-p.getx())/(q.gety()-p.gety()));
+    }
+    sort(crossings.begin(),crossings.end());
+    for (i=0,k=0;i<nx;i++)
+      if (stat[j*nx+i]!=VOL_CROSS)
+      {
+	while (k<crossings.size() && crossings[k]<left+(i+0.5)*side)
+	  k++;
+	stat[j*nx+i]=(k&1)?VOL_IN:VOL_OUT;
+      }
+  }
+}
+
+int BoundaryGrid::status(BoundRect &br)
+/* Returns VOL_IN or VOL_OUT if br is all inside or all outside the
+ * boundary, else VOL_CROSS, which means it may be either.
+ */
+{
+  int i,j,i0,i1,j0,j1,ret=-1;
+  i0=floor((br.left()-left)/side);
+  i1=floor((br.right()-left)/side);
+  j0=floor((br.bottom()-bottom)/side);
+  j1=floor((br.top()-bottom)/side);
+  if (i1<0 || j1<0 || i0>=nx || j0>=ny)
+    return VOL_OUT;
+  if (i0<0 || j0<0 || i1>=nx || j1>=ny)
+    ret=VOL_OUT; // partly outside the grid, which is outside the boundary
+  for (j=max(j0,0);j<=j1 && j<ny && ret!=VOL_CROSS;j++)
+    for (i=max(i0,0);i<=i1 && i<nx && ret!=VOL_CROSS;i++)
+      if (ret<0)
+	ret=stat[j*nx+i];
+      else if (ret!=stat[j*nx+i])
+	ret=VOL_CROSS;
+  return ret;
+}
+
+class TriangleGrid
+/* The design triangles sorted into a grid of squares by their bounding
+ * rectangles, so that all those overlapping an existing triangle are found,
+ * even if the overlap is a sliver or the design TIN is concave there.
+ * Triangles are numbered in the order of the map, and a query returns them
+ * in that order, so that the sums don't depend on addresses.
+ */
+{
+public:
+  TriangleGrid(pointlist &pl);
+  vector<triangle *> overlapping(BoundRect &br);
+private:
+  double left,bottom,side;
+  int nx,ny;
+  vector<triangle *> tris;
+  vector<int> cellStart,cellTris;
+  void range(BoundRect &br,int &i0,int &i1,int &j0,int &j1);
+};
+
+TriangleGrid::TriangleGrid(pointlist &pl)
+{
+  int i,j,k,m,i0,i1,j0,j1;
+  BoundRect br,tbr;
+  map<int,triangle>::iterator t;
+  vector<int> fill;
+  for (t=pl.triangles.begin();t!=pl.triangles.end();t++)
+  {
+    tris.push_back(&t->second);
+    br.include(*t->second.a);
+    br.include(*t->second.b);
+    br.include(*t->second.c);
+  }
+  left=br.left();
+  bottom=br.bottom();
+  k=max(1,(int)sqrt(tris.size()));
+  side=max(br.right()-left,br.top()-bottom)/k;
+  if (!(side>0))
+    side=1;
+  nx=ny=0;
+  if (tris.size())
+  {
+    nx=min(k,(int)ceil((br.right()-left)/side))+1;
+    ny=min(k,(int)ceil((br.top()-bottom)/side))+1;
+  }
+  cellStart.resize(nx*ny+1,0);
+  // Count the triangles in each square, then fill them in.
+  for (k=0;k<2;k++)
+  {
+    for (i=0;i<tris.size();i++)
+    {
+      tbr.clear();
+      tbr.include(*tris[i]->a);
+      tbr.include(*tris[i]->b);
+      tbr.include(*tris[i]->c);
+      range(tbr,i0,i1,j0,j1);
+      for (j=j0;j<=j1;j++)
+	for (m=i0;m<=i1;m++)
+	  if (k)
+	    cellTris[fill[j*nx+m]++]=i;
+	  else
+	    cellStart[j*nx+m+1]++;
+    }
+    if (!k)
+    {
+      for (i=0;i<nx*ny;i++)
+	cellStart[i+1]+=cellStart[i];
+      cellTris.resize(cellStart[nx*ny]);
+      fill.assign(cellStart.begin(),cellStart.end()-1);
+    }
+  }
+}
+
+void TriangleGrid::range(BoundRect &br,int &i0,int &i1,int &j0,int &j1)
+// Sets the range of squares that br touches, clipped to the grid.
+{
+  i0=max(0,(int)floor((br.left()-left)/side));
+  i1=min(nx-1,(int)floor((br.right()-left)/side));
+  j0=max(0,(int)floor((br.bottom()-bottom)/side));
+  j1=min(ny-1,(int)floor((br.top()-bottom)/side));
+}
+
+vector<triangle *> TriangleGrid::overlapping(BoundRect &br)
+/* Returns the triangles whose bounding rectangles touch the squares that
+ * br touches. Some may not overlap br; clipping gets rid of them.
+ */
+{
+  int i,j,k,i0,i1,j0,j1;
+  vector<int> nums;
+  vector<triangle *> ret;
+  if (tris.empty())
+    return ret;
+  range(br,i0,i1,j0,j1);
+  for (j=j0;j<=j1;j++)
+    for (i=i0;i<=i1;i++)
+      for (k=cellStart[j*nx+i];k<cellStart[j*nx+i+1];k++)
+	nums.push_back(cellTris[k]);
+  sort(nums.begin(),nums.end());
+  nums.erase(unique(nums.begin(),nums.end()),nums.end());
+  for (i=0;i<nums.size();i++)
+    ret.push_back(tris[nums[i]]);
+  return ret;
+}
+
+double positiveMean(double v0,double v1,double v2)
+/* Returns the mean over a triangle of the positive part of the linear
+ * function whose values at the corners are v0, v1, and v2.
+ */
+{
+  if (v0>=0 && v1>=0 && v2>=0)
+    return (v0+v1+v2)/3;
+  if (v0<=0 && v1<=0 && v2<=0)
+    return 0;
+  if ((v0>0)+(v1>0)+(v2>0)==1)
+  {
+    if (v1>0)
+      swap(v0,v1);
+    if (v2>0)
+      swap(v0,v2);
+    return v0*v0*v0/(v0-v1)/(v0-v2)/3;
+  }
+  return (v0+v1+v2)/3+positiveMean(-v0,-v1,-v2);
+}
+
+const double latticeWeight[10][3]=
+{
+  {1,0,0},{0,1,0},{0,0,1},
+  {2/3.,1/3.,0},{1/3.,2/3.,0},
+  {0,2/3.,1/3.},{0,1/3.,2/3.},
+  {1/3.,0,2/3.},{2/3.,0,1/3.},
+  {1/3.,1/3.,1/3.}
+};
+
+void barycentric(triangle *tri,xy pnt,double bary[3])
+{
+  double totarea;
+  bary[0]=area3(pnt,*tri->b,*tri->c);
+  bary[1]=area3(*tri->a,pnt,*tri->c);
+  bary[2]=area3(*tri->a,*tri->b,pnt);
+  totarea=bary[0]+bary[1]+bary[2];
+  bary[0]/=totarea;
+  bary[1]/=totarea;
+  bary[2]/=totarea;
+}
+
+double latticeElevation(triangle *tri,double corner[3][3],int n)
+{
+  int i;
+  double bary[3];
+  for (i=0;i<3;i++)
+    bary[i]=latticeWeight[n][0]*corner[0][i]+latticeWeight[n][1]*corner[1][i]+
+            latticeWeight[n][2]*corner[2][i];
+  return tri->elevation(bary[0],bary[1],bary[2]);
+}
+
+void integrateDiff(triangle *exist,triangle *design,xy p0,xy p1,xy p2,int depth,double sign,CellSums &sums)
+/* Integrates the difference between the surfaces over the triangle p0p1p2,
+ * which is counterclockwise, adding sign times the cut and fill to sums.
+ * The difference is sampled at the ten points of the cubic lattice, which
+ * are converted to Bézier control points: corners, two on each side,
+ * and one in the middle. The integral is the area times their mean.
+ * The lattice points' barycentric coordinates in the two TIN triangles are
+ * interpolated from those of the corners.
+ */
+{
+  double f[10],b[10],ebary[3][3],dbary[3][3],lo,hi,area,total,lin,delta;
+  int i;
+  barycentric(exist,p0,ebary[0]);
+  barycentric(exist,p1,ebary[1]);
+  barycentric(exist,p2,ebary[2]);
+  barycentric(design,p0,dbary[0]);
+  barycentric(design,p1,dbary[1]);
+  barycentric(design,p2,dbary[2]);
+  for (i=0;i<10;i++)
+    f[i]=latticeElevation(exist,ebary,i)-latticeElevation(design,dbary,i);
+  b[0]=f[0];
+  b[1]=f[1];
+  b[2]=f[2];
+  b[3]=(-5*f[0]+18*f[3]-9*f[4]+2*f[1])/6;
+  b[4]=(2*f[0]-9*f[3]+18*f[4]-5*f[1])/6;
+  b[5]=(-5*f[1]+18*f[5]-9*f[6]+2*f[2])/6;
+  b[6]=(2*f[1]-9*f[5]+18*f[6]-5*f[2])/6;
+  b[7]=(-5*f[2]+18*f[7]-9*f[8]+2*f[0])/6;
+  b[8]=(2*f[2]-9*f[7]+18*f[8]-5*f[0])/6;
+  b[9]=(27*f[9]-(b[0]+b[1]+b[2])-3*(b[3]+b[4]+b[5]+b[6]+b[7]+b[8]))/6;
+  lo=hi=b[0];
+  for (i=1;i<10;i++)
+  {
+    lo=min(lo,b[i]);
+    hi=max(hi,b[i]);
+  }
+  area=area3(p0,p1,p2);
+  total=area*pairwisesum(b,10)/10;
+  if (lo>=0)
+    sums.cut+=sign*total;
+  else if (hi<=0)
+    sums.fill-=sign*total;
+  else if (depth<VOL_DEPTH)
+  {
+    integrateDiff(exist,design,p0,(p0+p1)/2,(p2+p0)/2,depth+1,sign,sums);
+    integrateDiff(exist,design,(p0+p1)/2,p1,(p1+p2)/2,depth+1,sign,sums);
+    integrateDiff(exist,design,(p2+p0)/2,(p1+p2)/2,p2,depth+1,sign,sums);
+    integrateDiff(exist,design,(p0+p1)/2,(p1+p2)/2,(p2+p0)/2,depth+1,sign,sums);
+  }
+  else
+  {
+    lin=area*(f[0]+f[1]+f[2])/3;
+    delta=total-lin;
+    sums.cut+=sign*(area*positiveMean(f[0],f[1],f[2])+max(delta,0.));
+    sums.fill+=sign*(area*positiveMean(-f[0],-f[1],-f[2])+max(-delta,0.));
+  }
+}
+
+void integratePolygon(triangle *exist,triangle *design,vector<xy> &poly,CellSums &sums)
+/* The polygon is fanned out from its first corner. Triangles that go
+ * clockwise are subtracted, so a polygon from clipping a concave boundary
+ * is integrated correctly.
+ */
+{
+  int i;
+  double a;
+  for (i=2;i<poly.size();i++)
+  {
+    a=area3(poly[0],poly[i-1],poly[i]);
+    if (a>0)
+      integrateDiff(exist,design,poly[0],poly[i-1],poly[i],0,1,sums);
+    if (a<0)
+      integrateDiff(exist,design,poly[0],poly[i],poly[i-1],0,-1,sums);
+    sums.area+=a;
+  }
+}
+
+void cutFillTriangle(triangle *exist,TriangleGrid &design,BoundaryGrid &grid,vector<xy> &bdy,CellSums &sums)
+/* Finds the design triangles that overlap exist, and integrates over each
+ * overlap inside the boundary.
+ */
+{
+  int i,j;
+  vector<xy> tri,cell,piece;
+  vector<triangle *> overlap;
+  triangle *t;
+  BoundRect br;
+  tri.push_back(*exist->a);
+  tri.push_back(*exist->b);
+  tri.push_back(*exist->c);
+  for (i=0;i<3;i++)
+    br.include(tri[i]);
+  if (exist->sarea<=0 || grid.status(br)==VOL_OUT)
+    return;
+  overlap=design.overlapping(br);
+  for (j=0;j<overlap.size();j++)
+  {
+    t=overlap[j];
+    cell.clear();
+    cell.push_back(*t->a);
+    cell.push_back(*t->b);
+    cell.push_back(*t->c);
+    clipConvex(cell,tri);
+    if (cell.size()<3 || !(polygonArea(cell)>0))
+      continue;
+    br.clear();
+    for (i=0;i<cell.size();i++)
+      br.include(cell[i]);
+    switch (grid.status(br))
+    {
+      case VOL_IN:
+	integratePolygon(exist,t,cell,sums);
+	break;
+      case VOL_CROSS:
+	piece=bdy;
+	clipConvex(piece,cell);
+	integratePolygon(exist,t,piece,sums);
+	break;
+    }
+  }
+}
+
+CutFill cutFill(pointlist &existing,pointlist &design,polyline &boundary,int nthreads)
+/* Both TINs must have their triangles' control points set. The existing
+ * triangles are split among nthreads threads (0 means all cores), whose
+ * sums are merged.
+ */
+{
+  static int cores=thread::hardware_concurrency();
+  int j;
+  vector<xy> bdy=boundaryPolygon(boundary);
+  BoundaryGrid grid(bdy);
+  TriangleGrid designGrid(design);
+  vector<triangle *> tris;
+  map<int,triangle>::iterator i;
+  vector<future<CellSums> > parts;
+  CellSums sums,part;
+  CutFill ret;
+  if (nthreads<1)
+    nthreads=(cores>1)?cores:1;
+  for (i=existing.triangles.begin();i!=existing.triangles.end();i++)
+    tris.push_back(&i->second);
+  for (j=0;j<nthreads;j++)
+    parts.push_back(async(nthreads>1?launch::async:launch::deferred,[&tris,&designGrid,&grid,&bdy](size_t lo,size_t hi)
+      {
+	CellSums part;
+	for (;lo<hi;lo++)
+	  cutFillTriangle(tris[lo],designGrid,grid,bdy,part);
+	return part;
+      },tris.size()*j/nthreads,tris.size()*(j+1)/nthreads));
+  for (j=0;j<nthreads;j++)
+  {
+    part=parts[j].get();
+    sums.cut.merge(part.cut);
+    sums.fill.merge(part.fill);
+    sums.area.merge(part.area);
+  }
+  ret.cut=sums.cut.total();
+  ret.fill=sums.fill.total();
+  ret.area=sums.area.total();
+  return ret;
+}
+
+CutFill cutFillHalton(pointlist &existing,pointlist &design,polyline &boundary,unsigned npoints)
+/* Estimates cut and fill by sampling the boundary's bounding rectangle at
+ * Halton points. It converges much more slowly than cutFill, and is kept
+ * as a check on it.
+ */
+{
+  unsigned k,inside=0;
+  double d,cellArea;
+  xy pnt;
+  halton h;
+  BoundRect br;
+  triangle *te,*td;
+  manysum cut,fill;
+  CutFill ret;
+  br.include(&boundary);
+  cellArea=(br.right()-br.left())*(br.top()-br.bottom())/npoints;
+  for (k=0;k<npoints;k++)
+  {
+    pnt=h.pnt();
+    pnt=xy(br.left()+pnt.getx()*(br.right()-br.left()),br.bottom()+pnt.gety()*(br.top()-br.bottom()));
+    if (fabs(boundary.in(pnt))>0.5)
+    {
+      te=existing.findt(pnt);
+      td=design.findt(pnt);
+      if (te && td)
+      {
+	d=te->elevation(pnt)-td->elevation(pnt);
+	if (d>0)
+	  cut+=d;
+	else
+	  fill-=d;
+	inside++;
+      }
+    }
+  }
+  ret.cut=cut.total()*cellArea;
+  ret.fill=fill.total()*cellArea;
+  ret.area=inside*cellArea;
+  return ret;
+}
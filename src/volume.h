@@ -0,0 +1,42 @@
+/******************************************************/
+/*                                                    */
+/* volume.h - cut and fill between two surfaces       */
+/*                                                    */
+/******************************************************/
+/* Copyright 2026 Pierre Abbat.
+ * This file is part of Bezitopo.
+ *
+ * Bezitopo is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * Bezitopo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License and Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * and Lesser General Public License along with Bezitopo. If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+#ifndef VOLUME_H
+#define VOLUME_H
+#include <vector>
+#include "pointlist.h"
+#include "polyline.h"
+
+/* Cut is where the existing surface is above the design surface, fill
+ * where it is below. Area is the area inside the boundary where both
+ * TINs are; outside either TIN nothing is counted.
+ */
+struct CutFill
+{
+  double cut,fill,area;
+};
+
+std::vector<xy> boundaryPolygon(polyline &boundary);
+CutFill cutFill(pointlist &existing,pointlist &design,polyline &boundary,int nthreads=0);
+CutFill cutFillHalton(pointlist &existing,pointlist &design,polyline &boundary,unsigned npoints);
+#endif